@@ -146,6 +146,14 @@ ConfigData BoardConfig::defaultConfig() {
     snprintf(cfg.wifi_AP_PSK, 32, "dmxsun_pw");
     cfg.wifi_AP_ip = (cfg.wifi_AP_ip & 0xff00ffff) | ((uint32_t)shortId << 16);
 
+    for (int i = 0; i < 16; i++) {
+        cfg.portTiming[i] = constDefaultPortTiming;
+    }
+
+    for (int i = 0; i < 24; i++) {
+        cfg.bufferLoss[i] = constDefaultBufferLoss;
+    }
+
     // Patch the first 16 internal DMX buffers to the first 16 physical outputs
     // TODO: Needs to depend on boards connected!
     for (int i = 0; i < 16; i++) {
@@ -23,7 +23,7 @@
 #define MAX_PATCHINGS 32
 
 // Config data types and layout
-#define CONFIG_VERSION 7
+#define CONFIG_VERSION 11
 
 #ifdef __cplusplus
 
@@ -65,9 +65,46 @@ struct __attribute__((__packed__)) PortParams {
     uint8_t UNUSED                : 2;
 };
 
+enum PortTimingSlots : uint8_t {
+    slotsFixed                = 0, // Always send "slots" channels
+    slotsHighestNonZero       = 1, // Highest non-zero channel seen so far + "slots"
+};
+
+enum PortOutputMode : uint8_t {
+    outputContinuous          = 0, // Back-to-back packets
+    outputOnChange            = 1, // When the data changed, at least every "intervalMs"
+    outputCadence             = 2, // One packet every "intervalMs"
+};
+
+// Frame timing of one local DMX port
+// Size: 10 byte
+struct __attribute__((__packed__)) PortTiming {
+    uint16_t breakUs;              // BREAK. E1.11 transmitters: >= 92µs
+    uint8_t mabUs;                 // MARK-AFTER-BREAK. E1.11 transmitters: >= 12µs
+    uint8_t interSlotUs;           // Additional MARK between two slots
+    PortTimingSlots slotMode;
+    PortOutputMode outputMode;
+    uint16_t slots;                // See PortTimingSlots, without the start code
+    uint16_t intervalMs;           // See PortOutputMode
+};
+
+enum LossPolicy : uint8_t {
+    lossHold                  = 0, // Keep the last look
+    lossFade                  = 1, // Fade to zero
+    lossBackup                = 2, // Follow "backupBuffer" until the source is back
+};
+
+// What to do if a DMX buffer's source stops sending
+// Size: 4 byte
+struct __attribute__((__packed__)) BufferLossParams {
+    LossPolicy policy;
+    uint8_t backupBuffer;
+    uint16_t timeoutMs;            // No update for this long = source lost. 0 = never
+};
+
 enum UsbProtocol : uint8_t {
     EDP                       = 0, // Our "native" protocol only
-    JaRule                    = 1, // Max 8 ports, each IN or OUT
+    JaRule                    = 1, // 11 ports, TX and RDM (usb_JaRule.h)
     uDMX                      = 2, // One TX only, data comes in via CONTROL endpoint
     OpenDMX                   = 3, // Multiple (8?) serial endpoints
     NodleU1                   = 4, // Digital Enlightenment / DMXControl Projects e.V.
@@ -83,7 +120,24 @@ struct __attribute__((__packed__)) RadioParams {
     uint8_t allowSparse           : 1;
     rf24_datarate_e dataRate      : 3;
     rf24_pa_dbm_e txPower         : 3;
-    uint8_t padding               : 8;
+    uint8_t fecParity             : 3; // Number of EDP parity chunks per frame, 0 = no FEC
+    uint8_t noAck                 : 1; // Broadcast without auto-ACK and retransmits (use with FEC)
+    uint8_t hopping               : 2; // RadioHopping, broadcast only
+    uint8_t adaptive              : 1; // Broadcast: Adjust dataRate and txPower (sender) or follow the sender's rate (receiver)
+    uint8_t telemetry             : 1; // Broadcast: Receivers return their stats as ACK payload
+};
+
+enum RadioHopping : uint8_t {
+    hopOff                    = 0, // Stay on radioChannel
+    hopLeader                 = 1, // Pick the channels and hop after every frame sent
+    hopFollower               = 2, // Follow the leader's hop markers
+};
+
+enum RadioDual : uint8_t {
+    dualOff                   = 0, // Second module (WIRELESS_DUAL_RADIO builds) not used
+    dualStatic                = 1, // Sends the universes in radioUniverses2
+    dualBalanced              = 2, // Universes are moved between both modules to even out their airtime.
+                                   // Receivers need two modules as well
 };
 
 enum RadioRole : uint8_t {
@@ -185,10 +239,15 @@ struct __attribute__((__packed__)) ConfigData {
     RadioRole              radioRole;
     uint8_t                radioChannel; // 0-127; Higher values maybe FHSS?
     uint16_t               radioAddress; // RF24Mesh: "nodeId"
-    struct RadioParams     radioParams;  // Bit field: 0,1: Compression, 2: Sparse or Full transfers, 3,4: Data rate, 5,6: TX power
+    struct RadioParams     radioParams;  // Bit field: 0: Compression, 1: Sparse or Full transfers, 2-4: Data rate, 5-7: TX power, 8-10: FEC, 11: No ACK, 12,13: Hopping, 14: Adaptive, 15: Telemetry
     struct Patching        patching[MAX_PATCHINGS];
     struct EthDestParams   ethDestParams[16];
     uint8_t                statusLedBrightness;
+    struct PortTiming      portTiming[16];
+    struct BufferLossParams bufferLoss[24]; // One per DmxBuffer
+    RadioDual              radioDual;       // Broadcast only
+    uint8_t                radioChannel2;   // Of the second module, should be far from radioChannel
+    uint8_t                radioUniverses2; // dualStatic: Bit n set = universe n is sent by the second module
     // TODO: CRC for the configuration?
 };
 
@@ -200,6 +259,24 @@ static const RadioParams constDefaultRadioParams = {
     .allowSparse         = 1,
     .dataRate            = RF24_2MBPS,
     .txPower             = RF24_PA_HIGH,
+    .fecParity           = 0,
+    .noAck               = 0,
+};
+
+static const PortTiming constDefaultPortTiming = {
+    .breakUs             = 92,
+    .mabUs               = 16,
+    .interSlotUs         = 0,
+    .slotMode            = PortTimingSlots::slotsFixed,
+    .outputMode          = PortOutputMode::outputContinuous,
+    .slots               = 512,
+    .intervalMs          = 500,
+};
+
+static const BufferLossParams constDefaultBufferLoss = {
+    .policy              = LossPolicy::lossHold,
+    .backupBuffer        = 0,
+    .timeoutMs           = 3000,
 };
 
 static const ConfigData constDefaultConfig = {
@@ -222,6 +299,9 @@ static const ConfigData constDefaultConfig = {
     .radioAddress        = 0,
     .radioParams         = constDefaultRadioParams,
     .statusLedBrightness = 20,
+    .radioDual           = RadioDual::dualOff,
+    .radioChannel2       = 92,
+    .radioUniverses2     = 0x0a, // Universes 1 and 3
 };
 
 class BoardConfig {
@@ -0,0 +1,65 @@
+#include "crc_dma.h"
+
+#include <hardware/dma.h>
+#include <pico/critical_section.h>
+
+static int crc_dma_channel = -1;
+static critical_section_t crc_dma_lock;
+static uint32_t crc_dma_sink; // Destination when only the CRC is needed
+
+// The sniffer calculates the non-reflected CRC-16-CCITT over bit reversed
+// data, X25 is the reflected one: Same register, just bit reversed
+static inline uint16_t crc_dma_reverse16(uint16_t value)
+{
+    value = ((value >> 1) & 0x5555) | ((value & 0x5555) << 1);
+    value = ((value >> 2) & 0x3333) | ((value & 0x3333) << 2);
+    value = ((value >> 4) & 0x0f0f) | ((value & 0x0f0f) << 4);
+    return (value >> 8) | (value << 8);
+}
+
+void crc_dma_init(void)
+{
+    critical_section_init(&crc_dma_lock);
+    crc_dma_channel = dma_claim_unused_channel(false);
+}
+
+static crc_t crc_dma_transfer(crc_t crc, void *dst, bool incrementDst, const void *src, size_t data_len)
+{
+    dma_channel_config config = dma_channel_get_default_config(crc_dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, incrementDst);
+    channel_config_set_sniff_enable(&config, true);
+
+    critical_section_enter_blocking(&crc_dma_lock);
+
+    dma_hw->sniff_data = crc_dma_reverse16(crc);
+    dma_sniffer_enable(crc_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16R, true);
+    dma_channel_configure(crc_dma_channel, &config, dst, src, data_len, true);
+    dma_channel_wait_for_finish_blocking(crc_dma_channel);
+    crc = crc_dma_reverse16(dma_hw->sniff_data & 0xffff);
+    dma_sniffer_disable();
+
+    critical_section_exit(&crc_dma_lock);
+
+    return crc;
+}
+
+crc_t crc_dma_update(crc_t crc, const void *data, size_t data_len)
+{
+    if ((crc_dma_channel < 0) || (data_len < CRC_DMA_MIN_LENGTH)) {
+        return crc_update(crc, data, data_len);
+    }
+
+    return crc_dma_transfer(crc, &crc_dma_sink, false, data, data_len);
+}
+
+crc_t crc_dma_copy(crc_t crc, void *dst, const void *src, size_t data_len)
+{
+    if ((crc_dma_channel < 0) || (data_len < CRC_DMA_MIN_LENGTH)) {
+        memcpy(dst, src, data_len);
+        return crc_update(crc, src, data_len);
+    }
+
+    return crc_dma_transfer(crc, dst, true, src, data_len);
+}
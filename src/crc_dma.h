@@ -0,0 +1,49 @@
+#ifndef CRC_DMA_H
+#define CRC_DMA_H
+
+#include <string.h>
+
+#include "crc_X25.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-16/X25 (same as crc_update()) calculated by the DMA sniffer while the
+// DMA reads the data, optionally copying it at the same time. Runs at one
+// byte per cycle, short buffers and builds without DMA (host) use the
+// software implementation. The sniffer exists only once, calls from both
+// cores are serialised
+
+#define CRC_DMA_MIN_LENGTH    16  // Below this, setting up the DMA costs more than it saves
+
+#ifndef EDP_HOST
+
+// Claims a DMA channel. Until this is called, everything runs in software
+void crc_dma_init(void);
+
+crc_t crc_dma_update(crc_t crc, const void *data, size_t data_len);
+
+// memcpy(dst, src, data_len) + crc_update(crc, src, data_len) in one go
+crc_t crc_dma_copy(crc_t crc, void *dst, const void *src, size_t data_len);
+
+#else
+
+static inline crc_t crc_dma_update(crc_t crc, const void *data, size_t data_len)
+{
+    return crc_update(crc, data, data_len);
+}
+
+static inline crc_t crc_dma_copy(crc_t crc, void *dst, const void *src, size_t data_len)
+{
+    memcpy(dst, src, data_len);
+    return crc_update(crc, src, data_len);
+}
+
+#endif // EDP_HOST
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC_DMA_H
@@ -1,5 +1,7 @@
 #include "dmxbuffer.h"
 
+#include <pico/time.h>          // Arrival times for the interpolation
+
 #include "log.h"
 #include "boardconfig.h"
 #include "localdmx.h"
@@ -11,8 +13,19 @@ extern Wireless wireless;
 
 extern critical_section_t bufferLock;
 
-uint8_t DmxBuffer::buffer[DMXBUFFER_COUNT][512];
+// Word aligned so the interpolation can process 4 channels at once
+uint8_t DmxBuffer::buffer[DMXBUFFER_COUNT][512] __attribute__((aligned(4)));
 uint8_t DmxBuffer::allZeroes[512];
+uint32_t DmxBuffer::interpolated[128];
+uint8_t DmxBuffer::faded[512];
+
+// Expands 4 bits of DmxInterpolation::fixedMask to one byte per channel
+static const uint32_t fixedMaskBytes[16] = {
+    0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
+    0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
+    0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff,
+    0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff,
+};
 
 void DmxBuffer::init() {
     // Init the complete area to 0
@@ -20,17 +33,31 @@ void DmxBuffer::init() {
 
     // Init the allZeroes array
     memset(this->allZeroes, 0x00, 512);
+
+    memset(this->interpolations, 0x00, sizeof(this->interpolations));
+    memset(this->interpolationSlot, 0xff, sizeof(this->interpolationSlot));
+    this->lastInterpolationStep = 0;
+
+    memset(this->status, 0x00, sizeof(this->status));
+    this->lastLossStep = 0;
 }
 
-void DmxBuffer::zero(uint8_t bufferId) {
+void DmxBuffer::zero(uint8_t bufferId, DmxBufferSource from) {
+    if (bufferId >= DMXBUFFER_COUNT) {
+        return;
+    }
+
     LOG("ZERO buffer %u", bufferId);
 
     // Simply zero out the specified buffer
     critical_section_enter_blocking(&bufferLock);
+    this->interpolationNewFrame(bufferId, true);
     memset(this->buffer[bufferId], 0x00, 512);
+    this->status[bufferId].nonZeroChannels = 0;
+    this->sourceWrote(bufferId, from);
     critical_section_exit(&bufferLock);
 
-    this->triggerPatchings(bufferId, true);
+    this->triggerPatchings(bufferId);
 }
 
 bool DmxBuffer::getBuffer(uint8_t bufferId, uint8_t* dest, uint16_t destLength) {
@@ -46,7 +73,7 @@ bool DmxBuffer::getBuffer(uint8_t bufferId, uint8_t* dest, uint16_t destLength)
     return true;
 }
 
-bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength) {
+bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength, DmxBufferSource from) {
     if ((bufferId >= DMXBUFFER_COUNT) || (source == nullptr) || sourceLength == 0) {
         return false;
     }
@@ -58,8 +85,9 @@ bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLeng
     LOG("setBuffer Length: %d, Content: %02x %02x %02x %02x %02x %02x", sourceLength, source[0], source[1], source[2], source[3], source[4], source[5]);
 
     critical_section_enter_blocking(&bufferLock);
-    memset(this->buffer[bufferId], 0x00, 512);
-    memcpy(this->buffer[bufferId], source, length);
+    this->interpolationNewFrame(bufferId, false);
+    this->writeBuffer(bufferId, source, length);
+    this->sourceWrote(bufferId, from);
     critical_section_exit(&bufferLock);
 
     this->triggerPatchings(bufferId);
@@ -67,6 +95,54 @@ bool DmxBuffer::setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLeng
     return true;
 }
 
+// Copies a frame to the buffer (channels after "length" are zero) and keeps
+// the count of non-zero channels up to date while doing so. Call with
+// bufferLock held. Returns the number of changed channels
+uint16_t DmxBuffer::writeBuffer(uint8_t bufferId, uint8_t* source, uint16_t length) {
+    uint8_t* dest = this->buffer[bufferId];
+    uint16_t nonZero = this->status[bufferId].nonZeroChannels;
+    uint16_t changed = 0;
+    uint8_t value;
+
+    for (uint16_t chan = 0; chan < 512; chan++) {
+        value = (chan < length) ? source[chan] : 0;
+        if (value == dest[chan]) {
+            continue;
+        }
+        if (!dest[chan]) {
+            nonZero++;
+        } else if (!value) {
+            nonZero--;
+        }
+        dest[chan] = value;
+        changed++;
+    }
+
+    this->status[bufferId].nonZeroChannels = nonZero;
+    return changed;
+}
+
+// Updates the metadata after a source wrote to the buffer. Call with bufferLock held
+void DmxBuffer::sourceWrote(uint8_t bufferId, DmxBufferSource from) {
+    DmxBufferStatus* status = &this->status[bufferId];
+    uint32_t now = time_us_32();
+    int32_t interval = now - status->lastUpdate;
+
+    if (status->frames == 0) {
+        status->avgIntervalUs = 0;
+    } else if (status->avgIntervalUs == 0) {
+        status->avgIntervalUs = interval;
+    } else {
+        // Moving average over ~8 frames
+        status->avgIntervalUs += (interval - (int32_t)status->avgIntervalUs) / 8;
+    }
+
+    status->lastUpdate = now;
+    status->frames++;
+    status->source = from;
+    status->lost = false;
+}
+
 bool DmxBuffer::getChannel(uint8_t bufferId, uint16_t channel, uint8_t* value) {
     if ((bufferId >= DMXBUFFER_COUNT) || (channel >= 512) || (value == nullptr)) {
         return false;
@@ -78,29 +154,43 @@ bool DmxBuffer::getChannel(uint8_t bufferId, uint16_t channel, uint8_t* value) {
     return true;
 }
 
-bool DmxBuffer::setChannel(uint8_t bufferId, uint16_t channel, uint8_t value) {
+bool DmxBuffer::setChannel(uint8_t bufferId, uint16_t channel, uint8_t value, DmxBufferSource from) {
     if ((bufferId >= DMXBUFFER_COUNT) || (channel >= 512)) {
         return false;
     }
     // Shall we lock the buffer so two sources don't write at the same time?
     // TODO: Merge modes. For HTP and LTP we might need to remember the source that last wrote here?
 
+    critical_section_enter_blocking(&bufferLock);
+    this->interpolationNewFrame(bufferId, true);
+    if (!this->buffer[bufferId][channel] && value) {
+        this->status[bufferId].nonZeroChannels++;
+    } else if (this->buffer[bufferId][channel] && !value) {
+        this->status[bufferId].nonZeroChannels--;
+    }
     this->buffer[bufferId][channel] = value;
+    this->sourceWrote(bufferId, from);
+    critical_section_exit(&bufferLock);
 
     this->triggerPatchings(bufferId);
 
     return true;
 }
 
-void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
-    if ((allZero) || (!memcmp(DmxBuffer::buffer[bufferId], allZeroes, 512))) {
-        // universe is all zeroes
-        DmxBuffer::allZeroBuffers[bufferId] = true;
-    } else {
-        DmxBuffer::allZeroBuffers[bufferId] = false;
+bool DmxBuffer::isAllZero(uint8_t bufferId) {
+    return (bufferId < DMXBUFFER_COUNT) && (this->status[bufferId].nonZeroChannels == 0);
+}
+
+uint16_t DmxBuffer::getFps(uint8_t bufferId) {
+    if ((bufferId >= DMXBUFFER_COUNT) || this->status[bufferId].lost || !this->status[bufferId].avgIntervalUs) {
+        return 0;
     }
+    // Updates less than 153 µs apart (e.g. USB bursts) would wrap the uint16_t
+    return MIN(10000000 / this->status[bufferId].avgIntervalUs, (uint32_t)UINT16_MAX);
+}
 
-    LOG("DmxBuffer::triggerPatchings. bufferId: %d, allZeroes: %d", bufferId, DmxBuffer::allZeroBuffers[bufferId]);
+void DmxBuffer::triggerPatchings(uint8_t bufferId) {
+    LOG("DmxBuffer::triggerPatchings. bufferId: %d, allZeroes: %d", bufferId, this->isAllZero(bufferId));
 
     for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
         Patching patching = boardConfig.activeConfig->patching[i];
@@ -115,6 +205,10 @@ void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
 
         switch (patching.dstType) {
             case PatchType::local:
+                // Interpolated buffers are sent by interpolationTask()
+                if (this->interpolationSlot[bufferId] >= 0) {
+                    break;
+                }
                 localDmx.setPort(patching.dstInstance, DmxBuffer::buffer[bufferId], 512);
                 LOG("DmxBuffer::triggerPatchings. Setting localDmx port %d", patching.dstInstance);
                 break;
@@ -124,3 +218,240 @@ void DmxBuffer::triggerPatchings(uint8_t bufferId, bool allZero) {
         }
     }
 }
+
+void DmxBuffer::triggerLocalPatchings(uint8_t bufferId, uint8_t* data) {
+    for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
+        Patching patching = boardConfig.activeConfig->patching[i];
+        if ((patching.active) &&
+            (patching.srcType == PatchType::buffer) &&
+            (patching.srcInstance == bufferId) &&
+            (patching.dstType == PatchType::local))
+        {
+            localDmx.setPort(patching.dstInstance, data, 512);
+        }
+    }
+}
+
+bool DmxBuffer::setInterpolation(uint8_t bufferId, bool enabled) {
+    if (bufferId >= DMXBUFFER_COUNT) {
+        return false;
+    }
+
+    if (enabled == (this->interpolationSlot[bufferId] >= 0)) {
+        return true;
+    }
+
+    if (!enabled) {
+        critical_section_enter_blocking(&bufferLock);
+        this->interpolations[this->interpolationSlot[bufferId]].active = false;
+        this->interpolationSlot[bufferId] = -1;
+        critical_section_exit(&bufferLock);
+
+        // Outputs might still be somewhere between two frames
+        this->triggerLocalPatchings(bufferId, this->buffer[bufferId]);
+        return true;
+    }
+
+    for (uint8_t i = 0; i < DMXBUFFER_INTERPOLATION_SLOTS; i++) {
+        DmxInterpolation* interpolation = &this->interpolations[i];
+        if (interpolation->active) {
+            continue;
+        }
+
+        critical_section_enter_blocking(&bufferLock);
+        memset(interpolation, 0x00, sizeof(DmxInterpolation));
+        memcpy(interpolation->from, this->buffer[bufferId], 512);
+        interpolation->bufferId = bufferId;
+        interpolation->frameStart = time_us_32();
+        interpolation->active = true;
+        this->interpolationSlot[bufferId] = i;
+        critical_section_exit(&bufferLock);
+
+        LOG("DmxBuffer: Interpolating buffer %u in slot %u", bufferId, i);
+        return true;
+    }
+
+    LOG("DmxBuffer: No interpolation slot left for buffer %u", bufferId);
+    return false;
+}
+
+bool DmxBuffer::setInterpolationFixed(uint8_t bufferId, uint16_t channel, bool fixed) {
+    if ((bufferId >= DMXBUFFER_COUNT) || (channel >= 512) || (this->interpolationSlot[bufferId] < 0)) {
+        return false;
+    }
+    DmxInterpolation* interpolation = &this->interpolations[this->interpolationSlot[bufferId]];
+
+    if (fixed) {
+        interpolation->fixedMask[channel / 32] |= (1 << (channel % 32));
+    } else {
+        interpolation->fixedMask[channel / 32] &= ~(1 << (channel % 32));
+    }
+
+    return true;
+}
+
+bool DmxBuffer::isInterpolated(uint8_t bufferId) {
+    return (bufferId < DMXBUFFER_COUNT) && (this->interpolationSlot[bufferId] >= 0);
+}
+
+bool DmxBuffer::isInterpolationFixed(uint8_t bufferId, uint16_t channel) {
+    if ((channel >= 512) || !this->isInterpolated(bufferId)) {
+        return false;
+    }
+
+    return this->interpolations[this->interpolationSlot[bufferId]].fixedMask[channel / 32] & (1 << (channel % 32));
+}
+
+// A new frame is about to be written to the buffer. Needs to be called with
+// bufferLock held. The output fades from where it is right now to the new
+// frame within the time the last frame was on. That's one frame latency
+// but the steps of slow sources are gone
+void DmxBuffer::interpolationNewFrame(uint8_t bufferId, bool jump) {
+    if (this->interpolationSlot[bufferId] < 0) {
+        return;
+    }
+    DmxInterpolation* interpolation = &this->interpolations[this->interpolationSlot[bufferId]];
+    uint32_t now = time_us_32();
+
+    this->interpolate(interpolation, this->interpolationWeight(interpolation, now), interpolation->from);
+
+    interpolation->framePeriod = now - interpolation->frameStart;
+    if (jump || (interpolation->framePeriod > DMXBUFFER_INTERPOLATION_MAX_GAP_US)) {
+        interpolation->framePeriod = 0;
+    }
+    interpolation->frameStart = now;
+    interpolation->done = false;
+}
+
+// 0 = "from", 256 = current frame
+uint32_t DmxBuffer::interpolationWeight(DmxInterpolation* interpolation, uint32_t now) {
+    uint32_t elapsed = now - interpolation->frameStart;
+
+    if (elapsed >= interpolation->framePeriod) {
+        return 256;
+    }
+    return (elapsed << 8) / interpolation->framePeriod;
+}
+
+// Linear interpolation of 4 channels at once. Every 32 bit word is split
+// into two words with 2 channels in 16 bit lanes each. 255 * 256 fits into
+// a lane, so the lanes can't overflow into each other
+static inline uint32_t lerp4(uint32_t from, uint32_t to, uint32_t weight) {
+    uint32_t inverse = 256 - weight;
+    uint32_t even = (((from & 0x00ff00ff) * inverse + (to & 0x00ff00ff) * weight) >> 8) & 0x00ff00ff;
+    uint32_t odd = (((from >> 8) & 0x00ff00ff) * inverse + ((to >> 8) & 0x00ff00ff) * weight) & 0xff00ff00;
+    return even | odd;
+}
+
+void DmxBuffer::interpolate(DmxInterpolation* interpolation, uint32_t weight, uint32_t* dest) {
+    const uint32_t* to = (const uint32_t*)this->buffer[interpolation->bufferId];
+    uint32_t fixed;
+
+    for (uint8_t word = 0; word < 128; word++) {
+        fixed = fixedMaskBytes[(interpolation->fixedMask[word / 8] >> ((word % 8) * 4)) & 0x0f];
+        dest[word] = (lerp4(interpolation->from[word], to[word], weight) & ~fixed) | (to[word] & fixed);
+    }
+}
+
+// Calculates and sends the intermediate frames of all interpolated buffers
+// until they reached their current frame
+void DmxBuffer::interpolationTask() {
+    uint32_t now = time_us_32();
+    uint32_t weight;
+    uint8_t bufferId;
+
+    if ((now - this->lastInterpolationStep) < DMXBUFFER_INTERPOLATION_STEP_US) {
+        return;
+    }
+    this->lastInterpolationStep = now;
+
+    for (uint8_t i = 0; i < DMXBUFFER_INTERPOLATION_SLOTS; i++) {
+        DmxInterpolation* interpolation = &this->interpolations[i];
+
+        critical_section_enter_blocking(&bufferLock);
+        if (!interpolation->active || interpolation->done) {
+            critical_section_exit(&bufferLock);
+            continue;
+        }
+        weight = this->interpolationWeight(interpolation, now);
+        this->interpolate(interpolation, weight, DmxBuffer::interpolated);
+        interpolation->done = (weight == 256);
+        bufferId = interpolation->bufferId;
+        critical_section_exit(&bufferLock);
+
+        this->triggerLocalPatchings(bufferId, (uint8_t*)DmxBuffer::interpolated);
+    }
+}
+
+// Checks all buffers for sources that stopped sending and applies the
+// buffer's loss policy (see BufferLossParams) until the source is back
+void DmxBuffer::lossTask() {
+    uint32_t now = time_us_32();
+
+    if ((now - this->lastLossStep) < DMXBUFFER_LOSS_STEP_US) {
+        return;
+    }
+    this->lastLossStep = now;
+
+    for (uint8_t bufferId = 0; bufferId < DMXBUFFER_COUNT; bufferId++) {
+        BufferLossParams* params = &boardConfig.activeConfig->bufferLoss[bufferId];
+        DmxBufferStatus* status = &this->status[bufferId];
+        uint16_t changed = 0;
+        bool justLost = false;
+
+        if (!params->timeoutMs || !status->frames) {
+            continue;
+        }
+
+        critical_section_enter_blocking(&bufferLock);
+
+        if (!status->lost) {
+            if ((now - status->lastUpdate) >= ((uint32_t)params->timeoutMs * 1000)) {
+                status->lost = true;
+                justLost = true;
+            }
+        }
+
+        if (status->lost) {
+            switch (params->policy) {
+                case LossPolicy::lossFade:
+                    if (!status->nonZeroChannels) {
+                        break;
+                    }
+                    for (uint16_t chan = 0; chan < 512; chan++) {
+                        DmxBuffer::faded[chan] = (this->buffer[bufferId][chan] > DMXBUFFER_LOSS_FADE_STEP) ?
+                            (this->buffer[bufferId][chan] - DMXBUFFER_LOSS_FADE_STEP) : 0;
+                    }
+                    this->interpolationNewFrame(bufferId, false);
+                    changed = this->writeBuffer(bufferId, DmxBuffer::faded, 512);
+                    break;
+
+                case LossPolicy::lossBackup:
+                    if ((params->backupBuffer >= DMXBUFFER_COUNT) || (params->backupBuffer == bufferId)) {
+                        break;
+                    }
+                    this->interpolationNewFrame(bufferId, false);
+                    changed = this->writeBuffer(bufferId, this->buffer[params->backupBuffer], 512);
+                    break;
+
+                default:
+                    // lossHold: Nothing to do
+                    break;
+            }
+            if (changed) {
+                status->source = DmxBufferSource::sourceLossPolicy;
+            }
+        }
+
+        critical_section_exit(&bufferLock);
+
+        // Not under bufferLock: LOG runs tud_task(), which can end up in setBuffer()
+        if (justLost) {
+            LOG("DmxBuffer: Source of buffer %u lost, policy %u", bufferId, params->policy);
+        }
+
+        if (changed) {
+            this->triggerPatchings(bufferId);
+        }
+    }
+}
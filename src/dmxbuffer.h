@@ -8,25 +8,96 @@
 #define DMXBUFFER_COUNT 24
 #endif // DMXBUFFER_COUNT
 
+// Number of buffers that can be interpolated at the same time
+#ifndef DMXBUFFER_INTERPOLATION_SLOTS
+#define DMXBUFFER_INTERPOLATION_SLOTS 16
+#endif // DMXBUFFER_INTERPOLATION_SLOTS
+
+#define DMXBUFFER_INTERPOLATION_STEP_US     10000 // Rate of the intermediate frames (100Hz)
+#define DMXBUFFER_INTERPOLATION_MAX_GAP_US 100000 // Frames further apart are not faded
+
+#define DMXBUFFER_LOSS_STEP_US              10000 // How often loss policies are checked/applied
+#define DMXBUFFER_LOSS_FADE_STEP                2 // lossFade: Decrement per step, ~1.3s from full to zero
+
 #ifdef __cplusplus
 
+// Who wrote a buffer last
+enum DmxBufferSource : uint8_t {
+    sourceNone                = 0,
+    sourceWeb                 = 1,
+    sourceArtNet              = 2,
+    sourceE131                = 3,
+    sourceEdp                 = 4, // EDP via USB or UDP
+    sourceEdpWireless         = 5, // EDP via nRF24
+    sourceNodleU1             = 6,
+    sourceLossPolicy          = 7, // Fading or copied from the backup buffer
+    sourceUsbBulk             = 8, // Native bulk protocol on the vendor interface
+    sourceJaRule              = 9, // Ja Rule emulation (OLA)
+};
+
+// Metadata of one buffer, updated on every write
+struct DmxBufferStatus {
+    uint32_t        lastUpdate;      // time_us_32() of the last write by a source
+    uint32_t        frames;          // Writes by a source since boot
+    uint32_t        avgIntervalUs;   // Moving average of the time between two writes
+    uint16_t        nonZeroChannels;
+    DmxBufferSource source;
+    bool            lost;            // Source timed out, loss policy active
+};
+
+// State of one interpolated buffer. Channels are handled as words of 4
+struct DmxInterpolation {
+    bool     active;
+    bool     done;              // Target reached and sent to the outputs
+    uint8_t  bufferId;
+    uint32_t frameStart;        // time_us_32() when the current frame arrived
+    uint32_t framePeriod;       // Time to fade to the current frame. 0 = jump
+    uint32_t fixedMask[16];     // Bit set = channel is not interpolated (gobo, colour wheel, ...)
+    uint32_t from[128];         // Output at the time the current frame arrived
+};
+
 // Class that stores and manages ALL internal "main" DMX buffers
 class DmxBuffer {
   public:
     static uint8_t buffer[DMXBUFFER_COUNT][512];
     static uint8_t allZeroes[512]; // Array of 512 zero-bytes to be used with memcmp for performance
     void init();
-    void zero(uint8_t bufferId);
+    void zero(uint8_t bufferId, DmxBufferSource from = DmxBufferSource::sourceNone);
     bool getBuffer(uint8_t bufferId, uint8_t* dest, uint16_t destLength); // alias "copyTo"
-    bool setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength); // alias "copyFrom"
+    bool setBuffer(uint8_t bufferId, uint8_t* source, uint16_t sourceLength, DmxBufferSource from = DmxBufferSource::sourceNone); // alias "copyFrom"
     bool getChannel(uint8_t bufferId, uint16_t channel, uint8_t* value);
-    bool setChannel(uint8_t bufferId, uint16_t channel, uint8_t value);
+    bool setChannel(uint8_t bufferId, uint16_t channel, uint8_t value, DmxBufferSource from = DmxBufferSource::sourceNone);
 
     bool isAllZero(uint8_t bufferId);
 
+    // Metadata and loss policies, see lossTask()
+    DmxBufferStatus status[DMXBUFFER_COUNT];
+    uint16_t getFps(uint8_t bufferId);      // Frames per second * 10, 0 if lost, saturates at UINT16_MAX
+    void lossTask(); // Runs on core1
+
+    // Optional interpolation between received frames, see interpolationTask()
+    bool setInterpolation(uint8_t bufferId, bool enabled);
+    bool setInterpolationFixed(uint8_t bufferId, uint16_t channel, bool fixed);
+    bool isInterpolated(uint8_t bufferId);
+    bool isInterpolationFixed(uint8_t bufferId, uint16_t channel);
+    void interpolationTask(); // Runs on core1
+
   private:
-    void triggerPatchings(uint8_t bufferId, bool allZero = false);
-    bool allZeroBuffers[DMXBUFFER_COUNT];
+    void triggerPatchings(uint8_t bufferId);
+    void triggerLocalPatchings(uint8_t bufferId, uint8_t* data);
+    void sourceWrote(uint8_t bufferId, DmxBufferSource from);
+    uint16_t writeBuffer(uint8_t bufferId, uint8_t* source, uint16_t length);
+    uint32_t lastLossStep;
+    static uint8_t faded[512];                  // Frame of a fading buffer, too big for core1's stack
+
+    void interpolationNewFrame(uint8_t bufferId, bool jump);
+    uint32_t interpolationWeight(DmxInterpolation* interpolation, uint32_t now);
+    void interpolate(DmxInterpolation* interpolation, uint32_t weight, uint32_t* dest);
+
+    DmxInterpolation interpolations[DMXBUFFER_INTERPOLATION_SLOTS];
+    int8_t interpolationSlot[DMXBUFFER_COUNT];  // -1 = not interpolated
+    uint32_t lastInterpolationStep;
+    static uint32_t interpolated[128];          // Intermediate frame handed to the outputs
 };
 
 #endif // __cplusplus
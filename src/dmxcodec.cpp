@@ -0,0 +1,246 @@
+#include "dmxcodec.h"
+
+#include <string.h>
+
+// Number of channels from pos on that can be expressed as 4 bit signed delta
+// to the channel <stride> positions before. Channels before the start count as 0
+uint8_t DmxCodec::deltaLength(const uint8_t* in, uint16_t pos, uint16_t length, uint8_t stride) {
+    uint8_t count = 0;
+    int16_t delta;
+
+    while ((pos + count < length) && (count < DMXCODEC_MAX_COUNT)) {
+        delta = in[pos + count] - ((pos + count >= stride) ? in[pos + count - stride] : 0);
+        if ((delta < -8) || (delta > 7)) {
+            break;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+// Is cost/count smaller than bestCost/bestCount? Compares the bytes per channel
+bool DmxCodec::cheaper(uint16_t cost, uint16_t count, uint16_t bestCost, uint16_t bestCount) {
+    if (!bestCount) {
+        return true;
+    }
+    return (cost * bestCount) < (bestCost * count);
+}
+
+// Greedy: At every position, take the token that produces the most channels
+// per byte. If none of them beats copying the bytes, collect them in a literal
+uint16_t DmxCodec::encode(const uint8_t* in, uint16_t length, uint8_t* out, uint16_t outSize) {
+    uint16_t pos = 0;
+    uint16_t literalStart = 0;
+    uint16_t written = 0;
+
+    DmxCodecOp bestOp;
+    uint16_t bestCost;
+    uint16_t bestCount;
+    uint8_t packBase = 0;
+    uint8_t packWidth = 0;
+
+    while (pos <= length) {
+        bestCount = 0;
+        bestCost = 0;
+        bestOp = DmxCodecOp::opLiteral;
+
+        if (pos < length) {
+            // Run
+            uint16_t count = 1;
+            while ((pos + count < length) && (count < DMXCODEC_MAX_COUNT) && (in[pos + count] == in[pos])) {
+                count++;
+            }
+            if (count >= 3) {
+                bestOp = DmxCodecOp::opRun;
+                bestCost = 2;
+                bestCount = count;
+            }
+
+            // Deltas
+            for (uint8_t stride = 1; stride <= 2; stride++) {
+                count = deltaLength(in, pos, length, stride);
+                if ((count >= 4) && cheaper(1 + (count + 1) / 2, count, bestCost, bestCount)) {
+                    bestOp = (stride == 1) ? DmxCodecOp::opDelta1 : DmxCodecOp::opDelta2;
+                    bestCost = 1 + (count + 1) / 2;
+                    bestCount = count;
+                }
+            }
+
+            // Bit packing
+            uint8_t min = in[pos];
+            uint8_t max = in[pos];
+            for (count = 1; (pos + count <= length) && (count <= DMXCODEC_MAX_COUNT); count++) {
+                uint8_t value = in[pos + count - 1];
+                uint8_t width = 1;
+                min = (value < min) ? value : min;
+                max = (value > max) ? value : max;
+                while ((width < 8) && ((max - min) >> width)) {
+                    width++;
+                }
+                if (width > 7) {
+                    break;
+                }
+                uint16_t cost = 3 + (count * width + 7) / 8;
+                if ((count >= 6) && cheaper(cost, count, bestCost, bestCount)) {
+                    bestOp = DmxCodecOp::opPack;
+                    bestCost = cost;
+                    bestCount = count;
+                    packBase = min;
+                    packWidth = width;
+                }
+            }
+
+            // Only worth it if it beats the bytes themselves
+            if (bestCount && (bestCost >= bestCount)) {
+                bestCount = 0;
+            }
+        }
+
+        // Flush the literal if something else follows, it's full or we are at the end
+        if ((pos > literalStart) && (bestCount || (pos - literalStart == DMXCODEC_MAX_COUNT) || (pos == length))) {
+            uint16_t count = pos - literalStart;
+            if (written + 1 + count > outSize) {
+                return 0;
+            }
+            out[written++] = (DmxCodecOp::opLiteral << 5) | (count - 1);
+            memcpy(out + written, in + literalStart, count);
+            written += count;
+            literalStart = pos;
+        }
+
+        if (pos == length) {
+            break;
+        }
+
+        if (!bestCount) {
+            pos++;
+            continue;
+        }
+
+        if (written + bestCost > outSize) {
+            return 0;
+        }
+        out[written++] = (bestOp << 5) | (bestCount - 1);
+
+        if (bestOp == DmxCodecOp::opRun) {
+            out[written++] = in[pos];
+        } else if ((bestOp == DmxCodecOp::opDelta1) || (bestOp == DmxCodecOp::opDelta2)) {
+            uint8_t stride = (bestOp == DmxCodecOp::opDelta1) ? 1 : 2;
+            for (uint16_t i = 0; i < bestCount; i++) {
+                uint16_t chan = pos + i;
+                uint8_t nibble = (in[chan] - ((chan >= stride) ? in[chan - stride] : 0)) & 0x0f;
+                if (i & 1) {
+                    out[written++] |= (nibble << 4);
+                } else {
+                    out[written] = nibble;
+                }
+            }
+            if (bestCount & 1) {
+                written++;
+            }
+        } else if (bestOp == DmxCodecOp::opPack) {
+            uint16_t bits = 0;
+            uint8_t bitCount = 0;
+            out[written++] = packBase;
+            out[written++] = packWidth;
+            for (uint16_t i = 0; i < bestCount; i++) {
+                bits |= (in[pos + i] - packBase) << bitCount;
+                bitCount += packWidth;
+                while (bitCount >= 8) {
+                    out[written++] = bits & 0xff;
+                    bits >>= 8;
+                    bitCount -= 8;
+                }
+            }
+            if (bitCount) {
+                out[written++] = bits & 0xff;
+            }
+        }
+
+        pos += bestCount;
+        literalStart = pos;
+    }
+
+    return written;
+}
+
+uint16_t DmxCodec::decode(const uint8_t* in, uint16_t length, uint8_t* out, uint16_t outSize) {
+    uint16_t read = 0;
+    uint16_t pos = 0;
+
+    while (read < length) {
+        DmxCodecOp op = (DmxCodecOp)(in[read] >> 5);
+        uint16_t count = (in[read] & 0x1f) + 1;
+        read++;
+
+        if (pos + count > outSize) {
+            return 0;
+        }
+
+        switch (op) {
+            case DmxCodecOp::opLiteral:
+                if (read + count > length) {
+                    return 0;
+                }
+                memcpy(out + pos, in + read, count);
+                read += count;
+                break;
+
+            case DmxCodecOp::opRun:
+                if (read + 1 > length) {
+                    return 0;
+                }
+                memset(out + pos, in[read], count);
+                read++;
+                break;
+
+            case DmxCodecOp::opDelta1:
+            case DmxCodecOp::opDelta2: {
+                uint8_t stride = (op == DmxCodecOp::opDelta1) ? 1 : 2;
+                if (read + (count + 1) / 2 > length) {
+                    return 0;
+                }
+                for (uint16_t i = 0; i < count; i++) {
+                    uint16_t chan = pos + i;
+                    uint8_t nibble = (i & 1) ? (in[read + i / 2] >> 4) : (in[read + i / 2] & 0x0f);
+                    int8_t delta = (nibble & 0x08) ? (int8_t)(nibble | 0xf0) : (int8_t)nibble;
+                    out[chan] = ((chan >= stride) ? out[chan - stride] : 0) + delta;
+                }
+                read += (count + 1) / 2;
+                break;
+            }
+
+            case DmxCodecOp::opPack: {
+                if (read + 2 > length) {
+                    return 0;
+                }
+                uint8_t base = in[read];
+                uint8_t width = in[read + 1];
+                read += 2;
+                if ((width < 1) || (width > 7) || (read + (count * width + 7) / 8 > length)) {
+                    return 0;
+                }
+                uint16_t bits = 0;
+                uint8_t bitCount = 0;
+                for (uint16_t i = 0; i < count; i++) {
+                    if (bitCount < width) {
+                        bits |= in[read++] << bitCount;
+                        bitCount += 8;
+                    }
+                    out[pos + i] = base + (bits & ((1 << width) - 1));
+                    bits >>= width;
+                    bitCount -= width;
+                }
+                break;
+            }
+
+            default:
+                return 0;
+        }
+
+        pos += count;
+    }
+
+    return pos;
+}
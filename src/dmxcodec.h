@@ -0,0 +1,41 @@
+#ifndef DMXCODEC_H
+#define DMXCODEC_H
+
+#include <cstdint>
+
+// Byte oriented codec tuned for DMX frames. Cheap enough for the M0+ and, in
+// contrast to snappy, good at what DMX data usually looks like: Flat ranges,
+// slow gradients over neighbouring channels (pixels), 16 bit coarse/fine
+// pairs and ranges using only a few distinct values
+//
+// The encoded data is a sequence of tokens. Each token starts with a control
+// byte: Upper 3 bits are the operation, lower 5 bits are the number of
+// channels the token produces - 1 (=> 1 to 32)
+#define DMXCODEC_MAX_COUNT 32
+
+#ifdef __cplusplus
+
+enum DmxCodecOp : uint8_t {
+    opLiteral                 = 0, // <count> bytes follow, copied as they are
+    opRun                     = 1, // 1 byte follows, repeated <count> times
+    opDelta1                  = 2, // 4 bit signed deltas to the previous channel, 2 per byte, low nibble first
+    opDelta2                  = 3, // Same, but to the channel before the previous one (16 bit pairs)
+    opPack                    = 4, // Base value and width (1-7) follow, then <count> values - base with <width> bits each, LSB first
+};
+
+class DmxCodec {
+  public:
+    // Returns the encoded length or 0 if it doesn't fit into outSize
+    static uint16_t encode(const uint8_t* in, uint16_t length, uint8_t* out, uint16_t outSize);
+
+    // Returns the number of channels written to out or 0 if the data is invalid
+    static uint16_t decode(const uint8_t* in, uint16_t length, uint8_t* out, uint16_t outSize);
+
+  private:
+    static uint8_t deltaLength(const uint8_t* in, uint16_t pos, uint16_t length, uint8_t stride);
+    static bool cheaper(uint16_t cost, uint16_t count, uint16_t bestCost, uint16_t bestCount);
+};
+
+#endif // __cplusplus
+
+#endif // DMXCODEC_H
@@ -1,18 +1,31 @@
 #include "edp.h"
 
-#include "crc_X25.h"
+#include "crc_dma.h"
+#include "dmxcodec.h"
 
+#ifndef EDP_HOST
 #include "boardconfig.h"
 #include "dmxbuffer.h"
 
+#include "pico/unique_id.h"
+
 extern BoardConfig boardConfig;
 extern DmxBuffer dmxBuffer;
+#endif
 
-extern critical_section_t bufferLock;
-
-void Edp::init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource) {
+void Edp::init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource, EdpReassemblySlot* slots, uint8_t numSlots) {
     this->initOkay = false;
 
+    memset(&stats, 0x00, sizeof(struct EdpStats));
+    memset(txSequence, 0x00, sizeof(txSequence));
+    memset(rxCompleted, 0x00, sizeof(rxCompleted));
+    this->fecParityChunks = 0;
+    this->compression = true;
+    this->prepareDmxData_parityChunks = 0;
+    this->responseSize = 0;
+    this->frameHandler = nullptr;
+    this->frameHandlerContext = nullptr;
+
     if (!inData || !outData || (maxSendChunkSize < 20)) {
         return;
     }
@@ -22,42 +35,88 @@ void Edp::init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, Pat
     this->maxSendChunkSize = maxSendChunkSize;
     this->patchSource = patchSource;
 
+    this->references = nullptr;
+    this->numReferences = 0;
+
+    this->slots = slots;
+    this->numSlots = slots ? numSlots : 0;
+    for (uint8_t i = 0; i < this->numSlots; i++) {
+        this->slots[i].inUse = false;
+    }
+
     this->initOkay = true;
 }
 
+void Edp::setFrameHandler(EdpFrameHandler handler, void* context) {
+    this->frameHandlerContext = context;
+    this->frameHandler = handler;
+}
+
+uint16_t Edp::takeResponse() {
+    uint16_t size = this->responseSize;
+    this->responseSize = 0;
+    return size;
+}
+
+// Enables keyframes and deltas. Senders keep the last keyframe they sent for
+// each universe, receivers the last keyframe they got
+void Edp::initDelta(EdpReference* references, uint8_t numReferences) {
+    this->references = references;
+    this->numReferences = references ? numReferences : 0;
+    for (uint8_t i = 0; i < this->numReferences; i++) {
+        this->references[i].valid = false;
+    }
+}
+
+bool Edp::setFec(uint8_t parityChunks) {
+    uint16_t stride = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+
+    if (!initOkay || (parityChunks > EDP_FEC_MAX_PARITY) || (parityChunks && (stride > EDP_FEC_MAX_STRIDE))) {
+        return false;
+    }
+
+    this->fecParityChunks = parityChunks;
+    return true;
+}
+
+void Edp::setCompression(bool enabled) {
+    this->compression = enabled;
+}
+
 // Take data from inData, prepare the complete packet in scratch
 // Then, chop it into chunks and store them in outData, one per call
 bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain) {
     uint16_t limitedInDataSize;
-    uint16_t sparseSize;
+    uint16_t payloadSize;
+    uint16_t referenceHeaderSize;
     uint8_t* destination;
-    uint16_t firstUsedChannel;
-    uint16_t lastUsedChannel;
+    bool anyUsedChannel;
+    bool delta;
+    EdpReference* reference;
+    const uint16_t headerSize = sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
 
     struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)(outData + sizeof(Edp_Commands));
-    struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)(outData + sizeof(Edp_Commands) + sizeof(Edp_DmxData_ChunkHeader));
+    struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)(outData + headerSize);
+    struct Edp_DmxData_ReferenceHeader* referenceHeader = (struct Edp_DmxData_ReferenceHeader*)(outData + headerSize + sizeof(struct Edp_DmxData_PacketHeader));
 
     if (inDataSize != 0) {
         // Start a new packet, discard existing data and chunks
 
         memset(outData, 0x00, 600);
 
-        // Loop over the input data so we know:
-        //   - if it's all empty / zero
-        //   - what the first and last used channels are so can send a sparse frame
-        firstUsedChannel = 600;  // Some invalid value so we can detect if NO channel is in use
-        lastUsedChannel = 600;   // Some invalid value so we can detect if NO channel is in use
-        for (uint16_t i = 0; i < inDataSize; i++) {
-            if ((firstUsedChannel == 600) && (inData[i] != 0)) {
-                firstUsedChannel = i;
-            }
+        // Channels not given are zero. Deltas are calculated over the full frame
+        limitedInDataSize = MIN(inDataSize, 512);
+        memset(inData + limitedInDataSize, 0x00, 512 - limitedInDataSize);
+
+        // Special case: allZero packet
+        anyUsedChannel = false;
+        for (uint16_t i = 0; i < limitedInDataSize; i++) {
             if (inData[i] != 0) {
-                lastUsedChannel = i;
+                anyUsedChannel = true;
+                break;
             }
         }
-
-        // Special case: allZero packet
-        if (lastUsedChannel == 600) {
+        if (!anyUsedChannel) {
             outData[0] = Edp_Commands::DmxDataAllZero;
             outData[1] = universeId;
             *thisChunkSize = 2;
@@ -65,42 +124,63 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
             return true;
         }
 
-        outData[0] = Edp_Commands::DmxData;
         packetHeader->universeId = universeId;
-
-        limitedInDataSize = MIN(inDataSize, 512);
+        chunkHeader->universeId = universeId;
+        chunkHeader->sequence = txSequence[universeId & 0x3f]++;
 
         prepareDmxData_chunkOffset = maxSendChunkSize;
 
-        // TODO: Not yet supported
-        // IF NOT SUPPORT SPARSE
-        packetHeader->sparse = 0;
-        packetHeader->sparseOffset = 0;
-        sparseSize = 512;
-        // ELSE
-        packetHeader->sparse = 1;
-        packetHeader->sparseOffset = MIN(firstUsedChannel, 255);
-        sparseSize = MIN(lastUsedChannel, 511) - packetHeader->sparseOffset + 1;
-        LOG("prepareDMX: firstUsedChannel: %u, lastUsedChannel: %u, sparseOffset: %u, sparseSize: %u", firstUsedChannel, lastUsedChannel, packetHeader->sparseOffset, sparseSize);
-
-        // Compress inData to outData. If it's larger than the input, it will be overwritten later
-        prepareDmxData_sizeOfDataToBeSent = 600 - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader) - sizeof(Edp_DmxData_PacketHeader);
-        destination = outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(Edp_DmxData_PacketHeader);
-        snappy::RawCompress((const char *)inData + packetHeader->sparseOffset, sparseSize, (char*)destination, &prepareDmxData_sizeOfDataToBeSent);
-
-        if (prepareDmxData_sizeOfDataToBeSent >= sparseSize) {
-            LOG("Compressed size: %d (inSize: %d) => SENDING UNCOMPRESSED!", prepareDmxData_sizeOfDataToBeSent, sparseSize);
-            packetHeader->compressed = 0;
-            memcpy(destination, inData + packetHeader->sparseOffset, sparseSize);
-            prepareDmxData_sizeOfDataToBeSent = sparseSize;
-        } else {
-            packetHeader->compressed = 1;
+        // With reference storage, every packet is either a keyframe or a
+        // delta against the last keyframe and carries the keyframe's id
+        reference = findReference(universeId, true);
+        referenceHeaderSize = reference ? sizeof(struct Edp_DmxData_ReferenceHeader) : 0;
+        destination = outData + headerSize + sizeof(struct Edp_DmxData_PacketHeader) + referenceHeaderSize;
+
+        delta = false;
+        if (reference && reference->valid && ((time_us_32() - reference->keyframeTime) < EDP_KEYFRAME_INTERVAL_US)) {
+            // XOR against the keyframe, unchanged channels become zero
+            for (uint16_t i = 0; i < 512; i++) {
+                inData[i] ^= reference->data[i];
+            }
+            payloadSize = encodeFrame(inData, packetHeader, destination);
+
+            if (payloadSize < reference->keyframeSize) {
+                delta = true;
+                outData[0] = Edp_Commands::DmxDataDelta;
+            } else {
+                // Not worth it, restore the frame and send a new keyframe instead
+                for (uint16_t i = 0; i < 512; i++) {
+                    inData[i] ^= reference->data[i];
+                }
+            }
+        }
+
+        if (!delta) {
+            payloadSize = encodeFrame(inData, packetHeader, destination);
+
+            if (reference) {
+                outData[0] = Edp_Commands::DmxDataKeyframe;
+                memcpy(reference->data, inData, 512);
+                reference->keyframeId++;
+                reference->keyframeSize = payloadSize;
+                reference->keyframeTime = time_us_32();
+                reference->valid = true;
+            } else {
+                outData[0] = Edp_Commands::DmxData;
+            }
         }
 
+        if (reference) {
+            referenceHeader->keyframeId = reference->keyframeId;
+        }
+
+        LOG("prepareDMX: command: %02x, ranges: %u, codec: %u, payloadSize: %u", outData[0], packetHeader->ranges, packetHeader->codec, payloadSize);
+
         // Calculate a CRC so the receivers know if they got all the correct chunks
         // CRC is over the complete "payload" = without the PacketHeader
+        prepareDmxData_sizeOfDataToBeSent = referenceHeaderSize + payloadSize;
         packetHeader->crc = crc_init();
-        packetHeader->crc = crc_update(packetHeader->crc, outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + sizeof(Edp_DmxData_PacketHeader), prepareDmxData_sizeOfDataToBeSent);
+        packetHeader->crc = crc_dma_update(packetHeader->crc, outData + headerSize + sizeof(Edp_DmxData_PacketHeader), prepareDmxData_sizeOfDataToBeSent);
         packetHeader->crc = crc_finalize(packetHeader->crc);
 
         // Increase the size of the packet by the prepended header
@@ -108,13 +188,35 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
 
         LOG("Size with packetHeader: %u", prepareDmxData_sizeOfDataToBeSent);
 
+        // FEC: Pad the packet to full chunks and calculate the parity now,
+        // since sending the chunks overwrites the start of the packet
+        prepareDmxData_parityChunks = 0;
+        if (fecParityChunks) {
+            const uint16_t stride = maxSendChunkSize - headerSize;
+            uint8_t* packet = outData + headerSize;
+            uint8_t dataChunks = (prepareDmxData_sizeOfDataToBeSent + stride - 1) / stride;
+
+            packetHeader->padding = dataChunks * stride - prepareDmxData_sizeOfDataToBeSent;
+            memset(packet + prepareDmxData_sizeOfDataToBeSent, 0x00, packetHeader->padding);
+            prepareDmxData_sizeOfDataToBeSent += packetHeader->padding;
+
+            prepareDmxData_parityChunks = MIN(fecParityChunks, dataChunks);
+            prepareDmxData_nextParity = 0;
+            prepareDmxData_lastDataChunk = dataChunks - 1;
+
+            memset(fecParity, 0x00, sizeof(fecParity));
+            for (uint16_t i = 0; i < prepareDmxData_sizeOfDataToBeSent; i++) {
+                fecParity[(i / stride) % prepareDmxData_parityChunks][i % stride] ^= packet[i];
+            }
+        }
+
         // Make chunk 0 ready
         chunkHeader->chunkCounter = Edp_DmxData_ChunkCounter::FirstPacket;
         if ((prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader)) <= maxSendChunkSize) {
             // Yay, only one chunk needed :D
             chunkHeader->lastChunk = true;
             *thisChunkSize = prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader);
-            *callAgain = false;
+            *callAgain = (prepareDmxData_parityChunks > 0);
             LOG("Only one chunk is needed :D Size: %u", prepareDmxData_sizeOfDataToBeSent + sizeof(Edp_Commands) + sizeof (struct Edp_DmxData_ChunkHeader));
             return true;
         }
@@ -133,10 +235,26 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
         // TODO: Check if there actually is a next chunk or if this was accidentally
         //       called without inDataSize
 
+        // All data chunks are out, continue with the parity chunks
+        if (prepareDmxData_parityChunks && (chunkHeader->chunkCounter == prepareDmxData_lastDataChunk)) {
+            outData[0] = Edp_Commands::DmxDataParity | (prepareDmxData_parityChunks - 1);
+            chunkHeader->lastChunk = false;
+            chunkHeader->parityIndex = prepareDmxData_nextParity;
+            memcpy(outData + headerSize, fecParity[prepareDmxData_nextParity], maxSendChunkSize - headerSize);
+
+            prepareDmxData_nextParity++;
+            *thisChunkSize = maxSendChunkSize;
+            *callAgain = (prepareDmxData_nextParity < prepareDmxData_parityChunks);
+            return true;
+        }
+
         // ChunkOffset points to the OLD chunk's data
 
+        // Large chunks (mesh) would read past the packet, only copy what is left of it
+        size_t packetLeft = prepareDmxData_sizeOfDataToBeSent - (prepareDmxData_chunkOffset - headerSize);
+        size_t chunkPayload = maxSendChunkSize - headerSize;
         destination = outData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
-        memcpy(destination, outData + prepareDmxData_chunkOffset, maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader));
+        memcpy(destination, outData + prepareDmxData_chunkOffset, MIN(chunkPayload, packetLeft));
 
         chunkHeader->chunkCounter = (Edp_DmxData_ChunkCounter)(chunkHeader->chunkCounter + 1);
 
@@ -146,161 +264,666 @@ bool Edp::prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* this
             maxSendChunkSize,
             prepareDmxData_sizeOfDataToBeSent);
 
-        if (prepareDmxData_chunkOffset + maxSendChunkSize >= prepareDmxData_sizeOfDataToBeSent + sizeof(struct Edp_DmxData_PacketHeader)) {
+        // The packet starts at outData + headerSize, so the chunk's position
+        // inside the packet is chunkOffset - headerSize
+        if ((size_t)(prepareDmxData_chunkOffset - headerSize + (maxSendChunkSize - headerSize)) >= prepareDmxData_sizeOfDataToBeSent) {
             chunkHeader->lastChunk = true;
-            *thisChunkSize = prepareDmxData_sizeOfDataToBeSent - prepareDmxData_chunkOffset + sizeof(struct Edp_DmxData_PacketHeader);
-            *callAgain = false;
+            *thisChunkSize = headerSize + prepareDmxData_sizeOfDataToBeSent - (prepareDmxData_chunkOffset - headerSize);
+            *callAgain = (prepareDmxData_parityChunks > 0);
             LOG("It's the last chunk! Size: %u %04x", *thisChunkSize, *thisChunkSize);
             return true;
         }
 
-        prepareDmxData_chunkOffset = prepareDmxData_chunkOffset + (maxSendChunkSize - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader));
+        prepareDmxData_chunkOffset = prepareDmxData_chunkOffset + (maxSendChunkSize - headerSize);
         *callAgain = true;
 
         return true;
     }
 }
 
+// Encode a 512 byte frame to destination: Either the window between the first
+// and the last used channel or the list of used ranges, whatever is smaller.
+// Then with the codec that makes it smallest
+// Fills the packet header (except the CRC), returns the payload length
+uint16_t Edp::encodeFrame(uint8_t* frame, struct Edp_DmxData_PacketHeader* packetHeader, uint8_t* destination) {
+    uint16_t firstUsedChannel;
+    uint16_t lastUsedChannel;
+    uint16_t bodySize;
+    uint16_t rangesSize;
+    uint16_t dmxCodecSize;
+    uint8_t* body;
+    size_t compressedSize = 0;
+
+    // Loop over the input data so we know what the first and last used
+    // channels are so can send a sparse frame
+    firstUsedChannel = 600;  // Some invalid value so we can detect if NO channel is in use
+    lastUsedChannel = 0;
+    for (uint16_t i = 0; i < 512; i++) {
+        if (frame[i] != 0) {
+            if (firstUsedChannel == 600) {
+                firstUsedChannel = i;
+            }
+            lastUsedChannel = i;
+        }
+    }
+
+    // A delta without any change still needs some payload
+    if (firstUsedChannel == 600) {
+        firstUsedChannel = 0;
+    }
+
+    packetHeader->sparse = 1;
+    packetHeader->sparseOffset = firstUsedChannel & 0xff;
+    packetHeader->sparseOffsetHigh = firstUsedChannel >> 8;
+    body = frame + firstUsedChannel;
+    bodySize = lastUsedChannel - firstUsedChannel + 1;
+
+    // Channels used far apart (changes at 3 and 500) are cheaper as ranges
+    packetHeader->ranges = 0;
+    rangesSize = encodeRanges(frame, scratch, bodySize - 1);
+    if (rangesSize) {
+        packetHeader->ranges = 1;
+        body = scratch;
+        bodySize = rangesSize;
+    }
+
+    // The DMX codec is cheap, only try snappy if it didn't save at least a quarter
+    dmxCodecSize = DmxCodec::encode(body, bodySize, destination, bodySize - 1);
+    if (dmxCodecSize && (dmxCodecSize <= bodySize * 3 / 4)) {
+        packetHeader->codec = Edp_DmxData_Codec::codecDmx;
+        return dmxCodecSize;
+    }
+
+    // Compress to destination. If it's larger than the input, it will be overwritten
+    if (compression) {
+        compressedSize = 600 - sizeof(Edp_Commands) - sizeof(Edp_DmxData_ChunkHeader) - sizeof(Edp_DmxData_PacketHeader) - sizeof(Edp_DmxData_ReferenceHeader);
+        snappy::RawCompress((const char *)body, bodySize, (char*)destination, &compressedSize);
+        stats.snappyTried++;
+
+        if (compressedSize < MIN(bodySize, dmxCodecSize ? dmxCodecSize : bodySize)) {
+            stats.snappyUsed++;
+            packetHeader->codec = Edp_DmxData_Codec::codecSnappy;
+            return compressedSize;
+        }
+    }
+
+    if (dmxCodecSize) {
+        packetHeader->codec = Edp_DmxData_Codec::codecDmx;
+        return DmxCodec::encode(body, bodySize, destination, bodySize - 1);
+    }
+
+    LOG("Compressed size: %d (inSize: %d) => SENDING UNCOMPRESSED!", compressedSize, bodySize);
+    packetHeader->codec = Edp_DmxData_Codec::codecNone;
+    memcpy(destination, body, bodySize);
+    return bodySize;
+}
+
+// Write the used channels of frame as list of ranges. A range ends at a gap
+// of more than sizeof(Edp_DmxData_RangeHeader) zeros, since a new range is
+// cheaper then. Returns the size or 0 if it doesn't fit into destinationSize
+uint16_t Edp::encodeRanges(uint8_t* frame, uint8_t* destination, uint16_t destinationSize) {
+    uint16_t written = 0;
+    uint16_t start;
+    uint16_t last;
+    uint16_t chan = 0;
+
+    while (chan < 512) {
+        if (!frame[chan]) {
+            chan++;
+            continue;
+        }
+
+        start = chan;
+        last = chan;
+        while ((chan < 512) && (chan - start < 128)) {
+            if (frame[chan]) {
+                last = chan;
+            } else if (chan > last + sizeof(struct Edp_DmxData_RangeHeader)) {
+                break;
+            }
+            chan++;
+        }
+        chan = last + 1;
+
+        uint16_t length = last - start + 1;
+        if (written + sizeof(struct Edp_DmxData_RangeHeader) + length > destinationSize) {
+            return 0;
+        }
+
+        struct Edp_DmxData_RangeHeader* rangeHeader = (struct Edp_DmxData_RangeHeader*)(destination + written);
+        rangeHeader->offset = start & 0xff;
+        rangeHeader->offsetHigh = start >> 8;
+        rangeHeader->length = length - 1;
+        written += sizeof(struct Edp_DmxData_RangeHeader);
+
+        memcpy(destination + written, frame + start, length);
+        written += length;
+    }
+
+    return written;
+}
+
 // Since every data source calling this has its own instance of EDP, this
 // should be safe
 bool Edp::processIncomingChunk(uint16_t chunkSize) {
-    Patching patching;
-    uint8_t universeId;
-    uint16_t copySize;
-    uint16_t crc;
-    size_t uncompressedLength;
+    EdpReassemblySlot* slot;
+    const uint16_t headerSize = sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader);
+    uint16_t payloadSize;
+    uint16_t packetOffset;
+    uint16_t stride;
+    uint32_t chunkBit;
 
     if (chunkSize < 1) {
         return false;
     }
 
-    patching.active = false;
-
     LOG("EDP INCOMING: %d byte. Command: %d", chunkSize, inData[0]);
 
+    if (inData[0] == Edp_Commands::Ping) {
+        // Answer with our serial and whatever the requester sent, so it
+        // can match the Pong (for example to measure the round-trip time)
+        uint16_t echoSize = MIN(chunkSize - sizeof(Edp_Commands), EDP_PING_MAX_PAYLOAD);
+        uint8_t* response = outData;
+
+        response[0] = Edp_Commands::Pong;
+#ifndef EDP_HOST
+        pico_get_unique_board_id((pico_unique_board_id_t*)(response + sizeof(Edp_Commands)));
+#else
+        memset(response + sizeof(Edp_Commands), 0x00, 8);
+#endif
+        memmove(response + sizeof(Edp_Commands) + 8, inData + sizeof(Edp_Commands), echoSize);
+        this->responseSize = sizeof(Edp_Commands) + 8 + echoSize;
+        return true;
+    }
+
     if (inData[0] == Edp_Commands::DmxDataAllZero) {
         // No chunk header, no packetheader, just the universeId
-        patching = findPatching(inData[1]);
+        uint8_t universeId = inData[1];
 
-        LOG("allZero packet. universe: %u patching active: %u buffer: %u", inData[1], patching.active, patching.dstInstance);
+        LOG("allZero packet. universe: %u", universeId);
 
-        if (patching.active) {
-            // Easy: Just clear the DmxBuffer
-            dmxBuffer.zero(patching.dstInstance);
-            return true;
-        }
-        return false;
+        // A frame of this universe still being assembled is outdated now
+        evictReassemblySlot(universeId);
+
+        memset(inData, 0x00, 512);
+        return deliverFrame(universeId, inData, true);
     }
 
-    if (inData[0] == Edp_Commands::DmxData) {
+    bool parity = ((inData[0] & ~(EDP_FEC_MAX_PARITY - 1)) == Edp_Commands::DmxDataParity);
+
+    if ((inData[0] == Edp_Commands::DmxData) ||
+        (inData[0] == Edp_Commands::DmxDataKeyframe) ||
+        (inData[0] == Edp_Commands::DmxDataDelta) ||
+        parity)
+    {
         // At least a chunk header + 1 byte payload needs to be there
+        if (chunkSize < (headerSize + 1)) {
+            stats.chunksInvalid++;
+            return false;
+        }
 
-        if (chunkSize < (sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader) + 1)) {
+        struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)(inData + sizeof(Edp_Commands));
+
+        LOG("DmxData: Universe: %u, Sequence: %u, Chunk: %d, LastChunk: %d, Parity: %d", chunkHeader->universeId, chunkHeader->sequence, chunkHeader->chunkCounter, chunkHeader->lastChunk, parity);
+
+        // All chunks but the last one are full, so the sender's chunk size
+        // (same transport = same maxSendChunkSize) tells us where this one goes
+        stride = maxSendChunkSize - headerSize;
+        payloadSize = chunkSize - headerSize;
+        packetOffset = chunkHeader->chunkCounter * stride;
+        if ((!chunkHeader->lastChunk && (chunkSize != maxSendChunkSize)) ||
+            (packetOffset + (parity ? stride : payloadSize) > EDP_MAX_PADDED_PACKET) ||
+            (parity && ((stride > EDP_FEC_MAX_STRIDE) || (chunkHeader->parityIndex > (inData[0] & (EDP_FEC_MAX_PARITY - 1))))))
+        {
+            stats.chunksInvalid++;
             return false;
         }
 
-        struct Edp_DmxData_ChunkHeader* chunkHeader = (struct Edp_DmxData_ChunkHeader*)inData + sizeof(Edp_Commands);
-
-        LOG("DmxData: Chunk: %d, LastChunk: %d", chunkHeader->chunkCounter, chunkHeader->lastChunk);
-
-        // Complete frame (all chunks) is assembled in outData
-
-        if (chunkHeader->chunkCounter == Edp_DmxData_ChunkCounter::FirstPacket) {
-            // Clear outData so the following chunks comes in clean
-            copySize = MIN((chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader)), 600);
-            LOG("DmxData: FIRST chunk. Will copy %u byte", copySize);
-            critical_section_enter_blocking(&bufferLock);
-            memset(outData, 0x00, 600);
-            memcpy(outData, inData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
-            critical_section_exit(&bufferLock);
-            prepareDmxData_chunkOffset = copySize;
-        } else if (chunkHeader->chunkCounter < 32) {
-            // Some intermediate packet: Just copy it to outData
-            copySize = MIN((chunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader)), 600);
-            LOG("DmxData: INTERMEDIATE chunk. Will copy %u at offset %u", copySize, prepareDmxData_chunkOffset);
-            critical_section_enter_blocking(&bufferLock);
-            memcpy(outData + prepareDmxData_chunkOffset, inData + sizeof(Edp_Commands) + sizeof(struct Edp_DmxData_ChunkHeader), copySize);
-            critical_section_exit(&bufferLock);
-            prepareDmxData_chunkOffset += copySize;
-        }
-
-        // If the last chunk just came in, we have everything and can act on it
-        if (chunkHeader->lastChunk) {
-            struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)outData;
-
-            // Check CRC and discard packet if it doesn't match
-            LOG("Checksum first byte: %02x, len: %u", (outData + sizeof(struct Edp_DmxData_PacketHeader))[0], prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-            crc = crc_init();
-            crc = crc_update(crc, outData + sizeof(struct Edp_DmxData_PacketHeader), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-            crc = crc_finalize(crc);
-            if (crc != packetHeader->crc) {
-                LOG("CRC mismatch! Expected: %04x, Calculated: %04x", packetHeader->crc, crc);
-                return false;
+        // Parity chunks usually come in after the frame has been completed
+        if (rxCompleted[chunkHeader->universeId] == (0x80 | chunkHeader->sequence)) {
+            if (!parity) {
+                stats.chunksDuplicate++;
             }
+            return true;
+        }
 
-            // The complete packet (compressed or not) sits at outData
-            // inData contains the last chunk received + possibly garbage
-
-            // For sparse packets to work, we need 512 byte of zeroed space, so we
-            // will re-use inData for that. So zero it here
-            memset(inData, 0x00, 600);
+        slot = findReassemblySlot(chunkHeader->universeId, chunkHeader->sequence);
+        if (!slot) {
+            return false;
+        }
 
-            patching = findPatching(packetHeader->universeId);
+        if (parity) {
+            chunkBit = (1UL << chunkHeader->parityIndex);
+            if (slot->receivedParity & chunkBit) {
+                stats.chunksDuplicate++;
+                return true;
+            }
 
-            LOG("DmxData packet complete! universe: %u, packetLen: %u, compressed: %u, sparse: %u, sparseOffset: %u, patching active: %u buffer: %u",
-                packetHeader->universeId,
-                prepareDmxData_chunkOffset,
-                packetHeader->compressed,
-                packetHeader->sparse,
-                packetHeader->sparseOffset,
-                patching.active,
-                patching.dstInstance
-            );
+            memcpy(slot->parity[chunkHeader->parityIndex], inData + headerSize, stride);
+            slot->receivedParity |= chunkBit;
+            slot->parityChunks = (inData[0] & (EDP_FEC_MAX_PARITY - 1)) + 1;
 
-            // If this universe is not patched, no need to do anything
-            if (!patching.active) {
-                return true; // TODO: or better false?
+            // Tells us how many data chunks there are, even if the last one got lost
+            if (slot->lastChunk == 0xff) {
+                slot->lastChunk = chunkHeader->chunkCounter;
+                slot->length = packetOffset + stride;
+            }
+        } else {
+            slot->command = inData[0];
+
+            // Might have been rebuilt from parity already, but the command
+            // is only known now
+            chunkBit = (1UL << chunkHeader->chunkCounter);
+            if (slot->receivedChunks & chunkBit) {
+                stats.chunksDuplicate++;
+                return completeReassembly(slot);
             }
 
-            if (packetHeader->compressed) {
-                if (snappy::GetUncompressedLength((const char*)(outData + sizeof(struct Edp_DmxData_PacketHeader)), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader), &uncompressedLength) == true) {
-                    LOG("snappy::GetUncompressedLength: %d", uncompressedLength);
-
-                    // Sanity check: uncompressedLength must be 512 OR the frame is sparse
-                    if ((!packetHeader->sparse && uncompressedLength != 512) || (packetHeader->sparse && uncompressedLength > 512)) {
-                        return false;
-                    }
-
-                    if (snappy::RawUncompress((const char*)(outData + sizeof(struct Edp_DmxData_PacketHeader)), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader), (char*)inData + packetHeader->sparseOffset) == true) {
-                        dmxBuffer.setBuffer(patching.dstInstance, inData, uncompressedLength + packetHeader->sparseOffset);
-                        return true;
-                    } else {
-                        LOG("snappy::RawUncompress failed :(");
-                        return false;
-                    }
-                } else {
-                    LOG("snappy::GetUncompressedLength failed :(");
-                    return false;
+            if ((packetOffset <= slot->crcLength) && (slot->crcLength < packetOffset + payloadSize)) {
+                // Continues the checksummed part: Calculate the CRC while copying. The
+                // packet header (in chunk 0) and FEC padding (in the last chunk) are not covered
+                uint16_t skip = slot->crcLength - packetOffset;
+                uint16_t crcSize = payloadSize - skip;
+
+                memcpy(slot->data + packetOffset, inData + headerSize, skip);
+                if (chunkHeader->lastChunk) {
+                    uint8_t padding = ((struct Edp_DmxData_PacketHeader*)slot->data)->padding;
+                    crcSize = (padding < crcSize) ? (crcSize - padding) : 0;
                 }
+                slot->crc = crc_dma_copy(slot->crc, slot->data + slot->crcLength, inData + headerSize + skip, crcSize);
+                slot->crcLength += crcSize;
+                memcpy(slot->data + slot->crcLength, inData + headerSize + skip + crcSize, payloadSize - skip - crcSize);
             } else {
-                // Sanity check: if full frame, packetLen MUST be 512 + sizeof PacketHeader
-                if (prepareDmxData_chunkOffset == (512 + sizeof(Edp_DmxData_PacketHeader))) {
-                    dmxBuffer.setBuffer(patching.dstInstance, outData + sizeof(struct Edp_DmxData_PacketHeader), (prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader)));
-                    return true;
-                } else if (packetHeader->sparse) {
-                    memcpy(inData + packetHeader->sparseOffset, outData + sizeof(struct Edp_DmxData_PacketHeader), prepareDmxData_chunkOffset - sizeof(struct Edp_DmxData_PacketHeader));
-                    dmxBuffer.setBuffer(patching.dstInstance, inData, prepareDmxData_chunkOffset + packetHeader->sparseOffset);
-                    return true;
-                }
-                return false;
+                memcpy(slot->data + packetOffset, inData + headerSize, payloadSize);
+            }
+            slot->receivedChunks |= chunkBit;
+
+            if (chunkHeader->lastChunk) {
+                slot->lastChunk = chunkHeader->chunkCounter;
+                slot->length = packetOffset + payloadSize;
             }
         }
+
+        return completeReassembly(slot);
     }
 
     // Should not reach here!
     return false;
 }
 
+// Find the slot the chunk of universeId/sequence belongs to. Allocates a new
+// slot if this is the first chunk of a frame, evicting older frames if
+// required. Returns nullptr if the chunk belongs to an outdated frame
+EdpReassemblySlot* Edp::findReassemblySlot(uint8_t universeId, uint8_t sequence) {
+    EdpReassemblySlot* slot = nullptr;
+    EdpReassemblySlot* oldest = nullptr;
+    uint32_t now = time_us_32();
+
+    for (uint8_t i = 0; i < numSlots; i++) {
+        EdpReassemblySlot* candidate = &slots[i];
+
+        if (candidate->inUse && ((now - candidate->started) > EDP_REASSEMBLY_TIMEOUT_US)) {
+            LOG("EDP: Partial frame of universe %u timed out. Chunks: %08x", candidate->universeId, candidate->receivedChunks);
+            candidate->inUse = false;
+            stats.framesTimedOut++;
+        }
+
+        if (!candidate->inUse) {
+            if (!slot) {
+                slot = candidate;
+            }
+            continue;
+        }
+
+        if (candidate->universeId == universeId) {
+            if (candidate->sequence == sequence) {
+                return candidate;
+            }
+
+            // The sequence is only 2 bit. One behind means the chunk is late,
+            // everything else means a new frame started before this one completed
+            if (((sequence - candidate->sequence) & 0x03) == 0x03) {
+                stats.chunksStale++;
+                return nullptr;
+            }
+
+            LOG("EDP: Partial frame of universe %u superseded. Chunks: %08x", candidate->universeId, candidate->receivedChunks);
+            candidate->inUse = false;
+            stats.framesDropped++;
+            slot = candidate;
+            continue;
+        }
+
+        if (!oldest || ((int32_t)(candidate->started - oldest->started) < 0)) {
+            oldest = candidate;
+        }
+    }
+
+    if (!slot) {
+        if (!oldest) {
+            // No slots configured
+            return nullptr;
+        }
+        LOG("EDP: Out of reassembly slots, dropping partial frame of universe %u", oldest->universeId);
+        stats.framesDropped++;
+        slot = oldest;
+    }
+
+    // A new frame, so a chunk with the sequence of the last finished one is not late any more
+    rxCompleted[universeId] = 0;
+
+    slot->inUse = true;
+    slot->universeId = universeId;
+    slot->sequence = sequence;
+    slot->command = 0;
+    slot->lastChunk = 0xff;
+    slot->receivedChunks = 0;
+    slot->parityChunks = 0;
+    slot->receivedParity = 0;
+    slot->crc = crc_init();
+    slot->crcLength = sizeof(struct Edp_DmxData_PacketHeader);
+    slot->length = 0;
+    slot->started = now;
+
+    return slot;
+}
+
+// Process the slot's packet if the last chunk and all before it are there
+// (or can be rebuilt from the parity chunks)
+bool Edp::completeReassembly(EdpReassemblySlot* slot) {
+    uint32_t allChunks;
+    uint32_t missingChunks;
+
+    if (slot->lastChunk == 0xff) {
+        return true;
+    }
+
+    allChunks = 0xffffffffUL >> (31 - slot->lastChunk);
+    missingChunks = allChunks & ~slot->receivedChunks;
+    if (missingChunks && slot->receivedParity) {
+        recoverChunks(slot, missingChunks);
+        missingChunks = allChunks & ~slot->receivedChunks;
+    }
+
+    // The command is only known from the data chunks
+    if (missingChunks || !slot->command) {
+        return true;
+    }
+
+    // Strip the padding FEC added to fill the last chunk
+    struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)slot->data;
+    uint16_t length = slot->length - packetHeader->padding;
+    bool result = false;
+
+    if ((slot->length < sizeof(struct Edp_DmxData_PacketHeader)) ||
+        (packetHeader->padding >= slot->length - sizeof(struct Edp_DmxData_PacketHeader)) ||
+        (slot->crcLength > length))
+    {
+        stats.chunksInvalid++;
+    } else {
+        // Checksum whatever didn't come in in order
+        uint16_t crc = crc_dma_update(slot->crc, slot->data + slot->crcLength, length - slot->crcLength);
+
+        // Frame is complete, the slot is free for the next one as soon as
+        // the packet has been processed
+        result = processDmxDataPacket(slot->command, slot->data, length, crc_finalize(crc));
+    }
+
+    if (result) {
+        uint32_t reassemblyUs = time_us_32() - slot->started;
+        stats.reassemblyUsSum += reassemblyUs;
+        stats.reassemblyUsMax = MAX(stats.reassemblyUsMax, reassemblyUs);
+        stats.lastUniverse = slot->universeId;
+        stats.lastSequence = slot->sequence;
+    }
+
+    rxCompleted[slot->universeId] = 0x80 | slot->sequence;
+    slot->inUse = false;
+    return result;
+}
+
+// Rebuild every missing chunk that is the only one missing of its parity group
+void Edp::recoverChunks(EdpReassemblySlot* slot, uint32_t missingChunks) {
+    const uint16_t stride = maxSendChunkSize - sizeof(Edp_Commands) - sizeof(struct Edp_DmxData_ChunkHeader);
+    uint8_t lost;
+    uint8_t lostCount;
+    uint8_t* target;
+
+    for (uint8_t p = 0; p < slot->parityChunks; p++) {
+        if (!(slot->receivedParity & (1 << p))) {
+            continue;
+        }
+
+        lost = 0;
+        lostCount = 0;
+        for (uint8_t n = p; n <= slot->lastChunk; n += slot->parityChunks) {
+            if (missingChunks & (1UL << n)) {
+                lost = n;
+                lostCount++;
+            }
+        }
+        if (lostCount != 1) {
+            continue;
+        }
+
+        target = slot->data + lost * stride;
+        memcpy(target, slot->parity[p], stride);
+        for (uint8_t n = p; n <= slot->lastChunk; n += slot->parityChunks) {
+            if (n == lost) {
+                continue;
+            }
+            for (uint16_t i = 0; i < stride; i++) {
+                target[i] ^= slot->data[n * stride + i];
+            }
+        }
+
+        LOG("EDP: Rebuilt chunk %u of universe %u from parity %u", lost, slot->universeId, p);
+        slot->receivedChunks |= (1UL << lost);
+        stats.chunksRecovered++;
+    }
+}
+
+void Edp::evictReassemblySlot(uint8_t universeId) {
+    for (uint8_t i = 0; i < numSlots; i++) {
+        if (slots[i].inUse && (slots[i].universeId == universeId)) {
+            slots[i].inUse = false;
+            stats.framesDropped++;
+        }
+    }
+}
+
+// Check and unpack a completely reassembled DmxData packet (packet header + payload)
+// crc is the one calculated over the received packet
+bool Edp::processDmxDataPacket(uint8_t command, uint8_t* packet, uint16_t packetLength, uint16_t crc) {
+    EdpReference* reference;
+    size_t uncompressedLength;
+    uint16_t referenceHeaderSize = (command == Edp_Commands::DmxData) ? 0 : sizeof(struct Edp_DmxData_ReferenceHeader);
+    uint8_t* body;
+    uint16_t bodyLength;
+
+    if (packetLength <= sizeof(struct Edp_DmxData_PacketHeader) + referenceHeaderSize) {
+        stats.chunksInvalid++;
+        return false;
+    }
+
+    struct Edp_DmxData_PacketHeader* packetHeader = (struct Edp_DmxData_PacketHeader*)packet;
+    struct Edp_DmxData_ReferenceHeader* referenceHeader = (struct Edp_DmxData_ReferenceHeader*)(packet + sizeof(struct Edp_DmxData_PacketHeader));
+    uint8_t* payload = packet + sizeof(struct Edp_DmxData_PacketHeader) + referenceHeaderSize;
+    uint16_t payloadLength = packetLength - sizeof(struct Edp_DmxData_PacketHeader) - referenceHeaderSize;
+
+    // Discard packet if the CRC doesn't match
+    if (crc != packetHeader->crc) {
+        LOG("CRC mismatch! Expected: %04x, Calculated: %04x", packetHeader->crc, crc);
+        stats.framesCrcError++;
+        return false;
+    }
+
+    stats.framesComplete++;
+
+    LOG("DmxData packet complete! command: %02x, universe: %u, packetLen: %u, codec: %u, sparse: %u, ranges: %u, sparseOffset: %u",
+        command,
+        packetHeader->universeId,
+        packetLength,
+        packetHeader->codec,
+        packetHeader->sparse,
+        packetHeader->ranges,
+        packetHeader->sparseOffset | (packetHeader->sparseOffsetHigh << 8)
+    );
+
+    // inData contains the last chunk received + possibly garbage
+    // The frame is unpacked there, channels not in the packet are zero
+    memset(inData, 0x00, 600);
+
+    // Undo the codec, the body is what encodeFrame put in
+    body = payload;
+    bodyLength = payloadLength;
+
+    if (packetHeader->codec == Edp_DmxData_Codec::codecSnappy) {
+        if (snappy::GetUncompressedLength((const char*)payload, payloadLength, &uncompressedLength) != true) {
+            LOG("snappy::GetUncompressedLength failed :(");
+            return false;
+        }
+
+        LOG("snappy::GetUncompressedLength: %d", uncompressedLength);
+
+        if (uncompressedLength > 512) {
+            return false;
+        }
+
+        if (snappy::RawUncompress((const char*)payload, payloadLength, (char*)scratch) != true) {
+            LOG("snappy::RawUncompress failed :(");
+            return false;
+        }
+        body = scratch;
+        bodyLength = uncompressedLength;
+    } else if (packetHeader->codec == Edp_DmxData_Codec::codecDmx) {
+        bodyLength = DmxCodec::decode(payload, payloadLength, scratch, 512);
+        if (!bodyLength) {
+            LOG("DmxCodec::decode failed :(");
+            return false;
+        }
+        body = scratch;
+    } else if (packetHeader->codec != Edp_DmxData_Codec::codecNone) {
+        return false;
+    }
+
+    // Put the body in place
+    if (packetHeader->ranges) {
+        uint16_t position = 0;
+        while (position + sizeof(struct Edp_DmxData_RangeHeader) <= bodyLength) {
+            struct Edp_DmxData_RangeHeader* rangeHeader = (struct Edp_DmxData_RangeHeader*)(body + position);
+            uint16_t start = rangeHeader->offset | (rangeHeader->offsetHigh << 8);
+            uint16_t length = rangeHeader->length + 1;
+            position += sizeof(struct Edp_DmxData_RangeHeader);
+
+            if ((start + length > 512) || (position + length > bodyLength)) {
+                return false;
+            }
+            memcpy(inData + start, body + position, length);
+            position += length;
+        }
+        if (position != bodyLength) {
+            return false;
+        }
+    } else if (packetHeader->sparse) {
+        uint16_t start = packetHeader->sparseOffset | (packetHeader->sparseOffsetHigh << 8);
+        if (start + bodyLength > 512) {
+            return false;
+        }
+        memcpy(inData + start, body, bodyLength);
+    } else {
+        // Sanity check: if full frame, body MUST be 512
+        if (bodyLength != 512) {
+            return false;
+        }
+        memcpy(inData, body, bodyLength);
+    }
+
+    if (command == Edp_Commands::DmxDataKeyframe) {
+        // Remember it, even if the universe is not patched (yet)
+        reference = findReference(packetHeader->universeId, true);
+        if (reference) {
+            memcpy(reference->data, inData, 512);
+            reference->keyframeId = referenceHeader->keyframeId;
+            reference->keyframeTime = time_us_32();
+            reference->valid = true;
+        }
+    } else if (command == Edp_Commands::DmxDataDelta) {
+        reference = findReference(packetHeader->universeId, false);
+        if (!reference || !reference->valid || (reference->keyframeId != referenceHeader->keyframeId)) {
+            // Missed the keyframe, wait for the next one
+            LOG("Delta for universe %u without keyframe %u", packetHeader->universeId, referenceHeader->keyframeId);
+            stats.framesNoReference++;
+            return false;
+        }
+        for (uint16_t i = 0; i < 512; i++) {
+            inData[i] ^= reference->data[i];
+        }
+    }
+
+    deliverFrame(packetHeader->universeId, inData, false);
+    return true;
+}
+
+bool Edp::deliverFrame(uint8_t universeId, uint8_t* data, bool allZero) {
+    if (this->frameHandler) {
+        this->frameHandler(this->frameHandlerContext, universeId, data);
+        return true;
+    }
+
+#ifndef EDP_HOST
+    Patching patching = findPatching(universeId);
+
+    LOG("Frame for universe %u. patching active: %u buffer: %u", universeId, patching.active, patching.dstInstance);
+
+    // If this universe is not patched, no need to do anything
+    if (!patching.active) {
+        return false;
+    }
+
+    if (allZero) {
+        // Easy: Just clear the DmxBuffer
+        dmxBuffer.zero(patching.dstInstance, this->bufferSource());
+    } else {
+        dmxBuffer.setBuffer(patching.dstInstance, data, 512, this->bufferSource());
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Keyframe of a universe, allocating one (replacing the oldest) if requested
+EdpReference* Edp::findReference(uint8_t universeId, bool allocate) {
+    EdpReference* oldest = nullptr;
+
+    for (uint8_t i = 0; i < numReferences; i++) {
+        if (references[i].valid && (references[i].universeId == universeId)) {
+            return &references[i];
+        }
+        if (!oldest ||
+            (oldest->valid && (!references[i].valid || ((int32_t)(references[i].keyframeTime - oldest->keyframeTime) < 0))))
+        {
+            oldest = &references[i];
+        }
+    }
+
+    if (!allocate || !oldest) {
+        return nullptr;
+    }
+
+    oldest->valid = false;
+    oldest->universeId = universeId;
+    oldest->keyframeId = 0;
+    oldest->keyframeSize = 0;
+    return oldest;
+}
+
+#ifndef EDP_HOST
+DmxBufferSource Edp::bufferSource() {
+    return (this->patchSource == PatchType::nrf24) ? DmxBufferSource::sourceEdpWireless : DmxBufferSource::sourceEdp;
+}
+
 // Find a patching patching from ETH -> buffer. All other patching destination
 // are NOT supported for now
 Patching Edp::findPatching(uint8_t universeId) {
@@ -321,3 +944,4 @@ Patching Edp::findPatching(uint8_t universeId) {
 
     return retPatch;
 }
+#endif // EDP_HOST
@@ -3,8 +3,15 @@
 
 #ifdef __cplusplus
 
+#ifdef EDP_HOST
+// Built into the host library (tools/libedp), which provides the few
+// platform bits used here
+#include "edp_host.h"
+#else
 #include "log.h"
 #include "boardconfig.h"
+#include "dmxbuffer.h"
+#endif
 
 #include "snappy.h"
 
@@ -13,25 +20,48 @@
 // Efficient Dmx Protocol Commands
 
 enum Edp_Commands : uint8_t {
-    Ping                      = 0x00, // Payload: Serial number of requester
-    Pong                      = 0x01, // Payload: Serial number of responder
+    Ping                      = 0x00, // Payload: Serial number of requester + anything up to EDP_PING_MAX_PAYLOAD
+    Pong                      = 0x01, // Payload: Serial number of responder (8 byte), followed by the Ping's payload
     DmxDataAllZero            = 0x10, // Followed by 1 byte (universeId), no chunk header, no packet header
     DmxData                   = 0x11, // One command for compressed and uncompressed data, sent in chunks
     DmxDataRequest            = 0x12, // Poll the content of a universe
+    DmxDataKeyframe           = 0x13, // Like DmxData, but the receiver keeps it as reference for deltas
+    DmxDataDelta              = 0x14, // Like DmxData, payload is XORed with the referenced keyframe
+    DmxDataParity             = 0x18, // 0x18 - 0x1b: FEC parity chunk, lowest 2 bit = number of parity chunks - 1
     DiscoveryRequest          = 0x20,
     DiscoveryRespone          = 0x21,
     DiscoveryMute             = 0x22,
     DiscoveryUnMuteAll        = 0x23,
+    RadioHop                  = 0x30, // Used by the nRF24 transport for channel hopping, not handled by EDP
+    RadioRate                 = 0x31, // Used by the nRF24 transport to announce a data rate change, not handled by EDP
+    RadioTelemetry            = 0x32, // Used by the nRF24 transport for receiver stats in ACK payloads, not handled by EDP
+    HidStatus                 = 0x40, // Used by the HID transport for flow control (Edp_HidStatus), not handled by EDP
 };
 
+// Sent by the device in IN reports whenever a frame was completed (or
+// dropped), at least every USB_EDP_STATUS_INTERVAL_US. The host knows how
+// many reports it sent, the difference to reportsReceived is what is still
+// in flight. Counters are the low 16 bits and wrap
+struct Edp_HidStatus {
+    uint16_t              reportsReceived;
+    uint16_t              framesComplete;
+    uint16_t              framesCrcError;
+    uint16_t              framesLost;      // Timed out or dropped during reassembly
+    uint8_t               lastUniverse;    // Of the last frame completed
+    uint8_t               lastSequence;
+    uint8_t               slotsInUse;      // Frames being reassembled
+    uint8_t               slots;
+} __attribute__((__packed__));
+
 // The smallest chunk size this is designed to work on is 32 bytes (RF24 max payload length)
 // However, we need to transfer at most 512 byte (One DMX frame). How many chunks do we need?
 // 1 byte COMMAND
-// 1 byte "DmxData" chunk header (= universe & chunk counter)
-//     = 30 byte DMX data per packet maximum
-//       512 byte + 4 byte DmxData packet header (crc + universe + full/sparse + sparseOffset)
-//       = 516 Byte DmxData Playload
-//     516/30 = 18 packets MAX (= 540 byte)  => 5 bit required for the chunk counter => 32 possible values
+// 2 byte "DmxData" chunk header (= universe, sequence & chunk counter)
+//     = 29 byte DMX data per packet maximum
+//       512 byte + 5 byte DmxData packet header (crc + universe + full/sparse + sparseOffset + codec)
+//       + 1 byte reference header (keyframe id, only for keyframes and deltas)
+//       = 518 Byte DmxData Playload
+//     518/29 = 18 packets MAX (= 522 byte)  => 5 bit required for the chunk counter => 32 possible values
 // => since we could now count 31 chunks, we could also use even smaller chunk sizes (~18 byte)
 
 // Special values for the chunk counter
@@ -40,31 +70,147 @@ enum Edp_DmxData_ChunkCounter : uint8_t {
     FirstPacket               = 0
 };
 
-// Should occupy one byte
+// Should occupy two bytes
+// Every chunk carries the universe and a per-universe frame sequence, so the
+// receiver can reassemble chunks of several universes that arrive interleaved
+// or out of order. All chunks but the last one are of the same (maximum) size,
+// so the position of a chunk's data in the packet follows from its counter
 struct Edp_DmxData_ChunkHeader {
-    uint8_t                   RESERVED0    : 2; // Reserved for future use ;)
+    uint8_t                   sequence     : 2; // Frame counter per universe, tells two frames apart
     Edp_DmxData_ChunkCounter  chunkCounter : 5;
     bool                      lastChunk    : 1; // 0 = first or middle chunk, 1 = last chunk
+    uint8_t                   universeId   : 6; // Same as in the packet header
+    uint8_t                   parityIndex  : 2; // DmxDataParity only: Which of the parity chunks this is
 };
 
-// 4 byte
+// Forward error correction (optional, for transports without retransmits):
+// After the data chunks of a packet, the sender adds up to
+// EDP_FEC_MAX_PARITY parity chunks. Parity chunk p is the XOR of all data
+// chunks n with n % (number of parity chunks) == p, so the receiver can
+// rebuild one lost chunk per parity chunk, as long as the lost chunks are
+// spread over the groups (chunks are lost in bursts less often than not).
+// The chunk counter of a parity chunk is the counter of the last data chunk.
+// The packet is padded (see the packet header) so all data chunks are full
+#define EDP_FEC_MAX_PARITY         4
+#define EDP_FEC_MAX_STRIDE        32  // Largest chunk payload FEC is done for, the padding needs to fit 5 bit
+
+// How the payload is encoded
+enum Edp_DmxData_Codec : uint8_t {
+    codecNone                 = 0, // Raw channel values
+    codecSnappy               = 1,
+    codecDmx                  = 2, // See dmxcodec.h
+};
+
+// 5 byte
 struct Edp_DmxData_PacketHeader {
     uint16_t              crc;
-    uint8_t               compressed   : 1; // 0 = raw, 1 = compressed
-    uint8_t               sparse      : 1; // 0 = full frame, 1 = sparse
+    uint8_t               sparseOffsetHigh : 1; // Bit 8 of sparseOffset
+    uint8_t               sparse       : 1; // 0 = full frame, 1 = sparse
     uint8_t               universeId   : 6; // Universe Id (64 possibilities)
-    uint8_t               sparseOffset;    // If sparse: Position the frame starts at
+    uint8_t               sparseOffset;    // If sparse: Position the frame starts at (bits 0-7)
+    Edp_DmxData_Codec     codec        : 2;
+    uint8_t               ranges       : 1; // 1 = (decoded) payload is a list of ranges, see below
+    uint8_t               padding      : 5; // FEC only: Number of zeros appended to the packet, not covered by the CRC
+} __attribute__((__packed__));
+
+// If "ranges" is set, the decoded payload is a sequence of ranges, each
+// starting with this header followed by the channel values
+// Channels not in any range are zero
+struct Edp_DmxData_RangeHeader {
+    uint8_t               offset;          // Bits 0-7 of the first channel
+    uint8_t               offsetHigh   : 1; // Bit 8 of the first channel
+    uint8_t               length       : 7; // Number of channels - 1
+};
+
+#define EDP_MAX_PACKET           (512 + 6)  // Largest DmxData packet, including the packet and reference header
+#define EDP_MAX_PADDED_PACKET    (EDP_MAX_PACKET + EDP_FEC_MAX_STRIDE - 1)
+#define EDP_REASSEMBLY_TIMEOUT_US  100000  // Partial frames older than this are evicted
+
+// One frame of one universe being reassembled from its chunks
+struct EdpReassemblySlot {
+    bool                  inUse;
+    uint8_t               universeId;
+    uint8_t               sequence;
+    uint8_t               command;         // DmxData, DmxDataKeyframe or DmxDataDelta. 0 until a data chunk is there
+    uint8_t               lastChunk;       // Counter of the last chunk, 0xff as long as it's missing
+    uint32_t              receivedChunks;  // Bit n set = chunk n is there
+    uint16_t              length;          // Packet length, known once the last chunk is there
+    uint16_t              crc;             // Running CRC over data[sizeof(packet header) .. crcLength)
+    uint16_t              crcLength;       // Chunks coming in in order are checksummed while being copied
+    uint32_t              started;         // time_us_32() when the first chunk (in any order) came in
+    uint8_t               parityChunks;    // Number of parity chunks the sender adds, 0 = no FEC (yet)
+    uint8_t               receivedParity;  // Bit p set = parity chunk p is there
+    uint8_t               parity[EDP_FEC_MAX_PARITY][EDP_FEC_MAX_STRIDE];
+    uint8_t               data[EDP_MAX_PADDED_PACKET];
+};
+
+struct EdpStats {
+    uint32_t framesComplete;   // Reassembled and CRC okay
+    uint32_t framesCrcError;
+    uint32_t framesTimedOut;   // Partial frames evicted because chunks were missing for too long
+    uint32_t framesDropped;    // Partial frames evicted by a newer frame or lack of slots
+    uint32_t chunksDuplicate;
+    uint32_t chunksStale;      // Chunks of a frame that was already superseded
+    uint32_t chunksInvalid;    // Wrong size or position
+    uint32_t framesNoReference; // Deltas for a keyframe that wasn't received
+    uint32_t chunksRecovered;  // Lost chunks rebuilt from parity chunks
+    uint32_t snappyTried;      // Frames snappy was run on
+    uint32_t snappyUsed;       // ... and was the smallest
+    uint64_t reassemblyUsSum;  // First chunk in until the frame was complete, summed over framesComplete
+    uint32_t reassemblyUsMax;
+    uint8_t lastUniverse;      // Of the last frame completed
+    uint8_t lastSequence;
+};
+
+// 1 byte, follows the packet header of DmxDataKeyframe and DmxDataDelta
+// Counted up with every keyframe of a universe, a delta names the keyframe
+// it has to be applied to
+struct Edp_DmxData_ReferenceHeader {
+    uint8_t               keyframeId;
+};
+
+#define EDP_KEYFRAME_INTERVAL_US  1000000  // Send a keyframe at least this often, so receivers can join and recover
+
+// Last keyframe of one universe
+struct EdpReference {
+    bool                  valid;
+    uint8_t               universeId;
+    uint8_t               keyframeId;
+    uint16_t              keyframeSize;    // Sender only: Payload length of the keyframe, deltas need to be smaller
+    uint32_t              keyframeTime;    // time_us_32() of the keyframe
+    uint8_t               data[512];
 };
 
+#define EDP_PING_MAX_PAYLOAD       32
+
+// Called with every frame (512 channels) received. Without a handler, the
+// firmware writes the frame to the DmxBuffer the universe is patched to
+typedef void (*EdpFrameHandler)(void* context, uint8_t universeId, uint8_t* data);
+
 class Edp {
   public:
-    void init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource);
+    // slots/numSlots are only needed by instances receiving DmxData
+    void init(uint8_t* inData, uint8_t* outData, uint16_t maxSendChunkSize, PatchType patchSource, EdpReassemblySlot* slots = nullptr, uint8_t numSlots = 0);
+    void initDelta(EdpReference* references, uint8_t numReferences);
+
+    // Add parityChunks (0 = off, max EDP_FEC_MAX_PARITY) parity chunks to
+    // every DmxData packet sent. Only possible for chunks up to EDP_FEC_MAX_STRIDE
+    bool setFec(uint8_t parityChunks);
+    void setCompression(bool enabled); // snappy, the cheap codecs are always tried
 
     // TODO: Chunk generation with buffer, universe id and max chunk size given
     bool prepareDmxData(uint8_t universeId, uint16_t inDataSize, uint16_t* thisChunkSize, bool* callAgain);
 
     bool processIncomingChunk(uint16_t chunkSize);
 
+    void setFrameHandler(EdpFrameHandler handler, void* context);
+
+    // Size of the response (Pong) processIncomingChunk left in outData to
+    // be sent back to the requester. 0 if there is none. Clears it
+    uint16_t takeResponse();
+
+    struct EdpStats stats;
+
   private:
     bool initOkay;
     PatchType patchSource;
@@ -74,8 +220,41 @@ class Edp {
 
     size_t prepareDmxData_sizeOfDataToBeSent;  // Packetheader + payload length
     uint16_t prepareDmxData_chunkOffset;
+    uint8_t prepareDmxData_parityChunks;       // Parity chunks of the current packet
+    uint8_t prepareDmxData_nextParity;         // Parity chunk to be sent next, after all data chunks
+    uint8_t prepareDmxData_lastDataChunk;
+    uint8_t fecParityChunks;
+    bool compression;
+    uint8_t fecParity[EDP_FEC_MAX_PARITY][EDP_FEC_MAX_STRIDE];
+    uint8_t rxCompleted[64];  // Per universe: 0x80 | sequence of the last frame finished, late chunks of it are ignored
+    uint8_t txSequence[64];
+    uint8_t scratch[512]; // Ranges to be encoded or decoded payload
+    uint16_t responseSize;
+
+    EdpFrameHandler frameHandler;
+    void* frameHandlerContext;
+
+    EdpReassemblySlot* slots;
+    uint8_t numSlots;
+
+    EdpReference* references;
+    uint8_t numReferences;
 
+    EdpReassemblySlot* findReassemblySlot(uint8_t universeId, uint8_t sequence);
+    void evictReassemblySlot(uint8_t universeId);
+    bool completeReassembly(EdpReassemblySlot* slot);
+    void recoverChunks(EdpReassemblySlot* slot, uint32_t missingChunks);
+    bool processDmxDataPacket(uint8_t command, uint8_t* packet, uint16_t packetLength, uint16_t crc);
+    bool deliverFrame(uint8_t universeId, uint8_t* data, bool allZero);
+
+    uint16_t encodeFrame(uint8_t* frame, struct Edp_DmxData_PacketHeader* packetHeader, uint8_t* destination);
+    uint16_t encodeRanges(uint8_t* frame, uint8_t* destination, uint16_t destinationSize);
+    EdpReference* findReference(uint8_t universeId, bool allocate);
+
+#ifndef EDP_HOST
     Patching findPatching(uint8_t universeId);
+    DmxBufferSource bufferSource();
+#endif
 };
 
 #endif // __cplusplus
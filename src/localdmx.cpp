@@ -1,5 +1,6 @@
 #include "log.h"
 #include "localdmx.h"
+#include "boardconfig.h"
 
 #include <string.h>
 
@@ -7,15 +8,20 @@
 #include <hardware/dma.h>       // To control the data transfer from mem to pio
 #include <hardware/gpio.h>      // To "manually" control the trigger pin
 #include <hardware/irq.h>       // To control the data transfer from mem to pio
+#include <pico/time.h>          // Timestamps and idle alarm of the output scheduler
 
 #include "tx16.pio.h"           // Header file for the PIO program
 
 extern LocalDmx localDmx;
+extern BoardConfig boardConfig;
 
 extern critical_section_t bufferLock;
 
 uint8_t LocalDmx::buffer[LOCALDMX_COUNT][512];
-uint16_t LocalDmx::wavetable[WAVETABLE_LENGTH];  // 16 universes (data type) with 5648 bit each
+uint16_t LocalDmx::wavetable[WAVETABLE_LENGTH];  // 16 universes (data type) with up to 6400 bit each
+
+// tx16 runs at 250kbit/s, so the timing resolution is 4µs
+#define US_TO_BITS(us) (((us) + 3) / 4)
 
 // So, we have 7 state machines for "local output"
 // - WS2812 LEDs (besides) the status LEDs work but won't be supported for now.
@@ -47,7 +53,8 @@ uint16_t LocalDmx::wavetable[WAVETABLE_LENGTH];  // 16 universes (data type) wit
 // will halt, and raise an interrupt flag. The processor will enter the
 // interrupt handler in response to this, where it will:
 // - Toggle GP28 LOW
-// - Zero the complete wave table
+// - Size the packet according to the ports' timing profiles
+// - Zero that part of the wave table
 // - Prepare the next DMX packet to be sent in the wavetable
 // - Sets GP28 HIGH (so we can trigger a scope on it)
 // - Restart the DMA channel
@@ -65,6 +72,11 @@ void LocalDmx::init() {
     gpio_put(PIN_TRIGGER, 0);
 #endif // PIN_TRIGGER
 
+    memset(this->highestUsed, 0x00, sizeof(this->highestUsed));
+    memset(this->layout, 0x00, sizeof(this->layout));
+    this->changedMask = 0xffff;
+    this->encodedMask = 0;
+
     // Set up a PIO state machine to serialise our bits at 250000 bit/s
     uint offset = pio_add_program(pio0, &tx16_program);
     float div = (float)clock_get_hz(clk_sys) / 250000;
@@ -83,8 +95,8 @@ void LocalDmx::init() {
         &c,
         &pio0_hw->txf[0], // Write address (only need to set this once)
         NULL,             // Don't provide a read address yet
-        WAVETABLE_LENGTH/2, // Write one complete DMX packet, then halt and interrupt
-                          // It's WAVETABLE_LENGTH/2 since we transfer 32 bit per transfer
+        0,                // The length depends on the port's timing profiles and is set
+                          // by the handler before each packet
         false             // Don't start yet
     );
 
@@ -109,15 +121,51 @@ bool LocalDmx::setPort(uint8_t portId, uint8_t* source, uint16_t sourceLength) {
     // TODO: Don't change the buffer while the conversion to the wavetable is running
 
     uint16_t length = MIN(sourceLength, 512);
+    bool changed;
 
     critical_section_enter_blocking(&bufferLock);
-    memset(this->buffer[portId], 0x00, 512);
-    memcpy(this->buffer[portId], source, length);
+    changed = memcmp(this->buffer[portId], source, length);
+    for (uint16_t chan = length; !changed && (chan < 512); chan++) {
+        changed = this->buffer[portId][chan];
+    }
+    if (changed) {
+        // The output scheduler only re-encodes ports that have changed
+        memset(this->buffer[portId], 0x00, 512);
+        memcpy(this->buffer[portId], source, length);
+        this->changedMask |= (1 << portId);
+    }
     critical_section_exit(&bufferLock);
 
     return true;
 }
 
+uint16_t LocalDmx::activeSlots(uint8_t portId) {
+    PortTiming* timing = &boardConfig.activeConfig->portTiming[portId];
+    uint16_t slots = timing->slots;
+
+    if (timing->slotMode == PortTimingSlots::slotsHighestNonZero) {
+        for (uint16_t chan = 512; chan > this->highestUsed[portId]; chan--) {
+            if (this->buffer[portId][chan - 1]) {
+                this->highestUsed[portId] = chan;
+                break;
+            }
+        }
+        slots += this->highestUsed[portId];
+    }
+
+    return MAX(MIN(slots, 512), 1);
+}
+
+void LocalDmx::resetHighestUsed(uint8_t portId) {
+    if (portId >= LOCALDMX_COUNT) {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
+    this->highestUsed[portId] = 0;
+    critical_section_exit(&bufferLock);
+}
+
 // Appends one bit to the wavetable for port "port" at the position
 // bitoffset. The offset will be increased by 1!
 void LocalDmx::wavetable_write_bit(int port, uint16_t* bitoffset, uint8_t value) {
@@ -154,56 +202,168 @@ void dma_handler_0_0_c() {
     localDmx.dma_handler_0_0();
 }
 
-// One transfer has finished, prepare the next DMX packet and restart the
-// DMA transfer
+// Nothing was due when the last packet finished. Check again
+static int64_t localdmx_idle_alarm_callback(alarm_id_t id, void *user_data) {
+    localDmx.dma_handler_0_0();
+    return 0;
+}
+
+// Ports that need to be part of the next packet according to their output mode
+uint16_t LocalDmx::portsDue(uint32_t now) {
+    uint16_t due = 0;
+
+    for (uint8_t universe = 0; universe < 16; universe++) {
+        PortTiming* timing = &boardConfig.activeConfig->portTiming[universe];
+        bool intervalOver = ((now - this->lastSent[universe]) >= ((uint32_t)timing->intervalMs * 1000));
+
+        switch (timing->outputMode) {
+            case PortOutputMode::outputOnChange:
+                if ((this->changedMask & (1 << universe)) || intervalOver) {
+                    due |= (1 << universe);
+                }
+                break;
+            case PortOutputMode::outputCadence:
+                if (intervalOver) {
+                    due |= (1 << universe);
+                }
+                break;
+            default:
+                due |= (1 << universe);
+                break;
+        }
+    }
+
+    return due;
+}
+
+// One transfer has finished (or the idle alarm fired), prepare the next DMX
+// packet and restart the DMA transfer. Ports that are not due according to
+// their output mode stay at MARK. If neither the set of ports nor their data
+// or layout changed, the previous wavetable is sent again as it is
 void LocalDmx::dma_handler_0_0() {
     uint8_t universe;   // Loop over the 16 universes
     uint16_t bitoffset; // Current bit offset inside current universe
     uint16_t chan;      // Current channel in universe
+    uint8_t bit;
+
+    uint32_t now = time_us_32();
+    uint16_t due;
+    uint16_t laneBits;
+    uint16_t idleMask;
+    struct LaneLayout newLayout[LOCALDMX_COUNT];
 
 #ifdef PIN_TRIGGER
     // Drive the TRIGGER GPIO to LOW
     gpio_put(PIN_TRIGGER, 0);
 #endif // PIN_TRIGGER
 
+    // Clear the interrupt request.
+    dma_hw->ints0 = 1u << dma_chan_0_0;
+
     critical_section_enter_blocking(&bufferLock);
 
-    // Zero the wavetable. *2 because of the data type: uint16_t = 2 byte per element
-    memset(wavetable, 0x00, WAVETABLE_LENGTH * sizeof(uint16_t));
+    due = this->portsDue(now);
+    if (!due) {
+        // Line stays at MARK. Look again in a bit, data might change
+        critical_section_exit(&bufferLock);
+        if (add_alarm_in_us(LOCALDMX_IDLE_POLL_US, localdmx_idle_alarm_callback, nullptr, true) >= 0) {
+            return;
+        }
+        // No alarm left: Without a transfer nothing would ever call us
+        // again, so refresh all ports instead of waiting
+        critical_section_enter_blocking(&bufferLock);
+        due = 0xffff;
+    }
 
-    // Loop through all 16 universes
+    // All universes share one wavetable, so the longest one sizes the packet.
+    // Shorter ones just stay at MARK until the packet is over
+    memset(newLayout, 0x00, sizeof(newLayout));
+    uint16_t newFrameBits = US_TO_BITS(DMX_MIN_PACKET_US);
     for (universe = 0; universe < 16; universe++) {
-        // Usually, DMX needs a BREAK (LOW level) of at least 96µs before
-        // MARK-AFTER-BREAK (MAB, HIGH LEVEL)
-        // However, since the line is already at a defined LOW level
-        // and we need CPU time to prepare the wavetable (~3ms), we don't
-        // generate a BREAK. We start right away with the MAB
-        bitoffset = 0;
-
-        // Write 4 bit MARK-AFTER-BREAK (16µs)
-        wavetable_write_bit(universe, &bitoffset, 1);
-        wavetable_write_bit(universe, &bitoffset, 1);
-        wavetable_write_bit(universe, &bitoffset, 1);
-        wavetable_write_bit(universe, &bitoffset, 1);
-
-        // Write the startbyte
-        wavetable_write_byte(universe, &bitoffset, 0);
-
-        // Write the data (channel values) from the universe's buffer
-        for (chan = 0; chan < 512; chan++) {
-            wavetable_write_byte(universe, &bitoffset, this->buffer[universe][chan]);
+        if (!(due & (1 << universe))) {
+            continue;
+        }
+        PortTiming* timing = &boardConfig.activeConfig->portTiming[universe];
+
+        newLayout[universe].breakBits = MIN(US_TO_BITS(timing->breakUs), 255);
+        newLayout[universe].mabBits = US_TO_BITS(timing->mabUs);
+        newLayout[universe].interSlotBits = US_TO_BITS(timing->interSlotUs);
+
+        // Drop channels at the end if the profile doesn't fit the wavetable
+        newLayout[universe].slots = MIN(this->activeSlots(universe),
+            (WAVETABLE_LENGTH - newLayout[universe].breakBits - newLayout[universe].mabBits - 11) / (11 + newLayout[universe].interSlotBits));
+
+        laneBits = newLayout[universe].breakBits + newLayout[universe].mabBits + 11 + newLayout[universe].slots * (11 + newLayout[universe].interSlotBits);
+        newFrameBits = MAX(newFrameBits, laneBits);
+    }
+    // We transfer 32 bit (= 2 bit times) per DMA transfer
+    newFrameBits = (newFrameBits + 1) & ~1;
+
+    if ((due != this->encodedMask) || (due & this->changedMask) ||
+        (newFrameBits != this->frameBits) || memcmp(newLayout, this->layout, sizeof(newLayout)))
+    {
+        this->frameBits = newFrameBits;
+        memcpy(this->layout, newLayout, sizeof(newLayout));
+
+        // Ports not in this packet idle at MARK, the others start with
+        // BREAK. *2 because of the data type: uint16_t = 2 byte per element
+        idleMask = ~due;
+        if (idleMask) {
+            for (bitoffset = 0; bitoffset < this->frameBits; bitoffset++) {
+                wavetable[bitoffset] = idleMask;
+            }
+        } else {
+            memset(wavetable, 0x00, this->frameBits * sizeof(uint16_t));
+        }
+
+        // Loop through all 16 universes
+        for (universe = 0; universe < 16; universe++) {
+            if (!(due & (1 << universe))) {
+                continue;
+            }
+
+            // BREAK: The wavetable is already zeroed
+            bitoffset = this->layout[universe].breakBits;
+
+            // MARK-AFTER-BREAK
+            for (bit = 0; bit < this->layout[universe].mabBits; bit++) {
+                wavetable_write_bit(universe, &bitoffset, 1);
+            }
+
+            // Write the startbyte
+            wavetable_write_byte(universe, &bitoffset, 0);
+
+            // Write the data (channel values) from the universe's buffer
+            for (chan = 0; chan < this->layout[universe].slots; chan++) {
+                for (bit = 0; bit < this->layout[universe].interSlotBits; bit++) {
+                    wavetable_write_bit(universe, &bitoffset, 1);
+                }
+                wavetable_write_byte(universe, &bitoffset, this->buffer[universe][chan]);
+            }
+
+            // Leave the line at MARK until the packet is over. The state machine
+            // keeps the last bit on the pins while we prepare the next packet
+            while (bitoffset < this->frameBits) {
+                wavetable_write_bit(universe, &bitoffset, 1);
+            }
         }
 
-        // Leave the line at a defined LOW level (BREAK) until the next packet starts
-        wavetable_write_bit(universe, &bitoffset, 0);
+        this->encodedMask = due;
+        this->changedMask &= ~due;
+        this->packetsEncoded++;
     }
 
-    critical_section_exit(&bufferLock);
+    for (universe = 0; universe < 16; universe++) {
+        if (due & (1 << universe)) {
+            this->lastSent[universe] = now;
+        }
+    }
+    this->packetsSent++;
 
-    // Clear the interrupt request.
-    dma_hw->ints0 = 1u << dma_chan_0_0;
+    critical_section_exit(&bufferLock);
 
     // Give the channel a new wavetable-entry to read from, and re-trigger it
+    dma_channel_set_trans_count(dma_chan_0_0, this->frameBits / 2, false);
     dma_channel_set_read_addr(dma_chan_0_0, wavetable, true);
 
 #ifdef PIN_TRIGGER
@@ -9,7 +9,10 @@
 #define LOCALDMX_COUNT 16
 #endif // LOCALDMX_COUNT
 
-#define WAVETABLE_LENGTH 5648   // bits per DMX packet. Wavetable has 16*this bits in total
+#define WAVETABLE_LENGTH 6400   // Max bits per DMX packet. Wavetable has 16*this bits in total
+                                // Enough for 513 slots with 4µs inter-slot time
+#define DMX_MIN_PACKET_US 1204  // BREAK to BREAK according to E1.11
+#define LOCALDMX_IDLE_POLL_US 1000 // How often to check for changes when no port needs a packet
 
 #ifdef __cplusplus
 
@@ -20,6 +23,15 @@ class LocalDmx {
     bool setPort(uint8_t portId, uint8_t* source, uint16_t sourceLength); // alias "copyFrom"
     void init();
 
+    // Number of channels (without start code) the port's timing profile
+    // wants to send right now. Call with bufferLock held
+    uint16_t activeSlots(uint8_t portId);
+    void resetHighestUsed(uint8_t portId);
+
+    uint16_t frameBits;                // Length of the last DMX packet generated by tx16
+    uint32_t packetsSent;              // Packets sent by tx16
+    uint32_t packetsEncoded;           // Packets that needed a new wavetable
+
     // 7 DMA handlers, one for each state machine
     void dma_handler_0_0(); // The DMA handler to call if PIO 0, SM0 needs data
     void dma_handler_0_1(); // The DMA handler to call if PIO 0, SM1 needs data
@@ -43,8 +55,27 @@ class LocalDmx {
     int dma_chan_1_2;                  // The DMA channel for PIO 1, SM2
     // PIO 1, SM3 is used for the Status LEDs
 
+    // Highest non-zero channel (1-based) ever seen per port. Only grows
+    // so channels that went back to zero are still sent
+    uint16_t highestUsed[LOCALDMX_COUNT];
+
+    // Output scheduling, see PortOutputMode
+    uint16_t changedMask;              // Bit set = port's buffer changed since it was encoded
+    uint16_t encodedMask;              // Ports that are part of the current wavetable
+    uint32_t lastSent[LOCALDMX_COUNT]; // time_us_32() of the last packet that contained the port
+
+    // Layout of every universe's packet in the current wavetable, in bits
+    struct LaneLayout {
+        uint16_t slots;
+        uint8_t breakBits;
+        uint8_t mabBits;
+        uint8_t interSlotBits;
+    } layout[LOCALDMX_COUNT];
+
+    uint16_t portsDue(uint32_t now);
+
     // TODO: This assumes 16 OUTs
-    static uint16_t wavetable[WAVETABLE_LENGTH];  // 16 universes (data type) with 5648 bit each
+    static uint16_t wavetable[WAVETABLE_LENGTH];  // 16 universes (data type) with up to 6400 bit each
 
     // Helper functions for DMX output generation
     // TODO: Check if those work for RDM ports (or fewer universes than 16)
@@ -72,6 +72,8 @@
 #define LWIP_HTTPD_MAX_TAG_NAME_LEN     64
 #define LWIP_HTTPD_SSI_INCLUDE_TAG      0
 #define LWIP_HTTPD_MAX_TAG_INSERT_LEN   2048
+#define LWIP_HTTPD_FILE_STATE           1 // Per connection state for SSI tags (WebServerConnectionState) ...
+#define LWIP_HTTPD_CGI_SSI              1 // ... filled from the request's parameters in httpd_cgi_handler()
 
 #define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
 
@@ -20,6 +20,7 @@ extern "C" {
 #include "picotool_binary_information.h"
 
 #include "stdio_usb.h"
+#include "crc_dma.h"
 }
 
 #include "log.h"
@@ -29,6 +30,7 @@ extern "C" {
 #include "webserver.h"
 #include "wireless.h"
 #include "localdmx.h"
+#include "rdm.h"
 #include "eth_cyw43.h"
 #include "oled_u8g2.h"
 
@@ -36,6 +38,8 @@ extern "C" {
 
 #include "usb_EDP.h"
 #include "usb_NodleU1.h"
+#include "usb_Bulk.h"
+#include "usb_JaRule.h"
 
 #include "udp_artnet.h"
 #include "udp_e1_31.h"
@@ -71,6 +75,7 @@ enum {
 Log logger;
 DmxBuffer dmxBuffer;
 LocalDmx localDmx;
+Rdm rdm;
 StatusLeds statusLeds;
 Oled_u8g2 oled_u8g2;
 BoardConfig boardConfig;
@@ -146,6 +151,9 @@ int main() {
     critical_section_init(&bufferLock);
     dmxBuffer.init();
 
+    // EDP checksums through the DMA sniffer
+    crc_dma_init();
+
     // Phase 3: Make sure we have some configuration ready (includes Phase 3b)
     boardConfig.prepareConfig();
 
@@ -153,6 +161,7 @@ int main() {
     //          However, we would need to instantiate the relevant class here
     Usb_EDP::init();
     Usb_NodleU1::init();
+    Usb_Bulk::init();
 
     // Phase 5: Enable the USB interface, the debugging console, ...
     tusb_init();
@@ -184,6 +193,10 @@ int main() {
     // Phase 8: Set up PIOs and GPIOs according to the IO boards
     localDmx.init();
 
+    // Switchable ports on RDM boards are taken over by the RDM controller.
+    // Needs to run after localDmx.init() since it re-assigns their GPIOs
+    rdm.init();
+
     // Re-init the PICO-LED to a normal LED
     gpio_init(PIN_LED_PICO);
     gpio_set_dir(PIN_LED_PICO, GPIO_OUT);
@@ -224,6 +237,9 @@ int main() {
     // Wireless is on core1 so waiting for ACKs won't slow down everything else
     while (true) {
         tud_task();
+        Usb_EDP::cyclicTask();
+        Usb_Bulk::cyclicTask();
+        Usb_JaRule::cyclicTask();
 
         if (tud_mounted()) {
             statusLeds.setStaticOn(5, 0, 1, 0);
@@ -237,6 +253,8 @@ int main() {
         if (BoardConfig::boardIsPicoW) {
             eth_cyw43.cyclicTask();
         }
+
+        rdm.cyclicTask();
 //        wireless.cyclicTask();
 //        statusLeds.cyclicTask();
 //        led_blinking_task();
@@ -246,11 +264,16 @@ int main() {
 
 // Core1 handles wireless (which can delay quite a bit) + status LEDs
 void core1_tasks() {
+    // The radio's IRQ is handled on this core, next to everything else using it
+    wireless.initIrq();
+
     while (true) {
 //        tud_task();
 //        webServer.cyclicTask();
         wireless.cyclicTask();
         statusLeds.cyclicTask();
+        dmxBuffer.interpolationTask();
+        dmxBuffer.lossTask();
         led_blinking_task();
 //        sleep_us(10);
     }
@@ -270,24 +293,11 @@ bool led_toggle_timer_callback(repeating_timer_t *rt) {
 // BLINKING TASK
 //--------------------------------------------------------------------+
 void led_blinking_task(void) {
-    // The following calculations take lots of time. However, this doesn't
-    // matter since the DMX updating is done via IRQ handler
-
-    // TODO: This iteration through all universes takes quite much time.
-    //       Make the DmxBuffer remember for each universe if it's all 0s
-    //       and read that property here
-
     uint universes_none_zero = 0;
-    // Check the universes for non-zero channels
+    // Count the universes with non-zero channels. DmxBuffer keeps track of them
     for (uint16_t j = 0; j < 16; j++) {
-        for (uint16_t i = 0; i < 512; i++) {
-            if (dmxBuffer.buffer[j][i]) {
-                universes_none_zero++;
-                break;
-            }
-        }
-        if (universes_none_zero > 4) {
-            break;
+        if (!dmxBuffer.isAllZero(j)) {
+            universes_none_zero++;
         }
     }
 
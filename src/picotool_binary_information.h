@@ -18,6 +18,9 @@ bi_decl(bi_2pins_with_func(PIN_I2C_SCL, PIN_I2C_SDA, GPIO_FUNC_I2C));
 
 bi_decl(bi_4pins_with_func(PIN_SPI_CLK, PIN_SPI_MOSI, PIN_SPI_MISO, PIN_SPI_CS0, GPIO_FUNC_SPI));
 bi_decl(bi_1pin_with_name(PIN_RF24_CE, "RF24 CE"));
+#ifdef WIRELESS_DUAL_RADIO
+bi_decl(bi_2pins_with_names(PIN_SPI_CS1, "RF24 (second module) CSN", PIN_RF24_CE1, "RF24 (second module) CE"));
+#endif
 
 bi_decl(bi_4pins_with_names(PIN_IO00_0, "IO board 00, pin 0", PIN_IO00_1, "IO board 00, pin 1", PIN_IO00_2, "IO board 00, pin 2", PIN_IO00_3, "IO board 00, pin 3"));
 bi_decl(bi_4pins_with_names(PIN_IO01_0, "IO board 01, pin 0", PIN_IO01_1, "IO board 01, pin 1", PIN_IO01_2, "IO board 01, pin 2", PIN_IO01_3, "IO board 01, pin 3"));
@@ -28,6 +31,8 @@ bi_decl(bi_1pin_with_name(PIN_LED_PICO, "On-board status LED (Pico only)"));
 
 bi_decl(bi_1pin_with_name(PIN_LEDS, "Off-board status LEDs (WS2812-based)"));
 
+#ifdef PIN_TRIGGER
 bi_decl(bi_1pin_with_name(PIN_TRIGGER, "Optional helper pin for DMX driver-enable to trigger oscilloscope"));
+#endif
 
 #endif // PICOTOOL_BINARY_INFORMATION_H
\ No newline at end of file
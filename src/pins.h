@@ -16,6 +16,15 @@
 #define PIN_SPI_MISO    4
 #define PIN_SPI_CS0     5
 #define PIN_RF24_CE    28
+#ifndef WIRELESS_DUAL_RADIO
+#define PIN_RF24_IRQ   27  // Only if solder jumper JP1 on the baseboard is set to IRQ_NRF
+#else
+// Optional second nRF24L01+ module on the same SPI bus. All other pins are
+// taken, so it uses the ones of the IRQ line and the trigger output, which
+// are not available then
+#define PIN_SPI_CS1    26
+#define PIN_RF24_CE1   27
+#endif
 
 // IO board 00
 #define PIN_IO00_0      6
@@ -53,4 +62,6 @@
 // Helper pin for DMX TX (DriverEnable output)
 // this is mainly useful to trigger an oscilloscope to check the
 // generated DMX frames
+#ifndef WIRELESS_DUAL_RADIO
 #define PIN_TRIGGER    26
+#endif
@@ -0,0 +1,812 @@
+#include "rdm.h"
+
+#include <string.h>
+
+#include <hardware/dma.h>       // To feed the PIO from / drain it to memory
+#include <hardware/timer.h>     // time_us_32() for all the protocol timings
+#include <pico/unique_id.h>     // To generate our own UID
+
+#include "json/json.h"
+
+#include "log.h"
+#include "boardconfig.h"
+#include "localdmx.h"
+
+#include "rdm.pio.h"            // Header file for the PIO program
+
+extern BoardConfig boardConfig;
+extern LocalDmx localDmx;
+
+extern critical_section_t bufferLock;
+
+// Timings (all in µs). See E1.20, tables 3-1 to 3-3
+#define RDM_BREAK_US          176   // Controllers need to send at least 176µs
+#define RDM_MAB_US             16
+#define RDM_SLOT_US            46   // One slot as generated by rdm.pio (11.5 bit times)
+#define RDM_RESPONSE_US      2800   // Max time until a responder starts its response
+#define RDM_INTERSLOT_US     2100   // Max time between two slots of a response
+#define RDM_BRANCH_WINDOW_US 5800   // Time to listen for DISC_UNIQUE_BRANCH responses
+
+// After how many DMX frames an RDM transaction may be squeezed in
+#define RDM_DMX_FRAMES_BETWEEN  1
+
+// E1.20 parameter IDs used by discovery
+#define RDM_PID_DISC_UNIQUE_BRANCH 0x0001
+#define RDM_PID_DISC_MUTE          0x0002
+#define RDM_PID_DISC_UN_MUTE       0x0003
+
+// Manufacturer ID 0x7ff0 is in the range reserved for prototypes
+#define RDM_MANUFACTURER_ID   0x7ff0
+
+uint64_t Rdm::ownUid;
+
+void Rdm::init() {
+    pico_unique_board_id_t id;
+
+    memset(this->ports, 0x00, sizeof(this->ports));
+    this->numPorts = 0;
+
+    pico_get_unique_board_id(&id);
+    ownUid = ((uint64_t)RDM_MANUFACTURER_ID << 32) |
+        ((uint32_t)id.id[4] << 24) | ((uint32_t)id.id[5] << 16) | ((uint32_t)id.id[6] << 8) | id.id[7];
+
+    // Every switchable port on an RDM IO board becomes an RDM controller port
+    for (uint8_t slot = 0; slot < 4; slot++) {
+        if (!boardConfig.responding[slot]) {
+            continue;
+        }
+
+        BoardType type = boardConfig.configData[slot]->boardType;
+        if ((type != BoardType::dmx_2ports_rdm_unisolated) &&
+            (type != BoardType::dmx_2ports_rdm_isolated))
+        {
+            continue;
+        }
+
+        for (uint8_t portOnBoard = 0; portOnBoard < 2; portOnBoard++) {
+            if (boardConfig.configData[slot]->portParams[portOnBoard].direction == PortParamsDirection::switchable) {
+                this->addPort(slot, portOnBoard);
+            }
+        }
+    }
+
+    LOG("RDM: %u ports, own UID %04x:%08x", this->numPorts, (uint16_t)(ownUid >> 32), (uint32_t)ownUid);
+
+    // Find out what's connected
+    for (uint8_t i = 0; i < this->numPorts; i++) {
+        this->startDiscovery(i);
+    }
+}
+
+// A 2-port RDM board uses two GPIOs per port:
+// First one is the data line, second one is the driver enable
+void Rdm::addPort(uint8_t slot, uint8_t portOnBoard) {
+    if (this->numPorts >= RDM_MAX_PORTS) {
+        LOG("RDM: No state machine left for port %u on board %u", portOnBoard, slot);
+        return;
+    }
+
+    if (this->numPorts == 0) {
+        this->pioOffset = pio_add_program(pio1, &rdm_program);
+    }
+
+    RdmPort* port = &this->ports[this->numPorts];
+
+    port->sm = this->numPorts;
+    port->dataPin = PIN_IO00_0 + slot * 4 + portOnBoard * 2;
+    port->dePin = port->dataPin + 1;
+    port->localPort = port->dataPin - PIN_IO00_0;
+    port->state = RdmPortState::portIdle;
+    port->transaction = RdmTransaction::transactionNone;
+
+    pio_sm_claim(pio1, port->sm);
+    rdm_program_init(pio1, port->sm, this->pioOffset, port->dataPin, port->dePin);
+
+    // TX: Memory to the state machine, one slot per FIFO word
+    port->dmaTx = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(port->dmaTx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(pio1, port->sm, true));
+    dma_channel_configure(port->dmaTx, &c, &pio1->txf[port->sm], NULL, 0, false);
+
+    // RX: The received byte sits in the upper 8 bits of the FIFO word
+    port->dmaRx = dma_claim_unused_channel(true);
+    c = dma_channel_get_default_config(port->dmaRx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(pio1, port->sm, false));
+    dma_channel_configure(port->dmaRx, &c, port->rxBuf, (io_rw_8*)&pio1->rxf[port->sm] + 3, 0, false);
+
+    port->active = true;
+    this->numPorts++;
+
+    LOG("RDM: Port %u on board %u is RDM port %u (GPIO %u/%u)", portOnBoard, slot, port->sm, port->dataPin, port->dePin);
+}
+
+uint8_t Rdm::portCount() {
+    return this->numPorts;
+}
+
+void Rdm::cyclicTask() {
+    for (uint8_t i = 0; i < this->numPorts; i++) {
+        this->portTask(&this->ports[i]);
+    }
+}
+
+// Advances the state machine of one port. Only ever looks at the clock and
+// the DMA counters, so it returns immediately in every state
+void Rdm::portTask(RdmPort* port) {
+    uint32_t now = time_us_32();
+    uint32_t elapsed = now - port->stateStart;
+    uint32_t rxCount;
+    bool complete = false;
+    bool timedOut = false;
+
+    switch (port->state) {
+        case RdmPortState::portIdle:
+            if ((port->framesSinceRdm >= RDM_DMX_FRAMES_BETWEEN) && this->startRdmTransaction(port)) {
+                return;
+            }
+            this->startDmxFrame(port);
+            break;
+
+        case RdmPortState::portDmxTx:
+            if (elapsed >= port->stateLength) {
+                port->state = RdmPortState::portIdle;
+            }
+            break;
+
+        case RdmPortState::portRdmTx:
+            if (elapsed < port->stateLength) {
+                break;
+            }
+            if ((port->transaction == RdmTransaction::transactionUnMute) ||
+                ((port->transaction == RdmTransaction::transactionRequest) && (port->current->status == RdmRequestStatus::requestBroadcast)) ||
+                ((port->transaction == RdmTransaction::transactionRaw) && (port->rawType == RdmRawType::rawBroadcast)))
+            {
+                // Broadcasts are never answered
+                this->finishTransaction(port);
+                break;
+            }
+            port->state = RdmPortState::portRdmWait;
+            port->stateStart = now;
+            port->lastRxCount = 0;
+            port->lastRxTime = now;
+            break;
+
+        case RdmPortState::portRdmWait:
+            rxCount = RDM_MAX_PACKET - dma_channel_hw_addr(port->dmaRx)->transfer_count;
+            if (rxCount != port->lastRxCount) {
+                port->lastRxCount = rxCount;
+                port->lastRxTime = now;
+            }
+
+            if ((port->transaction == RdmTransaction::transactionBranch) ||
+                ((port->transaction == RdmTransaction::transactionRaw) && (port->rawType == RdmRawType::rawDiscovery)))
+            {
+                // Non-framed response: 0-7 preamble bytes, delimiter, 16 byte encoded UID + checksum
+                complete = (rxCount >= 24);
+                timedOut = (elapsed >= RDM_BRANCH_WINDOW_US);
+            } else {
+                // Framed response: Message length is in the third slot, checksum follows
+                complete = (rxCount >= 3) && (rxCount >= (uint32_t)port->rxBuf[2] + 2);
+                timedOut = (rxCount == 0) ? (elapsed >= RDM_RESPONSE_US) : ((now - port->lastRxTime) >= RDM_INTERSLOT_US);
+            }
+
+            if (complete || timedOut) {
+                this->finishTransaction(port);
+            }
+            break;
+    }
+}
+
+// Uses the port's timing profile. The inter-slot time is fixed by rdm.pio
+void Rdm::startDmxFrame(RdmPort* port) {
+    PortTiming* timing = &boardConfig.activeConfig->portTiming[port->localPort];
+    uint16_t slots;
+
+    port->txBuf[0] = 0x00; // NULL start code
+
+    critical_section_enter_blocking(&bufferLock);
+    slots = localDmx.activeSlots(port->localPort);
+    memcpy(port->txBuf + 1, LocalDmx::buffer[port->localPort], slots);
+    critical_section_exit(&bufferLock);
+
+    this->startTx(port, slots + 1, RdmPortState::portDmxTx, MAX(timing->breakUs, 1), MAX(timing->mabUs, 1));
+
+    port->stats.dmxFrames++;
+    if (port->framesSinceRdm < 255) {
+        port->framesSinceRdm++;
+    }
+}
+
+// Picks the next RDM transaction for this port, if any. Queued requests
+// and discovery steps take turns so neither can starve the other
+bool Rdm::startRdmTransaction(RdmPort* port) {
+    RdmRequest* request = this->nextQueued(port);
+    uint8_t pd[12];
+    uint16_t length;
+
+    if (port->rawStatus == RdmRequestStatus::requestQueued) {
+        port->txBuf[0] = 0xcc;
+        memcpy(port->txBuf + 1, port->rawBuf, port->rawLength);
+        port->rawStatus = (port->rawType == RdmRawType::rawBroadcast) ?
+            RdmRequestStatus::requestBroadcast : RdmRequestStatus::requestInFlight;
+        port->transaction = RdmTransaction::transactionRaw;
+        port->stats.rdmRequests++;
+        this->startTx(port, port->rawLength + 1, RdmPortState::portRdmTx, RDM_BREAK_US, RDM_MAB_US);
+        return true;
+    }
+
+    if (request && (port->preferQueue || !port->discoveryRunning)) {
+        port->preferQueue = false;
+        length = this->buildPacket(port, request->destUid, request->commandClass, request->pid, request->subDevice, request->pd, request->pdl);
+        request->status = ((request->destUid & 0xffffffffULL) == 0xffffffffULL) ?
+            RdmRequestStatus::requestBroadcast : RdmRequestStatus::requestInFlight;
+        port->transaction = RdmTransaction::transactionRequest;
+        port->current = request;
+        port->stats.rdmRequests++;
+        this->startTx(port, length, RdmPortState::portRdmTx, RDM_BREAK_US, RDM_MAB_US);
+        return true;
+    }
+
+    port->preferQueue = true;
+
+    if (!port->discoveryRunning) {
+        return false;
+    }
+
+    if (!port->discoveryUnMuted) {
+        length = this->buildPacket(port, RDM_UID_BROADCAST, RdmCommandClass::DiscoveryCommand, RDM_PID_DISC_UN_MUTE, 0, nullptr, 0);
+        port->discoveryUnMuted = true;
+        port->transaction = RdmTransaction::transactionUnMute;
+    } else if (port->muteRetries) {
+        length = this->buildPacket(port, port->muteUid, RdmCommandClass::DiscoveryCommand, RDM_PID_DISC_MUTE, 0, nullptr, 0);
+        port->muteRetries--;
+        port->transaction = RdmTransaction::transactionMute;
+    } else if (port->branchDepth) {
+        writeUid(pd, port->branchLower[port->branchDepth - 1]);
+        writeUid(pd + 6, port->branchUpper[port->branchDepth - 1]);
+        length = this->buildPacket(port, RDM_UID_BROADCAST, RdmCommandClass::DiscoveryCommand, RDM_PID_DISC_UNIQUE_BRANCH, 0, pd, 12);
+        port->transaction = RdmTransaction::transactionBranch;
+    } else {
+        port->discoveryRunning = false;
+        LOG("RDM: Discovery on port %u done, %u responders", port->sm, port->todCount);
+        return false;
+    }
+
+    this->startTx(port, length, RdmPortState::portRdmTx, RDM_BREAK_US, RDM_MAB_US);
+    return true;
+}
+
+// Hands txBuf to the state machine. The header words fit into the empty
+// TX FIFO, the slots are fed by DMA so this returns right away
+void Rdm::startTx(RdmPort* port, uint16_t length, RdmPortState state, uint16_t breakUs, uint16_t mabUs) {
+    dma_channel_abort(port->dmaTx);
+    dma_channel_abort(port->dmaRx);
+
+    rdm_program_start_tx(pio1, port->sm, this->pioOffset);
+    pio_sm_put(pio1, port->sm, breakUs - 1);
+    pio_sm_put(pio1, port->sm, mabUs - 1);
+    pio_sm_put(pio1, port->sm, length - 1);
+
+    if (state == RdmPortState::portRdmTx) {
+        dma_channel_transfer_to_buffer_now(port->dmaRx, port->rxBuf, RDM_MAX_PACKET);
+    }
+    dma_channel_transfer_from_buffer_now(port->dmaTx, port->txBuf, length);
+
+    port->state = state;
+    port->stateStart = time_us_32();
+    port->stateLength = breakUs + mabUs + length * RDM_SLOT_US;
+    if (state == RdmPortState::portDmxTx) {
+        port->stateLength = MAX(port->stateLength, DMX_MIN_PACKET_US);
+    }
+}
+
+// Evaluates whatever has been received and goes back to idle
+void Rdm::finishTransaction(RdmPort* port) {
+    uint32_t rxCount = port->lastRxCount;
+    RdmRequest* request;
+    uint64_t uid;
+    uint64_t lower;
+    uint64_t upper;
+    uint64_t middle;
+
+    dma_channel_abort(port->dmaRx);
+
+    switch (port->transaction) {
+        case RdmTransaction::transactionBranch:
+            lower = port->branchLower[port->branchDepth - 1];
+            upper = port->branchUpper[port->branchDepth - 1];
+
+            if (rxCount == 0) {
+                // Nobody in this branch (or all of them are muted)
+                port->branchDepth--;
+            } else if (this->decodeBranchResponse(port->rxBuf, rxCount, &uid) && (uid >= lower) && (uid <= upper)) {
+                // Exactly one responder answered. Mute it and ask the same branch again
+                port->muteUid = uid;
+                port->muteRetries = 3;
+            } else {
+                // Collision: Split the branch in half
+                port->stats.discCollisions++;
+                port->branchDepth--;
+                if ((lower < upper) && (port->branchDepth + 2 <= RDM_BRANCH_STACK)) {
+                    middle = lower + (upper - lower) / 2;
+                    port->branchLower[port->branchDepth] = middle + 1;
+                    port->branchUpper[port->branchDepth] = upper;
+                    port->branchDepth++;
+                    port->branchLower[port->branchDepth] = lower;
+                    port->branchUpper[port->branchDepth] = middle;
+                    port->branchDepth++;
+                }
+            }
+            break;
+
+        case RdmTransaction::transactionMute:
+            if (this->validateResponse(port, port->rxBuf, rxCount, port->muteUid)) {
+                this->discoveryGotUid(port, port->muteUid);
+                port->muteRetries = 0;
+            } else if (!port->muteRetries) {
+                // Responder answers the branch but not the mute. Split the
+                // branch so we don't ask for the same range forever
+                lower = port->branchLower[port->branchDepth - 1];
+                upper = port->branchUpper[port->branchDepth - 1];
+                port->branchDepth--;
+                if (lower < upper) {
+                    middle = lower + (upper - lower) / 2;
+                    port->branchLower[port->branchDepth] = middle + 1;
+                    port->branchUpper[port->branchDepth] = upper;
+                    port->branchDepth++;
+                    port->branchLower[port->branchDepth] = lower;
+                    port->branchUpper[port->branchDepth] = middle;
+                    port->branchDepth++;
+                }
+            }
+            break;
+
+        case RdmTransaction::transactionRequest:
+            request = port->current;
+            port->current = nullptr;
+            if (!request || (request->status != RdmRequestStatus::requestInFlight)) {
+                break;
+            }
+            if (this->validateResponse(port, port->rxBuf, rxCount, request->destUid)) {
+                request->responseType = (RdmResponseType)port->rxBuf[16];
+                request->responsePdl = MIN(port->rxBuf[23], RDM_MAX_PDL);
+                memcpy(request->responsePd, port->rxBuf + 24, request->responsePdl);
+                request->status = RdmRequestStatus::requestDone;
+                port->stats.rdmResponses++;
+            } else {
+                request->status = RdmRequestStatus::requestTimeout;
+                if (rxCount) {
+                    port->stats.rdmInvalid++;
+                } else {
+                    port->stats.rdmTimeouts++;
+                }
+            }
+            break;
+
+        case RdmTransaction::transactionRaw:
+            if (port->rawStatus != RdmRequestStatus::requestInFlight) {
+                break;
+            }
+            // Whatever it is, the host makes sense of it
+            memcpy(port->rawBuf, port->rxBuf, MIN(rxCount, RDM_MAX_PACKET));
+            port->rawLength = MIN(rxCount, RDM_MAX_PACKET);
+            if (rxCount) {
+                port->rawStatus = RdmRequestStatus::requestDone;
+                port->stats.rdmResponses++;
+            } else {
+                port->rawStatus = RdmRequestStatus::requestTimeout;
+                port->stats.rdmTimeouts++;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    port->transaction = RdmTransaction::transactionNone;
+    port->state = RdmPortState::portIdle;
+    port->framesSinceRdm = 0;
+}
+
+// Writes a complete RDM request including start code and checksum to txBuf
+uint16_t Rdm::buildPacket(RdmPort* port, uint64_t destUid, RdmCommandClass commandClass, uint16_t pid, uint16_t subDevice, uint8_t* pd, uint8_t pdl) {
+    uint8_t* packet = port->txBuf;
+    uint16_t checksum = 0;
+    uint8_t messageLength = 24 + pdl;
+
+    port->transactionNumber++;
+
+    packet[0] = 0xcc;                        // START Code
+    packet[1] = 0x01;                        // Sub-START Code
+    packet[2] = messageLength;
+    writeUid(packet + 3, destUid);
+    writeUid(packet + 9, ownUid);
+    packet[15] = port->transactionNumber;
+    packet[16] = port->sm + 1;               // Port ID
+    packet[17] = 0;                          // Message count
+    packet[18] = subDevice >> 8;
+    packet[19] = subDevice & 0xff;
+    packet[20] = commandClass;
+    packet[21] = pid >> 8;
+    packet[22] = pid & 0xff;
+    packet[23] = pdl;
+    if (pdl && pd) {
+        memcpy(packet + 24, pd, pdl);
+    }
+
+    for (uint16_t i = 0; i < messageLength; i++) {
+        checksum += packet[i];
+    }
+    packet[messageLength] = checksum >> 8;
+    packet[messageLength + 1] = checksum & 0xff;
+
+    return messageLength + 2;
+}
+
+// DISC_UNIQUE_BRANCH responses are not framed like other responses:
+// Up to 7 times 0xfe, 0xaa, then every byte of UID and checksum is sent
+// twice, once OR'ed with 0xaa and once OR'ed with 0x55
+bool Rdm::decodeBranchResponse(uint8_t* data, uint32_t length, uint64_t* uid) {
+    uint32_t pos = 0;
+    uint16_t checksum = 0;
+    uint8_t decoded[6];
+
+    while ((pos < length) && (pos < 7) && (data[pos] == 0xfe)) {
+        pos++;
+    }
+    if ((pos >= length) || (data[pos] != 0xaa)) {
+        return false;
+    }
+    pos++;
+    if ((length - pos) < 16) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 12; i++) {
+        checksum += data[pos + i];
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+        decoded[i] = data[pos + 2 * i] & data[pos + 2 * i + 1];
+    }
+    if (checksum != (((data[pos + 12] & data[pos + 13]) << 8) | (data[pos + 14] & data[pos + 15]))) {
+        return false;
+    }
+
+    *uid = readUid(decoded);
+    return true;
+}
+
+bool Rdm::validateResponse(RdmPort* port, uint8_t* data, uint32_t length, uint64_t expectedSrc) {
+    uint16_t checksum = 0;
+    uint8_t messageLength;
+
+    if ((length < 26) || (data[0] != 0xcc) || (data[1] != 0x01)) {
+        return false;
+    }
+
+    messageLength = data[2];
+    if ((messageLength < 24) || (length < (uint32_t)messageLength + 2) || (data[23] != messageLength - 24)) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < messageLength; i++) {
+        checksum += data[i];
+    }
+    if (checksum != ((data[messageLength] << 8) | data[messageLength + 1])) {
+        return false;
+    }
+
+    // Response must be for us, from the one we asked, for what we asked
+    return (readUid(data + 3) == ownUid) &&
+        (readUid(data + 9) == expectedSrc) &&
+        (data[15] == port->transactionNumber) &&
+        (data[20] == port->txBuf[20] + 1);
+}
+
+void Rdm::discoveryGotUid(RdmPort* port, uint64_t uid) {
+    for (uint8_t i = 0; i < port->todCount; i++) {
+        if (port->tod[i] == uid) {
+            return;
+        }
+    }
+
+    if (port->todCount >= RDM_TOD_SIZE) {
+        LOG("RDM: TOD of port %u is full, ignoring %04x:%08x", port->sm, (uint16_t)(uid >> 32), (uint32_t)uid);
+        return;
+    }
+
+    port->tod[port->todCount++] = uid;
+    LOG("RDM: Found %04x:%08x on port %u", (uint16_t)(uid >> 32), (uint32_t)uid, port->sm);
+}
+
+bool Rdm::startDiscovery(uint8_t portId) {
+    if (portId >= this->numPorts) {
+        return false;
+    }
+    RdmPort* port = &this->ports[portId];
+
+    // Full discovery: Forget everything, un-mute everyone, search the whole UID space
+    port->todCount = 0;
+    port->discoveryUnMuted = false;
+    port->muteRetries = 0;
+    port->branchLower[0] = 0;
+    port->branchUpper[0] = RDM_UID_MAX;
+    port->branchDepth = 1;
+    port->discoveryRunning = true;
+
+    return true;
+}
+
+int Rdm::queueRequest(uint8_t portId, uint64_t destUid, RdmCommandClass commandClass, uint16_t pid, uint16_t subDevice, uint8_t* pd, uint8_t pdl) {
+    if ((portId >= this->numPorts) || (pdl > RDM_MAX_PDL) ||
+        ((commandClass != RdmCommandClass::GetCommand) && (commandClass != RdmCommandClass::SetCommand)))
+    {
+        return -1;
+    }
+    RdmPort* port = &this->ports[portId];
+
+    RdmRequest* request = nullptr;
+    for (uint8_t i = 0; i < RDM_QUEUE_LENGTH; i++) {
+        if (port->queue[i].status == RdmRequestStatus::requestFree) {
+            request = &port->queue[i];
+            break;
+        }
+    }
+
+    // No free entry: Recycle the oldest finished one, its result is
+    // lost if nobody picked it up until now
+    if (!request) {
+        for (uint8_t i = 0; i < RDM_QUEUE_LENGTH; i++) {
+            RdmRequest* candidate = &port->queue[i];
+            if ((candidate->status != RdmRequestStatus::requestDone) &&
+                (candidate->status != RdmRequestStatus::requestTimeout) &&
+                (candidate->status != RdmRequestStatus::requestBroadcast))
+            {
+                continue;
+            }
+            if (!request || ((uint8_t)(port->queueNextId - candidate->id) > (uint8_t)(port->queueNextId - request->id))) {
+                request = candidate;
+            }
+        }
+    }
+
+    if (!request || (request == port->current)) {
+        // Queue full
+        return -1;
+    }
+
+    request->id = port->queueNextId++;
+    request->destUid = destUid;
+    request->commandClass = commandClass;
+    request->pid = pid;
+    request->subDevice = subDevice;
+    request->pdl = pdl;
+    if (pdl && pd) {
+        memcpy(request->pd, pd, pdl);
+    }
+    request->responsePdl = 0;
+    request->status = RdmRequestStatus::requestQueued;
+    return request->id;
+}
+
+bool Rdm::getRequest(uint8_t portId, uint8_t id, RdmRequest* request) {
+    if ((portId >= this->numPorts) || (request == nullptr)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < RDM_QUEUE_LENGTH; i++) {
+        if ((this->ports[portId].queue[i].status != RdmRequestStatus::requestFree) && (this->ports[portId].queue[i].id == id)) {
+            memcpy(request, &this->ports[portId].queue[i], sizeof(RdmRequest));
+            return true;
+        }
+    }
+    return false;
+}
+
+void Rdm::freeRequest(uint8_t portId, uint8_t id) {
+    if (portId >= this->numPorts) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < RDM_QUEUE_LENGTH; i++) {
+        RdmRequest* request = &this->ports[portId].queue[i];
+        // The running request is still referenced by the port's state machine
+        if ((request->id == id) && (request != this->ports[portId].current)) {
+            request->status = RdmRequestStatus::requestFree;
+        }
+    }
+}
+
+// Only one raw frame per port at a time. Its checksum is the host's job
+bool Rdm::queueRaw(uint8_t portId, RdmRawType type, const uint8_t* frame, uint16_t length) {
+    if ((portId >= this->numPorts) || !frame || !length || (length > RDM_MAX_PACKET - 1)) {
+        return false;
+    }
+    RdmPort* port = &this->ports[portId];
+
+    if ((port->rawStatus == RdmRequestStatus::requestQueued) || (port->rawStatus == RdmRequestStatus::requestInFlight)) {
+        return false;
+    }
+
+    // A host doing RDM itself does its own discovery, ours would mute its responders
+    port->discoveryRunning = false;
+
+    memcpy(port->rawBuf, frame, length);
+    port->rawLength = length;
+    port->rawType = type;
+    port->rawStatus = RdmRequestStatus::requestQueued;
+    return true;
+}
+
+// The response is copied as it was received: Framed ones with their start
+// code, DISC_UNIQUE_BRANCH responses with preamble, possibly garbled
+RdmRequestStatus Rdm::getRaw(uint8_t portId, uint8_t* response, uint16_t* length) {
+    if (portId >= this->numPorts) {
+        return RdmRequestStatus::requestFree;
+    }
+    RdmPort* port = &this->ports[portId];
+
+    if ((port->rawStatus == RdmRequestStatus::requestDone) && response && length) {
+        memcpy(response, port->rawBuf, port->rawLength);
+        *length = port->rawLength;
+    }
+    return port->rawStatus;
+}
+
+void Rdm::freeRaw(uint8_t portId) {
+    if (portId >= this->numPorts) {
+        return;
+    }
+
+    // The running frame is still in the port's state machine
+    if (this->ports[portId].rawStatus != RdmRequestStatus::requestInFlight) {
+        this->ports[portId].rawStatus = RdmRequestStatus::requestFree;
+    }
+}
+
+// Oldest queued request first. Ids are handed out in order, so the
+// smallest distance to the next id to be given out is the oldest
+RdmRequest* Rdm::nextQueued(RdmPort* port) {
+    RdmRequest* oldest = nullptr;
+
+    for (uint8_t i = 0; i < RDM_QUEUE_LENGTH; i++) {
+        RdmRequest* request = &port->queue[i];
+        if (request->status != RdmRequestStatus::requestQueued) {
+            continue;
+        }
+        if (!oldest || ((uint8_t)(port->queueNextId - request->id) > (uint8_t)(port->queueNextId - oldest->id))) {
+            oldest = request;
+        }
+    }
+    return oldest;
+}
+
+void Rdm::writeUid(uint8_t* dest, uint64_t uid) {
+    for (int8_t i = 5; i >= 0; i--) {
+        *dest++ = (uid >> (i * 8)) & 0xff;
+    }
+}
+
+uint64_t Rdm::readUid(uint8_t* src) {
+    uint64_t uid = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+        uid = (uid << 8) | src[i];
+    }
+    return uid;
+}
+
+// Summary of all ports. TOD and requests are in getRdmPortStatus() and the
+// response data in getRdmResponse(), all of it together doesn't fit one SSI insert
+std::string Rdm::getRdmStatus() {
+    Json::Value output;
+    Json::StreamWriterBuilder wbuilder;
+    std::string output_string;
+    char uidString[14];
+
+    wbuilder["indentation"] = "";
+
+    snprintf(uidString, 14, "%04x:%08x", (uint16_t)(ownUid >> 32), (uint32_t)ownUid);
+    output["uid"] = uidString;
+
+    for (uint8_t i = 0; i < this->numPorts; i++) {
+        RdmPort* port = &this->ports[i];
+
+        output["ports"][i]["localPort"] = port->localPort;
+        output["ports"][i]["state"] = port->state;
+        output["ports"][i]["discoveryRunning"] = port->discoveryRunning;
+        output["ports"][i]["todCount"] = port->todCount;
+
+        output["ports"][i]["stats"]["dmxFrames"] = port->stats.dmxFrames;
+        output["ports"][i]["stats"]["rdmRequests"] = port->stats.rdmRequests;
+        output["ports"][i]["stats"]["rdmResponses"] = port->stats.rdmResponses;
+        output["ports"][i]["stats"]["rdmTimeouts"] = port->stats.rdmTimeouts;
+        output["ports"][i]["stats"]["rdmInvalid"] = port->stats.rdmInvalid;
+        output["ports"][i]["stats"]["discCollisions"] = port->stats.discCollisions;
+    }
+
+    output_string = Json::writeString(wbuilder, output);
+    return output_string;
+}
+
+// TOD and queued requests of one port, without the response data
+std::string Rdm::getRdmPortStatus(uint8_t portId) {
+    Json::Value output;
+    Json::StreamWriterBuilder wbuilder;
+    std::string output_string;
+    char uidString[14];
+
+    wbuilder["indentation"] = "";
+
+    if (portId >= this->numPorts) {
+        return "{}";
+    }
+    RdmPort* port = &this->ports[portId];
+
+    output["port"] = portId;
+    output["tod"] = Json::arrayValue;
+    for (uint8_t j = 0; j < port->todCount; j++) {
+        snprintf(uidString, 14, "%04x:%08x", (uint16_t)(port->tod[j] >> 32), (uint32_t)port->tod[j]);
+        output["tod"][j] = uidString;
+    }
+
+    uint8_t k = 0;
+    output["requests"] = Json::arrayValue;
+    for (uint8_t j = 0; j < RDM_QUEUE_LENGTH; j++) {
+        RdmRequest* request = &port->queue[j];
+        if (request->status == RdmRequestStatus::requestFree) {
+            continue;
+        }
+        output["requests"][k]["id"] = request->id;
+        output["requests"][k]["status"] = request->status;
+        output["requests"][k]["pid"] = request->pid;
+        output["requests"][k]["responseType"] = request->responseType;
+        output["requests"][k]["pdl"] = request->responsePdl;
+        k++;
+    }
+
+    output_string = Json::writeString(wbuilder, output);
+    return output_string;
+}
+
+// One request with its response data as hex
+std::string Rdm::getRdmResponse(uint8_t portId, uint8_t id) {
+    Json::Value output;
+    Json::StreamWriterBuilder wbuilder;
+    std::string output_string;
+    RdmRequest request;
+    char hex[3];
+
+    wbuilder["indentation"] = "";
+
+    if (!this->getRequest(portId, id, &request)) {
+        return "{}";
+    }
+
+    std::string data;
+    for (uint8_t l = 0; l < request.responsePdl; l++) {
+        snprintf(hex, 3, "%02x", request.responsePd[l]);
+        data += hex;
+    }
+    output["port"] = portId;
+    output["id"] = request.id;
+    output["status"] = request.status;
+    output["pid"] = request.pid;
+    output["responseType"] = request.responseType;
+    output["data"] = data;
+
+    output_string = Json::writeString(wbuilder, output);
+    return output_string;
+}
+
+char* getRdmUidString() {
+    static char uidString[14];
+
+    snprintf(uidString, 14, "%04x:%08x", (uint16_t)(Rdm::ownUid >> 32), (uint32_t)Rdm::ownUid);
+    return uidString;
+}
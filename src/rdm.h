@@ -0,0 +1,216 @@
+#ifndef RDM_H
+#define RDM_H
+
+#include <stdio.h>
+
+#include <hardware/pio.h>
+
+#include "pins.h"
+
+// RDM ports use PIO1, SM0 to SM2. PIO1, SM3 is used for the Status LEDs.
+// Using PIO1 is on purpose: Switching the GPIO function to PIO1 takes the
+// pin away from the tx16 program on PIO0 that serialises all 16 outputs
+#ifndef RDM_MAX_PORTS
+#define RDM_MAX_PORTS 3
+#endif // RDM_MAX_PORTS
+
+#define RDM_TOD_SIZE         32  // Max responders remembered per port
+#define RDM_QUEUE_LENGTH      4  // Max GET/SET requests waiting per port
+#define RDM_MAX_PDL         231  // Max parameter data length according to E1.20
+#define RDM_MAX_PACKET      257  // Start code + 255 byte message + 2 byte checksum
+#define RDM_BRANCH_STACK     50  // Max depth of the discovery binary search + 2
+
+#define RDM_UID_BROADCAST   0xffffffffffffULL
+#define RDM_UID_MAX         0xfffffffffffeULL
+
+#ifdef __cplusplus
+
+#include <string>
+
+// E1.20 command classes
+enum RdmCommandClass : uint8_t {
+    DiscoveryCommand          = 0x10,
+    DiscoveryCommandResponse  = 0x11,
+    GetCommand                = 0x20,
+    GetCommandResponse        = 0x21,
+    SetCommand                = 0x30,
+    SetCommandResponse        = 0x31,
+};
+
+// E1.20 response types
+enum RdmResponseType : uint8_t {
+    Ack                       = 0x00,
+    AckTimer                  = 0x01,
+    NackReason                = 0x02,
+    AckOverflow               = 0x03,
+};
+
+enum RdmPortState : uint8_t {
+    portIdle                  = 0, // Nothing on the line, next frame can start
+    portDmxTx                 = 1, // Sending a DMX frame (NULL start code)
+    portRdmTx                 = 2, // Sending an RDM request
+    portRdmWait               = 3, // Waiting for the response of a responder
+};
+
+enum RdmTransaction : uint8_t {
+    transactionNone           = 0,
+    transactionUnMute         = 1, // Broadcast DISC_UN_MUTE, no response
+    transactionBranch         = 2, // DISC_UNIQUE_BRANCH, non-framed response
+    transactionMute           = 3, // DISC_MUTE to a single UID
+    transactionRequest        = 4, // Queued GET or SET
+    transactionRaw            = 5, // Frame built by the host, response passed on as received
+};
+
+// What a raw frame is, decides how long we listen after it
+enum RdmRawType : uint8_t {
+    rawRequest                = 0, // Framed response from one responder
+    rawDiscovery              = 1, // DISC_UNIQUE_BRANCH, non-framed responses, collisions
+    rawBroadcast              = 2, // No response expected
+};
+
+enum RdmRequestStatus : uint8_t {
+    requestFree               = 0,
+    requestQueued             = 1,
+    requestInFlight           = 2,
+    requestDone               = 3, // Valid response (ACK, ACK_TIMER, NACK, ...) received
+    requestTimeout            = 4, // No or no valid response
+    requestBroadcast          = 5, // Sent as broadcast, no response expected
+};
+
+struct RdmRequest {
+    RdmRequestStatus status;
+    uint8_t          id;          // Handle given to the caller
+    uint64_t         destUid;
+    RdmCommandClass  commandClass;
+    uint16_t         pid;
+    uint16_t         subDevice;
+    uint8_t          pdl;
+    uint8_t          pd[RDM_MAX_PDL];
+
+    // Filled when status is requestDone
+    RdmResponseType  responseType;
+    uint8_t          responsePdl;
+    uint8_t          responsePd[RDM_MAX_PDL];
+};
+
+struct RdmStats {
+    uint32_t dmxFrames;
+    uint32_t rdmRequests;
+    uint32_t rdmResponses;
+    uint32_t rdmTimeouts;
+    uint32_t rdmInvalid;        // Checksum, length or addressing wrong
+    uint32_t discCollisions;
+};
+
+struct RdmPort {
+    bool             active;
+    uint             sm;
+    uint             dataPin;
+    uint             dePin;
+    uint8_t          localPort;   // Index into LocalDmx::buffer this port outputs
+    int              dmaTx;
+    int              dmaRx;
+
+    RdmPortState     state;
+    RdmTransaction   transaction;
+    uint32_t         stateStart;  // time_us_32() when the state was entered
+    uint32_t         stateLength; // µs the state lasts at least
+    uint32_t         lastRxCount; // Bytes received when we last looked
+    uint32_t         lastRxTime;
+    uint8_t          framesSinceRdm;
+    uint8_t          transactionNumber;
+    bool             preferQueue; // Alternate between queue and discovery
+
+    uint8_t          txBuf[513];  // DMX frame (start code + 512 slots) or RDM request
+    uint8_t          rxBuf[RDM_MAX_PACKET];
+
+    // Table of devices, filled by discovery
+    uint64_t         tod[RDM_TOD_SIZE];
+    uint8_t          todCount;
+
+    // Discovery (binary search over the UID space)
+    bool             discoveryRunning;
+    bool             discoveryUnMuted;
+    uint64_t         branchLower[RDM_BRANCH_STACK];
+    uint64_t         branchUpper[RDM_BRANCH_STACK];
+    uint8_t          branchDepth;
+    uint64_t         muteUid;     // UID we are currently trying to mute
+    uint8_t          muteRetries;
+
+    // GET/SET requests, served in order between DMX frames
+    RdmRequest       queue[RDM_QUEUE_LENGTH];
+    uint8_t          queueNextId;
+    RdmRequest*      current;     // Request of the running transaction
+
+    // One frame of a host doing RDM itself (Ja Rule emulation). Goes
+    // before the queue since the host waits for every single response
+    RdmRequestStatus rawStatus;
+    RdmRawType       rawType;
+    uint16_t         rawLength;
+    uint8_t          rawBuf[RDM_MAX_PACKET]; // Frame without start code, then the response as received
+
+    RdmStats         stats;
+};
+
+// RDM controller for all switchable ports on RDM capable IO boards
+// Everything is an asynchronous state machine: cyclicTask() needs to be
+// called regularly (from the main loop) and never blocks
+class Rdm {
+  public:
+    void init();
+    void cyclicTask();
+
+    uint8_t portCount();
+    bool startDiscovery(uint8_t port);
+    int queueRequest(uint8_t port, uint64_t destUid, RdmCommandClass commandClass, uint16_t pid, uint16_t subDevice, uint8_t* pd, uint8_t pdl); // Returns the request id or -1
+    bool getRequest(uint8_t port, uint8_t id, RdmRequest* request);
+    void freeRequest(uint8_t port, uint8_t id);
+    bool queueRaw(uint8_t port, RdmRawType type, const uint8_t* frame, uint16_t length); // frame without start code
+    RdmRequestStatus getRaw(uint8_t port, uint8_t* response, uint16_t* length);      // response needs RDM_MAX_PACKET bytes
+    void freeRaw(uint8_t port);
+
+    std::string getRdmStatus();
+    std::string getRdmPortStatus(uint8_t port);
+    std::string getRdmResponse(uint8_t port, uint8_t id);
+
+    static uint64_t ownUid;
+
+  private:
+    RdmPort ports[RDM_MAX_PORTS];
+    uint8_t numPorts;
+    uint pioOffset;
+
+    void addPort(uint8_t slot, uint8_t portOnBoard);
+    void portTask(RdmPort* port);
+
+    void startDmxFrame(RdmPort* port);
+    bool startRdmTransaction(RdmPort* port);
+    void startTx(RdmPort* port, uint16_t length, RdmPortState state, uint16_t breakUs, uint16_t mabUs);
+    void finishTransaction(RdmPort* port);
+
+    uint16_t buildPacket(RdmPort* port, uint64_t destUid, RdmCommandClass commandClass, uint16_t pid, uint16_t subDevice, uint8_t* pd, uint8_t pdl);
+    bool decodeBranchResponse(uint8_t* data, uint32_t length, uint64_t* uid);
+    bool validateResponse(RdmPort* port, uint8_t* data, uint32_t length, uint64_t expectedSrc);
+
+    void discoveryGotUid(RdmPort* port, uint64_t uid);
+    RdmRequest* nextQueued(RdmPort* port);
+
+    static void writeUid(uint8_t* dest, uint64_t uid);
+    static uint64_t readUid(uint8_t* src);
+};
+
+#endif // __cplusplus
+
+// Helper methods which are called from C code
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "mmmm:dddddddd", the format OLA expects as USB serial number of Ja Rule devices
+char* getRdmUidString();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RDM_H
@@ -94,8 +94,10 @@ extern "C" {
 
 // Vendor FIFO size of TX and RX
 // If not configured vendor endpoints will not be buffered
-#define CFG_TUD_VENDOR_RX_BUFSIZE 64
-#define CFG_TUD_VENDOR_TX_BUFSIZE 64
+// RX: Lets the host send ahead while a frame is written to the buffers
+// TX: Holds a complete (raw) universe block sent to the host (usb_Bulk.h)
+#define CFG_TUD_VENDOR_RX_BUFSIZE 1024
+#define CFG_TUD_VENDOR_TX_BUFSIZE 1024
 
 #ifdef __cplusplus
 }
@@ -114,7 +114,7 @@ void Udp_ArtNet::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const i
           length = MIN(length, 512);
 
           if (dmx->universe < DMXBUFFER_COUNT) {
-            dmxBuffer.setBuffer(dmx->universe, dmx->data, length);
+            dmxBuffer.setBuffer(dmx->universe, dmx->data, length, DmxBufferSource::sourceArtNet);
           }
 
         break;
@@ -110,7 +110,7 @@ void Udp_E1_31::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip
           ntohs(dmp->first_property_address), ntohs(dmp->address_increment), size);
 
         if (universe < DMXBUFFER_COUNT) {
-          dmxBuffer.setBuffer(universe, dmp->start_and_data + 1, size);
+          dmxBuffer.setBuffer(universe, dmp->start_and_data + 1, size, DmxBufferSource::sourceE131);
         }
         break;
     }
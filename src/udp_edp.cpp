@@ -6,25 +6,41 @@ udp_pcb* Udp_EDP::pcb;
 
 uint8_t Udp_EDP::tmpBuf[600];
 uint8_t Udp_EDP::tmpBuf2[600];
+EdpReassemblySlot Udp_EDP::slots[1]; // A datagram always carries a complete frame
 Edp Udp_EDP::edp;
 
 // UDP recv callback (for C-based code, not part of the class)
 static void edp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
   Udp_EDP::receive(arg, pcb, p, addr, port);
+  pbuf_free(p);
 }
 
 void Udp_EDP::receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    struct pbuf *p_send;
+    uint16_t responseSize;
+
     uint16_t size = MIN(p->tot_len, 600);
-    memcpy(tmpBuf, p->payload, size);
+    pbuf_copy_partial(p, tmpBuf, size, 0);
 
     edp.processIncomingChunk(size);
+
+    // Pong goes back to where the Ping came from
+    responseSize = edp.takeResponse();
+    if (responseSize) {
+        p_send = pbuf_alloc(PBUF_TRANSPORT, responseSize, PBUF_RAM);
+        if (p_send != NULL) {
+            memcpy(p_send->payload, tmpBuf2, responseSize);
+            udp_sendto(pcb, p_send, addr, port);
+            pbuf_free(p_send);
+        }
+    }
 }
 
 void Udp_EDP::init(void) {
   memset(tmpBuf, 0x00, 600);
   memset(tmpBuf2, 0x00, 600);
 
-  edp.init(tmpBuf, tmpBuf2, 600, PatchType::ip);
+  edp.init(tmpBuf, tmpBuf2, 600, PatchType::ip, slots, 1);
 
   if (pcb == NULL) {
     pcb = udp_new_ip_type(IPADDR_TYPE_V4);
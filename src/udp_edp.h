@@ -27,6 +27,7 @@ class Udp_EDP {
 
     static uint8_t tmpBuf[600];
     static uint8_t tmpBuf2[600];
+    static EdpReassemblySlot slots[1];
 
     static Edp edp;
 };
@@ -0,0 +1,393 @@
+#include "usb_Bulk.h"
+
+#include "log.h"
+
+#include "boardconfig.h"
+#include "dmxbuffer.h"
+#include "dmxcodec.h"
+
+extern uint8_t usb_buffer[24][512];
+
+extern DmxBuffer dmxBuffer;
+
+struct UsbBulkStats Usb_Bulk::stats;
+UsbBulkState Usb_Bulk::state;
+struct UsbBulk_MessageHeader Usb_Bulk::message;
+struct UsbBulk_UniverseHeader Usb_Bulk::universe;
+struct UsbBulk_Range Usb_Bulk::range;
+uint16_t Usb_Bulk::messageLeft;
+uint16_t Usb_Bulk::blockLeft;
+uint16_t Usb_Bulk::partLeft;
+uint8_t* Usb_Bulk::partDest;
+uint32_t Usb_Bulk::blockStarted;
+uint32_t Usb_Bulk::subscribedMask;
+uint16_t Usb_Bulk::subscribedIntervalMs;
+uint32_t Usb_Bulk::sentFrames[DMXBUFFER_COUNT];
+uint32_t Usb_Bulk::sentTime[DMXBUFFER_COUNT];
+uint8_t Usb_Bulk::nextInput;
+uint8_t Usb_Bulk::scratch[600];
+uint8_t Usb_Bulk::frame[512];
+
+void Usb_Bulk::init() {
+    memset(&stats, 0x00, sizeof(struct UsbBulkStats));
+    subscribedMask = 0;
+    subscribedIntervalMs = 0;
+    nextInput = 0;
+    startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+}
+
+// The vendor FIFO holds what the host sent until it's read here, so
+// everything is handled in the order it came in and the host is throttled
+// by the bus (NAK) when we fall behind
+void Usb_Bulk::cyclicTask() {
+    uint16_t length;
+    uint8_t byte;
+
+    if (!tud_vendor_mounted()) {
+        // A new host (or host application) starts with a new message
+        if (state != UsbBulkState::bulkMessageHeader) {
+            startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+        }
+        subscribedMask = 0;
+        return;
+    }
+
+    // The FIFO is only refilled by tud_task(), so this ends
+    while (tud_vendor_available()) {
+        if (state == UsbBulkState::bulkSkip) {
+            uint32_t count = tud_vendor_read(scratch, MIN(messageLeft, sizeof(scratch)));
+            stats.bytesIn += count;
+            messageLeft -= count;
+            if (!messageLeft) {
+                startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+            }
+            continue;
+        }
+
+        if ((state == UsbBulkState::bulkMessageHeader) && (partLeft == sizeof(struct UsbBulk_MessageHeader))) {
+            // Garbage (or the rest of a message of a host application that
+            // went away) is skipped byte by byte until the magic is found
+            tud_vendor_read(&byte, 1);
+            stats.bytesIn++;
+            if (byte != USB_BULK_MAGIC) {
+                stats.resyncBytes++;
+                continue;
+            }
+            message.magic = byte;
+            partDest++;
+            partLeft--;
+            continue;
+        }
+
+        if (!readPart()) {
+            continue;
+        }
+
+        switch (state) {
+            case UsbBulkState::bulkMessageHeader:
+                messageStarted();
+                break;
+
+            case UsbBulkState::bulkUniverseHeader:
+                universeStarted();
+                break;
+
+            case UsbBulkState::bulkRangeHeader:
+                if (((range.offset + range.count) > 512) || (range.count > blockLeft)) {
+                    invalid();
+                } else if (range.count) {
+                    startPart(usb_buffer[universe.bufferId] + range.offset, range.count, UsbBulkState::bulkChannels);
+                } else if (blockLeft) {
+                    // Empty range, the next header follows directly
+                    if (blockLeft < sizeof(struct UsbBulk_Range)) {
+                        invalid();
+                    } else {
+                        startPart(&range, sizeof(struct UsbBulk_Range), UsbBulkState::bulkRangeHeader);
+                    }
+                } else {
+                    universeDone();
+                }
+                break;
+
+            case UsbBulkState::bulkChannels:
+                if ((universe.encoding == UsbBulk_Encoding::bulkRanges) && blockLeft) {
+                    if (blockLeft < sizeof(struct UsbBulk_Range)) {
+                        invalid();
+                    } else {
+                        startPart(&range, sizeof(struct UsbBulk_Range), UsbBulkState::bulkRangeHeader);
+                    }
+                } else {
+                    universeDone();
+                }
+                break;
+
+            case UsbBulkState::bulkEncoded:
+                // Decoded into frame first, so nothing is staged if it's broken
+                length = DmxCodec::decode(scratch, universe.length, frame, 512);
+                if (length) {
+                    memcpy(usb_buffer[universe.bufferId], frame, length);
+                    memset(usb_buffer[universe.bufferId] + length, 0x00, 512 - length);
+                    universeDone();
+                } else {
+                    // The block has been read completely, go on with the next one
+                    stats.invalid++;
+                    nextUniverse();
+                }
+                break;
+
+            case UsbBulkState::bulkPayload:
+                if (message.command == UsbBulk_Commands::BulkPing) {
+                    if (!send(UsbBulk_Commands::BulkPong, nullptr, 0, scratch, message.length)) {
+                        stats.txFull++;
+                    }
+                } else if (message.command == UsbBulk_Commands::BulkSubscribe) {
+                    struct UsbBulk_Subscribe* subscribe = (struct UsbBulk_Subscribe*)scratch;
+                    subscribedMask = subscribe->bufferMask & ((1 << DMXBUFFER_COUNT) - 1);
+                    subscribedIntervalMs = subscribe->intervalMs;
+                    // Send everything subscribed once, so the host knows the current state
+                    memset(sentFrames, 0xff, sizeof(sentFrames));
+                    LOG("Usb_Bulk: Subscribed 0x%06x every %u ms", subscribedMask, subscribedIntervalMs);
+                }
+                messageDone();
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    sendInput();
+}
+
+// Reads what is there of the current part. True if it's complete
+bool Usb_Bulk::readPart() {
+    uint32_t count = tud_vendor_read(partDest, partLeft);
+
+    partDest += count;
+    partLeft -= count;
+    stats.bytesIn += count;
+
+    if (state != UsbBulkState::bulkMessageHeader) {
+        messageLeft -= count;
+    }
+    if ((state == UsbBulkState::bulkRangeHeader) || (state == UsbBulkState::bulkChannels) || (state == UsbBulkState::bulkEncoded)) {
+        blockLeft -= count;
+    }
+
+    return (partLeft == 0);
+}
+
+void Usb_Bulk::startPart(void* dest, uint16_t length, UsbBulkState nextState) {
+    partDest = (uint8_t*)dest;
+    partLeft = length;
+    state = nextState;
+}
+
+void Usb_Bulk::messageStarted() {
+    messageLeft = message.length;
+
+    if (getUsbProtocol() != 0) {
+        // Another protocol is emulated, the vendor interface is not ours
+        state = UsbBulkState::bulkSkip;
+    } else if (message.command == UsbBulk_Commands::BulkFrames) {
+        if (messageLeft < sizeof(struct UsbBulk_UniverseHeader)) {
+            invalid();
+        } else {
+            startPart(&universe, sizeof(struct UsbBulk_UniverseHeader), UsbBulkState::bulkUniverseHeader);
+        }
+    } else if ((message.command == UsbBulk_Commands::BulkPing) && messageLeft && (messageLeft <= USB_BULK_MAX_PING)) {
+        startPart(scratch, messageLeft, UsbBulkState::bulkPayload);
+    } else if ((message.command == UsbBulk_Commands::BulkSubscribe) && (messageLeft == sizeof(struct UsbBulk_Subscribe))) {
+        startPart(scratch, messageLeft, UsbBulkState::bulkPayload);
+    } else if ((message.command == UsbBulk_Commands::BulkStatsRequest) && !messageLeft) {
+        messageDone();
+    } else {
+        invalid();
+    }
+
+    if ((state == UsbBulkState::bulkSkip) && !messageLeft) {
+        startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+    }
+}
+
+void Usb_Bulk::messageDone() {
+    stats.messages++;
+
+    if (message.command == UsbBulk_Commands::BulkStatsRequest) {
+        if (!send(UsbBulk_Commands::BulkStats, nullptr, 0, &stats, sizeof(struct UsbBulkStats))) {
+            stats.txFull++;
+        }
+    }
+
+    startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+}
+
+void Usb_Bulk::universeStarted() {
+    blockLeft = universe.length;
+    blockStarted = time_us_32();
+
+    if ((universe.bufferId >= DMXBUFFER_COUNT) || (universe.length > messageLeft)) {
+        invalid();
+        return;
+    }
+
+    switch (universe.encoding) {
+        case UsbBulk_Encoding::bulkRaw:
+            if (universe.length > 512) {
+                invalid();
+            } else if (universe.length) {
+                startPart(usb_buffer[universe.bufferId], universe.length, UsbBulkState::bulkChannels);
+            } else {
+                universeDone();
+            }
+            break;
+
+        case UsbBulk_Encoding::bulkRanges:
+            if (!universe.length) {
+                universeDone();
+            } else if (universe.length < sizeof(struct UsbBulk_Range)) {
+                invalid();
+            } else {
+                startPart(&range, sizeof(struct UsbBulk_Range), UsbBulkState::bulkRangeHeader);
+            }
+            break;
+
+        case UsbBulk_Encoding::bulkDmxCodec:
+            if (!universe.length || (universe.length > sizeof(scratch))) {
+                invalid();
+            } else {
+                startPart(scratch, universe.length, UsbBulkState::bulkEncoded);
+            }
+            break;
+
+        case UsbBulk_Encoding::bulkAllZero:
+            if (universe.length) {
+                invalid();
+            } else {
+                universeDone();
+            }
+            break;
+
+        default:
+            invalid();
+            break;
+    }
+}
+
+// The staging buffer has the complete frame, write it to the DMX buffer
+void Usb_Bulk::universeDone() {
+    uint8_t* staged = usb_buffer[universe.bufferId];
+
+    if (universe.encoding == UsbBulk_Encoding::bulkRaw) {
+        memset(staged + universe.length, 0x00, 512 - universe.length);
+    } else if (universe.encoding == UsbBulk_Encoding::bulkAllZero) {
+        memset(staged, 0x00, 512);
+    }
+    dmxBuffer.setBuffer(universe.bufferId, staged, 512, DmxBufferSource::sourceUsbBulk);
+
+    stats.universes++;
+    stats.applyUsMax = MAX(stats.applyUsMax, time_us_32() - blockStarted);
+
+    nextUniverse();
+}
+
+void Usb_Bulk::nextUniverse() {
+    if (messageLeft >= sizeof(struct UsbBulk_UniverseHeader)) {
+        startPart(&universe, sizeof(struct UsbBulk_UniverseHeader), UsbBulkState::bulkUniverseHeader);
+    } else if (messageLeft) {
+        invalid();
+    } else {
+        messageDone();
+    }
+}
+
+// Drops the rest of the current message
+void Usb_Bulk::invalid() {
+    stats.invalid++;
+
+    if (messageLeft) {
+        state = UsbBulkState::bulkSkip;
+    } else {
+        startPart(&message, sizeof(struct UsbBulk_MessageHeader), UsbBulkState::bulkMessageHeader);
+    }
+}
+
+// Sends the subscribed buffers other sources wrote to since they were last
+// sent. The host's own frames are not echoed
+void Usb_Bulk::sendInput() {
+    struct UsbBulk_UniverseHeader header;
+    uint32_t now = time_us_32();
+    uint16_t length;
+    uint8_t bufferId;
+
+    if (!subscribedMask || (getUsbProtocol() != 0)) {
+        return;
+    }
+
+    for (uint8_t n = 0; n < DMXBUFFER_COUNT; n++) {
+        bufferId = (nextInput + n) % DMXBUFFER_COUNT;
+
+        if (!(subscribedMask & (1 << bufferId)) ||
+            (dmxBuffer.status[bufferId].frames == sentFrames[bufferId]) ||
+            ((now - sentTime[bufferId]) < (subscribedIntervalMs * 1000))) {
+            continue;
+        }
+        if (dmxBuffer.status[bufferId].source == DmxBufferSource::sourceUsbBulk) {
+            sentFrames[bufferId] = dmxBuffer.status[bufferId].frames;
+            continue;
+        }
+
+        dmxBuffer.getBuffer(bufferId, frame, 512);
+
+        // Whatever is smaller: The channels up to the last one that isn't
+        // zero or the full frame encoded
+        for (length = 512; length && !frame[length - 1]; length--);
+
+        header.bufferId = bufferId;
+        header.length = 0;
+        if (!length) {
+            header.encoding = UsbBulk_Encoding::bulkAllZero;
+        } else if ((header.length = DmxCodec::encode(frame, 512, scratch, length - 1))) {
+            header.encoding = UsbBulk_Encoding::bulkDmxCodec;
+        } else {
+            header.encoding = UsbBulk_Encoding::bulkRaw;
+            header.length = length;
+        }
+
+        if (!send(UsbBulk_Commands::BulkFrames, &header, sizeof(header), (header.encoding == UsbBulk_Encoding::bulkDmxCodec) ? scratch : frame, header.length)) {
+            // Try again when the host has read what is in the FIFO
+            nextInput = bufferId;
+            return;
+        }
+
+        sentFrames[bufferId] = dmxBuffer.status[bufferId].frames;
+        sentTime[bufferId] = now;
+        stats.inputFrames++;
+    }
+}
+
+// A message goes into the TX FIFO completely or not at all
+bool Usb_Bulk::send(UsbBulk_Commands command, const void* header, uint16_t headerLength, const void* data, uint16_t length) {
+    struct UsbBulk_MessageHeader messageHeader;
+    uint32_t total = sizeof(struct UsbBulk_MessageHeader) + headerLength + length;
+
+    if (tud_vendor_write_available() < total) {
+        return false;
+    }
+
+    messageHeader.magic = USB_BULK_MAGIC;
+    messageHeader.command = command;
+    messageHeader.length = headerLength + length;
+
+    tud_vendor_write(&messageHeader, sizeof(struct UsbBulk_MessageHeader));
+    if (headerLength) {
+        tud_vendor_write(header, headerLength);
+    }
+    if (length) {
+        tud_vendor_write(data, length);
+    }
+    tud_vendor_write_flush();
+
+    stats.bytesOut += total;
+    return true;
+}
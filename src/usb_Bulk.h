@@ -0,0 +1,140 @@
+#ifndef USB_BULK_H
+#define USB_BULK_H
+
+#include <stdint.h>
+
+#ifndef EDP_HOST
+#include "tusb.h"
+
+#include "dmxbuffer.h"
+#endif
+
+// Native bulk protocol on the vendor interface (EP 0x07 OUT, 0x87 IN)
+//
+// In contrast to HID EDP (64 byte reports every 5 ms), bulk transfers use
+// all the bandwidth the bus has left, so all 24 buffers fit in a few
+// transfers per frame. The host writes to the internal DMX buffers
+// directly (no patching), the device streams the buffers other sources
+// write back to the host. Only active with the native USB protocol (0),
+// everything else is read and dropped
+//
+// Both directions are a stream of messages, each starts with a message
+// header. All multi-byte values are little endian. The tools/usbbulk host
+// client is the reference for the host side
+#define USB_BULK_MAGIC             0xd5
+#define USB_BULK_MAX_PING            64  // Largest Ping payload echoed back
+#define USB_BULK_REFRESH_US     1000000  // Host sends full frames at least this often
+
+enum UsbBulk_Commands : uint8_t {
+    BulkPing                  = 0x00, // Host -> device: Anything up to USB_BULK_MAX_PING bytes
+    BulkPong                  = 0x01, // Device -> host: The Ping's payload
+    BulkFrames                = 0x10, // Both directions: Universe blocks, see below
+    BulkSubscribe             = 0x20, // Host -> device: UsbBulk_Subscribe
+    BulkStatsRequest          = 0x30, // Host -> device: No payload
+    BulkStats                 = 0x31, // Device -> host: UsbBulkStats
+};
+
+// 4 byte, followed by <length> bytes of payload
+struct UsbBulk_MessageHeader {
+    uint8_t               magic;           // USB_BULK_MAGIC, to find the next message after garbage
+    UsbBulk_Commands      command;
+    uint16_t              length;
+} __attribute__((__packed__));
+
+// How the channels of a universe block are encoded
+enum UsbBulk_Encoding : uint8_t {
+    bulkRaw                   = 0, // Channels 0 .. length-1, the rest is zero
+    bulkRanges                = 1, // UsbBulk_Range + channels, repeated. Channels not in a range keep their value
+    bulkDmxCodec              = 2, // Full frame encoded with DmxCodec (dmxcodec.h)
+    bulkAllZero               = 3, // No payload
+};
+
+// 4 byte, the payload of BulkFrames is a sequence of these, each followed
+// by <length> bytes of encoded channels. A buffer is written as soon as
+// its block is complete
+struct UsbBulk_UniverseHeader {
+    uint8_t               bufferId;        // 0 .. DMXBUFFER_COUNT-1
+    UsbBulk_Encoding      encoding;
+    uint16_t              length;
+} __attribute__((__packed__));
+
+// 4 byte, followed by <count> channel values
+struct UsbBulk_Range {
+    uint16_t              offset;
+    uint16_t              count;
+} __attribute__((__packed__));
+
+// Which buffers the device sends back (BulkFrames) when they were written
+// by another source, at most every intervalMs per buffer
+struct UsbBulk_Subscribe {
+    uint32_t              bufferMask;      // Bit n = buffer n, 0 = off
+    uint16_t              intervalMs;
+} __attribute__((__packed__));
+
+struct UsbBulkStats {
+    uint32_t              messages;        // Received, complete
+    uint32_t              universes;       // Universe blocks written to the buffers
+    uint32_t              bytesIn;
+    uint32_t              bytesOut;
+    uint32_t              invalid;         // Messages or blocks dropped for a wrong header or size
+    uint32_t              resyncBytes;     // Skipped while looking for the next message header
+    uint32_t              inputFrames;     // Universe blocks sent to the host
+    uint32_t              txFull;          // Responses dropped, no space in the TX FIFO
+    uint32_t              applyUsMax;      // Longest time from a universe header until the buffer was written
+} __attribute__((__packed__));
+
+#if defined(__cplusplus) && !defined(EDP_HOST)
+
+// Where the message parser is
+enum UsbBulkState : uint8_t {
+    bulkMessageHeader         = 0,
+    bulkUniverseHeader        = 1,
+    bulkRangeHeader           = 2,
+    bulkChannels              = 3, // Straight into the staging buffer
+    bulkEncoded               = 4, // Into scratch, decoded when complete
+    bulkPayload               = 5, // Ping and Subscribe, into scratch
+    bulkSkip                  = 6, // Rest of an invalid or ignored message
+};
+
+class Usb_Bulk {
+  public:
+    static void init();
+    static void cyclicTask(); // Runs on core0, next to tud_task()
+
+    static struct UsbBulkStats stats;
+
+  private:
+    static UsbBulkState state;
+    static struct UsbBulk_MessageHeader message;
+    static struct UsbBulk_UniverseHeader universe;
+    static struct UsbBulk_Range range;
+    static uint16_t messageLeft;          // Bytes of the current message not read yet
+    static uint16_t blockLeft;            // Bytes of the current universe block not read yet
+    static uint16_t partLeft;             // Bytes of the current header, range or payload not read yet
+    static uint8_t* partDest;
+    static uint32_t blockStarted;
+
+    static uint32_t subscribedMask;
+    static uint16_t subscribedIntervalMs;
+    static uint32_t sentFrames[DMXBUFFER_COUNT]; // DmxBufferStatus.frames when the buffer was last sent
+    static uint32_t sentTime[DMXBUFFER_COUNT];
+    static uint8_t nextInput;             // Round robin, so a full TX FIFO doesn't starve buffers
+
+    static uint8_t scratch[600];
+    static uint8_t frame[512];
+
+    static bool readPart();
+    static void startPart(void* dest, uint16_t length, UsbBulkState nextState);
+    static void messageStarted();
+    static void messageDone();
+    static void universeStarted();
+    static void universeDone();
+    static void nextUniverse();
+    static void invalid();
+    static void sendInput();
+    static bool send(UsbBulk_Commands command, const void* header, uint16_t headerLength, const void* data, uint16_t length);
+};
+
+#endif // __cplusplus && !EDP_HOST
+
+#endif // USB_BULK_H
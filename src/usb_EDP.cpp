@@ -8,13 +8,87 @@ extern DmxBuffer dmxBuffer;
 
 uint8_t Usb_EDP::tmpBuf[600];
 uint8_t Usb_EDP::tmpBuf2[600];
+EdpReassemblySlot Usb_EDP::slots[4];
+EdpReference Usb_EDP::references[4];
 Edp Usb_EDP::edp;
+uint8_t Usb_EDP::response[CFG_TUD_HID_BUFSIZE];
+uint16_t Usb_EDP::reportsReceived;
+uint16_t Usb_EDP::statusFrames;
+uint32_t Usb_EDP::statusSent;
 
 void Usb_EDP::init() {
     memset(tmpBuf, 0x00, 600);
     memset(tmpBuf2, 0x00, 600);
 
-    edp.init(tmpBuf, tmpBuf2, 64, PatchType::ip);
+    edp.init(tmpBuf, tmpBuf2, USB_EDP_CHUNK_SIZE, PatchType::ip, slots, 4);
+    edp.initDelta(references, 4);
+
+    memset(response, 0x00, CFG_TUD_HID_BUFSIZE);
+    reportsReceived = 0;
+    statusFrames = 0;
+    statusSent = 0;
+}
+
+// Sends what is waiting for the IN endpoint: A Pong first, then the status
+// if a frame was finished since the last one or it's due anyway
+void Usb_EDP::cyclicTask() {
+    uint8_t report[CFG_TUD_HID_BUFSIZE];
+
+    if ((getUsbProtocol() != 0) || !tud_hid_ready()) {
+        return;
+    }
+
+    if (response[0]) {
+        if (tud_hid_report(0, response, CFG_TUD_HID_BUFSIZE)) {
+            response[0] = 0;
+        }
+        return;
+    }
+
+    uint16_t frames = edp.stats.framesComplete + edp.stats.framesCrcError + edp.stats.framesTimedOut + edp.stats.framesDropped;
+    if ((frames != statusFrames) || ((time_us_32() - statusSent) >= USB_EDP_STATUS_INTERVAL_US)) {
+        fillStatus(report);
+        if (tud_hid_report(0, report, CFG_TUD_HID_BUFSIZE)) {
+            statusFrames = frames;
+            statusSent = time_us_32();
+        }
+    }
+}
+
+// Report with the HidStatus chunk, returns its size
+uint16_t Usb_EDP::fillStatus(uint8_t* report) {
+    struct Edp_HidStatus status;
+
+    status.reportsReceived = reportsReceived;
+    status.framesComplete = edp.stats.framesComplete;
+    status.framesCrcError = edp.stats.framesCrcError;
+    status.framesLost = edp.stats.framesTimedOut + edp.stats.framesDropped;
+    status.lastUniverse = edp.stats.lastUniverse;
+    status.lastSequence = edp.stats.lastSequence;
+    status.slotsInUse = 0;
+    status.slots = 4;
+    for (uint8_t i = 0; i < 4; i++) {
+        status.slotsInUse += slots[i].inUse;
+    }
+
+    memset(report, 0x00, CFG_TUD_HID_BUFSIZE);
+    report[0] = sizeof(Edp_Commands) + sizeof(struct Edp_HidStatus);
+    report[1] = Edp_Commands::HidStatus;
+    memcpy(report + 2, &status, sizeof(struct Edp_HidStatus));
+    return CFG_TUD_HID_BUFSIZE;
+}
+
+// GET_REPORT on the control endpoint: The same status, for hosts that poll
+uint16_t Usb_EDP::hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen) {
+    // Unused parameters
+    (void) instance;
+    (void) report_id;
+    (void) report_type;
+
+    if (reqlen < CFG_TUD_HID_BUFSIZE) {
+        return 0;
+    }
+    return fillStatus(buffer);
 }
 
 void Usb_EDP::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize) {
@@ -23,8 +97,24 @@ void Usb_EDP::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_
     (void) report_id;
     (void) report_type;
 
-    uint16_t size = MIN(bufsize, 64);
-    memcpy(tmpBuf, buffer, size);
+    uint16_t responseSize;
+
+    // Reports are always padded to the full size, first byte tells how
+    // much of it is the chunk
+    if (bufsize < 1) {
+        return;
+    }
+    reportsReceived++;
+    uint16_t size = MIN(buffer[0], MIN(bufsize - 1, USB_EDP_CHUNK_SIZE));
+    memcpy(tmpBuf, buffer + 1, size);
 
     edp.processIncomingChunk(size);
+
+    // Sent by cyclicTask(), the IN endpoint might be busy with a status
+    responseSize = edp.takeResponse();
+    if (responseSize) {
+        memset(response, 0x00, CFG_TUD_HID_BUFSIZE);
+        response[0] = MIN(responseSize, USB_EDP_CHUNK_SIZE);
+        memcpy(response + 1, tmpBuf2, response[0]);
+    }
 }
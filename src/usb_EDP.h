@@ -6,16 +6,31 @@
 
 #include "edp.h"
 
+// HID reports are CFG_TUD_HID_BUFSIZE (64) byte: 1 byte length + the chunk
+#define USB_EDP_CHUNK_SIZE (CFG_TUD_HID_BUFSIZE - 1)
+
+#define USB_EDP_STATUS_INTERVAL_US  100000 // HidStatus is sent at least this often
+
 #ifdef __cplusplus
 
 class Usb_EDP {
   public:
     static void init();
+    static void cyclicTask(); // Runs on core0, next to tud_task()
     static void hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize);
+    static uint16_t hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen);
 
   private:
+    static uint8_t response[CFG_TUD_HID_BUFSIZE]; // Pong waiting for the IN endpoint, response[0] = 0: none
+    static uint16_t reportsReceived;
+    static uint16_t statusFrames;                 // framesComplete + lost of the last status sent
+    static uint32_t statusSent;
+
+    static uint16_t fillStatus(uint8_t* report);
     static uint8_t tmpBuf[600];
     static uint8_t tmpBuf2[600];
+    static EdpReassemblySlot slots[4];
+    static EdpReference references[4];
 
     static Edp edp;
 };
@@ -0,0 +1,366 @@
+#include "usb_JaRule.h"
+
+#include "device/usbd_pvt.h"    // Class driver interface of TinyUSB
+
+#include <pico/unique_id.h>     // For the MAC in the hardware info
+
+#include "log.h"
+
+#include "dmxbuffer.h"
+#include "rdm.h"
+
+extern uint8_t usb_buffer[24][512];
+
+extern DmxBuffer dmxBuffer;
+extern Rdm rdm;
+
+JaRulePort Usb_JaRule::ports[JARULE_MAX_PORTS];
+uint8_t Usb_JaRule::numPorts;
+uint8_t Usb_JaRule::usbPort;
+uint8_t Usb_JaRule::rdmResponse[RDM_MAX_PACKET];
+
+static usbd_class_driver_t const jaRuleDriver = {
+#if CFG_TUSB_DEBUG >= 2
+    .name             = "JARULE",
+#endif
+    .init             = Usb_JaRule::driverInit,
+    .reset            = Usb_JaRule::driverReset,
+    .open             = Usb_JaRule::driverOpen,
+    .control_xfer_cb  = Usb_JaRule::driverControlXfer,
+    .xfer_cb          = Usb_JaRule::driverXfer,
+    .sof              = NULL,
+};
+
+// TinyUSB tries these before its own class drivers. The Ja Rule interface
+// only exists in the Ja Rule configuration, so nothing else is taken away
+usbd_class_driver_t const* usbd_app_driver_get_cb(uint8_t* driver_count) {
+    *driver_count = 1;
+    return &jaRuleDriver;
+}
+
+// Everything is handled here and not in the transfer callbacks, so a
+// request waiting for the RDM port or for its response to be sent holds
+// off the rest of the port's requests (the host gets NAKs)
+void Usb_JaRule::cyclicTask() {
+    for (uint8_t i = 0; i < numPorts; i++) {
+        JaRulePort* port = &ports[i];
+
+        if (port->rdmPending && !port->inBusy) {
+            rdmTask(i);
+        }
+        if (!port->rdmPending && !port->inBusy) {
+            parse(i);
+        }
+
+        if (!port->outBusy && (port->outPos >= port->outLength)) {
+            port->outLength = 0;
+            port->outPos = 0;
+            port->outBusy = usbd_edpt_xfer(usbPort, port->epOut, port->outBuf, JARULE_EP_SIZE);
+        }
+    }
+}
+
+void Usb_JaRule::driverInit() {
+    driverReset(0);
+}
+
+void Usb_JaRule::driverReset(uint8_t rhport) {
+    (void)rhport;
+
+    memset(ports, 0x00, sizeof(ports));
+    numPorts = 0;
+}
+
+// Endpoints come in pairs, OUT first, one pair per port (usb_descriptors.c)
+uint16_t Usb_JaRule::driverOpen(uint8_t rhport, tusb_desc_interface_t const* itf, uint16_t maxLength) {
+    TU_VERIFY((itf->bInterfaceClass == TUSB_CLASS_VENDOR_SPECIFIC) &&
+        (itf->bInterfaceSubClass == 0xff) && (itf->bInterfaceProtocol == 0xff), 0);
+
+    uint16_t length = sizeof(tusb_desc_interface_t);
+    uint8_t const* desc = tu_desc_next(itf);
+
+    usbPort = rhport;
+    numPorts = 0;
+
+    for (uint8_t i = 0; i < itf->bNumEndpoints; i++) {
+        tusb_desc_endpoint_t const* ep = (tusb_desc_endpoint_t const*)desc;
+
+        TU_ASSERT(((length + sizeof(tusb_desc_endpoint_t)) <= maxLength) && (tu_desc_type(desc) == TUSB_DESC_ENDPOINT), 0);
+        TU_ASSERT(usbd_edpt_open(rhport, ep), 0);
+
+        if ((i / 2) < JARULE_MAX_PORTS) {
+            JaRulePort* port = &ports[i / 2];
+            if (tu_edpt_dir(ep->bEndpointAddress) == TUSB_DIR_IN) {
+                port->epIn = ep->bEndpointAddress;
+                resetParams(port);
+                numPorts = i / 2 + 1;
+            } else {
+                port->epOut = ep->bEndpointAddress;
+            }
+        }
+
+        length += sizeof(tusb_desc_endpoint_t);
+        desc = tu_desc_next(desc);
+    }
+
+    LOG("JaRule: %u ports", numPorts);
+    return length;
+}
+
+bool Usb_JaRule::driverControlXfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request) {
+    // Everything goes over the bulk endpoints
+    return false;
+}
+
+bool Usb_JaRule::driverXfer(uint8_t rhport, uint8_t epAddr, xfer_result_t result, uint32_t xferredBytes) {
+    for (uint8_t i = 0; i < numPorts; i++) {
+        JaRulePort* port = &ports[i];
+
+        if (epAddr == port->epOut) {
+            port->outBusy = false;
+            port->outLength = (result == XFER_RESULT_SUCCESS) ? xferredBytes : 0;
+            port->outPos = 0;
+            return true;
+        }
+
+        if (epAddr == port->epIn) {
+            // OLA reads more than a response can be, so a response filling
+            // the last packet completely needs a ZLP to end the transfer
+            if (port->inZlp && (result == XFER_RESULT_SUCCESS)) {
+                port->inZlp = false;
+                if (usbd_edpt_xfer(rhport, epAddr, NULL, 0)) {
+                    return true;
+                }
+            }
+            port->inBusy = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Same defaults as a real Ja Rule
+void Usb_JaRule::resetParams(JaRulePort* port) {
+    port->params[JaRule_Params::paramBreakTime] = 176;
+    port->params[JaRule_Params::paramMarkTime] = 12;
+    port->params[JaRule_Params::paramRdmBroadcastTimeout] = 28;
+    port->params[JaRule_Params::paramRdmResponseTimeout] = 28;
+    port->params[JaRule_Params::paramRdmDubResponseLimit] = 29;
+    port->params[JaRule_Params::paramRdmResponderDelay] = 2;
+    port->params[JaRule_Params::paramRdmResponderJitter] = 0;
+}
+
+// Collects one request from what the OUT endpoint got. Anything before a
+// SOM is skipped, a request with a payload that is too long is dropped
+void Usb_JaRule::parse(uint8_t portId) {
+    JaRulePort* port = &ports[portId];
+    uint16_t expected;
+    uint16_t count;
+
+    while (port->outPos < port->outLength) {
+        if (!port->requestLength) {
+            if (port->outBuf[port->outPos++] == JARULE_SOM) {
+                port->request[port->requestLength++] = JARULE_SOM;
+            }
+            continue;
+        }
+
+        expected = JARULE_REQUEST_HEADER;
+        if (port->requestLength >= JARULE_REQUEST_HEADER) {
+            expected += (port->request[4] | (port->request[5] << 8)) + 1;
+        }
+
+        count = MIN(port->outLength - port->outPos, expected - port->requestLength);
+        memcpy(port->request + port->requestLength, port->outBuf + port->outPos, count);
+        port->requestLength += count;
+        port->outPos += count;
+
+        if ((port->requestLength == JARULE_REQUEST_HEADER) && ((port->request[4] | (port->request[5] << 8)) > JARULE_MAX_PAYLOAD)) {
+            port->requestLength = 0;
+        } else if ((port->requestLength > JARULE_REQUEST_HEADER) && (port->requestLength == expected)) {
+            handleRequest(portId);
+            port->requestLength = 0;
+            // The next request waits until this one has been answered
+            return;
+        }
+    }
+}
+
+void Usb_JaRule::handleRequest(uint8_t portId) {
+    JaRulePort* port = &ports[portId];
+    uint8_t token = port->request[1];
+    JaRule_Commands command = (JaRule_Commands)(port->request[2] | (port->request[3] << 8));
+    uint16_t length = port->request[4] | (port->request[5] << 8);
+    uint8_t* payload = port->request + JARULE_REQUEST_HEADER;
+    pico_unique_board_id_t id;
+    uint8_t info[14];
+    uint8_t param;
+    RdmRawType rawType;
+
+    if (payload[length] != JARULE_EOM) {
+        // Not a request after all, the host will time out on it
+        return;
+    }
+
+    switch (command) {
+        case JaRule_Commands::JaRuleReset:
+            resetParams(port);
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+            break;
+
+        case JaRule_Commands::JaRuleSetMode:
+            respond(port, token, command,
+                ((length == 1) && (payload[0] == 0)) ? JaRule_ReturnCodes::JaRuleOk : JaRule_ReturnCodes::JaRuleBadParam,
+                NULL, 0, NULL, 0);
+            break;
+
+        case JaRule_Commands::JaRuleGetHardwareInfo:
+            // The MAC is the one of our end of the NCM link
+            pico_get_unique_board_id(&id);
+            info[0] = JARULE_MODEL_ID & 0xff;
+            info[1] = JARULE_MODEL_ID >> 8;
+            for (uint8_t i = 0; i < 6; i++) {
+                info[2 + i] = (Rdm::ownUid >> ((5 - i) * 8)) & 0xff;
+            }
+            info[8] = 0x02;
+            memcpy(info + 9, id.id + 1, 5);
+            info[13] ^= 0x01;
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, info, sizeof(info));
+            break;
+
+        case JaRule_Commands::JaRuleRunSelfTest:
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+            break;
+
+        case JaRule_Commands::JaRuleTxDmx:
+            if (length > 512) {
+                respond(port, token, command, JaRule_ReturnCodes::JaRuleBadParam, NULL, 0, NULL, 0);
+                break;
+            }
+            memcpy(usb_buffer[portId], payload, length);
+            memset(usb_buffer[portId] + length, 0x00, 512 - length);
+            dmxBuffer.setBuffer(portId, usb_buffer[portId], 512, DmxBufferSource::sourceJaRule);
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+            break;
+
+        case JaRule_Commands::JaRuleRdmDubRequest:
+        case JaRule_Commands::JaRuleRdmRequest:
+        case JaRule_Commands::JaRuleRdmBroadcastRequest:
+            rawType = (command == JaRule_Commands::JaRuleRdmDubRequest) ? RdmRawType::rawDiscovery :
+                ((command == JaRule_Commands::JaRuleRdmRequest) ? RdmRawType::rawRequest : RdmRawType::rawBroadcast);
+
+            if (portId >= rdm.portCount()) {
+                // No RDM on this port, so nobody ever answers
+                respond(port, token, command,
+                    (rawType == RdmRawType::rawBroadcast) ? JaRule_ReturnCodes::JaRuleOk : JaRule_ReturnCodes::JaRuleRdmTimeout,
+                    NULL, 0, NULL, 0);
+            } else if (!length || (length > (RDM_MAX_PACKET - 1))) {
+                respond(port, token, command, JaRule_ReturnCodes::JaRuleBadParam, NULL, 0, NULL, 0);
+            } else if (!rdm.queueRaw(portId, rawType, payload, length)) {
+                respond(port, token, command, JaRule_ReturnCodes::JaRuleBufferFull, NULL, 0, NULL, 0);
+            } else {
+                port->rdmPending = true;
+                port->rdmToken = token;
+                port->rdmCommand = command;
+            }
+            break;
+
+        case JaRule_Commands::JaRuleEcho:
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, payload, length);
+            break;
+
+        case JaRule_Commands::JaRuleGetFlags:
+            respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+            break;
+
+        default:
+            if (((command >= JaRule_Commands::JaRuleSetBreakTime) && (command <= JaRule_Commands::JaRuleGetMarkTime)) ||
+                ((command >= JaRule_Commands::JaRuleSetRdmBroadcastTimeout) && (command <= JaRule_Commands::JaRuleGetRdmResponderJitter)))
+            {
+                // SET and GET take turns, first break and mark, then the RDM times.
+                // They are remembered for the host, the ports keep their own timing
+                param = (command < JaRule_Commands::JaRuleSetRdmBroadcastTimeout) ?
+                    ((command - JaRule_Commands::JaRuleSetBreakTime) / 2) :
+                    (JaRule_Params::paramRdmBroadcastTimeout + (command - JaRule_Commands::JaRuleSetRdmBroadcastTimeout) / 2);
+
+                if (command & 0x01) {
+                    info[0] = port->params[param] & 0xff;
+                    info[1] = port->params[param] >> 8;
+                    respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, info, 2);
+                } else if (length == 2) {
+                    port->params[param] = payload[0] | (payload[1] << 8);
+                    respond(port, token, command, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+                } else {
+                    respond(port, token, command, JaRule_ReturnCodes::JaRuleBadParam, NULL, 0, NULL, 0);
+                }
+            } else {
+                respond(port, token, command, JaRule_ReturnCodes::JaRuleUnknownCommand, NULL, 0, NULL, 0);
+            }
+            break;
+    }
+}
+
+// Answers the RDM request once the RDM port is done with it. Framed
+// responses go to the host with their start code, after the timing
+void Usb_JaRule::rdmTask(uint8_t portId) {
+    JaRulePort* port = &ports[portId];
+    struct JaRule_DubTiming dubTiming;
+    struct JaRule_GetSetTiming getSetTiming;
+    uint16_t length = 0;
+
+    RdmRequestStatus status = rdm.getRaw(portId, rdmResponse, &length);
+
+    if ((status == RdmRequestStatus::requestQueued) || (status == RdmRequestStatus::requestInFlight)) {
+        return;
+    }
+
+    memset(&dubTiming, 0x00, sizeof(dubTiming));
+    memset(&getSetTiming, 0x00, sizeof(getSetTiming));
+
+    if (status == RdmRequestStatus::requestBroadcast) {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleOk, NULL, 0, NULL, 0);
+    } else if ((status == RdmRequestStatus::requestDone) && (port->rdmCommand == JaRule_Commands::JaRuleRdmDubRequest)) {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleOk,
+            &dubTiming, sizeof(dubTiming), rdmResponse, length);
+    } else if ((status == RdmRequestStatus::requestDone) && (length > 1) && (rdmResponse[0] == 0xcc)) {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleOk,
+            &getSetTiming, sizeof(getSetTiming), rdmResponse, length);
+    } else if (status == RdmRequestStatus::requestDone) {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleRdmInvalidResponse, NULL, 0, NULL, 0);
+    } else if (status == RdmRequestStatus::requestTimeout) {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleRdmTimeout, NULL, 0, NULL, 0);
+    } else {
+        respond(port, port->rdmToken, port->rdmCommand, JaRule_ReturnCodes::JaRuleTxError, NULL, 0, NULL, 0);
+    }
+
+    rdm.freeRaw(portId);
+    port->rdmPending = false;
+}
+
+// header and data are the payload, header is what a response puts in
+// front of data it got from somewhere else
+void Usb_JaRule::respond(JaRulePort* port, uint8_t token, uint16_t command, JaRule_ReturnCodes returnCode, const void* header, uint16_t headerLength, const void* data, uint16_t length) {
+    uint8_t* message = port->response;
+    uint16_t payloadLength = headerLength + length;
+    uint16_t total = JARULE_RESPONSE_HEADER + payloadLength + 1;
+
+    message[0] = JARULE_SOM;
+    message[1] = token;
+    message[2] = command & 0xff;
+    message[3] = command >> 8;
+    message[4] = payloadLength & 0xff;
+    message[5] = payloadLength >> 8;
+    message[6] = returnCode;
+    message[7] = 0x00; // Flags, none of them is ever set
+    if (headerLength) {
+        memcpy(message + JARULE_RESPONSE_HEADER, header, headerLength);
+    }
+    if (length) {
+        memcpy(message + JARULE_RESPONSE_HEADER + headerLength, data, length);
+    }
+    message[JARULE_RESPONSE_HEADER + payloadLength] = JARULE_EOM;
+
+    port->inZlp = !(total % JARULE_EP_SIZE);
+    port->inBusy = usbd_edpt_xfer(usbPort, port->epIn, message, total);
+}
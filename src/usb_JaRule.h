@@ -0,0 +1,142 @@
+#ifndef USB_JARULE_H
+#define USB_JARULE_H
+
+#include <stdint.h>
+
+#include "tusb.h"
+
+#include "rdm.h"
+
+// Ja Rule emulation (USB protocol 1), for OLA's native Ja Rule plugin
+//
+// OLA treats every bulk endpoint pair (same number, IN and OUT) of a vendor
+// interface with subclass and protocol 0xff as one port and takes the RDM
+// UID from the serial number string. The RP2040 only has 15 endpoint
+// numbers besides EP0 and the console (CDC ACM) and web interface (NCM)
+// keep 4 of them, so there are 11 ports instead of 16. Port n writes DMX
+// buffer n, its RDM frames go to RDM port n (rdm.h)
+//
+// Each port is a stream of requests, answered one after the other:
+// Request:  SOM, token, command, length, payload, EOM
+// Response: SOM, token, command, length, return code, flags, payload, EOM
+// command and length are 16 bit little endian, length is the payload's
+#define JARULE_MAX_PORTS          11
+#define JARULE_EP_SIZE            64
+#define JARULE_SOM              0x5a
+#define JARULE_EOM              0xa5
+#define JARULE_MAX_PAYLOAD       513
+#define JARULE_REQUEST_HEADER      6
+#define JARULE_RESPONSE_HEADER     8
+#define JARULE_MAX_MESSAGE      (JARULE_RESPONSE_HEADER + JARULE_MAX_PAYLOAD + 1)
+#define JARULE_MODEL_ID       0x2040 // None of the real Ja Rule boards
+
+#ifdef __cplusplus
+
+enum JaRule_Commands : uint16_t {
+    JaRuleReset                   = 0x00,
+    JaRuleSetMode                 = 0x01, // 0 = controller, responder mode is not supported
+    JaRuleGetHardwareInfo         = 0x02, // Model ID (16 bit), UID, MAC
+    JaRuleRunSelfTest             = 0x03,
+    JaRuleSetBreakTime            = 0x10, // µs
+    JaRuleGetBreakTime            = 0x11,
+    JaRuleSetMarkTime             = 0x12, // µs
+    JaRuleGetMarkTime             = 0x13,
+    JaRuleSetRdmBroadcastTimeout  = 0x20, // All RDM times in 1/10 ms
+    JaRuleGetRdmBroadcastTimeout  = 0x21,
+    JaRuleSetRdmResponseTimeout   = 0x22,
+    JaRuleGetRdmResponseTimeout   = 0x23,
+    JaRuleSetRdmDubResponseLimit  = 0x24,
+    JaRuleGetRdmDubResponseLimit  = 0x25,
+    JaRuleSetRdmResponderDelay    = 0x26,
+    JaRuleGetRdmResponderDelay    = 0x27,
+    JaRuleSetRdmResponderJitter   = 0x28,
+    JaRuleGetRdmResponderJitter   = 0x29,
+    JaRuleTxDmx                   = 0x30, // Up to 512 slots, no start code
+    JaRuleRdmDubRequest           = 0x31, // RDM frames without start code
+    JaRuleRdmRequest              = 0x32,
+    JaRuleRdmBroadcastRequest     = 0x33,
+    JaRuleEcho                    = 0xf0,
+    JaRuleGetFlags                = 0xf2,
+};
+
+enum JaRule_ReturnCodes : uint8_t {
+    JaRuleOk                      = 0,
+    JaRuleUnknownCommand          = 1,
+    JaRuleBufferFull              = 2,
+    JaRuleBadParam                = 3,
+    JaRuleTxError                 = 4,
+    JaRuleRdmTimeout              = 5,
+    JaRuleRdmBroadcastResponse    = 6,
+    JaRuleRdmInvalidResponse      = 7,
+    JaRuleInvalidMode             = 8,
+};
+
+// Index into JaRulePort.params, one per SET/GET pair
+enum JaRule_Params : uint8_t {
+    paramBreakTime                = 0,
+    paramMarkTime                 = 1,
+    paramRdmBroadcastTimeout      = 2,
+    paramRdmResponseTimeout       = 3,
+    paramRdmDubResponseLimit      = 4,
+    paramRdmResponderDelay        = 5,
+    paramRdmResponderJitter       = 6,
+    paramCount                    = 7,
+};
+
+// Put in front of RDM responses. Times in 1/10 µs, we don't measure them
+struct JaRule_DubTiming {
+    uint16_t              start;
+    uint16_t              end;
+} __attribute__((__packed__));
+
+struct JaRule_GetSetTiming {
+    uint16_t              breakStart;
+    uint16_t              markStart;
+    uint16_t              markEnd;
+} __attribute__((__packed__));
+
+struct JaRulePort {
+    uint8_t               epOut;
+    uint8_t               epIn;
+    bool                  outBusy;                 // OUT transfer queued, waiting for the host
+    uint8_t               outLength;               // Bytes in outBuf ...
+    uint8_t               outPos;                  // ... and how many have been parsed
+    bool                  inBusy;                  // Response on its way to the host
+    bool                  inZlp;                   // Response is a multiple of JARULE_EP_SIZE, needs a ZLP
+    bool                  rdmPending;              // Waiting for the RDM port
+    uint8_t               rdmToken;
+    JaRule_Commands       rdmCommand;
+    uint16_t              requestLength;           // Bytes of the current request in request[]
+    uint16_t              params[paramCount];
+    uint8_t               outBuf[JARULE_EP_SIZE];
+    uint8_t               request[JARULE_MAX_MESSAGE];
+    uint8_t               response[JARULE_MAX_MESSAGE];
+};
+
+class Usb_JaRule {
+  public:
+    static void cyclicTask(); // Runs on core0, next to tud_task()
+
+    // TinyUSB class driver for the Ja Rule interface (usbd_app_driver_get_cb)
+    static void driverInit();
+    static void driverReset(uint8_t rhport);
+    static uint16_t driverOpen(uint8_t rhport, tusb_desc_interface_t const* itf, uint16_t maxLength);
+    static bool driverControlXfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request);
+    static bool driverXfer(uint8_t rhport, uint8_t epAddr, xfer_result_t result, uint32_t xferredBytes);
+
+  private:
+    static JaRulePort ports[JARULE_MAX_PORTS];
+    static uint8_t numPorts;
+    static uint8_t usbPort;               // rhport the interface was opened on
+    static uint8_t rdmResponse[RDM_MAX_PACKET];
+
+    static void resetParams(JaRulePort* port);
+    static void parse(uint8_t portId);
+    static void handleRequest(uint8_t portId);
+    static void rdmTask(uint8_t portId);
+    static void respond(JaRulePort* port, uint8_t token, uint16_t command, JaRule_ReturnCodes returnCode, const void* header, uint16_t headerLength, const void* data, uint16_t length);
+};
+
+#endif // __cplusplus
+
+#endif // USB_JARULE_H
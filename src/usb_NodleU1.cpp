@@ -36,7 +36,7 @@ void Usb_NodleU1::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_rep
 
         // Check if this was the last transfer = DMX frame is complete
         if (buffer[0] == 15) {
-            dmxBuffer.setBuffer(0, usb_buffer[0], 512);
+            dmxBuffer.setBuffer(0, usb_buffer[0], 512, DmxBufferSource::sourceNodleU1);
         }
     } else if (buffer[0] == 32) {
         uint8_t uni = (buffer[1] >> 4) & 0xF;
@@ -50,7 +50,7 @@ void Usb_NodleU1::hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_rep
 
         // Check if this was the last transfer = DMX frame is complete
         if (offset == 8) {
-            dmxBuffer.setBuffer(uni, usb_buffer[uni], 512);
+            dmxBuffer.setBuffer(uni, usb_buffer[uni], 512, DmxBufferSource::sourceNodleU1);
         }
     }
 }
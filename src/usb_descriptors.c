@@ -30,6 +30,8 @@
 
 #include "version.h"
 #include "boardconfig.h"
+#include "rdm.h"
+#include "usb_JaRule.h"
 
 // Yeah, we got an official USB id:
 // https://github.com/pidcodes/pidcodes.github.com/blob/master/1209/ACEB/index.md
@@ -47,6 +49,7 @@ enum
   STRID_CDC_NCM_IFNAME,
   STRID_MAC,
   STRID_VENDOR,
+  STRID_JARULE,
 };
 
 // Available interfaces
@@ -62,6 +65,17 @@ enum {
     ITF_NUM_TOTAL
 };
 
+// The Ja Rule interface takes the place of HID, so the CDC interfaces keep
+// their numbers (the MS OS 2.0 descriptor below points to the NCM one)
+enum {
+    ITF_NUM_JARULE_PORTS,
+    ITF_NUM_JARULE_CDC_ACM_CMD,
+    ITF_NUM_JARULE_CDC_ACM_DATA,
+    ITF_NUM_JARULE_CDC_NCM_CMD,
+    ITF_NUM_JARULE_CDC_NCM_DATA,
+    ITF_NUM_JARULE_TOTAL
+};
+
 // Available configurations
 // Since NCM works on Linux, macOS and Windows hosts, we just have one config
 enum
@@ -175,7 +189,7 @@ uint8_t const ncm_configuration[] =
     // Interface number, string index, protocol, report descriptor len, EP In & Out address, size & polling interval
     TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE,
         sizeof(desc_hid_report), EPNUM_HID_OUT, EPNUM_HID_IN,
-        CFG_TUD_HID_BUFSIZE, 5),
+        CFG_TUD_HID_BUFSIZE, 1),
 
     // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_ACM_CMD, STRID_CDC_ACM_IFNAME, EPNUM_CDC_ACM_CMD,
@@ -189,12 +203,54 @@ uint8_t const ncm_configuration[] =
     TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STRID_VENDOR, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 64),
 };
 
+// Ja Rule emulation: Every bulk endpoint pair is one port for OLA. The
+// CDC interfaces use endpoints 3 to 6, all the others are ports
+#define TUD_JARULE_PORT_DESCRIPTOR(_epnum) \
+    7, TUSB_DESC_ENDPOINT, _epnum, TUSB_XFER_BULK, U16_TO_U8S_LE(JARULE_EP_SIZE), 0, \
+    7, TUSB_DESC_ENDPOINT, 0x80 | _epnum, TUSB_XFER_BULK, U16_TO_U8S_LE(JARULE_EP_SIZE), 0
+
+#define CONFIG_JARULE_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + 9 + JARULE_MAX_PORTS * 14 + TUD_CDC_DESC_LEN + TUD_CDC_NCM_DESC_LEN)
+
+uint8_t const jarule_configuration[] =
+{
+    // Config number, interface count, string index, total length, attribute, power in mA
+    TUD_CONFIG_DESCRIPTOR(CONFIG_ID_NCM+1, ITF_NUM_JARULE_TOTAL, 0, CONFIG_JARULE_TOTAL_LEN,
+        TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 500),
+
+    // Interface: Vendor class, subclass and protocol 0xff is what OLA looks for
+    9, TUSB_DESC_INTERFACE, ITF_NUM_JARULE_PORTS, 0, JARULE_MAX_PORTS * 2, TUSB_CLASS_VENDOR_SPECIFIC, 0xff, 0xff, STRID_JARULE,
+    TUD_JARULE_PORT_DESCRIPTOR(0x01),
+    TUD_JARULE_PORT_DESCRIPTOR(0x02),
+    TUD_JARULE_PORT_DESCRIPTOR(0x07),
+    TUD_JARULE_PORT_DESCRIPTOR(0x08),
+    TUD_JARULE_PORT_DESCRIPTOR(0x09),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0a),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0b),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0c),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0d),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0e),
+    TUD_JARULE_PORT_DESCRIPTOR(0x0f),
+
+    TUD_CDC_DESCRIPTOR(ITF_NUM_JARULE_CDC_ACM_CMD, STRID_CDC_ACM_IFNAME, EPNUM_CDC_ACM_CMD,
+        USBD_CDC_CMD_MAX_SIZE, EPNUM_CDC_ACM_OUT, EPNUM_CDC_ACM_IN,
+        USBD_CDC_IN_OUT_MAX_SIZE),
+
+    TUD_CDC_NCM_DESCRIPTOR(ITF_NUM_JARULE_CDC_NCM_CMD, STRID_CDC_NCM_IFNAME, STRID_MAC, EPNUM_CDC_NCM_CMD, 64, EPNUM_CDC_NCM_OUT, EPNUM_CDC_NCM_IN, CFG_TUD_NET_ENDPOINT_SIZE, CFG_TUD_NET_MTU),
+};
+
+TU_VERIFY_STATIC(sizeof(jarule_configuration) == CONFIG_JARULE_TOTAL_LEN, "Incorrect size");
+TU_VERIFY_STATIC(JARULE_MAX_PORTS == 11, "Endpoint list above doesn't match JARULE_MAX_PORTS");
+TU_VERIFY_STATIC(ITF_NUM_JARULE_CDC_NCM_CMD == ITF_NUM_CDC_NCM_CMD, "MS OS 2.0 descriptor points to the wrong interface");
+
 // Invoked when received GET CONFIGURATION DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
 uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
 {
     (void) index; // for multiple configurations
+    if (getUsbProtocol() == 1) {
+        return jarule_configuration;
+    }
     return ncm_configuration;
 }
 
@@ -344,7 +400,8 @@ char const *string_desc_arr[] =
     [STRID_CDC_ACM_IFNAME] = "Debugging Console",                    // 4: CDC ACM interface name
     [STRID_CDC_NCM_IFNAME] = "Network Interface",                    // 5: CDC NCM interface name
     [STRID_MAC]            = "000000000000",                         // 6: MAC address is handled in tud_descriptor_string_cb
-    [STRID_VENDOR]         = "WebUSB"                                // 7: Vendor Interface
+    [STRID_VENDOR]         = "WebUSB",                               // 7: Vendor Interface
+    [STRID_JARULE]         = "Ja Rule"                               // 8: Ja Rule Interface
 };
 
 static uint16_t _desc_str[128];
@@ -356,7 +413,10 @@ uint16_t const *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
     char *str = NULL;
     uint8_t chr_count = 0;
 
-    if (index == STRID_SERIAL) {
+    if ((index == STRID_SERIAL) && (getUsbProtocol() == 1)) {
+        // OLA takes a Ja Rule's UID from its serial number
+        str = getRdmUidString();
+    } else if (index == STRID_SERIAL) {
         // Serial number has been requested, construct it from the  board id
         str = getBoardSerialString();
     } else if (index == STRID_PRODUCT) {
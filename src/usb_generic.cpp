@@ -19,12 +19,11 @@ uint8_t usb_buffer[24][512] = {0};
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen) {
-    // TODO not Implemented
-    (void) instance;
-    (void) report_id;
-    (void) report_type;
-    (void) buffer;
-    (void) reqlen;
+    uint8_t usbProtocol = getUsbProtocol();
+
+    if (usbProtocol == 0) {
+        return Usb_EDP::hid_get_report_cb(instance, report_id, report_type, buffer, reqlen);
+    }
 
     return 0;
 }
@@ -36,9 +35,6 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 
   if (usbProtocol == 0) {
     Usb_EDP::hid_set_report_cb(instance, report_id, report_type, buffer, bufsize);
-  } else if (usbProtocol == 1) {
-    // JaRule emulation
-    // TODO
   } else if ((usbProtocol == 4) || (usbProtocol == 5)) {
     // Nodle U1 emulation
     Usb_NodleU1::hid_set_report_cb(instance, report_id, report_type, buffer, bufsize);
@@ -4,6 +4,9 @@
 
 #include <pico/unique_id.h>
 
+#include <lwip/mem.h>
+#include <lwip/apps/fs.h>
+
 #include "snappy.h"
 
 #include "json/json.h"
@@ -14,6 +17,8 @@
 #include "dmxbuffer.h"
 #include "wireless.h"
 #include "dhcpdata.h"
+#include "localdmx.h"
+#include "rdm.h"
 
 #define MAGIC_ENUM_RANGE_MAX 255
 #include "../lib/magic_enum/include/magic_enum.hpp"
@@ -22,6 +27,8 @@ extern StatusLeds statusLeds;
 extern BoardConfig boardConfig;
 extern DmxBuffer dmxBuffer;
 extern Wireless wireless;
+extern LocalDmx localDmx;
+extern Rdm rdm;
 
 extern char __StackLimit; /* Set by linker.  */
 
@@ -67,14 +74,42 @@ static const tCGI cgi_handlers[] = {
     "/config/wireless/set.json",
     cgi_config_wireless_set
   },
+  {
+    "/config/wireless/spectrum/set.json",
+    cgi_config_wireless_spectrum_set
+  },
   {
     "/dmxBuffer/set.json",
     cgi_dmxBuffer_set
   },
+  {
+    "/dmxBuffer/interpolation/set.json",
+    cgi_dmxBuffer_interpolation_set
+  },
+  {
+    "/dmxBuffer/loss/set.json",
+    cgi_dmxBuffer_loss_set
+  },
   {
     "/config/partyMode/set.json",
     cgi_config_partyMode_set
   },
+  {
+    "/config/portTiming/set.json",
+    cgi_config_portTiming_set
+  },
+  {
+    "/rdm/discovery.json",
+    cgi_rdm_discovery
+  },
+  {
+    "/rdm/request.json",
+    cgi_rdm_request
+  },
+  {
+    "/rdm/get.json",
+    cgi_rdm_get
+  },
 };
 
 // This array doesn't need elements since we are using LWIP_HTTPD_SSI_RAW
@@ -91,6 +126,39 @@ void WebServer::cyclicTask() {
     service_traffic();
 }
 
+// LWIP_HTTPD_FILE_STATE: Called when httpd opens a file for a connection
+void *fs_state_init(struct fs_file *file, const char *name) {
+    if (strncmp(name, "/rdm/", 5)) {
+        return nullptr;
+    }
+    return mem_calloc(1, sizeof(struct WebServerConnectionState));
+}
+
+void fs_state_free(struct fs_file *file, void *state) {
+    if (state) {
+        mem_free(state);
+    }
+}
+
+// LWIP_HTTPD_CGI_SSI: Called with the file's state after the CGI picked the
+// file, so the SSI tags see this request's parameters and not another's
+void httpd_cgi_handler(struct fs_file *file, const char* uri, int iNumParams, char **pcParam, char **pcValue, void *connection_state) {
+    WebServerConnectionState* state = (WebServerConnectionState*)connection_state;
+    std::map<std::string, std::string> params;
+
+    if (!state) {
+        return;
+    }
+
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+    if (params.contains(std::string("port"))) {
+        state->rdmPort = atoi(params["port"].c_str());
+    }
+    if (params.contains(std::string("request"))) {
+        state->rdmRequest = atoi(params["request"].c_str());
+    }
+}
+
 void WebServer::ipToString(uint32_t ip, char* ipString) {
     sprintf(ipString, "%ld.%ld.%ld.%ld", (ip & 0xff), ((ip >> 8) & 0xff), ((ip >> 16) & 0xff), ((ip >> 24) & 0xff));
 }
@@ -230,7 +298,8 @@ static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcP
 
     std::string decoded;
 
-    // role, channel, address, compress, sparse, rate, power
+    // role, channel, address, compress, sparse, rate, power, fec, noAck, hop, adaptive, telemetry,
+    // dual, channel2, universes2
 
     LOG("ConfigWirelessSet CONFIG PRE:");
     LOG("ConfigWirelessSet role is %d", boardConfig.activeConfig->radioRole);
@@ -240,6 +309,14 @@ static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcP
     LOG("ConfigWirelessSet allowSparse is %d", boardConfig.activeConfig->radioParams.allowSparse);
     LOG("ConfigWirelessSet rate is %d", boardConfig.activeConfig->radioParams.dataRate);
     LOG("ConfigWirelessSet txPower is %d", boardConfig.activeConfig->radioParams.txPower);
+    LOG("ConfigWirelessSet fecParity is %d", boardConfig.activeConfig->radioParams.fecParity);
+    LOG("ConfigWirelessSet noAck is %d", boardConfig.activeConfig->radioParams.noAck);
+    LOG("ConfigWirelessSet hopping is %d", boardConfig.activeConfig->radioParams.hopping);
+    LOG("ConfigWirelessSet adaptive is %d", boardConfig.activeConfig->radioParams.adaptive);
+    LOG("ConfigWirelessSet telemetry is %d", boardConfig.activeConfig->radioParams.telemetry);
+    LOG("ConfigWirelessSet dual is %d", boardConfig.activeConfig->radioDual);
+    LOG("ConfigWirelessSet channel2 is %d", boardConfig.activeConfig->radioChannel2);
+    LOG("ConfigWirelessSet universes2 is %d", boardConfig.activeConfig->radioUniverses2);
 
     if (params.contains(std::string("role"))) {
         boardConfig.activeConfig->radioRole = (RadioRole)atoi(params["role"].c_str());
@@ -282,6 +359,55 @@ static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcP
         LOG("ConfigWirelessSet txPower is now %d", boardConfig.activeConfig->radioParams.txPower);
     }
 
+    if (params.contains(std::string("fec"))) {
+        boardConfig.activeConfig->radioParams.fecParity = MIN(MAX(atoi(params["fec"].c_str()), 0), EDP_FEC_MAX_PARITY);
+        LOG("ConfigWirelessSet fecParity is now %d", boardConfig.activeConfig->radioParams.fecParity);
+    }
+
+    if (params.contains(std::string("noAck"))) {
+        boardConfig.activeConfig->radioParams.noAck = false;
+        if (params["noAck"] == "true") {
+            boardConfig.activeConfig->radioParams.noAck = true;
+        }
+        LOG("ConfigWirelessSet noAck is now %d", boardConfig.activeConfig->radioParams.noAck);
+    }
+
+    if (params.contains(std::string("hop"))) {
+        boardConfig.activeConfig->radioParams.hopping = MIN(MAX(atoi(params["hop"].c_str()), 0), RadioHopping::hopFollower);
+        LOG("ConfigWirelessSet hopping is now %d", boardConfig.activeConfig->radioParams.hopping);
+    }
+
+    if (params.contains(std::string("adaptive"))) {
+        boardConfig.activeConfig->radioParams.adaptive = false;
+        if (params["adaptive"] == "true") {
+            boardConfig.activeConfig->radioParams.adaptive = true;
+        }
+        LOG("ConfigWirelessSet adaptive is now %d", boardConfig.activeConfig->radioParams.adaptive);
+    }
+
+    if (params.contains(std::string("telemetry"))) {
+        boardConfig.activeConfig->radioParams.telemetry = false;
+        if (params["telemetry"] == "true") {
+            boardConfig.activeConfig->radioParams.telemetry = true;
+        }
+        LOG("ConfigWirelessSet telemetry is now %d", boardConfig.activeConfig->radioParams.telemetry);
+    }
+
+    if (params.contains(std::string("dual"))) {
+        boardConfig.activeConfig->radioDual = (RadioDual)MIN(MAX(atoi(params["dual"].c_str()), 0), RadioDual::dualBalanced);
+        LOG("ConfigWirelessSet dual is now %d", boardConfig.activeConfig->radioDual);
+    }
+
+    if (params.contains(std::string("channel2"))) {
+        boardConfig.activeConfig->radioChannel2 = atoi(params["channel2"].c_str());
+        LOG("ConfigWirelessSet channel2 is now %d", boardConfig.activeConfig->radioChannel2);
+    }
+
+    if (params.contains(std::string("universes2"))) {
+        boardConfig.activeConfig->radioUniverses2 = atoi(params["universes2"].c_str()) & ((1 << WIRELESS_UNIVERSES) - 1);
+        LOG("ConfigWirelessSet universes2 is now %d", boardConfig.activeConfig->radioUniverses2);
+    }
+
     return "/empty.json";
 }
 
@@ -315,6 +441,236 @@ static const char *cgi_config_partyMode_set(int iIndex, int iNumParams, char *pc
     return "/empty.json";
 }
 
+static const char *cgi_config_portTiming_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (!params.contains(std::string("port"))) {
+        return "/empty.json";
+    }
+
+    uint8_t port = atoi(params["port"].c_str());
+    if (port >= LOCALDMX_COUNT) {
+        return "/empty.json";
+    }
+    PortTiming* timing = &boardConfig.activeConfig->portTiming[port];
+
+    if (params.contains(std::string("break"))) {
+        timing->breakUs = MIN(MAX(atoi(params["break"].c_str()), 88), 1000);
+    }
+
+    if (params.contains(std::string("mab"))) {
+        timing->mabUs = MIN(MAX(atoi(params["mab"].c_str()), 8), 255);
+    }
+
+    if (params.contains(std::string("interSlot"))) {
+        timing->interSlotUs = MIN(MAX(atoi(params["interSlot"].c_str()), 0), 255);
+    }
+
+    if (params.contains(std::string("mode"))) {
+        timing->slotMode = (params["mode"] == "auto") ? PortTimingSlots::slotsHighestNonZero : PortTimingSlots::slotsFixed;
+        localDmx.resetHighestUsed(port);
+    }
+
+    if (params.contains(std::string("slots"))) {
+        timing->slots = MIN(MAX(atoi(params["slots"].c_str()), 0), 512);
+    }
+
+    if (params.contains(std::string("output"))) {
+        if (params["output"] == "onChange") {
+            timing->outputMode = PortOutputMode::outputOnChange;
+        } else if (params["output"] == "cadence") {
+            timing->outputMode = PortOutputMode::outputCadence;
+        } else {
+            timing->outputMode = PortOutputMode::outputContinuous;
+        }
+    }
+
+    // E1.11 allows at most 1s between two BREAKs
+    if (params.contains(std::string("interval"))) {
+        timing->intervalMs = MIN(MAX(atoi(params["interval"].c_str()), 1), 1000);
+    }
+
+    LOG("Port %u timing: BREAK %uus, MAB %uus, inter-slot %uus, mode %u, slots %u, output %u, interval %ums", port,
+        timing->breakUs, timing->mabUs, timing->interSlotUs, timing->slotMode, timing->slots, timing->outputMode, timing->intervalMs);
+
+    return "/empty.json";
+}
+
+static const char *cgi_rdm_discovery(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (params.contains(std::string("port"))) {
+        rdm.startDiscovery(atoi(params["port"].c_str()));
+    } else {
+        for (uint8_t i = 0; i < rdm.portCount(); i++) {
+            rdm.startDiscovery(i);
+        }
+    }
+
+    return "/empty.json";
+}
+
+// Queues a GET or SET. The result shows up in /rdm/get.json?port=<port>&request=<id>
+// Parameters: port, uid (MMMM:DDDDDDDD), cc (get|set), pid, sub, data (hex)
+static const char *cgi_rdm_request(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    unsigned int manufacturer = 0;
+    unsigned int device = 0;
+    uint8_t pd[RDM_MAX_PDL];
+    uint8_t pdl = 0;
+
+    if (!params.contains(std::string("port")) ||
+        !params.contains(std::string("uid")) ||
+        !params.contains(std::string("pid")) ||
+        (sscanf(params["uid"].c_str(), "%x:%x", &manufacturer, &device) != 2))
+    {
+        return "/empty.json";
+    }
+
+    RdmCommandClass commandClass = (params["cc"] == "set") ? RdmCommandClass::SetCommand : RdmCommandClass::GetCommand;
+    uint16_t pid = strtoul(params["pid"].c_str(), nullptr, 0);
+    uint16_t subDevice = params.contains(std::string("sub")) ? strtoul(params["sub"].c_str(), nullptr, 0) : 0;
+
+    if (params.contains(std::string("data"))) {
+        const std::string& data = params["data"];
+        for (size_t i = 0; ((i + 1) < data.length()) && (pdl < RDM_MAX_PDL); i += 2) {
+            pd[pdl++] = strtoul(data.substr(i, 2).c_str(), nullptr, 16);
+        }
+    }
+
+    int id = rdm.queueRequest(atoi(params["port"].c_str()), ((uint64_t)manufacturer << 32) | device, commandClass, pid, subDevice, pd, pdl);
+    LOG("RDM request queued with id %d", id);
+
+    return "/empty.json";
+}
+
+// Without parameters /rdm/get.json is a summary of all ports
+// Parameters: port (TOD and requests of that port), request (response data of that request)
+// Only picks the file, httpd_cgi_handler() stores the parameters for its tags
+static const char *cgi_rdm_get(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (!params.contains(std::string("port"))) {
+        return "/rdm/get.json";
+    }
+
+    if (params.contains(std::string("request"))) {
+        return "/rdm/response.json";
+    }
+
+    return "/rdm/port.json";
+}
+
+// Parameters: buffer, enabled (0|1), fixed (channels that are not
+// interpolated, 1-based, e.g. "5,9-12"). "fixed" replaces the previous list
+static const char *cgi_dmxBuffer_interpolation_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (!params.contains(std::string("buffer"))) {
+        return "/empty.json";
+    }
+    uint8_t bufferId = atoi(params["buffer"].c_str());
+
+    if (params.contains(std::string("enabled"))) {
+        dmxBuffer.setInterpolation(bufferId, (bool)atoi(params["enabled"].c_str()));
+    }
+
+    if (params.contains(std::string("fixed"))) {
+        std::string fixed = WebServer::urlDecode(params["fixed"]);
+        const char* pos = fixed.c_str();
+        char* end;
+
+        for (uint16_t channel = 0; channel < 512; channel++) {
+            dmxBuffer.setInterpolationFixed(bufferId, channel, false);
+        }
+
+        while (*pos) {
+            long first = strtol(pos, &end, 10);
+            long last = first;
+            if (end == pos) {
+                break;
+            }
+            if (*end == '-') {
+                pos = end + 1;
+                last = strtol(pos, &end, 10);
+            }
+            for (long channel = MAX(first, 1); channel <= MIN(last, 512); channel++) {
+                dmxBuffer.setInterpolationFixed(bufferId, channel - 1, true);
+            }
+            pos = (*end == ',') ? end + 1 : end;
+        }
+    }
+
+    return "/empty.json";
+}
+
+// Parameters: buffer, policy (hold|fade|backup), timeout (ms, 0 = never), backup (buffer id)
+static const char *cgi_dmxBuffer_loss_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (!params.contains(std::string("buffer"))) {
+        return "/empty.json";
+    }
+
+    uint8_t bufferId = atoi(params["buffer"].c_str());
+    if (bufferId >= DMXBUFFER_COUNT) {
+        return "/empty.json";
+    }
+    BufferLossParams* loss = &boardConfig.activeConfig->bufferLoss[bufferId];
+
+    if (params.contains(std::string("policy"))) {
+        if (params["policy"] == "fade") {
+            loss->policy = LossPolicy::lossFade;
+        } else if (params["policy"] == "backup") {
+            loss->policy = LossPolicy::lossBackup;
+        } else {
+            loss->policy = LossPolicy::lossHold;
+        }
+    }
+
+    if (params.contains(std::string("timeout"))) {
+        loss->timeoutMs = MIN(MAX(atoi(params["timeout"].c_str()), 0), 65535);
+    }
+
+    if (params.contains(std::string("backup"))) {
+        loss->backupBuffer = MIN(MAX(atoi(params["backup"].c_str()), 0), DMXBUFFER_COUNT - 1);
+    }
+
+    LOG("Buffer %u loss policy: %u, timeout %ums, backup %u", bufferId, loss->policy, loss->timeoutMs, loss->backupBuffer);
+
+    return "/empty.json";
+}
+
+static const char *cgi_config_wireless_spectrum_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    std::map<std::string, std::string> params;
+    WebServer::paramsToMap(iNumParams, pcParam, pcValue, &params);
+
+    if (params.contains(std::string("highRes"))) {
+        wireless.spectrumHighRes = (params["highRes"] == "true");
+        LOG("ConfigWirelessSpectrumSet highRes is now %d", wireless.spectrumHighRes);
+    }
+
+    if (params.contains(std::string("reset"))) {
+        wireless.spectrumReset();
+    }
+
+    return "/empty.json";
+}
+
 static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
 {
     uint8_t bufferId = 0;
@@ -343,7 +699,7 @@ static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[]
 
     if (!params.contains(std::string("data"))) {
         // Set a single channel
-        dmxBuffer.setChannel(bufferId, channel, value);
+        dmxBuffer.setChannel(bufferId, channel, value, DmxBufferSource::sourceWeb);
     } else {
         // TODO: Common, global methods for Base64-decode + Snappy decompress!
         LOG("Set complete buffer: %s", data);
@@ -354,7 +710,7 @@ static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[]
         if (snappy::GetUncompressedLength((const char*)WebServer::tmpBuf, decodedLength, &uncompressedLength) == true) {
             LOG("uncompressedLength: %d", uncompressedLength);
             if (snappy::RawUncompress((const char*)WebServer::tmpBuf, decodedLength, (char*)WebServer::tmpBuf2) == true) {
-                dmxBuffer.setBuffer(bufferId, WebServer::tmpBuf2, uncompressedLength);
+                dmxBuffer.setBuffer(bufferId, WebServer::tmpBuf2, uncompressedLength, DmxBufferSource::sourceWeb);
             }
         }
 
@@ -363,11 +719,11 @@ static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[]
     return "/empty.json";
 }
 
-static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen) {
-    return WebServer::ssi_handler(ssi_tag_name, pcInsert, iInsertLen);
+static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, void *connection_state) {
+    return WebServer::ssi_handler(ssi_tag_name, pcInsert, iInsertLen, connection_state);
 }
 
-u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen) {
+u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, void *connection_state) {
     // Called once per Tag, no matter which file has been requested
 
     std::string tagName(ssi_tag_name);
@@ -532,6 +888,97 @@ u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInse
         output["sparse"] = boardConfig.activeConfig->radioParams.allowSparse;
         output["dataRate"] = (int)boardConfig.activeConfig->radioParams.dataRate;
         output["txPower"] = (int)boardConfig.activeConfig->radioParams.txPower;
+        output["fec"] = boardConfig.activeConfig->radioParams.fecParity;
+        output["noAck"] = (bool)boardConfig.activeConfig->radioParams.noAck;
+        output["hop"] = boardConfig.activeConfig->radioParams.hopping;
+        output["adaptive"] = (bool)boardConfig.activeConfig->radioParams.adaptive;
+        output["telemetry"] = (bool)boardConfig.activeConfig->radioParams.telemetry;
+        output["dual"] = boardConfig.activeConfig->radioDual;
+        output["channel2"] = boardConfig.activeConfig->radioChannel2;
+        output["universes2"] = boardConfig.activeConfig->radioUniverses2;
+        output["module2"] = wireless.module2Available;
+        output_string = Json::writeString(wbuilder, output);
+        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
+
+    } else if (tagName == "ConfigPortTimingGet") {
+        for (uint8_t i = 0; i < LOCALDMX_COUNT; i++) {
+            output["ports"][i]["break"] = boardConfig.activeConfig->portTiming[i].breakUs;
+            output["ports"][i]["mab"] = boardConfig.activeConfig->portTiming[i].mabUs;
+            output["ports"][i]["interSlot"] = boardConfig.activeConfig->portTiming[i].interSlotUs;
+            output["ports"][i]["mode"] = (boardConfig.activeConfig->portTiming[i].slotMode == PortTimingSlots::slotsHighestNonZero) ? "auto" : "fixed";
+            output["ports"][i]["slots"] = boardConfig.activeConfig->portTiming[i].slots;
+            switch (boardConfig.activeConfig->portTiming[i].outputMode) {
+                case PortOutputMode::outputOnChange: output["ports"][i]["output"] = "onChange"; break;
+                case PortOutputMode::outputCadence:  output["ports"][i]["output"] = "cadence"; break;
+                default:                             output["ports"][i]["output"] = "continuous"; break;
+            }
+            output["ports"][i]["interval"] = boardConfig.activeConfig->portTiming[i].intervalMs;
+        }
+        // Resulting length of the packet on the 16 outputs
+        output["packetUs"] = localDmx.frameBits * 4;
+        output["packetsSent"] = localDmx.packetsSent;
+        output["packetsEncoded"] = localDmx.packetsEncoded;
+        output_string = Json::writeString(wbuilder, output);
+        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
+
+    } else if (tagName == "DmxBufferStatusGet") {
+        // Needs to be checked before the DmxBuffer<n>Get tags
+        // One array per property to keep it below the SSI insert limit
+        uint32_t now = time_us_32();
+
+        for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+            DmxBufferStatus* status = &dmxBuffer.status[i];
+            output["ageMs"][i] = status->frames ? (int64_t)((now - status->lastUpdate) / 1000) : -1;
+            output["fps10"][i] = dmxBuffer.getFps(i); // Frames per 10s
+            output["frames"][i] = status->frames;
+            output["nonZero"][i] = status->nonZeroChannels;
+            output["source"][i] = status->source;
+            output["lost"][i] = status->lost;
+            output["policy"][i] = boardConfig.activeConfig->bufferLoss[i].policy;
+            output["timeoutMs"][i] = boardConfig.activeConfig->bufferLoss[i].timeoutMs;
+            output["backup"][i] = boardConfig.activeConfig->bufferLoss[i].backupBuffer;
+        }
+        for (auto source : magic_enum::enum_values<DmxBufferSource>()) {
+            output["sourceNames"][(Json::ArrayIndex)source] = std::string(magic_enum::enum_name(source));
+        }
+        for (auto policy : magic_enum::enum_values<LossPolicy>()) {
+            output["policyNames"][(Json::ArrayIndex)policy] = std::string(magic_enum::enum_name(policy));
+        }
+        output_string = Json::writeString(wbuilder, output);
+        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
+
+    } else if (tagName == "DmxBufferInterpolationGet") {
+        // Needs to be checked before the DmxBuffer<n>Get tags
+        uint8_t j = 0;
+        for (uint8_t i = 0; i < DMXBUFFER_COUNT; i++) {
+            if (!dmxBuffer.isInterpolated(i)) {
+                continue;
+            }
+
+            // Non-interpolated channels as ranges, like in the set request
+            std::string fixed;
+            char range[12];
+            for (uint16_t first = 0; first < 512; first++) {
+                if (!dmxBuffer.isInterpolationFixed(i, first)) {
+                    continue;
+                }
+                uint16_t last = first;
+                while ((last < 511) && dmxBuffer.isInterpolationFixed(i, last + 1)) {
+                    last++;
+                }
+                if (first == last) {
+                    snprintf(range, 12, "%s%u", fixed.empty() ? "" : ",", first + 1);
+                } else {
+                    snprintf(range, 12, "%s%u-%u", fixed.empty() ? "" : ",", first + 1, last + 1);
+                }
+                fixed += range;
+                first = last;
+            }
+
+            output["buffers"][j]["buffer"] = i;
+            output["buffers"][j]["fixed"] = fixed;
+            j++;
+        }
         output_string = Json::writeString(wbuilder, output);
         return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
 
@@ -587,13 +1034,51 @@ u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInse
         offset += base64_encode_block(WebServer::tmpBuf, actuallyWritten, pcInsert + offset, &WebServer::b64Encode);
         offset += base64_encode_blockend(pcInsert + offset, &WebServer::b64Encode);
 
-        offset += sprintf(pcInsert + offset, "\"}");
+        offset += sprintf(pcInsert + offset, "\",\"highRes\":%s", wireless.spectrumHighRes ? "true" : "false");
+
+        if (wireless.spectrumHighRes) {
+            // Same encoding, peak is uint16_t like the spectrum, occupancy uint8_t
+            offset += sprintf(pcInsert + offset, ",\"peak\":\"");
+            actuallyWritten = 1000;
+            snappy::RawCompress((const char *)wireless.signalPeak, MAXCHANNEL*sizeof(uint16_t), (char*)WebServer::tmpBuf, &actuallyWritten);
+            base64_init_encodestate(&WebServer::b64Encode);
+            offset += base64_encode_block(WebServer::tmpBuf, actuallyWritten, pcInsert + offset, &WebServer::b64Encode);
+            offset += base64_encode_blockend(pcInsert + offset, &WebServer::b64Encode);
+
+            offset += sprintf(pcInsert + offset, "\",\"occupancy\":\"");
+            actuallyWritten = 1000;
+            snappy::RawCompress((const char *)wireless.signalOccupancy, MAXCHANNEL*sizeof(uint8_t), (char*)WebServer::tmpBuf, &actuallyWritten);
+            base64_init_encodestate(&WebServer::b64Encode);
+            offset += base64_encode_block(WebServer::tmpBuf, actuallyWritten, pcInsert + offset, &WebServer::b64Encode);
+            offset += base64_encode_blockend(pcInsert + offset, &WebServer::b64Encode);
+            offset += sprintf(pcInsert + offset, "\"");
+        }
+
+        offset += sprintf(pcInsert + offset, "}");
 
         return offset;
 
     } else if (tagName == "ConfigWirelessStatsGet") {
         output_string = wireless.getWirelessStats();
-        return snprintf(pcInsert, iInsertLen, "%s", output_string.c_str());
+        return WebServer::insertString(pcInsert, iInsertLen, output_string);
+
+    } else if (tagName == "ConfigWirelessRemotesGet") {
+        output_string = wireless.getWirelessRemotes();
+        return WebServer::insertString(pcInsert, iInsertLen, output_string);
+
+    } else if (tagName == "RdmGet") {
+        output_string = rdm.getRdmStatus();
+        return WebServer::insertString(pcInsert, iInsertLen, output_string);
+
+    } else if ((tagName == "RdmPortGet") && connection_state) {
+        WebServerConnectionState* state = (WebServerConnectionState*)connection_state;
+        output_string = rdm.getRdmPortStatus(state->rdmPort);
+        return WebServer::insertString(pcInsert, iInsertLen, output_string);
+
+    } else if ((tagName == "RdmResponseGet") && connection_state) {
+        WebServerConnectionState* state = (WebServerConnectionState*)connection_state;
+        output_string = rdm.getRdmResponse(state->rdmPort, state->rdmRequest);
+        return WebServer::insertString(pcInsert, iInsertLen, output_string);
 
     } else if (tagName == "LogGet") {
         // Don't use jsoncpp here for performance reasons, write directly to pcInsert
@@ -613,6 +1098,15 @@ u16_t WebServer::ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInse
     }
 }
 
+// snprintf() returns the untruncated length, lwIP must only get what has been written
+u16_t WebServer::insertString(char *pcInsert, int iInsertLen, const std::string& input) {
+    if (iInsertLen <= 0) {
+        return 0;
+    }
+    snprintf(pcInsert, iInsertLen, "%s", input.c_str());
+    return MIN(input.length(), (size_t)(iInsertLen - 1));
+}
+
 void WebServer::paramsToMap(int iNumParams, char *pcParam[], char *pcValue[], std::map<std::string, std::string>* params) {
     for (int i = 0; i < iNumParams; i++) {
         if ((pcParam[i] == nullptr) || (pcValue[i] == nullptr)) {
@@ -20,12 +20,20 @@ extern "C" {
 
 #ifdef __cplusplus
 
+// Per connection, for SSI tags that depend on the request's parameters.
+// Only files below /rdm/ get one
+struct WebServerConnectionState {
+    uint8_t rdmPort;
+    uint8_t rdmRequest;
+};
+
 class WebServer {
   public:
     void init();
     void cyclicTask();
     static inline void ipToString(uint32_t ip, char* ipString);
-    static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen);
+    static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, void *connection_state);
+    static u16_t insertString(char *pcInsert, int iInsertLen, const std::string& input);
 
     static inline void paramsToMap(int iNumParams, char *pcParam[], char *pcValue[], std::map<std::string, std::string>* params);
     static std::string urlDecode(std::string &input);
@@ -48,6 +56,8 @@ extern "C" {
 static const char *cgi_system_reset_boot(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_statusLeds_brightness_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_dmxBuffer_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_dmxBuffer_loss_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_dmxBuffer_interpolation_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_ioBoards_config(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_load(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_save(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
@@ -55,10 +65,15 @@ static const char *cgi_config_enable(int iIndex, int iNumParams, char *pcParam[]
 static const char *cgi_config_disable(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_wireless_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_config_wireless_spectrum_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 static const char *cgi_config_partyMode_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_config_portTiming_set(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_rdm_discovery(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_rdm_request(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+static const char *cgi_rdm_get(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
 
 
-static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen);
+static u16_t ssi_handler(const char* ssi_tag_name, char *pcInsert, int iInsertLen, void *connection_state);
 
 
 #ifdef __cplusplus
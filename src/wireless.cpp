@@ -4,6 +4,11 @@
 #include <RF24Network.h>
 #include <RF24Mesh.h>
 
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/unique_id.h>
+
 #include "json/json.h"
 
 #include "log.h"
@@ -15,21 +20,38 @@
 extern StatusLeds statusLeds;
 extern BoardConfig boardConfig;
 extern DmxBuffer dmxBuffer;
+extern Wireless wireless;
 
 extern critical_section_t bufferLock;
 
 uint8_t Wireless::tmpBuf_RX0[600]; // Used to store incoming data from radio
-uint8_t Wireless::tmpBuf_RX1[600]; // Used by edpRX to assemble the packets
+uint8_t Wireless::tmpBuf_RX1[600]; // outData of edpRX, not used for receiving
 uint8_t Wireless::tmpBufQueueCopy[600]; // Used to quickly copy data from the sendQueue. goes to edpTX as inData
 uint8_t Wireless::tmpBuf_TX1[600]; // Used by edpRX to store the chunks ready to be sent
-
-// TODO: Do we need one tmpBuf per incoming universe to assemble them?
-//       Or can we expect them to come in order?
-//       Currently using tmpBuf2 as assemble-buffer for ALL INCOMING packets + outgoing will overwrite them!
+EdpReassemblySlot Wireless::edpRX_slots[4]; // Up to 4 universes can be assembled at the same time, in any order
+EdpReference Wireless::edpRX_references[4]; // Keyframes received, deltas are applied to them
+EdpReference Wireless::edpTX_references[4]; // Keyframes sent, one per universe in the sendQueue
+WirelessRxPayload Wireless::rxRing[WIRELESS_RX_RING]; // From the radio's RX FIFO (IRQ) to EDP (cyclicTask)
+uint8_t Wireless::tmpBufQueueCopy2[512]; // Like tmpBufQueueCopy, for the second module
+WirelessChunkList Wireless::dualChunks[2]; // One frame per module, prepared before sending
 
 RF24 rf24radio(PIN_RF24_CE, PIN_SPI_CS0);
 RF24Network rf24network(rf24radio);
 RF24Mesh rf24mesh(rf24radio, rf24network);
+#ifdef WIRELESS_DUAL_RADIO
+RF24 rf24radio2(PIN_RF24_CE1, PIN_SPI_CS1);
+#endif
+
+// The IRQ handler must not use the SPI bus while we do
+static inline void wireless_irq_set(bool enabled) {
+#ifdef PIN_RF24_IRQ
+    gpio_set_irq_enabled(PIN_RF24_IRQ, GPIO_IRQ_EDGE_FALL, enabled);
+#endif
+}
+
+static int64_t wireless_scan_alarm_callback(alarm_id_t id, void* user_data) {
+    return wireless.scanStep();
+}
 
 void Wireless::init() {
     SPI spi;
@@ -37,14 +59,71 @@ void Wireless::init() {
 
     // Stats
     memset(&stats, 0x00, sizeof(struct WirelessStats));
+    memset(queueStats, 0x00, sizeof(queueStats));
+
+    memset(sendQueueValid, 0x00, sizeof(sendQueueValid));
+    memset(sendQueueUsed, 0x00, sizeof(sendQueueUsed));
+    memset(sendQueueChanges, 0x00, sizeof(sendQueueChanges));
+    nextUniverse = 0;
+    airtimeBudgetUs = 0;
+    airtimeRefilled = time_us_32();
+    memset(meshNodes, 0x00, sizeof(meshNodes));
+    memset(hopLoss, 0x00, sizeof(hopLoss));
+    memset(hopBlacklist, 0x00, sizeof(hopBlacklist));
+
+    dataRate = boardConfig.activeConfig->radioParams.dataRate;
+    txPower = boardConfig.activeConfig->radioParams.txPower;
+    rxLastPayload = time_us_32();
+    adaptWindowStart = time_us_32();
+    adaptFrames = 0;
+    adaptLost = 0;
+    adaptArcSum = 0;
+    adaptGood = 0;
+    adaptHold = WIRELESS_ADAPT_HOLD_MIN;
+    adaptSnappyPause = 0;
+    adaptSnappyTried = 0;
+    adaptSnappyUsed = 0;
 
-    // RX path goes via RX0 from radio to EDP and RX1 is out buffer
-    edpRX.init(tmpBuf_RX0, tmpBuf_RX1, 32, PatchType::nrf24);
+    pico_unique_board_id_t id;
+    pico_get_unique_board_id(&id);
+    remoteId = ((uint32_t)id.id[4] << 24) | ((uint32_t)id.id[5] << 16) | ((uint32_t)id.id[6] << 8) | id.id[7];
+    memset(remotes, 0x00, sizeof(remotes));
+    telemetryWritten = time_us_32();
+    telemetryReassemblySum = 0;
+    telemetryFrames = 0;
+    meshSubscribed = time_us_32() - WIRELESS_MESH_SUBSCRIBE_US;
+    for (uint8_t n = 0; n < WIRELESS_UNIVERSES; n++) {
+        if (boardConfig.activeConfig->radioDual == RadioDual::dualStatic) {
+            dualRadio[n] = (boardConfig.activeConfig->radioUniverses2 >> n) & 1;
+        } else {
+            dualRadio[n] = n & 1;
+        }
+    }
+    memset(dualLoadUs, 0x00, sizeof(dualLoadUs));
+    dualBalanced = time_us_32();
+
+    // Broadcast sends single radio payloads, RF24Network (mesh) takes care
+    // of fragmenting bigger messages itself
+    uint16_t chunkSize = (boardConfig.activeConfig->radioRole == RadioRole::mesh) ? WIRELESS_MESH_CHUNK_SIZE : 32;
+
+    // RX path goes via RX0 from radio to EDP, chunks are assembled in the slots
+    edpRX.init(tmpBuf_RX0, tmpBuf_RX1, chunkSize, PatchType::nrf24, edpRX_slots, 4);
+    edpRX.initDelta(edpRX_references, 4);
 
     // TX path goes from sendQueueCopy to EDP and TX1 it out buffer
-    edpTX.init(tmpBufQueueCopy, tmpBuf_TX1, 32, PatchType::nrf24);
+    edpTX.init(tmpBufQueueCopy, tmpBuf_TX1, chunkSize, PatchType::nrf24);
+    edpTX.initDelta(edpTX_references, 4);
+    edpTX.setCompression(boardConfig.activeConfig->radioParams.compression);
+    // Lost fragments are retransmitted by the mesh, FEC is for broadcast only
+    if ((boardConfig.activeConfig->radioRole == RadioRole::broadcast) &&
+        !edpTX.setFec(boardConfig.activeConfig->radioParams.fecParity))
+    {
+        LOG("RF24: Invalid FEC setting %u", boardConfig.activeConfig->radioParams.fecParity);
+    }
 
     memset(signalStrength, 0x00, MAXCHANNEL * sizeof(uint16_t));
+    spectrumReset();
+    scanRandom = time_us_32() | 1;
 
     spi.begin(spi0);
 
@@ -73,21 +152,156 @@ void Wireless::init() {
 
     // Depending on radioRole, more setup is required
     if (boardConfig.activeConfig->radioRole == RadioRole::broadcast) {
-        rf24radio.setPALevel(boardConfig.activeConfig->radioParams.txPower, true);
+        rf24radio.setPALevel(txPower, true);
         rf24radio.setChannel(boardConfig.activeConfig->radioChannel);
-        rf24radio.setDataRate(boardConfig.activeConfig->radioParams.dataRate);
+        rf24radio.setDataRate(dataRate);
         rf24radio.enableDynamicPayloads();
         rf24radio.setAutoAck(true);
         rf24radio.setCRCLength(RF24_CRC_16);
-        rf24radio.disableAckPayload();
+        if (boardConfig.activeConfig->radioParams.telemetry) {
+            rf24radio.enableAckPayload();
+        } else {
+            rf24radio.disableAckPayload();
+        }
+        rf24radio.enableDynamicAck(); // Allows to send without requesting an ACK (noAck)
         rf24radio.openWritingPipe((const uint8_t *)"DMXTX");
         rf24radio.openReadingPipe(1, (const uint8_t *)"DMXTX");
         rf24radio.setRetries(0, 8);
         rf24radio.startListening();
+
+        hopSwitched = time_us_32();
+        if (boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopLeader) {
+            hopStart();
+        }
+
+#ifdef WIRELESS_DUAL_RADIO
+        // Same setup on its own channel. Keeps the configured rate and power
+        if ((boardConfig.activeConfig->radioDual != RadioDual::dualOff) && rf24radio2.begin(&spi)) {
+            rf24radio2.setPALevel(boardConfig.activeConfig->radioParams.txPower, true);
+            rf24radio2.setChannel(boardConfig.activeConfig->radioChannel2);
+            rf24radio2.setDataRate(boardConfig.activeConfig->radioParams.dataRate);
+            rf24radio2.enableDynamicPayloads();
+            rf24radio2.setAutoAck(true);
+            rf24radio2.setCRCLength(RF24_CRC_16);
+            rf24radio2.disableAckPayload();
+            rf24radio2.enableDynamicAck();
+            rf24radio2.openWritingPipe((const uint8_t *)"DMXTX");
+            rf24radio2.openReadingPipe(1, (const uint8_t *)"DMXTX");
+            rf24radio2.setRetries(0, 8);
+            rf24radio2.startListening();
+            radio2 = &rf24radio2;
+            module2Available = true;
+        } else if (boardConfig.activeConfig->radioDual != RadioDual::dualOff) {
+            LOG("RF24: Second module not found");
+        }
+#endif
     } else if (boardConfig.activeConfig->radioRole == RadioRole::mesh) {
         LOG("RF24: Mesh setNodeID to %d", boardConfig.activeConfig->radioAddress);
         rf24mesh.setNodeID(boardConfig.activeConfig->radioAddress);
         rf24mesh.begin();
+        // Nodes pass multicasts on to their children, so a multicast to
+        // level 1 reaches the whole mesh
+        rf24network.multicastRelay = true;
+    }
+}
+
+#ifdef PIN_RF24_IRQ
+static void wireless_gpio_irq(uint gpio, uint32_t events) {
+    if (gpio == PIN_RF24_IRQ) {
+        wireless.irqHandler();
+    }
+}
+#endif
+
+// Needs to be called on the core running cyclicTask() since the IRQ handler
+// uses the SPI bus as well. If the IRQ line is not connected (or used by
+// the second module), cyclicTask() still polls the radio
+void Wireless::initIrq() {
+    // Restarting core1 (saving the config to flash) disables its IRQs
+    if (scanAlarmPool) {
+        irq_set_enabled(TIMER_IRQ_0 + alarm_pool_hardware_alarm_num(scanAlarmPool), true);
+    }
+
+#ifdef PIN_RF24_IRQ
+    if (!moduleAvailable || (boardConfig.activeConfig->radioRole != RadioRole::broadcast)) {
+        return;
+    }
+
+    // Only "data ready" pulls the line low
+    rf24radio.maskIRQ(true, true, false);
+
+    gpio_init(PIN_RF24_IRQ);
+    gpio_set_dir(PIN_RF24_IRQ, GPIO_IN);
+    gpio_pull_up(PIN_RF24_IRQ);
+    gpio_set_irq_enabled_with_callback(PIN_RF24_IRQ, GPIO_IRQ_EDGE_FALL, true, &wireless_gpio_irq);
+    irqEnabled = true;
+#endif
+}
+
+void Wireless::irqHandler() {
+    fetchPayloads();
+}
+
+// Move everything the radios received to the ring. Runs in the IRQ handler
+// or with interrupts disabled
+void Wireless::fetchPayloads() {
+    fetchPayloads(&rf24radio);
+    if (radio2) {
+        fetchPayloads(radio2);
+    }
+}
+
+void Wireless::fetchPayloads(RF24* radio) {
+    uint8_t next;
+    uint8_t bytes;
+
+    if (radio->rxFifoFull()) {
+        stats.rxFifoFull++;
+    }
+
+    while (radio->available()) {
+        next = (rxRingHead + 1) & (WIRELESS_RX_RING - 1);
+        if (next == rxRingTail) {
+            // Leave it in the radio, handleReceivedData() fetches it once
+            // there is space again
+            stats.rxRingFull++;
+            return;
+        }
+
+        // Returns 0 (and flushes the FIFO) if the payload is corrupt
+        bytes = radio->getDynamicPayloadSize();
+        if (!bytes) {
+            continue;
+        }
+
+        radio->read(rxRing[rxRingHead].data, bytes); // Clears the IRQ flag
+        rxLastPayload = time_us_32();
+
+        if ((rxRing[rxRingHead].data[0] == Edp_Commands::RadioTelemetry) &&
+            boardConfig.activeConfig->radioParams.telemetry)
+        {
+            telemetryReceived((WirelessTelemetry*)rxRing[rxRingHead].data, bytes);
+            continue;
+        }
+
+        if ((rxRing[rxRingHead].data[0] == Edp_Commands::RadioRate) &&
+            boardConfig.activeConfig->radioParams.adaptive)
+        {
+            adaptFollowRate((WirelessRateMarker*)rxRing[rxRingHead].data, bytes);
+            continue;
+        }
+
+        if ((rxRing[rxRingHead].data[0] == Edp_Commands::RadioHop) &&
+            (boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopFollower))
+        {
+            // Hop now, so nothing of the next frame is missed
+            hopFollow((WirelessHopMarker*)rxRing[rxRingHead].data, bytes);
+            continue;
+        }
+
+        rxRing[rxRingHead].length = bytes;
+        __dmb();
+        rxRingHead = next;
     }
 }
 
@@ -98,16 +312,26 @@ void Wireless::cyclicTask() {
 
     switch (boardConfig.activeConfig->radioRole) {
         case RadioRole::sniffer:
-            lastScannedChannel++;
-            if (lastScannedChannel >= MAXCHANNEL) {
-                lastScannedChannel = 0;
-            }
-            scanChannel(lastScannedChannel);
+            this->scanTask();
             break;
         case RadioRole::broadcast:
             // Nothing to do to keep any network alive
             this->doSendData();
             this->handleReceivedData();
+            if (boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopLeader) {
+                this->hopScan();
+            } else if (boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopFollower) {
+                this->hopCheckLost();
+            }
+            if (boardConfig.activeConfig->radioParams.adaptive) {
+                this->adaptTask();
+            }
+            if (boardConfig.activeConfig->radioParams.telemetry) {
+                this->telemetryTask();
+            }
+            if (radio2 && (boardConfig.activeConfig->radioDual == RadioDual::dualBalanced)) {
+                this->dualBalance();
+            }
             break;
         case RadioRole::mesh:
             rf24mesh.update();
@@ -120,26 +344,110 @@ void Wireless::cyclicTask() {
                 } else {
                     statusLeds.setStatic(6, 1, 0, 0);
                 }
+            } else if ((time_us_32() - meshSubscribed) > WIRELESS_MESH_SUBSCRIBE_US) {
+                this->meshSendSubscription();
             }
+            this->handleMeshData();
+            this->meshExpireNodes();
             this->doSendData();
             break;
     }
 }
 
+// Blocking scan of a single channel, for the hopping leader which needs
+// the radio back right away. The sniffer uses scanStep()
 void Wireless::scanChannel(uint8_t channel)
 {
     rf24radio.setChannel(channel);
-    sleep_us(130); // Let the radio tune
     rf24radio.startListening();
-    sleep_us(200); // Listen for some time
-    // TODO: Sleep time should ne random between 150 and 230 to
-    //       avoid strobe effects from FHSS devices
-    if (rf24radio.testRPD()) { // signal detected so increase signalStrength unless already maxed out
+    sleep_us(scanNextDwell());
+    scanRecord(channel, rf24radio.testRPD());
+    rf24radio.stopListening();
+}
+
+// Sniffer: Starts the sweep if it isn't running. The alarm pool is created
+// here since its callbacks fire on the core that created it, core1
+void Wireless::scanTask() {
+    if (scanRunning) {
+        return;
+    }
+
+    if (!scanAlarmPool) {
+        scanAlarmPool = alarm_pool_create_with_unused_hardware_alarm(1);
+    }
+
+    rf24radio.setChannel(lastScannedChannel);
+    rf24radio.startListening();
+    scanRunning = true;
+    if (alarm_pool_add_alarm_in_us(scanAlarmPool, scanNextDwell(), wireless_scan_alarm_callback, nullptr, true) < 0) {
+        // Tried again on the next cyclicTask()
+        scanRunning = false;
+    }
+}
+
+// Same as scanChannel() for all channels in turn, but returns instead of
+// sleeping. Runs in the alarm's IRQ handler on core1, so the main loop
+// can't make the dwell longer. Returns when to be called again: negative
+// is counted from now (alarm_callback_t), 0 ends the sweep
+int64_t Wireless::scanStep() {
+    if (boardConfig.activeConfig->radioRole != RadioRole::sniffer) {
+        // Don't touch the radio, it belongs to the new role now
+        scanRunning = false;
+        return 0;
+    }
+
+    scanRecord(lastScannedChannel, rf24radio.testRPD());
+    rf24radio.stopListening();
+
+    lastScannedChannel++;
+    if (lastScannedChannel >= MAXCHANNEL) {
+        lastScannedChannel = 0;
+    }
+
+    rf24radio.setChannel(lastScannedChannel);
+    rf24radio.startListening();
+
+    return -(int64_t)scanNextDwell();
+}
+
+// Settling time + random dwell between WIRELESS_SCAN_DWELL_MIN_US and _MAX_US
+uint32_t Wireless::scanNextDwell() {
+    scanRandom ^= scanRandom << 13;
+    scanRandom ^= scanRandom >> 17;
+    scanRandom ^= scanRandom << 5;
+
+    return WIRELESS_SCAN_SETTLE_US + WIRELESS_SCAN_DWELL_MIN_US +
+        (scanRandom % (WIRELESS_SCAN_DWELL_MAX_US - WIRELESS_SCAN_DWELL_MIN_US + 1));
+}
+
+void Wireless::scanRecord(uint8_t channel, bool detected) {
+    if (detected) { // signal detected so increase signalStrength unless already maxed out
         signalStrength[channel] += (0x7FFF - signalStrength[channel]) >> 5; // increase rapidly when previous value was low, with increase reducing exponentially as value approaches maximum
     } else { // no signal detected so reduce signalStrength unless already at minimum
         signalStrength[channel] -= signalStrength[channel] >> 5; // decrease rapidly when previous value was high, with decrease reducing exponentially as value approaches zero
     }
-    rf24radio.stopListening();
+
+    if (!spectrumHighRes) {
+        return;
+    }
+
+    signalPeak[channel] = MAX(signalPeak[channel], signalStrength[channel]);
+
+    // Halving both keeps the percentage but lets old visits fade out
+    scanVisits[channel]++;
+    scanHits[channel] += detected;
+    if (scanVisits[channel] >= WIRELESS_SCAN_OCCUPANCY_VISITS) {
+        scanVisits[channel] /= 2;
+        scanHits[channel] /= 2;
+    }
+    signalOccupancy[channel] = scanHits[channel] * 100 / scanVisits[channel];
+}
+
+void Wireless::spectrumReset() {
+    memset(signalPeak, 0x00, sizeof(signalPeak));
+    memset(signalOccupancy, 0x00, sizeof(signalOccupancy));
+    memset(scanVisits, 0x00, sizeof(scanVisits));
+    memset(scanHits, 0x00, sizeof(scanHits));
 }
 
 void Wireless::sendData(uint8_t universeId, uint8_t *source, uint16_t sourceLength) {
@@ -154,112 +462,1111 @@ void Wireless::sendData(uint8_t universeId, uint8_t *source, uint16_t sourceLeng
     // cares about the unsent, old data if we have new values anyway
     LOG("SendData. Universe: %d. RadioRole: %d", universeId, boardConfig.activeConfig->radioRole);
 
+    if (universeId >= WIRELESS_UNIVERSES) {
+        return;
+    }
+
     uint16_t length = MIN(sourceLength, 512);
+    uint8_t* data = this->sendQueueData[universeId];
+    uint32_t changes = 0;
+    uint8_t value;
 
     // TODO: Mutex should be fine here, no reason to disables IRQs
     critical_section_enter_blocking(&bufferLock);
-    memset(this->sendQueueData[universeId], 0x00, 512);
-    memcpy(this->sendQueueData[universeId], source, length);
-    critical_section_exit(&bufferLock);
+    for (uint16_t i = 0; i < 512; i++) {
+        value = (i < length) ? source[i] : 0;
+        changes += (data[i] != value);
+        data[i] = value;
+    }
 
+    if (!this->sendQueueValid[universeId]) {
+        this->sendQueueSince[universeId] = time_us_32();
+    }
+    this->sendQueueChanges[universeId] += changes;
+    this->sendQueueUsed[universeId] = true;
     this->sendQueueValid[universeId] = true;
+    critical_section_exit(&bufferLock);
 }
 
+// Sends (at most) one universe per call and module, so received data is
+// handled in between
 void Wireless::doSendData() {
-    bool triedToSend = false;
-    bool success = false;
-    bool anyFailed = false;
-    uint8_t automaticRetryCount = 0;
+    uint32_t now = time_us_32();
+    int8_t best;
+    int8_t best2 = -1;
+    bool success = true;
+    uint64_t sentBefore;
+    uint32_t airtime = 0;
+    bool dual = radio2 && (boardConfig.activeConfig->radioRole == RadioRole::broadcast);
+
+    // Refill the airtime budget
+    airtimeBudgetUs += MIN(now - airtimeRefilled, (uint32_t)WIRELESS_AIRTIME_BURST_US) * WIRELESS_AIRTIME_PERCENT / 100;
+    airtimeBudgetUs = MIN(airtimeBudgetUs, WIRELESS_AIRTIME_BURST_US);
+    airtimeRefilled = now;
+    if (airtimeBudgetUs <= 0) {
+        return;
+    }
+
+    // Give the followers time to change the channel
+    if ((boardConfig.activeConfig->radioRole == RadioRole::broadcast) &&
+        (boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopLeader) &&
+        ((now - hopSwitched) < WIRELESS_HOP_GUARD_US))
+    {
+        return;
+    }
+
+    critical_section_enter_blocking(&bufferLock);
 
+    best = pickUniverse(now, dual ? 0 : -1);
+    if (dual) {
+        best2 = pickUniverse(now, 1);
+    }
+
+    if ((best < 0) && (best2 < 0)) {
+        critical_section_exit(&bufferLock);
+        return;
+    }
+
+    // Copy the data away to somewhere it doesn't change while we read it
+    if (best >= 0) {
+        takeUniverse(best, now, Wireless::tmpBufQueueCopy);
+    }
+    if (best2 >= 0) {
+        takeUniverse(best2, now, Wireless::tmpBufQueueCopy2);
+    }
+    critical_section_exit(&bufferLock);
+
+    statusLeds.setBlinkOnce(6, 0, 1, 0);
+
+    sentBefore = stats.sentTried;
+    switch (boardConfig.activeConfig->radioRole) {
+        case RadioRole::broadcast:
+            if (dual) {
+                success = this->sendBroadcastDual(best, best2, &airtime);
+            } else {
+                success = this->sendBroadcast(best);
+            }
+        break;
+        case RadioRole::mesh:
+            success = this->sendMesh(best);
+        break;
+    }
+
+    // Pay for it. Both modules send at the same time
+    if (!dual) {
+        airtime = (stats.sentTried - sentBefore) * chunkAirtimeUs();
+    }
+    airtimeBudgetUs -= airtime;
+    stats.airtimeUs += airtime;
+
+    if (!success) {
+        statusLeds.setStaticOn(6, 1, 0, 0);
+    } else {
+        statusLeds.setStaticOff(6, 1, 0, 0);
+    }
+}
+
+// The pending universe to send next, by age and amount of change. Refreshes
+// come last. Only universes of the given module (-1 = any). Called with
+// bufferLock held, -1 if there is none
+int8_t Wireless::pickUniverse(uint32_t now, int8_t radio) {
+    uint32_t score;
+    uint32_t bestScore = 0;
+    int8_t best = -1;
+
+    for (uint8_t n = 0; n < WIRELESS_UNIVERSES; n++) {
+        uint8_t i = (nextUniverse + n) % WIRELESS_UNIVERSES;
+
+        if ((radio >= 0) && (dualRadio[i] != radio)) {
+            continue;
+        }
+
+        // The mesh master only sends what some node subscribed to. It
+        // stays queued, so a new subscriber gets it right away
+        if ((boardConfig.activeConfig->radioRole == RadioRole::mesh) &&
+            (boardConfig.activeConfig->radioAddress == 0) &&
+            !meshSubscribers(i, nullptr))
+        {
+            continue;
+        }
+
+        if (this->sendQueueValid[i]) {
+            score = (now - this->sendQueueSince[i]) + MIN(this->sendQueueChanges[i], 512) * WIRELESS_CHANGE_WEIGHT_US + 1;
+        } else if (this->sendQueueUsed[i] && ((now - this->lastSent[i]) > WIRELESS_REFRESH_US)) {
+            score = 0;
+        } else {
+            continue;
+        }
+
+        if ((best < 0) || (score > bestScore)) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    return best;
+}
+
+// Take the universe off the queue and copy it to destination. Called with
+// bufferLock held
+void Wireless::takeUniverse(uint8_t universeId, uint32_t now, uint8_t* destination) {
+    bool refresh = !this->sendQueueValid[universeId];
+
+    if (!refresh) {
+        uint32_t latency = now - this->sendQueueSince[universeId];
+        queueStats[universeId].latencySumUs += latency;
+        queueStats[universeId].latencyMaxUs = MAX(queueStats[universeId].latencyMaxUs, latency);
+    }
+    this->sendQueueValid[universeId] = false;
+    this->sendQueueChanges[universeId] = 0;
+
+    memcpy(destination, this->sendQueueData[universeId], 512);
+
+    this->lastSent[universeId] = now;
+    this->nextUniverse = (universeId + 1) % WIRELESS_UNIVERSES;
+    queueStats[universeId].sent++;
+    if (refresh) {
+        queueStats[universeId].refreshes++;
+    }
+}
+
+// Time one chunk occupies the channel: Preamble, address, control field,
+// 32 byte payload and CRC, then the ACK and the two TX/RX turnarounds
+uint32_t Wireless::chunkAirtimeUs() {
+    uint32_t bits = 8 * (1 + 5 + 32 + 2) + 9;
+    uint32_t settleUs = 130;
+
+    if (!boardConfig.activeConfig->radioParams.noAck) {
+        bits += 8 * (1 + 5 + 2) + 9;
+        settleUs += 130;
+    }
+
+    switch (dataRate) {
+        case RF24_2MBPS:
+            return bits / 2 + settleUs;
+        case RF24_250KBPS:
+            return bits * 4 + settleUs;
+        default:
+            return bits + settleUs;
+    }
+}
+
+// Send all chunks of a universe (in tmpBufQueueCopy). writeFast() only
+// blocks while the radio's 3 level TX FIFO is full, so the next chunk is
+// prepared while the ones before it are in the air
+bool Wireless::sendBroadcast(uint8_t universeId) {
     uint16_t thisChunkSize = 0;
     bool callAgain = false;
+    bool noAck = boardConfig.activeConfig->radioParams.noAck;
+    bool success = true;
+    uint32_t queued = 0;
+    uint64_t retriesBefore = stats.sentBulkRetries;
 
-    size_t actuallyWritten = 1000;
-    size_t payloadSize = 0;
+    // The IRQ handler must not use the SPI bus in between. Nothing is
+    // received while sending anyway
+    if (irqEnabled) {
+        wireless_irq_set(false);
+    }
+    rf24radio.stopListening();
 
-    int j = 0;
+    edpTX.prepareDmxData(universeId, 512, &thisChunkSize, &callAgain);
+    stats.sentTried++;
+    if (Wireless::tmpBuf_TX1[0] != Edp_Commands::DmxDataAllZero) {
+        stats.framesSent++;
+    }
 
-    for (int i = 0; i < 4; i++) {
-        if (this->sendQueueValid[i]) {
+    while (true) {
+        if (!rf24radio.writeFast(Wireless::tmpBuf_TX1, thisChunkSize, noAck)) {
+            // A chunk in the FIFO ran out of automatic retransmits. Resend
+            // the whole FIFO, then try to queue the chunk at hand again
+            stats.sentBulkRetries++;
+            if (!rf24radio.txStandBy(WIRELESS_TX_TIMEOUT_MS)) {
+                // Given up and flushed. The receiver can't complete this
+                // frame, so don't waste airtime on the rest of it
+                LOG("RF24: Universe %u not sent, TX timed out", universeId);
+                success = false;
+                break;
+            }
+            continue;
+        }
+        queued++;
+
+        // ACK payloads end up in the RX FIFO. Fetch them before it is
+        // full, the radio drops ACKs it can't store
+        if (boardConfig.activeConfig->radioParams.telemetry) {
+            fetchPayloads();
+        }
+
+        if (!callAgain) {
+            break;
+        }
+        edpTX.prepareDmxData(universeId, 0, &thisChunkSize, &callAgain);
+        stats.sentTried++;
+    }
+
+    // Wait until the FIFO is empty, retrying if needed
+    if (success && !rf24radio.txStandBy(WIRELESS_TX_TIMEOUT_MS)) {
+        success = false;
+    }
+    if (success) {
+        stats.sentSuccess += queued;
+    }
+
+    // Without ACKs, there is no way to know if the frame made it
+    if (boardConfig.activeConfig->radioParams.adaptive && !noAck) {
+        adaptFrame(!success || (stats.sentBulkRetries != retriesBefore), rf24radio.getARC());
+    }
+    if ((boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopLeader) && hopCount) {
+        hopNext(!success || (stats.sentBulkRetries != retriesBefore), !noAck);
+    }
+
+    rf24radio.startListening();
+    if (irqEnabled) {
+        wireless_irq_set(true);
+    }
+
+    return success;
+}
+
+// Send one universe per module (in tmpBufQueueCopy and tmpBufQueueCopy2, -1
+// = nothing for that module) at the same time. There is one EDP encoder, so
+// all chunks are prepared first. Then they are handed to the modules
+// alternately, writeFast() only blocks while a module's FIFO is full
+bool Wireless::sendBroadcastDual(int8_t universe1, int8_t universe2, uint32_t* airtime) {
+    RF24* radios[2] = { &rf24radio, radio2 };
+    int8_t universes[2] = { universe1, universe2 };
+    bool noAck = boardConfig.activeConfig->radioParams.noAck;
+    bool success[2] = { true, true };
+    bool busy[2];
+    uint32_t retries[2] = { 0, 0 };
+    uint32_t chunkUs = chunkAirtimeUs();
+
+    for (uint8_t r = 0; r < 2; r++) {
+        dualChunks[r].count = 0;
+        dualChunks[r].next = 0;
+        if (universes[r] < 0) {
+            continue;
+        }
+        if (r == 1) {
+            memcpy(Wireless::tmpBufQueueCopy, Wireless::tmpBufQueueCopy2, 512);
+        }
+        prepareChunks(universes[r], &dualChunks[r]);
+    }
+
+    if (irqEnabled) {
+        wireless_irq_set(false);
+    }
+    for (uint8_t r = 0; r < 2; r++) {
+        radios[r]->stopListening();
+        busy[r] = (dualChunks[r].count > 0);
+    }
+
+    while (busy[0] || busy[1]) {
+        for (uint8_t r = 0; r < 2; r++) {
+            struct WirelessChunkList* list = &dualChunks[r];
+
+            if (!busy[r]) {
+                continue;
+            }
 
-            critical_section_enter_blocking(&bufferLock);
-            this->sendQueueValid[i] = false;
-
-            // Copy the data away to somewhere it doesn't change while we read it
-            memcpy(Wireless::tmpBufQueueCopy, this->sendQueueData[i], 512);
-            critical_section_exit(&bufferLock);
-
-            triedToSend = true;
-            statusLeds.setBlinkOnce(6, 0, 1, 0);
-
-            switch (boardConfig.activeConfig->radioRole) {
-                case RadioRole::broadcast:
-                    rf24radio.stopListening();
-
-                    callAgain = false;
-                    edpTX.prepareDmxData(i, 512, &thisChunkSize, &callAgain);
-                    stats.sentTried++;
-                    success = rf24radio.write(Wireless::tmpBuf_TX1, thisChunkSize);
-                    if (!success) {
-                        anyFailed = true;
-                    } else {
-                        stats.sentSuccess++;
-                    }
-                    while(callAgain) {
-                        edpTX.prepareDmxData(i, 0, &thisChunkSize, &callAgain);
-                        success = rf24radio.write(Wireless::tmpBuf_TX1, thisChunkSize);
-                        stats.sentTried++;
-                        if (!success) {
-                            anyFailed = true;
-                        } else {
-                            stats.sentSuccess++;
-                        }
-                    }
-
-                    rf24radio.startListening();
+            if (!radios[r]->writeFast(list->data[list->next], list->length[list->next], noAck)) {
+                // See sendBroadcast()
+                stats.sentBulkRetries++;
+                retries[r]++;
+                if (!radios[r]->txStandBy(WIRELESS_TX_TIMEOUT_MS)) {
+                    LOG("RF24: Universe %d not sent, TX timed out", universes[r]);
+                    success[r] = false;
+                    busy[r] = false;
+                }
+                continue;
+            }
+            list->next++;
+            busy[r] = (list->next < list->count);
+
+            if (boardConfig.activeConfig->radioParams.telemetry) {
+                fetchPayloads();
+            }
+        }
+    }
+
+    for (uint8_t r = 0; r < 2; r++) {
+        if (!dualChunks[r].count) {
+            continue;
+        }
+        if (success[r] && !radios[r]->txStandBy(WIRELESS_TX_TIMEOUT_MS)) {
+            success[r] = false;
+        }
+        if (success[r]) {
+            stats.sentSuccess += dualChunks[r].count;
+        }
+        dualLoadUs[universes[r]] += dualChunks[r].count * chunkUs;
+    }
+
+    // Hopping and rate adaption are done by the first module only
+    if (universe1 >= 0) {
+        if (boardConfig.activeConfig->radioParams.adaptive && !noAck) {
+            adaptFrame(!success[0] || retries[0], rf24radio.getARC());
+        }
+        if ((boardConfig.activeConfig->radioParams.hopping == RadioHopping::hopLeader) && hopCount) {
+            hopNext(!success[0] || retries[0], !noAck);
+        }
+    }
+
+    for (uint8_t r = 0; r < 2; r++) {
+        radios[r]->startListening();
+    }
+    if (irqEnabled) {
+        wireless_irq_set(true);
+    }
+
+    stats.airtime2Us += dualChunks[1].count * chunkUs;
+    *airtime = MAX(dualChunks[0].count, dualChunks[1].count) * chunkUs;
+
+    return success[0] && success[1];
+}
+
+// All chunks of a universe (in tmpBufQueueCopy), counted like sendBroadcast() does
+void Wireless::prepareChunks(uint8_t universeId, WirelessChunkList* list) {
+    uint16_t thisChunkSize = 0;
+    uint16_t size = 512;
+    bool callAgain = true;
+
+    while (callAgain && (list->count < WIRELESS_DUAL_CHUNKS)) {
+        edpTX.prepareDmxData(universeId, size, &thisChunkSize, &callAgain);
+        size = 0;
+        stats.sentTried++;
+
+        memcpy(list->data[list->count], Wireless::tmpBuf_TX1, thisChunkSize);
+        list->length[list->count] = thisChunkSize;
+        list->count++;
+    }
+
+    if (list->data[0][0] != Edp_Commands::DmxDataAllZero) {
+        stats.framesSent++;
+    }
+}
+
+// dualBalanced: Assign the universes to the modules again, by the airtime
+// they needed since the last time. Biggest first, each to the module with
+// less so far. Only applied if it's clearly better, so universes don't
+// flap between the modules
+void Wireless::dualBalance() {
+    uint32_t now = time_us_32();
+    uint32_t load[2] = { 0, 0 };
+    uint32_t newLoad[2] = { 0, 0 };
+    uint32_t total = 0;
+    uint8_t order[WIRELESS_UNIVERSES];
+    uint8_t assignment[WIRELESS_UNIVERSES];
+    uint8_t moves = 0;
+
+    if ((now - dualBalanced) < WIRELESS_DUAL_BALANCE_US) {
+        return;
+    }
+    dualBalanced = now;
+
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        load[dualRadio[i]] += dualLoadUs[i];
+        total += dualLoadUs[i];
+        order[i] = i;
+    }
+
+    // Insertion sort, there are only a few
+    for (uint8_t i = 1; i < WIRELESS_UNIVERSES; i++) {
+        for (uint8_t j = i; (j > 0) && (dualLoadUs[order[j]] > dualLoadUs[order[j - 1]]); j--) {
+            uint8_t tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    for (uint8_t n = 0; n < WIRELESS_UNIVERSES; n++) {
+        uint8_t i = order[n];
+        assignment[i] = (newLoad[1] < newLoad[0]) ? 1 : 0;
+        newLoad[assignment[i]] += dualLoadUs[i];
+        moves += (assignment[i] != dualRadio[i]);
+    }
+
+    // Which module is called what doesn't matter, take the one moving less
+    if (moves > WIRELESS_UNIVERSES / 2) {
+        moves = WIRELESS_UNIVERSES - moves;
+        for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+            assignment[i] ^= 1;
+        }
+    }
+
+    uint32_t before = (load[0] > load[1]) ? (load[0] - load[1]) : (load[1] - load[0]);
+    uint32_t after = (newLoad[0] > newLoad[1]) ? (newLoad[0] - newLoad[1]) : (newLoad[1] - newLoad[0]);
+
+    if (moves && (after < before) && (((uint64_t)(before - after) * 100) > ((uint64_t)total * WIRELESS_DUAL_BALANCE_MIN))) {
+        for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+            if (assignment[i] != dualRadio[i]) {
+                LOG("RF24: Universe %u moves to module %u", i, assignment[i] + 1);
+                dualRadio[i] = assignment[i];
+                stats.dualMoves++;
+            }
+        }
+    }
+
+    memset(dualLoadUs, 0x00, sizeof(dualLoadUs));
+}
+
+// Send all chunks of a universe (in tmpBufQueueCopy) over the mesh. Nodes
+// send to the master. The master sends to the nodes that subscribed to the
+// universe: One by one if there are only a few of them, as multicast (no
+// retransmits, but sent only once) otherwise
+bool Wireless::sendMesh(uint8_t universeId) {
+    uint16_t thisChunkSize = 0;
+    bool callAgain = false;
+    bool success = true;
+    bool sent;
+    uint8_t nodeIds[WIRELESS_MESH_MAX_NODES];
+    uint8_t subscribers = 0;
+    uint32_t fragments;
+    bool master = (boardConfig.activeConfig->radioAddress == 0);
+
+    if (master) {
+        subscribers = meshSubscribers(universeId, nodeIds);
+        if (!subscribers) {
+            return true;
+        }
+    }
+
+    edpTX.prepareDmxData(universeId, 512, &thisChunkSize, &callAgain);
+
+    while (true) {
+        // Stats count radio payloads, like in broadcast mode
+        fragments = (thisChunkSize + WIRELESS_MESH_FRAGMENT - 1) / WIRELESS_MESH_FRAGMENT;
+
+        if (!master) {
+            stats.sentTried += fragments;
+            sent = rf24mesh.write(Wireless::tmpBuf_TX1, WirelessMeshMessage::meshEdpChunk, thisChunkSize);
+            stats.sentSuccess += sent ? fragments : 0;
+            success &= sent;
+        } else if (subscribers >= WIRELESS_MESH_MULTICAST_MIN) {
+            RF24NetworkHeader header(00, WirelessMeshMessage::meshEdpChunk);
+            stats.sentTried += fragments;
+            sent = rf24network.multicast(header, Wireless::tmpBuf_TX1, thisChunkSize, 1);
+            stats.sentSuccess += sent ? fragments : 0;
+            success &= sent;
+        } else {
+            for (uint8_t i = 0; i < subscribers; i++) {
+                stats.sentTried += fragments;
+                sent = rf24mesh.write(Wireless::tmpBuf_TX1, WirelessMeshMessage::meshEdpChunk, thisChunkSize, nodeIds[i]);
+                stats.sentSuccess += sent ? fragments : 0;
+                success &= sent;
+            }
+        }
+
+        if (!callAgain) {
+            break;
+        }
+        edpTX.prepareDmxData(universeId, 0, &thisChunkSize, &callAgain);
+    }
+
+    return success;
+}
+
+// Tell the master which universes we need: The ones patched from nrf24
+void Wireless::meshSendSubscription() {
+    uint8_t universes = 0;
+
+    meshSubscribed = time_us_32();
+
+    for (uint8_t i = 0; i < MAX_PATCHINGS; i++) {
+        struct Patching* patching = &boardConfig.activeConfig->patching[i];
+        if (patching->active && (patching->srcType == PatchType::nrf24) && (patching->srcInstance < WIRELESS_UNIVERSES)) {
+            universes |= (1 << patching->srcInstance);
+        }
+    }
+
+    if (!rf24mesh.write(&universes, WirelessMeshMessage::meshSubscribe, sizeof(universes))) {
+        // Lost the connection to the master? Might need a new address
+        if (!rf24mesh.checkConnection()) {
+            LOG("RF24: Mesh connection lost, renewing address");
+            rf24mesh.renewAddress();
+        }
+    }
+}
+
+void Wireless::meshUpdateNode(int16_t nodeId, uint8_t universes) {
+    struct WirelessMeshNode* entry = nullptr;
+
+    if (nodeId < 0) {
+        // Address not (or no longer) known to the DHCP
+        return;
+    }
+
+    for (uint8_t i = 0; i < WIRELESS_MESH_MAX_NODES; i++) {
+        if (meshNodes[i].universes && (meshNodes[i].nodeId == nodeId)) {
+            entry = &meshNodes[i];
+            break;
+        }
+        if (!entry && !meshNodes[i].universes) {
+            entry = &meshNodes[i];
+        }
+    }
+
+    if (!entry) {
+        LOG("RF24: No space for the subscription of mesh node %d", nodeId);
+        return;
+    }
+
+    entry->nodeId = nodeId;
+    entry->universes = universes;
+    entry->lastSeen = time_us_32();
+}
+
+// Drops subscriptions that timed out. Not part of meshSubscribers(), that
+// runs under bufferLock where we must not LOG
+void Wireless::meshExpireNodes() {
+    uint32_t now = time_us_32();
+
+    for (uint8_t i = 0; i < WIRELESS_MESH_MAX_NODES; i++) {
+        if (meshNodes[i].universes && ((now - meshNodes[i].lastSeen) > WIRELESS_MESH_NODE_TIMEOUT_US)) {
+            LOG("RF24: Subscription of mesh node %u timed out", meshNodes[i].nodeId);
+            meshNodes[i].universes = 0;
+        }
+    }
+}
+
+// Number of nodes subscribed to the universe. Their node IDs are stored
+// in nodeIds if given. Only reads the table, timed out nodes are skipped
+uint8_t Wireless::meshSubscribers(uint8_t universeId, uint8_t* nodeIds) {
+    uint8_t count = 0;
+    uint32_t now = time_us_32();
+
+    for (uint8_t i = 0; i < WIRELESS_MESH_MAX_NODES; i++) {
+        if ((meshNodes[i].universes & (1 << universeId)) &&
+            ((now - meshNodes[i].lastSeen) <= WIRELESS_MESH_NODE_TIMEOUT_US))
+        {
+            if (nodeIds) {
+                nodeIds[count] = meshNodes[i].nodeId;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void Wireless::handleMeshData() {
+    RF24NetworkHeader header;
+    uint16_t bytes;
+    uint8_t universes;
+
+    // rf24mesh.update() has put everything addressed to us in the queue
+    while (rf24network.available()) {
+        rf24network.peek(header);
+
+        switch (header.type) {
+            case WirelessMeshMessage::meshEdpChunk:
+                memset(Wireless::tmpBuf_RX0, 0x00, 32); // make sure we have defined values as long as one chunk can be
+                bytes = rf24network.read(header, Wireless::tmpBuf_RX0, WIRELESS_MESH_CHUNK_SIZE);
+
+                stats.received += (bytes + WIRELESS_MESH_FRAGMENT - 1) / WIRELESS_MESH_FRAGMENT;
+                statusLeds.setBlinkOnce(6, 0, 0, 1);
+
+                edpRX.processIncomingChunk(bytes);
+                break;
+            case WirelessMeshMessage::meshSubscribe:
+                universes = 0;
+                rf24network.read(header, &universes, sizeof(universes));
+                if (boardConfig.activeConfig->radioAddress == 0) {
+                    meshUpdateNode(rf24mesh.getNodeID(header.from_node), universes);
+                }
                 break;
-                case RadioRole::mesh:
-                    if (boardConfig.activeConfig->radioAddress) {
-                        // We are a node and send to the master?
-                    } else {
-                        // We are the mesh master and iterate through the nodes
-                    }
+            default:
+                // Not for us, drop it
+                rf24network.read(header, nullptr, 0);
                 break;
-            }
+        }
+    }
+}
 
-            LOG("doSendData DONE");
+// Send a single payload and wait until it is out
+static bool wireless_write_blocking(const void* data, uint8_t length, bool noAck) {
+    rf24radio.writeFast(data, length, noAck);
+    return rf24radio.txStandBy(WIRELESS_TX_TIMEOUT_MS);
+}
+
+// Scan all usable channels a few times and pick the cleanest ones before
+// sending anything. Only called once, from init()
+void Wireless::hopStart() {
+    int16_t channel;
+
+    for (uint8_t pass = 0; pass < WIRELESS_HOP_INIT_PASSES; pass++) {
+        for (uint8_t i = WIRELESS_HOP_FIRST; i <= WIRELESS_HOP_LAST; i++) {
+            scanChannel(i);
+        }
+    }
+
+    hopCount = 0;
+    while (hopCount < WIRELESS_HOP_CHANNELS) {
+        channel = hopBestChannel();
+        if (channel < 0) {
+            break;
         }
+        hopChannels[hopCount++] = channel;
+    }
+
+    hopIndex = 0;
+    hopScanChannel = WIRELESS_HOP_FIRST;
+    hopScanned = time_us_32();
+    hopBeacon = hopScanned - WIRELESS_HOP_BEACON_US;
+    hopSwitched = hopScanned;
+
+    LOG("RF24: Hopping over %u channels, first is %u", hopCount, hopChannels[0]);
+
+    rf24radio.setChannel(hopCount ? hopChannels[0] : boardConfig.activeConfig->radioChannel);
+    rf24radio.startListening();
+}
+
+// Leader: Keep signalStrength up to date, one channel at a time
+void Wireless::hopScan() {
+    if ((time_us_32() - hopScanned) < WIRELESS_HOP_SCAN_US) {
+        return;
     }
 
-    if (triedToSend) {
-        if (anyFailed) {
-            statusLeds.setStaticOn(6, 1, 0, 0);
+    if (irqEnabled) {
+        wireless_irq_set(false);
+    }
+
+    scanChannel(hopScanChannel);
+    rf24radio.setChannel(hopChannels[hopIndex]);
+    rf24radio.startListening();
+
+    if (irqEnabled) {
+        wireless_irq_set(true);
+    }
+
+    hopScanChannel = (hopScanChannel >= WIRELESS_HOP_LAST) ? WIRELESS_HOP_FIRST : (hopScanChannel + 1);
+    hopScanned = time_us_32();
+}
+
+// Leader, after a frame was sent: Rate the channel, replace it if it went
+// bad, then tell the followers where the next frame goes and go there
+void Wireless::hopNext(bool frameLost, bool lossKnown) {
+    struct WirelessHopMarker marker;
+    uint8_t channel = hopChannels[hopIndex];
+    uint32_t now = time_us_32();
+    bool noAck = boardConfig.activeConfig->radioParams.noAck;
+    int16_t replacement;
+
+    // Smoothed the same way as signalStrength
+    if (lossKnown) {
+        if (frameLost) {
+            hopLoss[channel] += (0x7FFF - hopLoss[channel]) >> 3;
         } else {
-            statusLeds.setStaticOff(6, 1, 0, 0);
+            hopLoss[channel] -= hopLoss[channel] >> 3;
         }
     }
+
+    if ((hopLoss[channel] > WIRELESS_HOP_LOSS_MAX) || (signalStrength[channel] > WIRELESS_HOP_NOISE_MAX)) {
+        // Stays in the set while looking for the replacement, so its
+        // neighbours (likely hit by the same interference) are avoided
+        hopBlacklist[channel] = (now + WIRELESS_HOP_BLACKLIST_US) | 1;
+        hopLoss[channel] = 0;
+        replacement = hopBestChannel();
+        if (replacement >= 0) {
+            hopChannels[hopIndex] = replacement;
+        }
+        stats.hopBlacklisted++;
+        LOG("RF24: Channel %u blacklisted, replaced by %d", channel, replacement);
+    }
+
+    marker.command = Edp_Commands::RadioHop;
+    marker.nextIndex = (hopIndex + 1) % hopCount;
+    marker.count = hopCount;
+    memcpy(marker.channels, hopChannels, sizeof(marker.channels));
+
+    stats.sentTried++;
+    stats.sentSuccess += wireless_write_blocking(&marker, sizeof(marker), noAck);
+
+    // Followers that lost track wait on radioChannel. Usually there are
+    // none, so don't wait for an ACK: It would retry until the TX timeout
+    if ((now - hopBeacon) > WIRELESS_HOP_BEACON_US) {
+        rf24radio.setChannel(boardConfig.activeConfig->radioChannel);
+        stats.sentTried++;
+        stats.sentSuccess += wireless_write_blocking(&marker, sizeof(marker), true);
+        hopBeacon = now;
+    }
+
+    hopIndex = marker.nextIndex;
+    rf24radio.setChannel(hopChannels[hopIndex]);
+    hopSwitched = time_us_32();
+    stats.hops++;
 }
 
-void Wireless::handleReceivedData() {
-    size_t copySize = 0;
-    uint8_t pipe = 0;
-    size_t uncompressedLength;
-    Patching patching;
+// Follower: Runs where fetchPayloads() runs, so the SPI bus is ours
+void Wireless::hopFollow(WirelessHopMarker* marker, uint8_t length) {
+    if ((length < sizeof(struct WirelessHopMarker)) ||
+        !marker->count ||
+        (marker->count > WIRELESS_HOP_CHANNELS) ||
+        (marker->nextIndex >= marker->count))
+    {
+        return;
+    }
 
-    // TODO: Check for radio mode
+    for (uint8_t i = 0; i < marker->count; i++) {
+        if (marker->channels[i] >= MAXCHANNEL) {
+            return;
+        }
+    }
 
-    if (rf24radio.available(&pipe)) {                    // is there a payload? get the pipe number that received it
-        uint8_t bytes = rf24radio.getDynamicPayloadSize(); // get the size of the payload
+    memcpy(hopChannels, marker->channels, sizeof(hopChannels));
+    hopCount = marker->count;
+    hopIndex = marker->nextIndex;
 
-        memset(Wireless::tmpBuf_RX0, 0x00, 32); // make sure we have defined values as long as one chunk can be
-        rf24radio.read(Wireless::tmpBuf_RX0, bytes);       // get incoming payload
-        // No need to manually send an ACK since autoAck is being used
+    // The new channel is only used after going through standby
+    rf24radio.stopListening();
+    rf24radio.setChannel(hopChannels[hopIndex]);
+    rf24radio.startListening();
+
+    hopSwitched = time_us_32();
+    hopParked = false;
+    stats.hops++;
+}
+
+// Follower: Missed a marker (or the leader is gone)? Wait for the next
+// beacon on radioChannel
+void Wireless::hopCheckLost() {
+    uint32_t interrupts;
+
+    if (hopParked || ((time_us_32() - hopSwitched) < WIRELESS_HOP_LOST_US)) {
+        return;
+    }
+
+    interrupts = save_and_disable_interrupts();
+    rf24radio.stopListening();
+    rf24radio.setChannel(boardConfig.activeConfig->radioChannel);
+    rf24radio.startListening();
+    restore_interrupts(interrupts);
+
+    hopParked = true;
+    stats.hopLost++;
+    LOG("RF24: Lost the hopping leader, waiting on channel %u", boardConfig.activeConfig->radioChannel);
+}
+
+// Quietest channel that is not blacklisted and not too close to one in the set
+int16_t Wireless::hopBestChannel() {
+    int16_t best = -1;
+    uint32_t now = time_us_32();
+    bool tooClose;
+
+    for (uint8_t channel = WIRELESS_HOP_FIRST; channel <= WIRELESS_HOP_LAST; channel++) {
+        if (hopBlacklist[channel]) {
+            if ((int32_t)(hopBlacklist[channel] - now) > 0) {
+                continue;
+            }
+            hopBlacklist[channel] = 0;
+        }
+
+        tooClose = false;
+        for (uint8_t i = 0; i < hopCount; i++) {
+            if (abs(channel - hopChannels[i]) < WIRELESS_HOP_SPACING) {
+                tooClose = true;
+                break;
+            }
+        }
+        if (tooClose) {
+            continue;
+        }
+
+        if ((best < 0) || (signalStrength[channel] < signalStrength[best])) {
+            best = channel;
+        }
+    }
+
+    return best;
+}
+
+// Slowest to fastest
+static const rf24_datarate_e wireless_rates[] = { RF24_250KBPS, RF24_1MBPS, RF24_2MBPS };
+
+static uint8_t wireless_rate_index(rf24_datarate_e rate) {
+    for (uint8_t i = 0; i < sizeof(wireless_rates) / sizeof(wireless_rates[0]); i++) {
+        if (wireless_rates[i] == rate) {
+            return i;
+        }
+    }
+    return 1;
+}
+
+void Wireless::adaptFrame(bool lost, uint8_t retransmits) {
+    adaptFrames++;
+    adaptLost += lost;
+    adaptArcSum += retransmits;
+}
+
+void Wireless::adaptTask() {
+    uint32_t now = time_us_32();
+    bool sending = false;
+    uint8_t rateIndex = wireless_rate_index(dataRate);
+    uint32_t lossPercent;
+    uint32_t arcTenths;
+    uint32_t interrupts;
+
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        sending |= sendQueueUsed[i];
+    }
+
+    if (!sending) {
+        // Receiver: Might have missed the rate markers, try the next rate
+        if ((now - rxLastPayload) > WIRELESS_ADAPT_SEARCH_US) {
+            dataRate = wireless_rates[(rateIndex + 1) % 3];
+            interrupts = save_and_disable_interrupts();
+            rf24radio.stopListening();
+            rf24radio.setDataRate(dataRate);
+            rf24radio.startListening();
+            restore_interrupts(interrupts);
+            rxLastPayload = now;
+            stats.rateSearches++;
+        }
+        return;
+    }
+
+    if ((now - adaptWindowStart) < WIRELESS_ADAPT_WINDOW_US) {
+        return;
+    }
+    adaptWindowStart = now;
+
+    adaptCompression();
+
+    // Without ACKs (or enough frames) there is nothing to go by
+    if (adaptFrames < WIRELESS_ADAPT_MIN_FRAMES) {
+        return;
+    }
+
+    lossPercent = adaptLost * 100 / adaptFrames;
+
+    // What the receivers report (link telemetry) counts as well
+    for (uint8_t i = 0; i < WIRELESS_REMOTES; i++) {
+        if (remotes[i].remoteId && ((now - remotes[i].lastSeen) < 2 * WIRELESS_ADAPT_WINDOW_US)) {
+            lossPercent = MAX(lossPercent, remotes[i].lossPermille / 10u);
+        }
+    }
+    arcTenths = adaptArcSum * 10 / adaptFrames;
+    adaptFrames = 0;
+    adaptLost = 0;
+    adaptArcSum = 0;
+
+    if (lossPercent >= WIRELESS_ADAPT_LOSS_HIGH) {
+        // More power first, it costs no airtime
+        adaptGood = 0;
+        adaptHold = MIN(adaptHold * 2, WIRELESS_ADAPT_HOLD_MAX);
+        if (txPower < RF24_PA_MAX) {
+            adaptSetPower((rf24_pa_dbm_e)(txPower + 1));
+        } else if (rateIndex > 0) {
+            adaptSetRate(wireless_rates[rateIndex - 1]);
+        }
+    } else if ((lossPercent == 0) && (arcTenths < WIRELESS_ADAPT_ARC_LOW)) {
+        // Faster first, then save power (and disturb others less)
+        adaptGood++;
+        if (adaptGood >= adaptHold) {
+            adaptGood = 0;
+            adaptHold = MAX(adaptHold / 2, WIRELESS_ADAPT_HOLD_MIN);
+            if (rateIndex < 2) {
+                adaptSetRate(wireless_rates[rateIndex + 1]);
+            } else if (txPower > RF24_PA_MIN) {
+                adaptSetPower((rf24_pa_dbm_e)(txPower - 1));
+            }
+        }
+    } else {
+        adaptGood = 0;
+    }
+}
+
+// snappy costs more CPU time than the other codecs. Turn it off for a while
+// if it rarely gives the smallest frame for the data at hand
+void Wireless::adaptCompression() {
+    uint32_t tried = edpTX.stats.snappyTried - adaptSnappyTried;
+    uint32_t used = edpTX.stats.snappyUsed - adaptSnappyUsed;
+
+    adaptSnappyTried = edpTX.stats.snappyTried;
+    adaptSnappyUsed = edpTX.stats.snappyUsed;
+
+    if (!boardConfig.activeConfig->radioParams.compression) {
+        return;
+    }
+
+    if (adaptSnappyPause) {
+        adaptSnappyPause--;
+        if (!adaptSnappyPause) {
+            edpTX.setCompression(true);
+        }
+    } else if ((tried >= WIRELESS_ADAPT_MIN_FRAMES) && (used * 100 < tried * WIRELESS_ADAPT_SNAPPY_WIN)) {
+        LOG("RF24: snappy won %u of %u frames, pausing it", used, tried);
+        edpTX.setCompression(false);
+        adaptSnappyPause = WIRELESS_ADAPT_SNAPPY_PAUSE;
+    }
+}
+
+void Wireless::adaptSetPower(rf24_pa_dbm_e power) {
+    uint32_t interrupts;
+
+    txPower = power;
+    interrupts = save_and_disable_interrupts();
+    rf24radio.setPALevel(txPower, true);
+    restore_interrupts(interrupts);
+    stats.powerChanges++;
+    LOG("RF24: txPower is now %u", txPower);
+}
+
+// Tell the receivers, then switch. The ones that miss it find us by
+// searching through the rates
+void Wireless::adaptSetRate(rf24_datarate_e rate) {
+    struct WirelessRateMarker marker;
+    bool noAck = boardConfig.activeConfig->radioParams.noAck;
+
+    marker.command = Edp_Commands::RadioRate;
+    marker.dataRate = rate;
+
+    if (irqEnabled) {
+        wireless_irq_set(false);
+    }
+    rf24radio.stopListening();
+
+    for (uint8_t i = 0; i < WIRELESS_ADAPT_RATE_MARKERS; i++) {
+        stats.sentTried++;
+        stats.sentSuccess += wireless_write_blocking(&marker, sizeof(marker), noAck);
+    }
+
+    dataRate = rate;
+    rf24radio.setDataRate(dataRate);
+    rf24radio.startListening();
+
+    if (irqEnabled) {
+        wireless_irq_set(true);
+    }
+
+    stats.rateChanges++;
+    LOG("RF24: dataRate is now %u", dataRate);
+}
+
+// Receiver: Runs where fetchPayloads() runs, so the SPI bus is ours
+void Wireless::adaptFollowRate(WirelessRateMarker* marker, uint8_t length) {
+    rf24_datarate_e rate = (rf24_datarate_e)marker->dataRate;
+
+    if ((length < sizeof(struct WirelessRateMarker)) ||
+        (wireless_rates[wireless_rate_index(rate)] != rate) ||
+        (rate == dataRate))
+    {
+        return;
+    }
+
+    dataRate = rate;
+    rf24radio.stopListening();
+    rf24radio.setDataRate(dataRate);
+    rf24radio.startListening();
+    stats.rateChanges++;
+}
+
+// Receiver: Replace the ACK payload with our current stats. Only the latest
+// one is kept, so it is never older than WIRELESS_TELEMETRY_US
+void Wireless::telemetryTask() {
+    struct WirelessTelemetry report;
+    uint32_t now = time_us_32();
+    uint32_t frames;
+    uint32_t interrupts;
+
+    if ((now - telemetryWritten) < WIRELESS_TELEMETRY_US) {
+        return;
+    }
+    telemetryWritten = now;
+
+    frames = edpRX.stats.framesComplete - telemetryFrames;
+
+    report.command = Edp_Commands::RadioTelemetry;
+    report.remoteId = remoteId;
+    report.framesComplete = edpRX.stats.framesComplete;
+    report.framesCrcError = edpRX.stats.framesCrcError;
+    report.framesIncomplete = edpRX.stats.framesTimedOut + edpRX.stats.framesDropped;
+    report.rxFifoFull = stats.rxFifoFull;
+    report.lastUniverse = edpRX.stats.lastUniverse;
+    report.lastSequence = edpRX.stats.lastSequence;
+    report.reassemblyAvgUs = frames ? MIN((edpRX.stats.reassemblyUsSum - telemetryReassemblySum) / frames, 0xffff) : 0;
+    report.reassemblyMaxUs = MIN(edpRX.stats.reassemblyUsMax, 0xffff);
+
+    edpRX.stats.reassemblyUsMax = 0;
+    telemetryReassemblySum = edpRX.stats.reassemblyUsSum;
+    telemetryFrames = edpRX.stats.framesComplete;
 
-        if (bytes < 1) {
-            // TODO: Does it make sense to have "command only" commands?
-            //       If not, we should fail if bytes < 2
+    interrupts = save_and_disable_interrupts();
+    rf24radio.flush_tx();
+    rf24radio.writeAckPayload(1, &report, sizeof(report));
+    restore_interrupts(interrupts);
+}
+
+// Sender: Runs where fetchPayloads() runs
+void Wireless::telemetryReceived(WirelessTelemetry* report, uint8_t length) {
+    struct WirelessRemote* remote = nullptr;
+    struct WirelessRemote* oldest = nullptr;
+    uint32_t now = time_us_32();
+    uint32_t sent;
+    uint32_t complete;
+    uint32_t loss;
+
+    if ((length < sizeof(struct WirelessTelemetry)) || !report->remoteId) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < WIRELESS_REMOTES; i++) {
+        if (remotes[i].remoteId == report->remoteId) {
+            remote = &remotes[i];
+            break;
+        }
+        // Free entries first, then the one not heard of the longest
+        if (!remotes[i].remoteId) {
+            if (!oldest || oldest->remoteId) {
+                oldest = &remotes[i];
+            }
+        } else if (!oldest || (oldest->remoteId && ((now - remotes[i].lastSeen) > (now - oldest->lastSeen)))) {
+            oldest = &remotes[i];
+        }
+    }
+
+    if (!remote) {
+        // Free entry or one of a remote we didn't hear of for some time
+        if (oldest->remoteId && ((now - oldest->lastSeen) < WIRELESS_REMOTE_TIMEOUT_US)) {
             return;
         }
+        remote = oldest;
+        memset(remote, 0x00, sizeof(struct WirelessRemote));
+        remote->remoteId = report->remoteId;
+    } else if (report->framesComplete >= remote->telemetry.framesComplete) {
+        // Frames we sent vs. frames it completed since the last report
+        sent = stats.framesSent - remote->framesSent;
+        complete = report->framesComplete - remote->telemetry.framesComplete;
+        if (sent) {
+            loss = (complete >= sent) ? 0 : ((sent - complete) * 1000 / sent);
+            remote->lossPermille = (remote->lossPermille * 7 + loss) / 8;
+        }
+    }
+
+    memcpy(&remote->telemetry, report, sizeof(struct WirelessTelemetry));
+    remote->framesSent = stats.framesSent;
+    remote->lastSeen = now;
+    remote->reports++;
+    stats.telemetryReceived++;
+}
+
+void Wireless::handleReceivedData() {
+    uint8_t bytes;
+    uint32_t interrupts;
+
+    // Catches what the IRQ missed: The line is not connected, the ring was
+    // full or a payload came in while the IRQ was disabled for sending
+    interrupts = save_and_disable_interrupts();
+    fetchPayloads();
+    restore_interrupts(interrupts);
+
+    while (rxRingTail != rxRingHead) {
+        __dmb();
+        bytes = rxRing[rxRingTail].length;
+        memset(Wireless::tmpBuf_RX0, 0x00, 32); // make sure we have defined values as long as one chunk can be
+        memcpy(Wireless::tmpBuf_RX0, rxRing[rxRingTail].data, bytes);
+        __dmb();
+        rxRingTail = (rxRingTail + 1) & (WIRELESS_RX_RING - 1);
 
         stats.received++;
 
@@ -278,7 +1585,106 @@ std::string Wireless::getWirelessStats() {
 
     output["sentTried"] = stats.sentTried;
     output["sentSuccess"] = stats.sentSuccess;
+    output["sentBulkRetries"] = stats.sentBulkRetries;
     output["received"] = stats.received;
+    output["rxFifoFull"] = stats.rxFifoFull;
+    output["rxRingFull"] = stats.rxRingFull;
+    output["airtimeUs"] = stats.airtimeUs;
+    if (boardConfig.activeConfig->radioParams.telemetry) {
+        // Per remote data is in getWirelessRemotes(), both together don't fit one SSI insert
+        output["framesSent"] = stats.framesSent;
+        output["telemetryReceived"] = stats.telemetryReceived;
+    }
+    if (boardConfig.activeConfig->radioParams.adaptive) {
+        output["dataRate"] = (int)dataRate;
+        output["txPower"] = (int)txPower;
+        output["rateChanges"] = stats.rateChanges;
+        output["powerChanges"] = stats.powerChanges;
+        output["rateSearches"] = stats.rateSearches;
+        output["snappyPaused"] = (adaptSnappyPause > 0);
+    }
+    if (boardConfig.activeConfig->radioParams.hopping != RadioHopping::hopOff) {
+        output["hops"] = stats.hops;
+        output["hopBlacklisted"] = stats.hopBlacklisted;
+        output["hopLost"] = stats.hopLost;
+        for (uint8_t i = 0; i < hopCount; i++) {
+            output["hopChannels"][i] = hopChannels[i];
+        }
+    }
+    if (radio2) {
+        output["airtime2Us"] = stats.airtime2Us;
+        output["dualMoves"] = stats.dualMoves;
+        for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+            output["dualModule"][i] = dualRadio[i] + 1;
+        }
+    }
+    if (boardConfig.activeConfig->radioRole == RadioRole::mesh) {
+        uint8_t nodes = 0;
+        output["meshNodes"] = Json::arrayValue;
+        for (uint8_t i = 0; i < WIRELESS_MESH_MAX_NODES; i++) {
+            if (!meshNodes[i].universes) {
+                continue;
+            }
+            // [nodeId, universes, lastSeenMs], keeps the answer below the SSI insert limit
+            output["meshNodes"][nodes][0] = meshNodes[i].nodeId;
+            output["meshNodes"][nodes][1] = meshNodes[i].universes;
+            output["meshNodes"][nodes][2] = (time_us_32() - meshNodes[i].lastSeen) / 1000;
+            nodes++;
+        }
+    }
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        uint32_t latencyCount = queueStats[i].sent - queueStats[i].refreshes;
+        output["queue"][i]["sent"] = queueStats[i].sent;
+        output["queue"][i]["refreshes"] = queueStats[i].refreshes;
+        output["queue"][i]["latencyAvgUs"] = (uint32_t)(latencyCount ? (queueStats[i].latencySumUs / latencyCount) : 0);
+        output["queue"][i]["latencyMaxUs"] = queueStats[i].latencyMaxUs;
+    }
+    output["edpFramesComplete"] = edpRX.stats.framesComplete;
+    output["edpFramesCrcError"] = edpRX.stats.framesCrcError;
+    output["edpFramesTimedOut"] = edpRX.stats.framesTimedOut;
+    output["edpFramesDropped"] = edpRX.stats.framesDropped;
+    output["edpChunksDuplicate"] = edpRX.stats.chunksDuplicate;
+    output["edpChunksStale"] = edpRX.stats.chunksStale;
+    output["edpChunksInvalid"] = edpRX.stats.chunksInvalid;
+    output["edpFramesNoReference"] = edpRX.stats.framesNoReference;
+    output["edpChunksRecovered"] = edpRX.stats.chunksRecovered;
+    output_string = Json::writeString(wbuilder, output);
+    return output_string;
+}
+
+std::string Wireless::getWirelessRemotes() {
+    Json::Value output;
+    Json::StreamWriterBuilder wbuilder;
+    std::string output_string;
+    uint64_t latencySum = 0;
+    uint32_t latencyCount = 0;
+    uint8_t count = 0;
+
+    wbuilder["indentation"] = "";
+
+    // Queueing on our side + reassembly on the remote's side
+    for (uint8_t i = 0; i < WIRELESS_UNIVERSES; i++) {
+        latencySum += queueStats[i].latencySumUs;
+        latencyCount += queueStats[i].sent - queueStats[i].refreshes;
+    }
+
+    output["remotes"] = Json::arrayValue;
+    for (uint8_t i = 0; i < WIRELESS_REMOTES; i++) {
+        if (!remotes[i].remoteId) {
+            continue;
+        }
+        char remoteId[9];
+        snprintf(remoteId, sizeof(remoteId), "%08lx", (unsigned long)remotes[i].remoteId);
+        output["remotes"][count]["id"] = remoteId;
+        output["remotes"][count]["lastSeenMs"] = (time_us_32() - remotes[i].lastSeen) / 1000;
+        output["remotes"][count]["framesComplete"] = remotes[i].telemetry.framesComplete;
+        output["remotes"][count]["framesCrcError"] = remotes[i].telemetry.framesCrcError;
+        output["remotes"][count]["framesIncomplete"] = remotes[i].telemetry.framesIncomplete;
+        output["remotes"][count]["rxFifoFull"] = remotes[i].telemetry.rxFifoFull;
+        output["remotes"][count]["lossPermille"] = remotes[i].lossPermille;
+        output["remotes"][count]["latencyEstUs"] = (uint32_t)((latencyCount ? (latencySum / latencyCount) : 0) + remotes[i].telemetry.reassemblyAvgUs);
+        count++;
+    }
     output_string = Json::writeString(wbuilder, output);
     return output_string;
 }
@@ -9,6 +9,8 @@
 #include <RF24Network.h>
 #include <RF24Mesh.h>
 
+#include <pico/time.h>
+
 #include "edp.h"
 #include "boardconfig.h"
 
@@ -17,23 +19,190 @@
 // nRF24L01+ can tune to 128 channels with 1 MHz spacing from 2400MHz to 2527MHz
 #define MAXCHANNEL 128
 
+// Sniffer: Channels are swept from an alarm of an alarm pool created on
+// core1, so its callbacks run there, next to everything else using the radio.
+// The dwell per channel is random, so FHSS devices don't show up as strobes
+#define WIRELESS_SCAN_SETTLE_US       130  // RX settling after tuning
+#define WIRELESS_SCAN_DWELL_MIN_US    150  // RPD needs at least 40µs of a signal within 170µs
+#define WIRELESS_SCAN_DWELL_MAX_US    230
+#define WIRELESS_SCAN_OCCUPANCY_VISITS 1000 // Occupancy counters are halved after this many visits of a channel
+
+// How long the TX FIFO is retried before a frame is given up
+#define WIRELESS_TX_TIMEOUT_MS 20
+
+// Universes that can be sent
+#define WIRELESS_UNIVERSES 4
+
+// TX scheduling: The universe waiting longest is sent first, every changed
+// channel counts as if it waited WIRELESS_CHANGE_WEIGHT_US longer
+#define WIRELESS_AIRTIME_PERCENT     80  // Max share of the time the radio sends, leaves room for others on the channel
+#define WIRELESS_AIRTIME_BURST_US 100000  // Airtime that can be saved up for bursts
+#define WIRELESS_CHANGE_WEIGHT_US     50
+#define WIRELESS_REFRESH_US      1000000  // Unchanged universes are resent (as keyframe) this often, so receivers can join
+
+// Payloads fetched from the radio by the IRQ handler, waiting for EDP. Power of 2
+#define WIRELESS_RX_RING 32
+
+// Channel hopping (broadcast): The leader picks the cleanest channels from
+// its scans and hops to the next one after every frame. A marker sent at the
+// end of each frame tells the followers where to go
+#define WIRELESS_HOP_CHANNELS         8
+#define WIRELESS_HOP_FIRST            2        // Channels used for hopping: 2402 to 2480 MHz
+#define WIRELESS_HOP_LAST            80
+#define WIRELESS_HOP_SPACING          3        // Min distance between channels of the set (2 MHz wide at 2 Mbps)
+#define WIRELESS_HOP_INIT_PASSES     16        // Scans of all channels before the first set is picked
+#define WIRELESS_HOP_SCAN_US      10000        // Leader keeps scanning one channel this often
+#define WIRELESS_HOP_BEACON_US   100000        // Marker is repeated on radioChannel this often, so followers can (re)join
+#define WIRELESS_HOP_GUARD_US       300        // Time the followers get to switch channels
+#define WIRELESS_HOP_LOST_US    1000000        // Followers without a marker for this long go back to radioChannel
+#define WIRELESS_HOP_LOSS_MAX    0x2000        // Smoothed frame loss (0x7FFF = all) from which a channel is blacklisted
+#define WIRELESS_HOP_NOISE_MAX   0x4000        // Same for signalStrength
+#define WIRELESS_HOP_BLACKLIST_US 30000000
+
+struct __attribute__((__packed__)) WirelessHopMarker {
+    uint8_t command;   // Edp_Commands::RadioHop
+    uint8_t nextIndex; // Index into channels for the next frame
+    uint8_t count;
+    uint8_t channels[WIRELESS_HOP_CHANNELS];
+};
+
+// Adaptive link (broadcast): The sender rates every window by the share of
+// frames that needed retries and steps txPower and dataRate. Receivers follow
+// its rate markers and try the other data rates if they hear nothing
+#define WIRELESS_ADAPT_WINDOW_US   1000000
+#define WIRELESS_ADAPT_MIN_FRAMES       20     // Windows with less frames sent are not rated
+#define WIRELESS_ADAPT_LOSS_HIGH         5     // % of frames with retries from which the link is stepped down
+#define WIRELESS_ADAPT_ARC_LOW           5     // Avg. retransmits of a frame's last chunk (in 1/10) below which the link is good
+#define WIRELESS_ADAPT_HOLD_MIN          4     // Good windows needed before stepping up. Doubles with every step down,
+#define WIRELESS_ADAPT_HOLD_MAX         64     // halves with every step up
+#define WIRELESS_ADAPT_RATE_MARKERS      3     // Rate markers sent before switching
+#define WIRELESS_ADAPT_SEARCH_US   2000000     // Receivers try the next data rate after hearing nothing for this long
+#define WIRELESS_ADAPT_SNAPPY_WIN        5     // % of frames snappy has to win to stay enabled
+#define WIRELESS_ADAPT_SNAPPY_PAUSE     30     // Windows snappy stays off before it is measured again
+
+struct __attribute__((__packed__)) WirelessRateMarker {
+    uint8_t command;   // Edp_Commands::RadioRate
+    uint8_t dataRate;  // rf24_datarate_e
+};
+
+// Link telemetry (broadcast): Receivers preload their stats as ACK payload,
+// the sender collects them per remote
+#define WIRELESS_TELEMETRY_US       100000  // Receivers refresh their ACK payload this often
+#define WIRELESS_REMOTES                 8  // Remotes the sender keeps track of
+#define WIRELESS_REMOTE_TIMEOUT_US 10000000 // Remotes not heard of for this long can be replaced
+
+// Max 32 byte, it's a single ACK payload
+struct __attribute__((__packed__)) WirelessTelemetry {
+    uint8_t command;          // Edp_Commands::RadioTelemetry
+    uint32_t remoteId;        // Lower 32 bit of the receiver's board id
+    uint32_t framesComplete;  // EdpStats of the receiver, counted since it started
+    uint32_t framesCrcError;
+    uint32_t framesIncomplete; // Timed out or dropped
+    uint16_t rxFifoFull;      // WirelessStats, lower 16 bit
+    uint8_t lastUniverse;     // Last frame completed
+    uint8_t lastSequence;
+    uint16_t reassemblyAvgUs; // Since the last report
+    uint16_t reassemblyMaxUs;
+};
+
+struct WirelessRemote {
+    uint32_t remoteId;        // 0 = entry is free
+    uint32_t lastSeen;        // time_us_32()
+    uint32_t reports;
+    uint32_t framesSent;      // Our WirelessStats.framesSent when the last report came in
+    uint16_t lossPermille;    // Frames sent but not completed by the remote, smoothed
+    struct WirelessTelemetry telemetry; // Last report
+};
+
+// Mesh: Universes go as EDP chunks over RF24Network, which fragments
+// them into radio payloads (24 bytes each after the network header)
+#define WIRELESS_MESH_CHUNK_SIZE     MAX_PAYLOAD_SIZE
+#define WIRELESS_MESH_FRAGMENT       24
+#define WIRELESS_MESH_MAX_NODES      16       // Subscriptions the master keeps track of
+#define WIRELESS_MESH_SUBSCRIBE_US   1000000  // Nodes renew their subscription this often
+#define WIRELESS_MESH_NODE_TIMEOUT_US 5000000 // Subscriptions not renewed are dropped
+#define WIRELESS_MESH_MULTICAST_MIN  2        // Subscribers from which a universe is multicast
+
+// RF24Network message types, 1-64 don't get a network-ACK
+enum WirelessMeshMessage : uint8_t {
+    meshEdpChunk              = 10, // One EDP chunk
+    meshSubscribe             = 11, // Node -> master: Bitmask of the universes the node wants
+};
+
+struct WirelessMeshNode {
+    uint8_t nodeId;
+    uint8_t universes; // Bitmask, 0 = entry is free
+    uint32_t lastSeen; // time_us_32() of the last subscription
+};
+
+// Second module (WIRELESS_DUAL_RADIO builds, radioDual set, broadcast only):
+// A broadcast channel of its own on radioChannel2. The sender splits the
+// universes between both modules and hands them chunks alternately, so both
+// are in the air at the same time. Hopping, rate adaption and telemetry stay
+// with the first module. Receivers with two modules listen on both channels
+#define WIRELESS_DUAL_CHUNKS   (32 + EDP_FEC_MAX_PARITY) // Chunks of one frame, all prepared before sending
+#define WIRELESS_DUAL_BALANCE_US   1000000  // dualBalanced: The assignment is checked this often
+#define WIRELESS_DUAL_BALANCE_MIN       20  // and changed if that reduces the difference between the modules by this % of the airtime
+
+struct WirelessChunkList {
+    uint8_t count;
+    uint8_t next;             // Next one to hand to the radio
+    uint8_t length[WIRELESS_DUAL_CHUNKS];
+    uint8_t data[WIRELESS_DUAL_CHUNKS][32];
+};
+
+struct WirelessRxPayload {
+    uint8_t length;
+    uint8_t data[32];
+};
+
 struct WirelessStats {
     uint64_t sentTried;   // Packets we tried to send in total
     uint64_t sentSuccess; // Packets we got an ACK for
+    uint64_t sentBulkRetries; // Times the TX FIFO had to be resent because a packet ran out of retransmits
     uint64_t received;    // Packets we received
+    uint64_t rxFifoFull;  // Times the radio's RX FIFO was full when we looked, payloads might have been lost
+    uint64_t rxRingFull;  // Times payloads had to be left in the radio since EDP didn't keep up
+    uint64_t airtimeUs;   // Estimated time spent sending
+    uint64_t hops;        // Channel changes due to hopping
+    uint64_t hopBlacklisted; // Leader: Channels removed from the set for loss or noise
+    uint64_t hopLost;     // Follower: Times it went back to radioChannel to find the leader
+    uint64_t rateChanges;
+    uint64_t powerChanges;
+    uint64_t rateSearches; // Receiver: Times it tried the next data rate to find the sender
+    uint64_t framesSent;  // DMX frames (not chunks) sent, except all-zero ones
+    uint64_t telemetryReceived;
+    uint64_t airtime2Us;  // Second module, part of airtimeUs
+    uint64_t dualMoves;   // dualBalanced: Universes moved to the other module
+};
+
+struct WirelessQueueStats {
+    uint32_t sent;
+    uint32_t refreshes;      // Sent without changes, see WIRELESS_REFRESH_US
+    uint32_t latencyMaxUs;   // From being queued until sending starts
+    uint64_t latencySumUs;
 };
 
 class Wireless {
   public:
     void init();
+    void initIrq();
     void cyclicTask();
+    void irqHandler();
+    int64_t scanStep(); // Sniffer sweep, from the alarm on core1
 
     bool moduleAvailable = false;
+    bool module2Available = false;
     uint16_t signalStrength[MAXCHANNEL]; // Used for spectrum analyser mode
+    uint16_t signalPeak[MAXCHANNEL];     // High resolution mode: Highest signalStrength since the reset
+    uint8_t signalOccupancy[MAXCHANNEL]; // High resolution mode: % of visits a signal was detected
+    bool spectrumHighRes = false;
+    void spectrumReset();
 
     void sendData(uint8_t universeId, uint8_t* source, uint16_t sourceLength);
 
     std::string getWirelessStats();
+    std::string getWirelessRemotes(); // Telemetry of the receivers, broadcast mode
 
     // TODO: Function to get/set the whole set or single parameters
     //       such as role, channel, txPower
@@ -42,20 +211,112 @@ class Wireless {
 
   private:
     uint8_t lastScannedChannel = 0;
+    alarm_pool_t* scanAlarmPool = nullptr;          // Created on core1, fires there
+    volatile bool scanRunning = false;              // Sweep alarm is scheduled
+    uint32_t scanRandom = 1;                        // xorshift32 state for the dwell
+    uint16_t scanVisits[MAXCHANNEL];
+    uint16_t scanHits[MAXCHANNEL];
     void scanChannel(uint8_t channel);
-    bool sendQueueValid[4];
-    uint8_t sendQueueData[4][512];
+    void scanTask();
+    uint32_t scanNextDwell();
+    void scanRecord(uint8_t channel, bool detected);
+    bool sendQueueValid[WIRELESS_UNIVERSES];
+    bool sendQueueUsed[WIRELESS_UNIVERSES];         // Got data at least once, so it is refreshed
+    uint32_t sendQueueSince[WIRELESS_UNIVERSES];    // time_us_32() the pending data was queued
+    uint32_t sendQueueChanges[WIRELESS_UNIVERSES];  // Channels changed since it was sent
+    uint32_t lastSent[WIRELESS_UNIVERSES];
+    uint8_t sendQueueData[WIRELESS_UNIVERSES][512];
+    uint8_t nextUniverse;                           // Round robin: Wins if the score is the same
+    int32_t airtimeBudgetUs;
+    uint32_t airtimeRefilled;
+    struct WirelessQueueStats queueStats[WIRELESS_UNIVERSES];
+    struct WirelessMeshNode meshNodes[WIRELESS_MESH_MAX_NODES]; // Master only
+    uint32_t meshSubscribed;                        // Node only: time_us_32() of the last subscription
 
     Edp edpTX;
     Edp edpRX;
 
-    static uint8_t tmpBuf_RX0[600];
+    static uint8_t tmpBuf_RX0[600]; // Big enough for WIRELESS_MESH_CHUNK_SIZE
     static uint8_t tmpBuf_RX1[600];
     static uint8_t tmpBufQueueCopy[600];
     static uint8_t tmpBuf_TX1[600];
+    static EdpReassemblySlot edpRX_slots[4];
+    static EdpReference edpRX_references[4];
+    static EdpReference edpTX_references[4];
+
+    RF24* radio2 = nullptr;                         // Second module, if it's there and in use
+    uint8_t dualRadio[WIRELESS_UNIVERSES];          // Module (0 = first) sending the universe
+    uint32_t dualLoadUs[WIRELESS_UNIVERSES];        // Airtime per universe since the last balancing
+    uint32_t dualBalanced;                          // time_us_32()
+    static uint8_t tmpBufQueueCopy2[512];           // Universe for the second module
+    static WirelessChunkList dualChunks[2];
+
+    static WirelessRxPayload rxRing[WIRELESS_RX_RING];
+    volatile uint8_t rxRingHead = 0; // Written by the IRQ handler only
+    volatile uint8_t rxRingTail = 0; // Written by handleReceivedData only
+    bool irqEnabled = false;
+
+    uint8_t hopChannels[WIRELESS_HOP_CHANNELS];
+    uint8_t hopCount = 0;
+    uint8_t hopIndex = 0;                           // Channel in use
+    uint16_t hopLoss[MAXCHANNEL];                   // Leader: Smoothed frame loss, scaled like signalStrength
+    uint32_t hopBlacklist[MAXCHANNEL];              // Leader: time_us_32() until the channel can be used again, 0 = not blacklisted
+    uint8_t hopScanChannel;
+    uint32_t hopScanned;
+    uint32_t hopBeacon;
+    uint32_t hopSwitched;                           // Leader: Last hop. Follower: Last marker received
+    bool hopParked = true;                          // Follower: Waiting on radioChannel
+
+    rf24_datarate_e dataRate;                       // In use, starts with the configured one
+    rf24_pa_dbm_e txPower;
+    volatile uint32_t rxLastPayload;                // time_us_32()
+    uint32_t adaptWindowStart;
+    uint32_t adaptFrames;
+    uint32_t adaptLost;                             // Frames that needed a FIFO retry or failed
+    uint32_t adaptArcSum;
+    uint8_t adaptGood;                              // Good windows in a row
+    uint8_t adaptHold;
+    uint8_t adaptSnappyPause;
+    uint32_t adaptSnappyTried;                      // edpTX.stats at the start of the window
+    uint32_t adaptSnappyUsed;
+
+    struct WirelessRemote remotes[WIRELESS_REMOTES]; // Sender: Telemetry per receiver
+    uint32_t remoteId;                              // Ours, when sending telemetry
+    uint32_t telemetryWritten;
+    uint64_t telemetryReassemblySum;                // edpRX.stats at the last report
+    uint32_t telemetryFrames;
 
+    void fetchPayloads();
+    void fetchPayloads(RF24* radio);
     void handleReceivedData();
     void doSendData();
+    int8_t pickUniverse(uint32_t now, int8_t radio);
+    void takeUniverse(uint8_t universeId, uint32_t now, uint8_t* destination);
+    bool sendBroadcast(uint8_t universeId);
+    bool sendBroadcastDual(int8_t universe1, int8_t universe2, uint32_t* airtime);
+    void prepareChunks(uint8_t universeId, WirelessChunkList* list);
+    void dualBalance();
+    bool sendMesh(uint8_t universeId);
+    void handleMeshData();
+    void meshSendSubscription();
+    void meshUpdateNode(int16_t nodeId, uint8_t universes);
+    void meshExpireNodes();
+    uint8_t meshSubscribers(uint8_t universeId, uint8_t* nodeIds);
+    uint32_t chunkAirtimeUs();
+    void hopStart();
+    void hopScan();
+    void hopNext(bool frameLost, bool lossKnown);
+    void hopFollow(WirelessHopMarker* marker, uint8_t length);
+    void hopCheckLost();
+    int16_t hopBestChannel();
+    void adaptTask();
+    void adaptFrame(bool lost, uint8_t retransmits);
+    void adaptCompression();
+    void adaptSetPower(rf24_pa_dbm_e power);
+    void adaptSetRate(rf24_datarate_e rate);
+    void adaptFollowRate(WirelessRateMarker* marker, uint8_t length);
+    void telemetryTask();
+    void telemetryReceived(WirelessTelemetry* report, uint8_t length);
 
     // Stats:
     struct WirelessStats stats;
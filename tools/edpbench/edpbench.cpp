@@ -0,0 +1,269 @@
+// edpbench: Replays DMX frames through the codecs EDP can use and reports the
+// compression ratio, the number of 32 byte radio chunks needed and the time
+// spent per frame
+//
+// Input files contain raw frames, 512 byte each, one after the other. Without
+// input files, a synthetic show is generated (static wash, fades, moving heads
+// with 16 bit pan/tilt and an RGB pixel chase)
+//
+// Every frame is encoded twice: as keyframe (the frame itself) and as delta
+// (XOR against the last keyframe), the same way Edp::prepareDmxData does it.
+// A new keyframe starts every FRAMES_PER_KEYFRAME frames or when the delta
+// isn't smaller than the keyframe. The firmware compares encoded sizes there,
+// the bench compares the sparse windows so all codecs see the same deltas
+//
+// M0+ cost model: The host runs a reference loop that costs
+// M0_CYCLES_PER_REF_BYTE on the RP2040 (ldrb, muls, eors, adds, cmp, bne).
+// Codec times are scaled by the ratio of both. That ignores cache and
+// branch prediction differences, so it's an estimate to compare codecs,
+// not a replacement for measuring on the device
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <snappy.h>
+
+#include "dmxcodec.h"
+
+#define FRAME_SIZE               512
+#define CHUNK_PAYLOAD             29  // 32 byte radio payload - command - chunk header
+#define PACKET_HEADERS             6  // Packet header + reference header
+#define SYNTHETIC_FRAMES        2000
+#define REPETITIONS               20  // Every frame is encoded this often for timing
+#define M0_CYCLES_PER_REF_BYTE     8
+#define FRAMES_PER_KEYFRAME       44  // EDP_KEYFRAME_INTERVAL_US (1 s) at the full DMX frame rate
+
+typedef std::vector<uint8_t> Frame;
+
+struct Result {
+    const char* name;
+    uint64_t    bytesIn;
+    uint64_t    bytesOut;
+    uint64_t    chunks;
+    double      seconds;
+};
+
+static volatile uint32_t sink;
+
+static bool loadFrames(const char* fileName, std::vector<Frame>* frames) {
+    FILE* file = fopen(fileName, "rb");
+    if (!file) {
+        fprintf(stderr, "Can't open %s\n", fileName);
+        return false;
+    }
+
+    Frame frame(FRAME_SIZE);
+    while (fread(frame.data(), 1, FRAME_SIZE, file) == FRAME_SIZE) {
+        frames->push_back(frame);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void syntheticShow(std::vector<Frame>* frames) {
+    for (int f = 0; f < SYNTHETIC_FRAMES; f++) {
+        Frame frame(FRAME_SIZE, 0);
+
+        // 1-48: 16 RGB pars, static wash in two colours
+        for (int i = 0; i < 16; i++) {
+            frame[i * 3 + 0] = (i & 1) ? 255 : 0;
+            frame[i * 3 + 1] = 0;
+            frame[i * 3 + 2] = (i & 1) ? 0 : 200;
+        }
+
+        // 49-60: 12 dimmers, slow sine-ish fade
+        int phase = f % 400;
+        uint8_t level = (phase < 200) ? (phase * 255 / 200) : ((400 - phase) * 255 / 200);
+        for (int i = 0; i < 12; i++) {
+            frame[48 + i] = level;
+        }
+
+        // 100-195: 6 moving heads with 16 channels: pan, pan fine, tilt, tilt fine, dimmer, colour, gobo, ...
+        for (int i = 0; i < 6; i++) {
+            uint16_t pan = 32768 + (int)(20000 * ((f + i * 50) % 300 - 150) / 150);
+            uint16_t tilt = 20000 + (f * 37 + i * 1000) % 8000;
+            uint8_t* head = frame.data() + 100 + i * 16;
+            head[0] = pan >> 8;
+            head[1] = pan & 0xff;
+            head[2] = tilt >> 8;
+            head[3] = tilt & 0xff;
+            head[4] = 255;
+            head[5] = 16 * (i % 4);
+            head[6] = 0;
+            head[7] = 128;
+        }
+
+        // 301-480: 60 RGB pixels, chase
+        for (int i = 0; i < 60; i++) {
+            int distance = (i - f / 2) % 60;
+            distance = (distance < 0) ? -distance : distance;
+            uint8_t value = (distance < 8) ? (255 - distance * 32) : 0;
+            frame[300 + i * 3 + 0] = value;
+            frame[300 + i * 3 + 1] = value / 2;
+            frame[300 + i * 3 + 2] = 0;
+        }
+
+        frames->push_back(frame);
+    }
+}
+
+// Same window as Edp::encodeFrame (without the ranges alternative)
+static bool sparseWindow(const uint8_t* frame, uint16_t* offset, uint16_t* size) {
+    int first = -1;
+    int last = 0;
+    for (int i = 0; i < FRAME_SIZE; i++) {
+        if (frame[i]) {
+            if (first < 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first < 0) {
+        return false;
+    }
+    *offset = first;
+    *size = last - first + 1;
+    return true;
+}
+
+static void addResult(Result* result, uint16_t in, uint16_t out) {
+    result->bytesIn += in;
+    result->bytesOut += out;
+    result->chunks += (out + PACKET_HEADERS + CHUNK_PAYLOAD - 1) / CHUNK_PAYLOAD;
+}
+
+// Seconds per reference byte on the host, to scale to the M0+
+static double referenceLoop() {
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i * 7;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t hash = 0;
+    for (int rep = 0; rep < 50; rep++) {
+        for (size_t i = 0; i < data.size(); i++) {
+            hash = (hash * 31) ^ data[i];
+        }
+    }
+    sink = hash;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / (50.0 * data.size());
+}
+
+static bool run(const std::vector<Frame>& input, const char* label) {
+    Result results[3] = {
+        { "none",   0, 0, 0, 0 },
+        { "snappy", 0, 0, 0, 0 },
+        { "dmx",    0, 0, 0, 0 },
+    };
+    uint64_t frames = 0;
+    uint8_t out[1024];
+    uint8_t decoded[FRAME_SIZE];
+
+    for (const Frame& frame : input) {
+        uint16_t offset;
+        uint16_t size;
+        if (!sparseWindow(frame.data(), &offset, &size)) {
+            continue; // Sent as DmxDataAllZero
+        }
+        const uint8_t* window = frame.data() + offset;
+        frames++;
+
+        addResult(&results[0], size, size);
+
+        // snappy
+        size_t snappySize = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < REPETITIONS; rep++) {
+            snappy::RawCompress((const char*)window, size, (char*)out, &snappySize);
+        }
+        results[1].seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / REPETITIONS;
+        addResult(&results[1], size, snappySize);
+
+        // DMX codec
+        uint16_t dmxSize = 0;
+        start = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < REPETITIONS; rep++) {
+            dmxSize = DmxCodec::encode(window, size, out, sizeof(out));
+        }
+        results[2].seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / REPETITIONS;
+        addResult(&results[2], size, dmxSize);
+
+        if ((DmxCodec::decode(out, dmxSize, decoded, sizeof(decoded)) != size) || memcmp(decoded, window, size)) {
+            fprintf(stderr, "DmxCodec round trip failed!\n");
+            return false;
+        }
+    }
+
+    double referenceSeconds = referenceLoop();
+
+    printf("\n%s: %llu frames\n", label, (unsigned long long)frames);
+    printf("%-8s %10s %10s %7s %12s %12s %14s\n", "codec", "bytes in", "bytes out", "ratio", "chunks/frame", "us/frame", "M0+ cycles/fr");
+    for (const Result& result : results) {
+        if (!frames) {
+            break;
+        }
+        double secondsPerFrame = result.seconds / frames;
+        printf("%-8s %10llu %10llu %7.3f %12.2f %12.3f %14.0f\n",
+            result.name,
+            (unsigned long long)result.bytesIn,
+            (unsigned long long)result.bytesOut,
+            result.bytesIn ? (double)result.bytesOut / result.bytesIn : 0,
+            (double)result.chunks / frames,
+            secondsPerFrame * 1e6,
+            secondsPerFrame / referenceSeconds * M0_CYCLES_PER_REF_BYTE);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<Frame> frames;
+
+    for (int i = 1; i < argc; i++) {
+        if (!loadFrames(argv[i], &frames)) {
+            return 1;
+        }
+    }
+
+    if (frames.empty()) {
+        syntheticShow(&frames);
+        printf("No input files given, using %d synthetic frames\n", SYNTHETIC_FRAMES);
+    }
+
+    // Deltas: XOR with the last keyframe
+    std::vector<Frame> deltas;
+    size_t keyframe = 0;
+    for (size_t f = 1; f < frames.size(); f++) {
+        Frame delta(FRAME_SIZE);
+        for (int i = 0; i < FRAME_SIZE; i++) {
+            delta[i] = frames[f][i] ^ frames[keyframe][i];
+        }
+
+        uint16_t offset;
+        uint16_t deltaSize = 0;
+        uint16_t keyframeSize = 0;
+        sparseWindow(delta.data(), &offset, &deltaSize);
+        sparseWindow(frames[keyframe].data(), &offset, &keyframeSize);
+        if (((f - keyframe) >= FRAMES_PER_KEYFRAME) || (deltaSize >= keyframeSize)) {
+            // Sent as keyframe
+            keyframe = f;
+            continue;
+        }
+        deltas.push_back(delta);
+    }
+
+    if (!run(frames, "Keyframes") || !run(deltas, "Deltas (XOR with last keyframe)")) {
+        return 1;
+    }
+
+    return 0;
+}
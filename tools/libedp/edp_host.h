@@ -0,0 +1,45 @@
+#ifndef EDP_HOST_H
+#define EDP_HOST_H
+
+// Platform bits src/edp.cpp expects from the pico-sdk and the firmware,
+// for building it on the host (EDP_HOST defined)
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef EDP_HOST_FIRMWARE
+// Built next to firmware modules (tools/rf24sim builds src/wireless.cpp):
+// The firmware's headers are used on top of the host stand-ins for the
+// pico-sdk, so LOG, time_us_32() and PatchType are the same for both
+#include "log.h"
+#include "boardconfig.h"
+#else
+
+#ifdef EDP_HOST_DEBUG
+#define LOG(...) do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } while (0)
+#else
+#define LOG(...) do { } while (0)
+#endif
+
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
+
+static inline uint32_t time_us_32() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Only used by the firmware to find the patching, any value does on the host
+enum PatchType : uint8_t {
+    host                      = 0,
+};
+
+#endif // EDP_HOST_FIRMWARE
+
+#endif // EDP_HOST_H
@@ -0,0 +1,181 @@
+// edphidbench: Universes per second over HID
+//
+// Sends frames of changing content on up to 24 universes via HID EDP, as
+// fast as the device takes them or at a given rate, with a window of
+// reports in flight. The device's status reports (HidStatus) tell how many
+// frames were completed, failed the CRC or were lost and how long it took
+// until a report was acknowledged
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "libedp.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Device counters are 16 bit and wrap, the differences are summed up here
+struct DeviceTotals {
+    bool     valid;
+    bool     counting;          // Only while the benchmark runs
+    struct Edp_HidStatus last;
+    uint64_t complete;
+    uint64_t crcErrors;
+    uint64_t lost;
+    uint64_t statusCount;
+    uint64_t slotsInUseSum;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s --hid <hidraw device> [options]\n"
+        "  --universes <n>    Number of universes, 1-%u (default %u)\n"
+        "  --fps <n>          Frames per second per universe, 0 = as fast as possible (default 0)\n"
+        "  --seconds <n>      Duration of the test (default 10)\n"
+        "  --window <n>       Reports in flight, 0 = no flow control (default 8)\n"
+        "  --changes <n>      Channels changed per frame, 512 = all (default 512)\n"
+        "  --delta            Send keyframes and deltas (default)\n"
+        "  --no-delta         Send plain DmxData\n",
+        name, EDP_HOST_UNIVERSES, EDP_HOST_UNIVERSES);
+}
+
+static void statusReceived(void* context, const struct Edp_HidStatus& status) {
+    DeviceTotals* totals = (DeviceTotals*)context;
+
+    if (totals->valid && totals->counting) {
+        totals->complete += (uint16_t)(status.framesComplete - totals->last.framesComplete);
+        totals->crcErrors += (uint16_t)(status.framesCrcError - totals->last.framesCrcError);
+        totals->lost += (uint16_t)(status.framesLost - totals->last.framesLost);
+        totals->statusCount++;
+        totals->slotsInUseSum += status.slotsInUse;
+    }
+    totals->last = status;
+    totals->valid = true;
+}
+
+int main(int argc, char** argv) {
+    EdpLink link;
+    DeviceTotals totals;
+    std::string hidDevice;
+    int universes = EDP_HOST_UNIVERSES;
+    double fps = 0;
+    double seconds = 10;
+    int window = 8;
+    int changes = 512;
+    bool delta = true;
+    uint8_t data[EDP_HOST_UNIVERSES][512];
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if ((arg == "--hid") && hasValue) {
+            hidDevice = argv[++i];
+        } else if ((arg == "--universes") && hasValue) {
+            universes = atoi(argv[++i]);
+        } else if ((arg == "--fps") && hasValue) {
+            fps = atof(argv[++i]);
+        } else if ((arg == "--seconds") && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if ((arg == "--window") && hasValue) {
+            window = atoi(argv[++i]);
+        } else if ((arg == "--changes") && hasValue) {
+            changes = atoi(argv[++i]);
+        } else if (arg == "--delta") {
+            delta = true;
+        } else if (arg == "--no-delta") {
+            delta = false;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (hidDevice.empty() || (universes < 1) || (universes > EDP_HOST_UNIVERSES) || (fps < 0) || (window < 0) ||
+        (changes < 1) || (changes > 512)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&totals, 0x00, sizeof(totals));
+    link.setStatusHandler(statusReceived, &totals);
+
+    if (!link.openHid(hidDevice.c_str())) {
+        fprintf(stderr, "Can't open %s\n", hidDevice.c_str());
+        return 1;
+    }
+    if (!totals.valid) {
+        fprintf(stderr, "No status from the device, firmware too old? Running without flow control\n");
+    }
+    link.enableDelta(delta);
+    link.setWindow(window);
+
+    memset(data, 0x00, sizeof(data));
+    totals.counting = true;
+
+    Clock::duration framePeriod = (fps > 0) ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps)) : Clock::duration::zero();
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    Clock::time_point nextFrame = start;
+    uint64_t frameSets = 0;
+    uint64_t universesSent = 0;
+
+    while (Clock::now() < end) {
+        if (Clock::now() >= nextFrame) {
+            for (int universe = 0; universe < universes; universe++) {
+                // Every frame differs from the last one in <changes> channels
+                for (int i = 0; i < changes; i++) {
+                    data[universe][(frameSets * 7 + i * (512 / changes)) % 512]++;
+                }
+                if (link.sendUniverse(universe, data[universe], 512)) {
+                    universesSent++;
+                }
+            }
+            frameSets++;
+            nextFrame += framePeriod;
+            if (Clock::now() > nextFrame) {
+                nextFrame = Clock::now();
+            }
+        }
+
+        if (link.poll(0) < 0) {
+            fprintf(stderr, "Receiving failed\n");
+            break;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Until everything sent is acknowledged (or it takes too long)
+    for (int i = 0; (i < 50) && link.reportsInFlight(); i++) {
+        link.poll(10);
+    }
+    link.poll(2 * EDP_HID_WINDOW_TIMEOUT_MS);
+
+    printf("Universes:   %d, window %d, %d channels changed per frame, %s\n", universes, window, changes, delta ? "delta" : "plain");
+    printf("Sent:        %llu universes (%.1f/s), %llu reports (%.0f/s), %.1f kB/s, %llu errors\n",
+        (unsigned long long)universesSent, universesSent / elapsed,
+        (unsigned long long)link.stats.chunksSent, link.stats.chunksSent / elapsed,
+        link.stats.bytesSent / elapsed / 1000,
+        (unsigned long long)link.stats.sendErrors);
+    if (totals.valid) {
+        printf("Device:      %llu complete (%.1f universes/s), %llu CRC errors, %llu lost, %u reports in flight at the end\n",
+            (unsigned long long)totals.complete, totals.complete / elapsed,
+            (unsigned long long)totals.crcErrors, (unsigned long long)totals.lost, link.reportsInFlight());
+        printf("Status:      %llu received, %.2f slots in use on average\n",
+            (unsigned long long)totals.statusCount,
+            totals.statusCount ? (double)totals.slotsInUseSum / totals.statusCount : 0.0);
+        printf("Flow:        %llu stalls, %llu timeouts",
+            (unsigned long long)link.stats.windowStalls,
+            (unsigned long long)link.stats.windowTimeouts);
+        if (link.stats.ackUsSamples) {
+            printf(", ack avg/max %.2f/%.2f ms",
+                link.stats.ackUsSum / (double)link.stats.ackUsSamples / 1000,
+                link.stats.ackUsMax / 1000.0);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
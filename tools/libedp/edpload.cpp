@@ -0,0 +1,198 @@
+// edpload: Load generator for the EDP receivers of a dmxsun
+//
+// Sends a test pattern on up to 24 universes at a given frame rate via UDP
+// or HID, pings the device in between and reports the achieved frame rate,
+// throughput and round-trip times
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "libedp.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct PingStats {
+    uint32_t received;
+    double   rttMin;
+    double   rttMax;
+    double   rttSum;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s (--udp <address> | --hid <hidraw device>) [options]\n"
+        "  --universes <n>    Number of universes, 1-%u (default %u)\n"
+        "  --fps <n>          Frames per second per universe (default 44)\n"
+        "  --seconds <n>      Duration of the test (default 10)\n"
+        "  --pattern <name>   fade, chase or random (default fade)\n"
+        "  --delta            Send keyframes and deltas (default for HID)\n"
+        "  --no-delta         Send plain DmxData (default for UDP)\n"
+        "  --ping-ms <n>      Ping interval in ms, 0 = off (default 100)\n",
+        name, EDP_HOST_UNIVERSES, EDP_HOST_UNIVERSES);
+}
+
+static void fillPattern(const std::string& pattern, uint32_t frame, uint8_t universe, uint8_t* data) {
+    if (pattern == "random") {
+        for (int i = 0; i < 512; i++) {
+            data[i] = rand();
+        }
+    } else if (pattern == "chase") {
+        memset(data, 0x00, 512);
+        for (int i = 0; i < 8; i++) {
+            data[(frame + universe * 8 + i) % 512] = 255 - i * 32;
+        }
+    } else {
+        // All channels fade up and down, universes are out of phase
+        uint32_t phase = (frame + universe * 10) % 512;
+        memset(data, (phase < 256) ? phase : (511 - phase), 512);
+    }
+}
+
+static void pongReceived(void* context, const uint8_t* serial, const uint8_t* payload, uint16_t length) {
+    PingStats* pingStats = (PingStats*)context;
+    int64_t sent;
+    (void) serial;
+
+    if (length < sizeof(sent)) {
+        return;
+    }
+    memcpy(&sent, payload, sizeof(sent));
+
+    double rtt = (std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() - sent) / 1e6;
+    if (!pingStats->received || (rtt < pingStats->rttMin)) {
+        pingStats->rttMin = rtt;
+    }
+    if (rtt > pingStats->rttMax) {
+        pingStats->rttMax = rtt;
+    }
+    pingStats->rttSum += rtt;
+    pingStats->received++;
+}
+
+int main(int argc, char** argv) {
+    EdpLink link;
+    PingStats pingStats;
+    std::string udpAddress;
+    std::string hidDevice;
+    std::string pattern = "fade";
+    int universes = EDP_HOST_UNIVERSES;
+    double fps = 44;
+    double seconds = 10;
+    int pingMs = 100;
+    int delta = -1;
+    uint8_t data[512];
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if ((arg == "--udp") && hasValue) {
+            udpAddress = argv[++i];
+        } else if ((arg == "--hid") && hasValue) {
+            hidDevice = argv[++i];
+        } else if ((arg == "--universes") && hasValue) {
+            universes = atoi(argv[++i]);
+        } else if ((arg == "--fps") && hasValue) {
+            fps = atof(argv[++i]);
+        } else if ((arg == "--seconds") && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if ((arg == "--pattern") && hasValue) {
+            pattern = argv[++i];
+        } else if ((arg == "--ping-ms") && hasValue) {
+            pingMs = atoi(argv[++i]);
+        } else if (arg == "--delta") {
+            delta = 1;
+        } else if (arg == "--no-delta") {
+            delta = 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((udpAddress.empty() == hidDevice.empty()) || (universes < 1) || (universes > EDP_HOST_UNIVERSES) || (fps <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool opened = udpAddress.empty() ? link.openHid(hidDevice.c_str()) : link.openUdp(udpAddress.c_str());
+    if (!opened) {
+        fprintf(stderr, "Can't open %s\n", udpAddress.empty() ? hidDevice.c_str() : udpAddress.c_str());
+        return 1;
+    }
+    if (delta >= 0) {
+        link.enableDelta(delta);
+    }
+
+    memset(&pingStats, 0x00, sizeof(pingStats));
+    link.setPongHandler(pongReceived, &pingStats);
+
+    Clock::duration framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    Clock::duration pingPeriod = std::chrono::milliseconds(pingMs);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    Clock::time_point nextFrame = start;
+    Clock::time_point nextPing = start;
+    uint32_t frameSets = 0;
+    uint32_t lateFrameSets = 0;
+
+    while (Clock::now() < end) {
+        Clock::time_point now = Clock::now();
+
+        if (now >= nextFrame) {
+            for (int universe = 0; universe < universes; universe++) {
+                fillPattern(pattern, frameSets, universe, data);
+                link.sendUniverse(universe, data, 512);
+            }
+            frameSets++;
+
+            nextFrame += framePeriod;
+            if (Clock::now() > nextFrame) {
+                // Can't keep up, don't try to catch up with a burst
+                lateFrameSets++;
+                nextFrame = Clock::now();
+            }
+        }
+
+        if (pingMs && (now >= nextPing)) {
+            int64_t sent = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+            link.sendPing((const uint8_t*)&sent, sizeof(sent));
+            nextPing += pingPeriod;
+        }
+
+        Clock::time_point next = (pingMs && (nextPing < nextFrame)) ? nextPing : nextFrame;
+        int timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+        if (link.poll((timeoutMs > 0) ? timeoutMs : 0) < 0) {
+            fprintf(stderr, "Receiving failed\n");
+            break;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Late Pongs
+    link.poll(200);
+
+    printf("Transport:   %s, %d universes, pattern %s\n", udpAddress.empty() ? "HID" : "UDP", universes, pattern.c_str());
+    printf("Frame rate:  %.1f fps target, %.1f fps achieved, %u late\n", fps, frameSets / elapsed, lateFrameSets);
+    printf("Sent:        %llu frames, %llu chunks (%.0f/s), %.1f kB/s, %llu errors\n",
+        (unsigned long long)link.stats.framesSent,
+        (unsigned long long)link.stats.chunksSent,
+        link.stats.chunksSent / elapsed,
+        link.stats.bytesSent / elapsed / 1000,
+        (unsigned long long)link.stats.sendErrors);
+    if (pingMs) {
+        printf("Ping:        %llu sent, %u received, %llu lost",
+            (unsigned long long)link.stats.pingsSent,
+            pingStats.received,
+            (unsigned long long)(link.stats.pingsSent - pingStats.received));
+        if (pingStats.received) {
+            printf(", rtt min/avg/max %.2f/%.2f/%.2f ms", pingStats.rttMin, pingStats.rttSum / pingStats.received, pingStats.rttMax);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include "libedp.h"
+
+#include <cerrno>
+#include <chrono>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EdpLink::EdpLink() {
+    this->fd = -1;
+    this->transport = EdpTransport::transportUdp;
+    this->chunkSize = 600;
+    this->pongHandler = nullptr;
+    this->pongHandlerContext = nullptr;
+    this->statusHandler = nullptr;
+    this->statusHandlerContext = nullptr;
+    this->window = 0;
+    this->statusSeen = false;
+    memset(&stats, 0x00, sizeof(struct EdpLinkStats));
+    initEdp();
+}
+
+EdpLink::~EdpLink() {
+    close();
+}
+
+void EdpLink::initEdp() {
+    tx.init(txIn, txOut, chunkSize, PatchType::host);
+    rx.init(rxIn, rxOut, chunkSize, PatchType::host, rxSlots, EDP_HOST_UNIVERSES);
+    rx.initDelta(rxReferences, EDP_HOST_UNIVERSES);
+    enableDelta(transport == EdpTransport::transportHid);
+}
+
+bool EdpLink::openUdp(const char* host, uint16_t port) {
+    struct addrinfo hints;
+    struct addrinfo* result;
+    char portString[8];
+
+    close();
+
+    memset(&hints, 0x00, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(portString, sizeof(portString), "%u", port);
+
+    if (getaddrinfo(host, portString, &hints, &result) != 0) {
+        return false;
+    }
+
+    for (struct addrinfo* candidate = result; candidate; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_NONBLOCK, candidate->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    // A datagram always carries a complete chunk
+    transport = EdpTransport::transportUdp;
+    chunkSize = 600;
+    initEdp();
+    return true;
+}
+
+bool EdpLink::openHid(const char* device) {
+    close();
+
+    fd = open(device, O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    transport = EdpTransport::transportHid;
+    chunkSize = EDP_HID_REPORT_SIZE - 1;
+    initEdp();
+
+    // The device's report counter goes on across connections, the first
+    // status tells where it is. Firmware without it: No flow control
+    statusSeen = false;
+    reportsSent = 0;
+    reportsAcked = 0;
+    for (int i = 0; (i < 4) && !statusSeen; i++) {
+        poll(EDP_HID_WINDOW_TIMEOUT_MS / 2);
+    }
+    return true;
+}
+
+void EdpLink::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void EdpLink::enableDelta(bool enable) {
+    if (enable) {
+        tx.initDelta(txReferences, EDP_HOST_UNIVERSES);
+    } else {
+        tx.initDelta(nullptr, 0);
+    }
+}
+
+void EdpLink::setFrameHandler(EdpFrameHandler handler, void* context) {
+    rx.setFrameHandler(handler, context);
+}
+
+void EdpLink::setPongHandler(EdpPongHandler handler, void* context) {
+    this->pongHandlerContext = context;
+    this->pongHandler = handler;
+}
+
+void EdpLink::setStatusHandler(EdpStatusHandler handler, void* context) {
+    this->statusHandlerContext = context;
+    this->statusHandler = handler;
+}
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EdpLink::statusReceived(const uint8_t* payload, uint16_t length) {
+    struct Edp_HidStatus status;
+
+    if (length < sizeof(status)) {
+        return;
+    }
+    memcpy(&status, payload, sizeof(status));
+    stats.statusReceived++;
+
+    if (!statusSeen) {
+        statusSeen = true;
+        reportsSent = status.reportsReceived;
+    } else if ((status.reportsReceived != reportsAcked) && ((uint16_t)(reportsSent - status.reportsReceived) < 256)) {
+        // Of the newest report acknowledged
+        uint64_t ackUs = nowUs() - reportSentUs[(uint8_t)(status.reportsReceived - 1)];
+        stats.ackUsSum += ackUs;
+        stats.ackUsSamples++;
+        stats.ackUsMax = MAX(stats.ackUsMax, ackUs);
+    }
+    reportsAcked = status.reportsReceived;
+
+    if (statusHandler) {
+        statusHandler(statusHandlerContext, status);
+    }
+}
+
+const struct EdpStats& EdpLink::receiveStats() {
+    return rx.stats;
+}
+
+bool EdpLink::sendChunk(const uint8_t* chunk, uint16_t size) {
+    uint8_t report[EDP_HID_REPORT_SIZE + 1];
+    ssize_t written;
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (transport == EdpTransport::transportHid) {
+        if (window && statusSeen && (reportsInFlight() >= window)) {
+            // Let the device catch up. If it doesn't say anything, go on
+            // anyway, the next status corrects the count
+            stats.windowStalls++;
+            auto start = std::chrono::steady_clock::now();
+            while (reportsInFlight() >= window) {
+                int waitedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                if ((waitedMs >= EDP_HID_WINDOW_TIMEOUT_MS) || (poll(EDP_HID_WINDOW_TIMEOUT_MS - waitedMs) < 0)) {
+                    stats.windowTimeouts++;
+                    break;
+                }
+            }
+        }
+
+        // hidraw: Report ID (0 = none) + the full, padded report
+        memset(report, 0x00, sizeof(report));
+        report[1] = size;
+        memcpy(report + 2, chunk, size);
+        written = write(fd, report, sizeof(report));
+        written = (written == sizeof(report)) ? size : -1;
+        if (written >= 0) {
+            reportSentUs[(uint8_t)reportsSent] = nowUs();
+            reportsSent++;
+        }
+    } else {
+        written = send(fd, chunk, size, 0);
+    }
+
+    if (written != size) {
+        stats.sendErrors++;
+        return false;
+    }
+
+    stats.chunksSent++;
+    stats.bytesSent += size;
+    return true;
+}
+
+bool EdpLink::sendUniverse(uint8_t universeId, const uint8_t* data, uint16_t length) {
+    uint16_t thisChunkSize = 0;
+    bool callAgain = false;
+    bool success = true;
+
+    if ((universeId >= 64) || !length) {
+        return false;
+    }
+
+    memset(txIn, 0x00, sizeof(txIn));
+    memcpy(txIn, data, MIN(length, 512));
+
+    if (!tx.prepareDmxData(universeId, 512, &thisChunkSize, &callAgain)) {
+        return false;
+    }
+    success &= sendChunk(txOut, thisChunkSize);
+
+    while (callAgain) {
+        if (!tx.prepareDmxData(universeId, 0, &thisChunkSize, &callAgain)) {
+            return false;
+        }
+        success &= sendChunk(txOut, thisChunkSize);
+    }
+
+    stats.framesSent++;
+    return success;
+}
+
+bool EdpLink::sendPing(const uint8_t* payload, uint16_t length) {
+    uint8_t ping[1 + EDP_PING_MAX_PAYLOAD];
+
+    length = MIN(length, EDP_PING_MAX_PAYLOAD);
+    ping[0] = Edp_Commands::Ping;
+    memcpy(ping + 1, payload, length);
+
+    stats.pingsSent++;
+    return sendChunk(ping, 1 + length);
+}
+
+// Reads one chunk into rxIn. Returns its size, 0 if there is none or -1
+int EdpLink::receiveChunk() {
+    uint8_t report[EDP_HID_REPORT_SIZE];
+    ssize_t size;
+
+    if (transport == EdpTransport::transportHid) {
+        size = read(fd, report, sizeof(report));
+        if (size < 1) {
+            return ((size < 0) && (errno != EAGAIN)) ? -1 : 0;
+        }
+        size = MIN((ssize_t)report[0], size - 1);
+        memcpy(rxIn, report + 1, size);
+        return size;
+    }
+
+    size = recv(fd, rxIn, sizeof(rxIn), 0);
+    if (size < 0) {
+        // Nobody listening (yet) is reported via ICMP, that's no reason to give up
+        return ((errno == EAGAIN) || (errno == ECONNREFUSED)) ? 0 : -1;
+    }
+    return size;
+}
+
+int EdpLink::poll(int timeoutMs) {
+    struct pollfd pollFd;
+    int processed = 0;
+    int size;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    pollFd.fd = fd;
+    pollFd.events = POLLIN;
+    if (::poll(&pollFd, 1, timeoutMs) < 0) {
+        return -1;
+    }
+
+    while ((size = receiveChunk()) > 0) {
+        processed++;
+
+        if (rxIn[0] == Edp_Commands::Pong) {
+            if (size >= 9) {
+                stats.pongsReceived++;
+                if (pongHandler) {
+                    pongHandler(pongHandlerContext, rxIn + 1, rxIn + 9, size - 9);
+                }
+            }
+            continue;
+        }
+
+        if (rxIn[0] == Edp_Commands::HidStatus) {
+            statusReceived(rxIn + 1, size - 1);
+            continue;
+        }
+
+        rx.processIncomingChunk(size);
+    }
+
+    return (size < 0) ? -1 : processed;
+}
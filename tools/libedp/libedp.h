@@ -0,0 +1,110 @@
+#ifndef LIBEDP_H
+#define LIBEDP_H
+
+// Host side of the Efficient Dmx Protocol: Sends universes to a dmxsun via
+// UDP or its HID interface (Linux hidraw) and handles what comes back.
+// Uses the firmware's src/edp.cpp, so it's also the reference for what the
+// device expects on the wire
+
+#include "edp.h"
+
+#define EDP_UDP_PORT            2040
+#define EDP_HID_REPORT_SIZE       64 // First byte: Length of the chunk that follows
+#define EDP_HOST_UNIVERSES        24
+
+enum EdpTransport : uint8_t {
+    transportUdp              = 0,
+    transportHid              = 1,
+};
+
+struct EdpLinkStats {
+    uint64_t framesSent;
+    uint64_t chunksSent;
+    uint64_t bytesSent;
+    uint64_t sendErrors;
+    uint64_t pingsSent;
+    uint64_t pongsReceived;
+    uint64_t statusReceived;     // HID only, see setWindow()
+    uint64_t windowStalls;       // Sending waited for the device to catch up
+    uint64_t windowTimeouts;     // ... and no status came in time
+    uint64_t ackUsSum;           // Report sent until a status acknowledged it
+    uint64_t ackUsSamples;
+    uint64_t ackUsMax;
+};
+
+// Called for every Pong: Responder's serial (8 byte) and the payload of the Ping
+typedef void (*EdpPongHandler)(void* context, const uint8_t* serial, const uint8_t* payload, uint16_t length);
+
+// Called for every HidStatus the device sends
+typedef void (*EdpStatusHandler)(void* context, const struct Edp_HidStatus& status);
+
+#define EDP_HID_WINDOW_TIMEOUT_MS  100 // Without a status, sending goes on after this
+
+class EdpLink {
+  public:
+    EdpLink();
+    ~EdpLink();
+
+    bool openUdp(const char* host, uint16_t port = EDP_UDP_PORT);
+    bool openHid(const char* device);
+    void close();
+
+    // Send keyframes and deltas instead of plain DmxData. The device only
+    // keeps keyframes for the HID and radio paths, so it's on for HID only
+    // by default
+    void enableDelta(bool enable);
+
+    // HID only: Send at most this many reports the device hasn't
+    // acknowledged (HidStatus) yet, 0 = no limit
+    void setWindow(uint16_t reports) { window = reports; }
+    uint16_t reportsInFlight() { return reportsSent - reportsAcked; }
+
+    bool sendUniverse(uint8_t universeId, const uint8_t* data, uint16_t length);
+    bool sendPing(const uint8_t* payload, uint16_t length);
+
+    // Handles everything that came in within timeoutMs. Returns the number
+    // of chunks processed or -1 on error
+    int poll(int timeoutMs);
+
+    void setFrameHandler(EdpFrameHandler handler, void* context);
+    void setPongHandler(EdpPongHandler handler, void* context);
+    void setStatusHandler(EdpStatusHandler handler, void* context);
+
+    struct EdpLinkStats stats;
+    const struct EdpStats& receiveStats();
+
+  private:
+    int fd;
+    EdpTransport transport;
+    uint16_t chunkSize;
+
+    Edp tx;
+    Edp rx;
+
+    uint8_t txIn[600];
+    uint8_t txOut[600];
+    uint8_t rxIn[600];
+    uint8_t rxOut[600];
+
+    EdpReassemblySlot rxSlots[EDP_HOST_UNIVERSES];
+    EdpReference txReferences[EDP_HOST_UNIVERSES];
+    EdpReference rxReferences[EDP_HOST_UNIVERSES];
+
+    EdpPongHandler pongHandler;
+    void* pongHandlerContext;
+    EdpStatusHandler statusHandler;
+    void* statusHandlerContext;
+
+    uint16_t window;
+    bool statusSeen;
+    uint16_t reportsSent;
+    uint16_t reportsAcked;       // The device's reportsReceived
+    uint64_t reportSentUs[256];  // Per report, by the low 8 bits of reportsSent
+
+    void initEdp();
+    bool sendChunk(const uint8_t* chunk, uint16_t size);
+    int receiveChunk();
+    void statusReceived(const uint8_t* payload, uint16_t length);
+};
+
+#endif // LIBEDP_H
@@ -0,0 +1,18 @@
+#ifndef RF24SIM_RF24_H
+#define RF24SIM_RF24_H
+
+// The firmware's radios are simulated ones (rf24sim.h). They are created
+// with the pins and end up in RF24Air::shared()
+
+#include "rf24sim.h"
+
+// The library's SPI wrapper for the pico-sdk, nothing to set up here
+typedef struct spi_inst spi_inst_t;
+#define spi0 ((spi_inst_t*)nullptr)
+
+class SPI {
+  public:
+    void begin(spi_inst_t* hw_id) { (void)hw_id; }
+};
+
+#endif // RF24SIM_RF24_H
@@ -0,0 +1,49 @@
+#ifndef RF24SIM_RF24MESH_H
+#define RF24SIM_RF24MESH_H
+
+// Model of RF24Mesh on top of the RF24Network model, NOT the library. The
+// addresses are handed out directly instead of with the DHCP messages: All
+// meshes of a process share one address list, begin() on a node takes the
+// next free child address of the master
+
+#include <cstdint>
+
+#include "RF24Network.h"
+
+#ifndef MESH_DEFAULT_CHANNEL
+#define MESH_DEFAULT_CHANNEL           97
+#endif
+#define MESH_MAX_NODES                  5  // Children of the master, there is one level
+
+struct RF24MeshAddress {
+    uint8_t nodeID;
+    uint16_t address;
+};
+
+class RF24Mesh {
+  public:
+    RF24Mesh(RF24& radio, RF24Network& network);
+
+    void setNodeID(uint8_t nodeID);
+    bool begin(uint8_t channel = MESH_DEFAULT_CHANNEL, rf24_datarate_e data_rate = RF24_1MBPS, uint32_t timeout = 7500);
+    uint8_t update();
+    void DHCP() { }
+    bool write(const void* data, uint8_t msg_type, size_t size, uint8_t nodeID = 0);
+    bool checkConnection();
+    uint16_t renewAddress(uint32_t timeout = 7500);
+    int16_t getNodeID(uint16_t address);
+    int16_t getAddress(uint8_t nodeID);
+
+    uint8_t addrListTop = 0;    // Master: Nodes that have an address
+
+  private:
+    RF24& radio;
+    RF24Network& network;
+    uint8_t nodeID = 0;
+    uint16_t address;
+
+    static RF24MeshAddress addrList[MESH_MAX_NODES];
+    static uint8_t addrCount;
+};
+
+#endif // RF24SIM_RF24MESH_H
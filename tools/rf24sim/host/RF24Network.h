@@ -0,0 +1,90 @@
+#ifndef RF24SIM_RF24NETWORK_H
+#define RF24SIM_RF24NETWORK_H
+
+// Model of RF24Network on a simulated radio, NOT the library: Its
+// submodule is built for the pico-sdk only. It has the part of the
+// interface src/wireless.cpp uses and uses the radio the way the library
+// does:
+// - Frames are an 8 byte header and up to 24 byte of message. Bigger
+//   messages are split into fragments (types 148-150), a message with a
+//   fragment missing is dropped
+// - Unicast frames are auto-ACKed and retried for txTimeout, multicast
+//   frames are sent once without ACK
+// - Messages wait in a queue of MAX_PAYLOAD_SIZE bytes until read, what
+//   doesn't fit is dropped
+// What isn't: Routing. There is one level, every node is a child of the
+// master (address 00) and talks to it directly, so up to 5 nodes
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "rf24sim.h"
+
+#ifndef MAX_PAYLOAD_SIZE
+#define MAX_PAYLOAD_SIZE              144
+#endif
+
+#define MAX_FRAME_SIZE                 32
+#define NETWORK_FIRST_FRAGMENT        148
+#define NETWORK_MORE_FRAGMENTS        149
+#define NETWORK_LAST_FRAGMENT         150
+#define NETWORK_MULTICAST_ADDRESS     0100
+
+struct RF24NetworkHeader {
+    uint16_t from_node;
+    uint16_t to_node;
+    uint16_t id;
+    unsigned char type;
+    unsigned char reserved;     // Fragments: Number left. Last one: The message type
+
+    static uint16_t next_id;
+
+    RF24NetworkHeader() { }
+    RF24NetworkHeader(uint16_t to, unsigned char type = 0) : to_node(to), id(next_id++), type(type) { }
+} __attribute__((__packed__));
+
+#define RF24NETWORK_HEADER_SIZE       sizeof(RF24NetworkHeader)
+#define RF24NETWORK_FRAGMENT_SIZE     (MAX_FRAME_SIZE - RF24NETWORK_HEADER_SIZE)
+
+struct RF24NetworkStats {
+    uint64_t messagesDropped;   // Fragment missing or no space in the queue
+};
+
+class RF24Network {
+  public:
+    RF24Network(RF24& radio);
+
+    void begin(uint8_t channel, uint16_t nodeAddress);
+    void begin(uint16_t nodeAddress);
+    uint8_t update();
+    bool available();
+    uint16_t peek(RF24NetworkHeader& header);
+    uint16_t read(RF24NetworkHeader& header, void* message, uint16_t maxlen);
+    bool write(RF24NetworkHeader& header, const void* message, uint16_t len);
+    bool multicast(RF24NetworkHeader& header, const void* message, uint16_t len, uint8_t level = 7);
+
+    uint16_t node_address;
+    uint16_t txTimeout = 25;    // ms
+    bool multicastRelay = false;
+    RF24NetworkStats stats;
+
+  private:
+    struct Message {
+        RF24NetworkHeader header;
+        std::vector<uint8_t> data;
+    };
+
+    RF24& radio;
+    std::deque<Message> queue;
+    uint16_t queued;            // Bytes in the queue
+    Message fragmented;         // Message being reassembled
+    uint8_t fragmentsLeft;      // 0 = none
+
+    void pipeAddress(uint16_t node, uint8_t* address);
+    bool writeFrames(RF24NetworkHeader& header, const void* message, uint16_t len, uint16_t to, bool multicast);
+    void enqueue(const Message& message);
+    void receiveFrame(const uint8_t* frame, uint8_t length);
+};
+
+#endif // RF24SIM_RF24NETWORK_H
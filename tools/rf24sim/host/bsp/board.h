@@ -0,0 +1,6 @@
+#ifndef RF24SIM_BSP_BOARD_H
+#define RF24SIM_BSP_BOARD_H
+
+#include "pico/stdlib.h"
+
+#endif // RF24SIM_BSP_BOARD_H
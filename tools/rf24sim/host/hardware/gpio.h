@@ -0,0 +1,30 @@
+#ifndef RF24SIM_HARDWARE_GPIO_H
+#define RF24SIM_HARDWARE_GPIO_H
+
+#include "pico/stdlib.h"
+
+// Only the IRQs of the pins are simulated: rf24sim_gpio_irq() (see
+// rf24simfirmware.h) pulls a pin low
+#define GPIO_IN                 false
+#define GPIO_OUT                true
+#define GPIO_IRQ_EDGE_FALL      0x4u
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t events);
+
+static inline void gpio_init(uint gpio) {
+    (void)gpio;
+}
+
+static inline void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+static inline void gpio_pull_up(uint gpio) {
+    (void)gpio;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+
+#endif // RF24SIM_HARDWARE_GPIO_H
@@ -0,0 +1,13 @@
+#ifndef RF24SIM_HARDWARE_IRQ_H
+#define RF24SIM_HARDWARE_IRQ_H
+
+#include "pico/stdlib.h"
+
+#define TIMER_IRQ_0 0
+
+static inline void irq_set_enabled(uint num, bool enabled) {
+    (void)num;
+    (void)enabled;
+}
+
+#endif // RF24SIM_HARDWARE_IRQ_H
@@ -0,0 +1,14 @@
+#ifndef RF24SIM_HARDWARE_SYNC_H
+#define RF24SIM_HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+// GPIO IRQs raised while interrupts are disabled are held back until they
+// are enabled again
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb() {
+}
+
+#endif // RF24SIM_HARDWARE_SYNC_H
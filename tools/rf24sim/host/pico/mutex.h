@@ -0,0 +1,28 @@
+#ifndef RF24SIM_PICO_MUTEX_H
+#define RF24SIM_PICO_MUTEX_H
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+typedef struct {
+    bool locked;
+} mutex_t;
+
+// Like on the chip, a critical section also holds off the IRQs
+typedef struct {
+    uint32_t save;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t* crit_sec) {
+    crit_sec->save = 0;
+}
+
+static inline void critical_section_enter_blocking(critical_section_t* crit_sec) {
+    crit_sec->save = save_and_disable_interrupts();
+}
+
+static inline void critical_section_exit(critical_section_t* crit_sec) {
+    restore_interrupts(crit_sec->save);
+}
+
+#endif // RF24SIM_PICO_MUTEX_H
@@ -0,0 +1,32 @@
+#ifndef RF24SIM_PICO_STDLIB_H
+#define RF24SIM_PICO_STDLIB_H
+
+// Host stand-ins for the parts of the pico-sdk src/wireless.cpp and the
+// headers it includes use, so the simulation builds the firmware's code
+// unchanged. rf24simfirmware.cpp implements them. Time is the simulated
+// clock of RF24Air::shared(), sleeping advances it
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+typedef unsigned int uint;
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+uint32_t edp_host_time_us();
+
+static inline uint32_t time_us_32() {
+    return edp_host_time_us();
+}
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+#endif // RF24SIM_PICO_STDLIB_H
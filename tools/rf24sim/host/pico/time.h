@@ -0,0 +1,16 @@
+#ifndef RF24SIM_PICO_TIME_H
+#define RF24SIM_PICO_TIME_H
+
+#include "pico/stdlib.h"
+
+// There are no timers in the simulation: Pools are created, but alarms
+// can't be added. Only the sniffer uses them
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+typedef struct alarm_pool alarm_pool_t;
+
+alarm_pool_t* alarm_pool_create_with_unused_hardware_alarm(uint max_timers);
+uint alarm_pool_hardware_alarm_num(alarm_pool_t* pool);
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t* pool, uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past);
+
+#endif // RF24SIM_PICO_TIME_H
@@ -0,0 +1,10 @@
+#ifndef RF24SIM_PICO_UTIL_QUEUE_H
+#define RF24SIM_PICO_UTIL_QUEUE_H
+
+#include "pico/stdlib.h"
+
+typedef struct {
+    uint32_t count;
+} queue_t;
+
+#endif // RF24SIM_PICO_UTIL_QUEUE_H
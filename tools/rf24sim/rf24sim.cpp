@@ -0,0 +1,490 @@
+#include "rf24sim.h"
+
+#include <algorithm>
+
+#include "edp_host.h"
+#include "crc_X25.h"
+
+// The air created last provides the clock of time_us_32()
+static RF24Air* rf24sim_clock = nullptr;
+
+uint32_t edp_host_time_us() {
+    return rf24sim_clock ? (uint32_t)rf24sim_clock->now() : 0;
+}
+
+RF24Air::RF24Air(uint32_t seed) {
+    nowUs = 0;
+    loss = 0;
+    reorder = 0;
+    memset(channelLoss, 0x00, sizeof(channelLoss));
+    std::fill(lastActivity, lastActivity + RF24SIM_CHANNELS, UINT64_MAX);
+    setSeed(seed);
+    rf24sim_clock = this;
+}
+
+// Created on first use, the firmware's radios are global objects
+RF24Air* RF24Air::shared() {
+    static RF24Air air;
+    return &air;
+}
+
+void RF24Air::setSeed(uint32_t seed) {
+    rngState = seed ? seed : 1; // xorshift gets stuck at 0
+}
+
+void RF24Air::setLoss(uint8_t percent) {
+    loss = MIN(percent, 100);
+}
+
+void RF24Air::setChannelLoss(uint8_t channel, uint8_t percent) {
+    if (channel < RF24SIM_CHANNELS) {
+        channelLoss[channel] = MIN(percent, 100);
+    }
+}
+
+void RF24Air::setReorder(uint8_t percent) {
+    reorder = MIN(percent, 100);
+}
+
+// Same xorshift32 as the firmware's scanner
+uint32_t RF24Air::random() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+bool RF24Air::chance(uint8_t percent) {
+    return percent && ((random() % 100) < percent);
+}
+
+void RF24Air::settle() {
+    for (RF24* radio : radios) {
+        if (radio->held) {
+            radio->held = false;
+            radio->putRx(radio->heldPayload, false);
+        }
+    }
+}
+
+void RF24Air::attach(RF24* radio) {
+    radios.push_back(radio);
+}
+
+void RF24Air::detach(RF24* radio) {
+    radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
+}
+
+// Probability a payload sent to the radio (or an ACK from it) is lost
+uint8_t RF24Air::lossTo(const RF24* radio) {
+    return MIN(loss + channelLoss[radio->channel] + radio->loss, 100);
+}
+
+RF24::RF24(uint16_t cePin, uint16_t csnPin) : RF24(RF24Air::shared(), cePin, csnPin) {
+}
+
+RF24::RF24(RF24Air* air, uint16_t cePin, uint16_t csnPin) {
+    (void)cePin;
+    (void)csnPin;
+
+    this->air = air;
+    memset(&stats, 0x00, sizeof(stats));
+    irqHandler = nullptr;
+    irqContext = nullptr;
+    loss = 0;
+    air->attach(this);
+    begin();
+}
+
+RF24::~RF24() {
+    air->detach(this);
+}
+
+// Power-on defaults of the library
+bool RF24::begin(void* spi) {
+    (void)spi;
+
+    channel = 76;
+    dataRate = RF24_1MBPS;
+    paLevel = RF24_PA_MAX;
+    crcLength = RF24_CRC_16;
+    autoAck = true;
+    dynamicAck = false;
+    ackPayloads = false;
+    listening = false;
+    retryDelay = 5;
+    retryCount = 15;
+    arc = 0;
+    maxRtFlag = false;
+    txPid = 0;
+    held = false;
+    memset(writeAddress, 0x00, sizeof(writeAddress));
+    memset(pipeAddress, 0x00, sizeof(pipeAddress));
+    memset(pipeOpen, 0x00, sizeof(pipeOpen));
+    std::fill(lastPid, lastPid + 6, -1);
+    txFifo.clear();
+    rxFifo.clear();
+
+    return true;
+}
+
+void RF24::setChannel(uint8_t channel) {
+    this->channel = MIN(channel, RF24SIM_CHANNELS - 1);
+}
+
+bool RF24::setDataRate(rf24_datarate_e rate) {
+    dataRate = rate;
+    return true;
+}
+
+void RF24::setPALevel(uint8_t level, bool lnaEnable) {
+    (void)lnaEnable;
+    paLevel = MIN(level, RF24_PA_MAX);
+}
+
+void RF24::setRetries(uint8_t delay, uint8_t count) {
+    retryDelay = MIN(delay, 15);
+    retryCount = MIN(count, 15);
+}
+
+void RF24::openWritingPipe(const uint8_t* address) {
+    memcpy(writeAddress, address, sizeof(writeAddress));
+    // Pipe 0 receives the ACKs
+    memcpy(pipeAddress[0], address, sizeof(writeAddress));
+}
+
+// Pipes 2-5 only differ from pipe 1 in the first byte, like on the radio
+void RF24::openReadingPipe(uint8_t pipe, const uint8_t* address) {
+    if (pipe >= 6) {
+        return;
+    }
+
+    if (pipe >= 2) {
+        memcpy(pipeAddress[pipe], pipeAddress[1], sizeof(writeAddress));
+        pipeAddress[pipe][0] = address[0];
+    } else {
+        memcpy(pipeAddress[pipe], address, sizeof(writeAddress));
+    }
+    pipeOpen[pipe] = true;
+    lastPid[pipe] = -1;
+}
+
+void RF24::startListening() {
+    if (ackPayloads) {
+        flush_tx();
+    }
+    listening = true;
+}
+
+void RF24::stopListening() {
+    if (ackPayloads) {
+        flush_tx();
+    }
+    listening = false;
+}
+
+bool RF24::available(uint8_t* pipe) {
+    if (rxFifo.empty()) {
+        return false;
+    }
+    if (pipe) {
+        *pipe = rxFifo.front().pipe;
+    }
+    return true;
+}
+
+uint8_t RF24::getDynamicPayloadSize() {
+    return rxFifo.empty() ? 0 : rxFifo.front().length;
+}
+
+void RF24::read(void* buffer, uint8_t length) {
+    if (rxFifo.empty()) {
+        return;
+    }
+    memcpy(buffer, rxFifo.front().data, MIN(length, rxFifo.front().length));
+    rxFifo.pop_front();
+}
+
+// Received Power Detector: Something was sent on the channel a moment
+// ago, or there is noise on it
+bool RF24::testRPD() {
+    uint64_t last = air->lastActivity[channel];
+
+    if ((last != UINT64_MAX) && ((air->nowUs - last) < RF24SIM_RPD_US)) {
+        return true;
+    }
+    return air->chance(air->channelLoss[channel]);
+}
+
+// Blocks until the payload is out (or ran out of retransmits)
+bool RF24::write(const void* data, uint8_t length, bool multicast) {
+    if (!writeFast(data, length, multicast) || maxRtFlag) {
+        maxRtFlag = false;
+        flush_tx();
+        return false;
+    }
+    return true;
+}
+
+// Queues the payload. Fails only if the FIFO is full and the radio stopped
+// on MAX_RT, the payload at hand is not queued then
+bool RF24::writeFast(const void* data, uint8_t length, bool multicast) {
+    RF24SimPayload payload;
+
+    if (txFifo.size() >= RF24SIM_FIFO_LEVELS) {
+        if (maxRtFlag) {
+            return false;
+        }
+        transmit();
+    }
+
+    payload.pipe = 0;
+    payload.length = MIN(length, RF24SIM_MAX_PAYLOAD);
+    payload.pid = txPid;
+    payload.noAck = multicast && dynamicAck;
+    memcpy(payload.data, data, payload.length);
+    txPid = (txPid + 1) & 0x03;
+    txFifo.push_back(payload);
+
+    if (!maxRtFlag && !listening) {
+        transmit();
+    }
+    return true;
+}
+
+// Fails (and flushes) on the first MAX_RT
+bool RF24::txStandBy() {
+    transmit();
+    if (maxRtFlag) {
+        maxRtFlag = false;
+        flush_tx();
+        return false;
+    }
+    return txFifo.empty();
+}
+
+// Retransmits on MAX_RT until the FIFO is empty or the timeout is over
+bool RF24::txStandBy(uint32_t timeoutMs) {
+    uint64_t start = air->nowUs;
+
+    while (!txFifo.empty() && !listening) {
+        if (maxRtFlag) {
+            maxRtFlag = false;
+            if ((air->nowUs - start) >= (uint64_t)timeoutMs * 1000) {
+                flush_tx();
+                return false;
+            }
+        }
+        transmit();
+    }
+    return txFifo.empty();
+}
+
+// Sent with the ACK of the next payload received on the pipe
+bool RF24::writeAckPayload(uint8_t pipe, const void* data, uint8_t length) {
+    RF24SimPayload payload;
+
+    if (txFifo.size() >= RF24SIM_FIFO_LEVELS) {
+        return false;
+    }
+
+    payload.pipe = pipe;
+    payload.length = MIN(length, RF24SIM_MAX_PAYLOAD);
+    payload.pid = 0;
+    payload.noAck = true;
+    memcpy(payload.data, data, payload.length);
+    txFifo.push_back(payload);
+    return true;
+}
+
+void RF24::reUseTX() {
+    maxRtFlag = false;
+    if (!listening) {
+        transmit();
+    }
+}
+
+uint8_t RF24::flush_tx() {
+    txFifo.clear();
+    return 0;
+}
+
+uint8_t RF24::flush_rx() {
+    rxFifo.clear();
+    held = false;
+    return 0;
+}
+
+void RF24::setIrqHandler(RF24SimIrqHandler handler, void* context) {
+    irqHandler = handler;
+    irqContext = context;
+}
+
+// Sends what's in the TX FIFO until it's empty or a payload runs out of
+// retransmits. The clock advances while the radio is busy
+void RF24::transmit() {
+    while (!txFifo.empty() && !maxRtFlag && !listening) {
+        RF24SimPayload& payload = txFifo.front();
+        bool wantAck = autoAck && !payload.noAck;
+        uint64_t started = air->nowUs;
+
+        arc = 0;
+        while (true) {
+            stats.transmissions++;
+            air->lastActivity[channel] = air->nowUs;
+            air->nowUs += RF24SIM_SETTLE_US + airtimeUs(payload.length);
+
+            RF24* receiver = deliver(payload, writeAddress);
+            if (!wantAck) {
+                break;
+            }
+
+            if (receiver) {
+                RF24SimPayload* ackPayload = nullptr;
+                if (ackPayloads && receiver->ackPayloads) {
+                    for (RF24SimPayload& queued : receiver->txFifo) {
+                        if (queued.pipe == receiver->matchPipe(writeAddress)) {
+                            ackPayload = &queued;
+                            break;
+                        }
+                    }
+                }
+
+                air->nowUs += RF24SIM_SETTLE_US + airtimeUs(ackPayload ? ackPayload->length : 0);
+
+                // The receiver considers its ACK payload sent either way
+                bool ackLost = air->chance(air->lossTo(receiver));
+                if (!ackLost && ackPayload) {
+                    RF24SimPayload received = *ackPayload;
+                    received.pipe = 0;
+                    putRx(received, false);
+                }
+                if (ackPayload) {
+                    for (auto it = receiver->txFifo.begin(); it != receiver->txFifo.end(); it++) {
+                        if (&*it == ackPayload) {
+                            receiver->txFifo.erase(it);
+                            break;
+                        }
+                    }
+                }
+
+                if (!ackLost) {
+                    break;
+                }
+                stats.acksLost++;
+            }
+
+            if (arc >= retryCount) {
+                stats.maxRt++;
+                stats.airtimeUs += air->nowUs - started;
+                maxRtFlag = true;
+                return;
+            }
+
+            // Auto retransmit delay, counted from the end of the payload
+            air->nowUs += 250 * (retryDelay + 1);
+            arc++;
+            stats.retransmits++;
+        }
+
+        stats.airtimeUs += air->nowUs - started;
+        txFifo.pop_front();
+    }
+}
+
+// Puts the payload in the RX FIFO of every radio listening to the address
+// on our channel and data rate. Returns the one that sends the ACK
+RF24* RF24::deliver(const RF24SimPayload& payload, const uint8_t* address) {
+    RF24* acker = nullptr;
+    RF24SimPayload copy = payload;
+    uint16_t crc = crc_update(crc_init(), payload.data, payload.length);
+
+    for (RF24* radio : air->radios) {
+        if ((radio == this) || !radio->listening || (radio->channel != channel) || (radio->dataRate != dataRate)) {
+            continue;
+        }
+
+        int8_t pipe = radio->matchPipe(address);
+        if (pipe < 0) {
+            continue;
+        }
+
+        if (air->chance(air->lossTo(radio))) {
+            radio->stats.lost++;
+            continue;
+        }
+
+        // A retransmit because the ACK got lost: ACKed again, but dropped
+        if ((radio->lastPid[pipe] == payload.pid) && (radio->lastCrc[pipe] == crc)) {
+            radio->stats.duplicates++;
+            acker = acker ? acker : radio;
+            continue;
+        }
+
+        // No space: Not ACKed, the sender retransmits
+        if (radio->rxFifoFull()) {
+            radio->stats.rxFifoFull++;
+            continue;
+        }
+
+        radio->lastPid[pipe] = payload.pid;
+        radio->lastCrc[pipe] = crc;
+        copy.pipe = pipe;
+        radio->putRx(copy, true);
+        acker = acker ? acker : radio;
+    }
+
+    return acker;
+}
+
+void RF24::putRx(const RF24SimPayload& payload, bool mayReorder) {
+    if (mayReorder && !held && air->chance(air->reorder)) {
+        held = true;
+        heldPayload = payload;
+        stats.reordered++;
+        return;
+    }
+
+    rxFifo.push_back(payload);
+    stats.received++;
+    if (irqHandler) {
+        irqHandler(irqContext, this);
+    }
+
+    if (mayReorder && held) {
+        held = false;
+        if (rxFifoFull()) {
+            stats.rxFifoFull++;
+            return;
+        }
+        rxFifo.push_back(heldPayload);
+        stats.received++;
+        if (irqHandler) {
+            irqHandler(irqContext, this);
+        }
+    }
+}
+
+int8_t RF24::matchPipe(const uint8_t* address) {
+    for (uint8_t pipe = 0; pipe < 6; pipe++) {
+        if (pipeOpen[pipe] && !memcmp(pipeAddress[pipe], address, sizeof(writeAddress))) {
+            return pipe;
+        }
+    }
+    return -1;
+}
+
+// Preamble, address, packet control field, payload and CRC
+uint32_t RF24::airtimeUs(uint8_t length) {
+    uint8_t crcBytes = (crcLength == RF24_CRC_16) ? 2 : ((crcLength == RF24_CRC_8) ? 1 : 0);
+    uint32_t bits = 8 * (1 + 5 + length + crcBytes) + 9;
+
+    switch (dataRate) {
+        case RF24_2MBPS:
+            return bits / 2;
+        case RF24_250KBPS:
+            return bits * 4;
+        default:
+            return bits;
+    }
+}
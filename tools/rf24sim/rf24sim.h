@@ -0,0 +1,224 @@
+#ifndef RF24SIM_H
+#define RF24SIM_H
+
+// Simulated nRF24L01(+) radios for the host, NOT part of the firmware build
+//
+// RF24 has the subset of the RF24 library's interface the firmware uses
+// (src/wireless.cpp). Radios created with the pins, like the firmware's,
+// are in RF24Air::shared(), others take the air they are in. All radios of
+// a process share one RF24Air: The medium, a virtual clock (time_us_32())
+// and a seeded random number generator, so every run with the same seed
+// gives the same result
+//
+// What is modelled:
+// - 3 level TX and RX FIFOs. writeFast() fails on MAX_RT and leaves the
+//   payload in the FIFO, txStandBy() retransmits until it's out or the
+//   timeout is over (then it flushes), like the library does
+// - Airtime of every payload and ACK at the configured data rate and the
+//   130 us PLL settling, auto retransmit delay and count (setRetries())
+// - Auto ACK, noAck payloads (enableDynamicAck()), ACK payloads from the
+//   receiver's FIFO and the duplicate detection by PID
+// - Loss of payloads and ACKs: For the whole air, per channel (noise, also
+//   seen by testRPD()) and per receiving radio
+// - Reordering: A payload is held back and delivered after the next one
+//   the same radio receives. The radio itself doesn't do that, but the
+//   ring buffers and relays behind it can
+// - An IRQ line: A callback run whenever a payload is put in the RX FIFO
+//
+// What isn't: Collisions (only one radio sends at a time, the sender's
+// clock advances while it does), several receivers ACKing the same payload
+// (the first one that got it does) and the time the CPU needs
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#define RF24SIM_FIFO_LEVELS        3
+#define RF24SIM_MAX_PAYLOAD       32
+#define RF24SIM_CHANNELS         126
+#define RF24SIM_SETTLE_US        130  // TX/RX switch and PLL settling
+#define RF24SIM_RPD_US          1000  // testRPD() sees transmissions this recent
+
+// Same values as the RF24 library
+typedef enum {
+    RF24_PA_MIN = 0,
+    RF24_PA_LOW,
+    RF24_PA_HIGH,
+    RF24_PA_MAX,
+    RF24_PA_ERROR,
+} rf24_pa_dbm_e;
+
+typedef enum {
+    RF24_1MBPS = 0,
+    RF24_2MBPS,
+    RF24_250KBPS,
+} rf24_datarate_e;
+
+typedef enum {
+    RF24_CRC_DISABLED = 0,
+    RF24_CRC_8,
+    RF24_CRC_16,
+} rf24_crclength_e;
+
+class RF24;
+
+// Called with a payload in the RX FIFO, like the radio's IRQ pin going low
+typedef void (*RF24SimIrqHandler)(void* context, RF24* radio);
+
+struct RF24SimPayload {
+    uint8_t               pipe;
+    uint8_t               length;
+    uint8_t               pid;            // Packet ID, for the duplicate detection
+    bool                  noAck;
+    uint8_t               data[RF24SIM_MAX_PAYLOAD];
+};
+
+struct RF24SimStats {
+    uint64_t              transmissions;  // Including retransmits
+    uint64_t              retransmits;
+    uint64_t              maxRt;          // Payloads that ran out of retransmits
+    uint64_t              received;       // Put in the RX FIFO
+    uint64_t              lost;           // Not received because of loss
+    uint64_t              duplicates;     // Received again because the ACK was lost, dropped
+    uint64_t              rxFifoFull;     // Dropped, no space in the RX FIFO
+    uint64_t              reordered;
+    uint64_t              acksLost;
+    uint64_t              airtimeUs;      // Sending, including the ACKs and waiting for them
+};
+
+class RF24Air {
+  public:
+    RF24Air(uint32_t seed = 1);
+
+    // The one of the radios created with the pins
+    static RF24Air* shared();
+    void setSeed(uint32_t seed);
+
+    // Probabilities in percent
+    void setLoss(uint8_t percent);
+    void setChannelLoss(uint8_t channel, uint8_t percent);
+    void setReorder(uint8_t percent);
+
+    uint64_t now() const { return nowUs; }
+    void advance(uint32_t us) { nowUs += us; }
+
+    // Deliver the payloads held back for reordering
+    void settle();
+
+    bool chance(uint8_t percent);
+    uint32_t random();
+
+  private:
+    friend class RF24;
+
+    uint64_t nowUs;
+    uint64_t lastActivity[RF24SIM_CHANNELS]; // Last time something was sent on the channel, UINT64_MAX = never
+    uint32_t rngState;
+    uint8_t loss;
+    uint8_t reorder;
+    uint8_t channelLoss[RF24SIM_CHANNELS];
+    std::vector<RF24*> radios;
+
+    void attach(RF24* radio);
+    void detach(RF24* radio);
+    uint8_t lossTo(const RF24* radio);
+};
+
+class RF24 {
+  public:
+    RF24(uint16_t cePin, uint16_t csnPin);
+    RF24(RF24Air* air, uint16_t cePin = 0, uint16_t csnPin = 0);
+    ~RF24();
+
+    bool begin(void* spi = nullptr);
+    bool isChipConnected() { return true; }
+    bool isPVariant() { return true; }
+
+    void setChannel(uint8_t channel);
+    uint8_t getChannel() { return channel; }
+    bool setDataRate(rf24_datarate_e rate);
+    rf24_datarate_e getDataRate() { return dataRate; }
+    void setPALevel(uint8_t level, bool lnaEnable = true);
+    uint8_t getPALevel() { return paLevel; }
+    void setCRCLength(rf24_crclength_e length) { crcLength = length; }
+    void setAutoAck(bool enable) { autoAck = enable; }
+    void setRetries(uint8_t delay, uint8_t count);
+    void enableDynamicPayloads() { }
+    void enableDynamicAck() { dynamicAck = true; }
+    void enableAckPayload() { ackPayloads = true; }
+    void disableAckPayload() { ackPayloads = false; }
+    void maskIRQ(bool txOk, bool txFail, bool rxReady) { (void)txOk; (void)txFail; (void)rxReady; }
+
+    void openWritingPipe(const uint8_t* address);
+    void openReadingPipe(uint8_t pipe, const uint8_t* address);
+    void closeReadingPipe(uint8_t pipe) { if (pipe < 6) pipeOpen[pipe] = false; }
+
+    void startListening();
+    void stopListening();
+
+    bool available() { return !rxFifo.empty(); }
+    bool available(uint8_t* pipe);
+    bool rxFifoFull() { return rxFifo.size() >= RF24SIM_FIFO_LEVELS; }
+    uint8_t getDynamicPayloadSize();
+    void read(void* buffer, uint8_t length);
+    bool isAckPayloadAvailable() { return available(); }
+    bool testRPD();
+
+    bool write(const void* data, uint8_t length, bool multicast = false);
+    bool writeFast(const void* data, uint8_t length, bool multicast = false);
+    bool txStandBy();
+    bool txStandBy(uint32_t timeoutMs);
+    bool writeAckPayload(uint8_t pipe, const void* data, uint8_t length);
+    void reUseTX();
+    uint8_t getARC() { return arc; }
+    uint8_t flush_tx();
+    uint8_t flush_rx();
+
+    void setIrqHandler(RF24SimIrqHandler handler, void* context);
+    void setLoss(uint8_t percent) { loss = percent; } // In addition to the air's
+
+    RF24SimStats stats;
+
+  private:
+    RF24Air* air;
+
+    uint8_t channel;
+    rf24_datarate_e dataRate;
+    uint8_t paLevel;
+    rf24_crclength_e crcLength;
+    bool autoAck;
+    bool dynamicAck;
+    bool ackPayloads;
+    bool listening;
+    uint8_t retryDelay;
+    uint8_t retryCount;
+    uint8_t arc;
+    bool maxRtFlag;
+    uint8_t txPid;
+    uint8_t loss;
+
+    uint8_t writeAddress[5];
+    uint8_t pipeAddress[6][5];
+    bool pipeOpen[6];
+    int16_t lastPid[6];           // Of the last payload received per pipe, -1 = none
+    uint16_t lastCrc[6];
+
+    std::deque<RF24SimPayload> txFifo;  // In PRX mode, the ACK payloads
+    std::deque<RF24SimPayload> rxFifo;
+    bool held;
+    RF24SimPayload heldPayload;
+
+    RF24SimIrqHandler irqHandler;
+    void* irqContext;
+
+    friend class RF24Air;
+
+    void transmit();
+    RF24* deliver(const RF24SimPayload& payload, const uint8_t* address);
+    void putRx(const RF24SimPayload& payload, bool mayReorder);
+    int8_t matchPipe(const uint8_t* address);
+    uint32_t airtimeUs(uint8_t length);
+};
+
+#endif // RF24SIM_H
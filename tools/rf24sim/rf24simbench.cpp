@@ -0,0 +1,576 @@
+// rf24simbench: Runs the firmware's wireless code (src/wireless.cpp) over
+// simulated radios (rf24sim.h) and reports the throughput and how many
+// frames the receivers got, for broadcast and mesh
+//
+// The sender is the firmware's Wireless, set up from a config like on the
+// board (see rf24simfirmware.h): Frames are queued with sendData() once per
+// frame period and sent by cyclicTask(), so the scheduler, the airtime
+// budget, FEC, hopping, the adaptive link, telemetry and the IRQ ring all
+// run as they do on the board. The mesh is the RF24Network and RF24Mesh
+// model in host/, the libraries are built for the pico-sdk only
+//
+// The receivers are bench code: EDP on a radio each (broadcast) or on a
+// mesh node subscribed to all universes. Broadcast receivers follow the
+// hop and rate markers and return telemetry as ACK payload
+//
+// One sender and a number of receivers in one process. Everything runs on
+// the simulated clock, so the result only depends on the options (the seed
+// included) and the run takes a fraction of the simulated time
+//
+// Every frame a receiver completes is compared to what was queued last.
+// The exit code is 1 if one of them differs, so it can run in CI
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json/json.h"
+
+#include "rf24sim.h"
+#include "rf24simfirmware.h"
+#include "RF24Network.h"
+#include "RF24Mesh.h"
+
+#include "boardconfig.h"
+#include "wireless.h"
+
+extern Wireless wireless;
+extern RF24 rf24radio;
+
+#define BENCH_MAX_NODES            8
+#define BENCH_LOOP_US             50  // core1's main loop when cyclicTask() has nothing to do
+#define BENCH_DRAIN_US        200000  // Run after the last frame was queued
+
+struct BenchOptions {
+    bool     mesh;
+    int      nodes;
+    int      universes;
+    int      frames;
+    double   fps;
+    rf24_datarate_e rate;
+    int      loss;
+    int      reorder;
+    int      fec;
+    bool     noAck;
+    bool     hop;
+    bool     adaptive;
+    bool     telemetry;
+    bool     compression;
+    bool     log;
+    uint32_t seed;
+    std::string pattern;
+};
+
+struct BenchNode {
+    RF24*    radio;
+    RF24Network* network;           // Mesh only
+    RF24Mesh* mesh;
+    Edp      edp;
+    uint8_t  rxIn[600];
+    uint8_t  rxOut[600];
+    EdpReassemblySlot slots[WIRELESS_UNIVERSES];
+    EdpReference references[WIRELESS_UNIVERSES];
+
+    uint32_t remoteId;
+    uint32_t lastPayload;           // time_us_32()
+    uint32_t telemetryWritten;
+    uint32_t subscribed;
+    uint8_t  universes;             // Bitmask subscribed to
+
+    uint64_t framesOkay;
+    uint64_t framesWrong;
+    uint8_t  (*sent)[512];
+    const BenchOptions* options;
+};
+
+static const rf24_datarate_e bench_rates[] = { RF24_250KBPS, RF24_1MBPS, RF24_2MBPS };
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --mode <name>      broadcast or mesh (default broadcast)\n"
+        "  --nodes <n>        Number of receivers, 1-%u, mesh 1-%u (default 2)\n"
+        "  --universes <n>    1-%u (default %u)\n"
+        "  --frames <n>       Frames queued per universe (default 500)\n"
+        "  --fps <n>          Frames per second per universe (default 44)\n"
+        "  --rate <rate>      Broadcast only: 250k, 1m or 2m (default 2m)\n"
+        "  --loss <percent>   Payloads and ACKs lost (default 0)\n"
+        "  --reorder <percent> Payloads delivered out of order (default 0)\n"
+        "  --fec <n>          Broadcast only: Parity chunks per frame, 0-%u (default 0)\n"
+        "  --no-ack           Broadcast only: Send without ACKs\n"
+        "  --hop              Broadcast only: Channel hopping\n"
+        "  --adaptive         Broadcast only: Adapt data rate and TX power\n"
+        "  --telemetry        Broadcast only: Receivers return their stats\n"
+        "  --no-compression   Don't try snappy\n"
+        "  --pattern <name>   fade, chase or random (default fade)\n"
+        "  --seed <n>         Seed of the simulation (default 1)\n"
+        "  --log              Firmware LOG() output to stderr\n",
+        name, BENCH_MAX_NODES, MESH_MAX_NODES, WIRELESS_UNIVERSES, WIRELESS_UNIVERSES, EDP_FEC_MAX_PARITY);
+}
+
+static void fillPattern(const std::string& pattern, RF24Air* air, uint32_t frame, uint8_t universe, uint8_t* data) {
+    if (pattern == "random") {
+        for (int i = 0; i < 512; i++) {
+            data[i] = air->random();
+        }
+    } else if (pattern == "chase") {
+        memset(data, 0x00, 512);
+        for (int i = 0; i < 8; i++) {
+            data[(frame + universe * 8 + i) % 512] = 255 - i * 32;
+        }
+    } else {
+        // All channels fade up and down, universes are out of phase
+        uint32_t phase = (frame + universe * 10) % 512;
+        memset(data, (phase < 256) ? phase : (511 - phase), 512);
+    }
+}
+
+static void frameReceived(void* context, uint8_t universeId, uint8_t* data) {
+    BenchNode* node = (BenchNode*)context;
+
+    if ((universeId < WIRELESS_UNIVERSES) && !memcmp(data, node->sent[universeId], 512)) {
+        node->framesOkay++;
+    } else {
+        node->framesWrong++;
+    }
+}
+
+// The radio of a broadcast receiver got something. Markers are followed
+// right away, like Wireless::fetchPayloads() does
+static void broadcastReceived(void* context, RF24* radio) {
+    BenchNode* node = (BenchNode*)context;
+    uint8_t bytes;
+
+    while (radio->available()) {
+        bytes = radio->getDynamicPayloadSize();
+        memset(node->rxIn, 0x00, 32);
+        radio->read(node->rxIn, bytes);
+        node->lastPayload = time_us_32();
+
+        if (node->rxIn[0] == Edp_Commands::RadioHop) {
+            WirelessHopMarker* marker = (WirelessHopMarker*)node->rxIn;
+            if (node->options->hop && (bytes >= sizeof(*marker)) && (marker->nextIndex < MIN(marker->count, WIRELESS_HOP_CHANNELS))) {
+                radio->stopListening();
+                radio->setChannel(marker->channels[marker->nextIndex]);
+                radio->startListening();
+            }
+            continue;
+        }
+
+        if (node->rxIn[0] == Edp_Commands::RadioRate) {
+            WirelessRateMarker* marker = (WirelessRateMarker*)node->rxIn;
+            if (node->options->adaptive && (bytes >= sizeof(*marker)) && (marker->dataRate <= RF24_250KBPS)) {
+                radio->stopListening();
+                radio->setDataRate((rf24_datarate_e)marker->dataRate);
+                radio->startListening();
+            }
+            continue;
+        }
+
+        node->edp.processIncomingChunk(bytes);
+    }
+}
+
+// The radio of a mesh node got something. The node's main loop would run
+// update() often enough to keep the radio's FIFO from filling up
+static void meshReceived(void* context, RF24* radio) {
+    BenchNode* node = (BenchNode*)context;
+    RF24NetworkHeader header;
+    uint16_t bytes;
+
+    node->network->update();
+
+    while (node->network->available()) {
+        node->network->peek(header);
+        if (header.type != WirelessMeshMessage::meshEdpChunk) {
+            node->network->read(header, nullptr, 0);
+            continue;
+        }
+
+        memset(node->rxIn, 0x00, 32);
+        bytes = node->network->read(header, node->rxIn, WIRELESS_MESH_CHUNK_SIZE);
+        node->lastPayload = time_us_32();
+        node->edp.processIncomingChunk(bytes);
+    }
+}
+
+// The firmware's IRQ line is connected to its first module
+static void senderIrq(void* context, RF24* radio) {
+    rf24sim_gpio_irq(PIN_RF24_IRQ);
+}
+
+// What the receivers' main loops do besides receiving
+static void nodeTask(BenchNode* node, const ConfigData* config) {
+    uint32_t now = time_us_32();
+
+    if (node->mesh) {
+        if ((now - node->subscribed) > WIRELESS_MESH_SUBSCRIBE_US) {
+            node->subscribed = now;
+            node->mesh->write(&node->universes, WirelessMeshMessage::meshSubscribe, sizeof(node->universes));
+        }
+        return;
+    }
+
+    // Missed the hop markers: Back to where the beacons are
+    if (node->options->hop && ((now - node->lastPayload) > WIRELESS_HOP_LOST_US) &&
+        (node->radio->getChannel() != config->radioChannel))
+    {
+        node->radio->stopListening();
+        node->radio->setChannel(config->radioChannel);
+        node->radio->startListening();
+    }
+
+    // Missed the rate markers: Try the next rate
+    if (node->options->adaptive && ((now - node->lastPayload) > WIRELESS_ADAPT_SEARCH_US)) {
+        uint8_t i = 0;
+        while ((i < 2) && (bench_rates[i] != node->radio->getDataRate())) {
+            i++;
+        }
+        node->radio->stopListening();
+        node->radio->setDataRate(bench_rates[(i + 1) % 3]);
+        node->radio->startListening();
+        node->lastPayload = now;
+    }
+
+    if (node->options->telemetry && ((now - node->telemetryWritten) >= WIRELESS_TELEMETRY_US)) {
+        EdpStats* stats = &node->edp.stats;
+        struct WirelessTelemetry report;
+
+        node->telemetryWritten = now;
+        report.command = Edp_Commands::RadioTelemetry;
+        report.remoteId = node->remoteId;
+        report.framesComplete = stats->framesComplete;
+        report.framesCrcError = stats->framesCrcError;
+        report.framesIncomplete = stats->framesTimedOut + stats->framesDropped;
+        report.rxFifoFull = node->radio->stats.rxFifoFull;
+        report.lastUniverse = stats->lastUniverse;
+        report.lastSequence = stats->lastSequence;
+        report.reassemblyAvgUs = stats->framesComplete ? MIN(stats->reassemblyUsSum / stats->framesComplete, 0xffff) : 0;
+        report.reassemblyMaxUs = MIN(stats->reassemblyUsMax, 0xffff);
+
+        node->radio->flush_tx();
+        node->radio->writeAckPayload(1, &report, sizeof(report));
+    }
+}
+
+// core1's main loop until the given time. The clock advances while
+// cyclicTask() sends, otherwise by BENCH_LOOP_US
+static void runUntil(uint64_t until, std::vector<BenchNode*>& nodes, const ConfigData* config) {
+    RF24Air* air = RF24Air::shared();
+
+    while (air->now() < until) {
+        uint64_t before = air->now();
+
+        wireless.cyclicTask();
+        air->settle();
+
+        for (BenchNode* node : nodes) {
+            nodeTask(node, config);
+        }
+
+        if (air->now() == before) {
+            air->advance(BENCH_LOOP_US);
+        }
+    }
+}
+
+static bool parseRate(const std::string& name, rf24_datarate_e* rate) {
+    if (name == "250k") {
+        *rate = RF24_250KBPS;
+    } else if (name == "1m") {
+        *rate = RF24_1MBPS;
+    } else if (name == "2m") {
+        *rate = RF24_2MBPS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char* rateName(int rate) {
+    switch (rate) {
+        case RF24_250KBPS:
+            return "250k";
+        case RF24_1MBPS:
+            return "1m";
+        default:
+            return "2m";
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::string mode = "broadcast";
+    std::string rate = "2m";
+
+    options.nodes = 2;
+    options.universes = WIRELESS_UNIVERSES;
+    options.frames = 500;
+    options.fps = 44;
+    options.loss = 0;
+    options.reorder = 0;
+    options.fec = 0;
+    options.noAck = false;
+    options.hop = false;
+    options.adaptive = false;
+    options.telemetry = false;
+    options.compression = true;
+    options.log = false;
+    options.seed = 1;
+    options.pattern = "fade";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if ((arg == "--mode") && hasValue) {
+            mode = argv[++i];
+        } else if ((arg == "--nodes") && hasValue) {
+            options.nodes = atoi(argv[++i]);
+        } else if ((arg == "--universes") && hasValue) {
+            options.universes = atoi(argv[++i]);
+        } else if ((arg == "--frames") && hasValue) {
+            options.frames = atoi(argv[++i]);
+        } else if ((arg == "--fps") && hasValue) {
+            options.fps = atof(argv[++i]);
+        } else if ((arg == "--rate") && hasValue) {
+            rate = argv[++i];
+        } else if ((arg == "--loss") && hasValue) {
+            options.loss = atoi(argv[++i]);
+        } else if ((arg == "--reorder") && hasValue) {
+            options.reorder = atoi(argv[++i]);
+        } else if ((arg == "--fec") && hasValue) {
+            options.fec = atoi(argv[++i]);
+        } else if (arg == "--no-ack") {
+            options.noAck = true;
+        } else if (arg == "--hop") {
+            options.hop = true;
+        } else if (arg == "--adaptive") {
+            options.adaptive = true;
+        } else if (arg == "--telemetry") {
+            options.telemetry = true;
+        } else if (arg == "--no-compression") {
+            options.compression = false;
+        } else if ((arg == "--pattern") && hasValue) {
+            options.pattern = argv[++i];
+        } else if ((arg == "--seed") && hasValue) {
+            options.seed = strtoul(argv[++i], nullptr, 0);
+        } else if (arg == "--log") {
+            options.log = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    options.mesh = (mode == "mesh");
+    if (((mode != "broadcast") && !options.mesh) || !parseRate(rate, &options.rate) ||
+        (options.nodes < 1) || (options.nodes > (options.mesh ? MESH_MAX_NODES : BENCH_MAX_NODES)) ||
+        (options.universes < 1) || (options.universes > WIRELESS_UNIVERSES) ||
+        (options.frames < 1) || (options.fps <= 0) ||
+        (options.loss < 0) || (options.loss > 100) || (options.reorder < 0) || (options.reorder > 100) ||
+        (options.fec < 0) || (options.fec > EDP_FEC_MAX_PARITY) ||
+        (options.mesh && (options.fec || options.noAck || options.hop || options.adaptive || options.telemetry)))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rf24sim_firmware_log(options.log);
+
+    RF24Air* air = RF24Air::shared();
+    air->setSeed(options.seed);
+    air->setLoss(options.loss);
+    air->setReorder(options.reorder);
+
+    uint8_t sent[WIRELESS_UNIVERSES][512];
+    memset(sent, 0x00, sizeof(sent));
+
+    // The sender: The firmware's Wireless, master of the mesh
+    static ConfigData config;
+    config = constDefaultConfig;
+    config.radioRole = options.mesh ? RadioRole::mesh : RadioRole::broadcast;
+    config.radioAddress = 0;
+    config.radioParams.compression = options.compression;
+    config.radioParams.dataRate = options.rate;
+    config.radioParams.fecParity = options.fec;
+    config.radioParams.noAck = options.noAck;
+    config.radioParams.hopping = options.hop ? RadioHopping::hopLeader : RadioHopping::hopOff;
+    config.radioParams.adaptive = options.adaptive;
+    config.radioParams.telemetry = options.telemetry;
+    BoardConfig::activeConfig = &config;
+
+    rf24radio.setIrqHandler(senderIrq, nullptr);
+    wireless.init();
+    wireless.initIrq();
+    if (!wireless.moduleAvailable) {
+        fprintf(stderr, "Wireless::init() failed\n");
+        return 1;
+    }
+
+    // The receivers
+    std::vector<BenchNode*> nodes;
+    for (int i = 0; i < options.nodes; i++) {
+        BenchNode* node = new BenchNode();
+
+        node->radio = new RF24(air);
+        node->edp.init(node->rxIn, node->rxOut, options.mesh ? WIRELESS_MESH_CHUNK_SIZE : 32, PatchType::nrf24, node->slots, WIRELESS_UNIVERSES);
+        node->edp.initDelta(node->references, WIRELESS_UNIVERSES);
+        node->edp.setFrameHandler(frameReceived, node);
+        node->remoteId = i + 1;
+        node->lastPayload = time_us_32();
+        node->telemetryWritten = time_us_32();
+        node->universes = (1 << options.universes) - 1;
+        node->sent = sent;
+        node->options = &options;
+
+        if (options.mesh) {
+            node->network = new RF24Network(*node->radio);
+            node->mesh = new RF24Mesh(*node->radio, *node->network);
+            node->mesh->setNodeID(i + 1);
+            if (!node->mesh->begin()) {
+                fprintf(stderr, "Node %d didn't get a mesh address\n", i + 1);
+                return 1;
+            }
+            // Spread the subscriptions, the first ones go out right away
+            node->subscribed = time_us_32() - WIRELESS_MESH_SUBSCRIBE_US + i * 1000;
+            node->radio->setIrqHandler(meshReceived, node);
+        } else {
+            node->radio->setChannel(config.radioChannel);
+            node->radio->setDataRate(options.rate);
+            node->radio->enableDynamicPayloads();
+            node->radio->setAutoAck(true);
+            node->radio->setCRCLength(RF24_CRC_16);
+            node->radio->enableDynamicAck();
+            if (options.telemetry) {
+                node->radio->enableAckPayload();
+            }
+            node->radio->openReadingPipe(1, (const uint8_t*)"DMXTX");
+            node->radio->setIrqHandler(broadcastReceived, node);
+            node->radio->startListening();
+        }
+        nodes.push_back(node);
+    }
+
+    // Queue all universes once per frame period, cyclicTask() sends them
+    // when the scheduler picks them. The hopping leader scanned in init()
+    uint64_t start = air->now();
+    uint64_t framePeriodUs = 1000000 / options.fps;
+
+    for (int frame = 0; frame < options.frames; frame++) {
+        runUntil(start + frame * framePeriodUs, nodes, &config);
+
+        for (int universe = 0; universe < options.universes; universe++) {
+            fillPattern(options.pattern, air, frame, universe, sent[universe]);
+            wireless.sendData(universe, sent[universe], 512);
+        }
+    }
+    runUntil(start + options.frames * framePeriodUs + BENCH_DRAIN_US, nodes, &config);
+
+    Json::Value stats;
+    Json::Value remotes;
+    Json::CharReaderBuilder rbuilder;
+    std::string json;
+    std::string errors;
+
+    json = wireless.getWirelessStats();
+    std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+    reader->parse(json.data(), json.data() + json.size(), &stats, &errors);
+    json = wireless.getWirelessRemotes();
+    reader->parse(json.data(), json.data() + json.size(), &remotes, &errors);
+
+    // Rates are per frame period, what is sent while draining counts too
+    double elapsed = options.frames * framePeriodUs / 1e6;
+    uint64_t framesQueued = (uint64_t)options.frames * options.universes;
+    uint64_t framesSent = 0;
+    uint64_t refreshes = 0;
+    uint64_t latencyMaxUs = 0;
+    int wrong = 0;
+
+    for (int i = 0; i < options.universes; i++) {
+        framesSent += stats["queue"][i]["sent"].asUInt();
+        refreshes += stats["queue"][i]["refreshes"].asUInt();
+        latencyMaxUs = MAX(latencyMaxUs, (uint64_t)stats["queue"][i]["latencyMaxUs"].asUInt());
+    }
+
+    printf("Mode:        %s%s, %d node%s, %d universe%s, %s, pattern %s, seed %u\n",
+        options.mesh ? "mesh" : "broadcast",
+        options.noAck ? " (no ACK)" : "",
+        options.nodes, (options.nodes == 1) ? "" : "s",
+        options.universes, (options.universes == 1) ? "" : "s",
+        options.mesh ? "1m" : rate.c_str(), options.pattern.c_str(), options.seed);
+    printf("Air:         %d%% loss, %d%% reordered, FEC %d%s%s%s\n", options.loss, options.reorder, options.fec,
+        options.hop ? ", hopping" : "", options.adaptive ? ", adaptive" : "", options.telemetry ? ", telemetry" : "");
+    printf("Frame rate:  %.1f fps target, %.1f fps sent per universe\n",
+        options.fps, (framesSent - refreshes) / (double)options.universes / elapsed);
+    printf("Sender:      %llu frames queued, %llu sent (%llu refreshes), latency max %.1f ms, %.1f%% airtime\n",
+        (unsigned long long)framesQueued,
+        (unsigned long long)framesSent,
+        (unsigned long long)refreshes,
+        latencyMaxUs / 1000.0,
+        100.0 * rf24radio.stats.airtimeUs / (air->now() - start));
+    printf("Radio:       %llu chunks tried, %llu ACKed, %llu FIFO retries, %llu payloads (%llu retransmits, %llu MAX_RT)\n",
+        (unsigned long long)stats["sentTried"].asUInt64(),
+        (unsigned long long)stats["sentSuccess"].asUInt64(),
+        (unsigned long long)stats["sentBulkRetries"].asUInt64(),
+        (unsigned long long)rf24radio.stats.transmissions,
+        (unsigned long long)rf24radio.stats.retransmits,
+        (unsigned long long)rf24radio.stats.maxRt);
+    if (options.hop) {
+        printf("Hopping:     %llu hops, %llu blacklisted, channels",
+            (unsigned long long)stats["hops"].asUInt64(),
+            (unsigned long long)stats["hopBlacklisted"].asUInt64());
+        for (const Json::Value& channel : stats["hopChannels"]) {
+            printf(" %u", channel.asUInt());
+        }
+        printf("\n");
+    }
+    if (options.adaptive) {
+        printf("Adaptive:    now %s, TX power %u, %llu rate changes, %llu power changes\n",
+            rateName(stats["dataRate"].asInt()),
+            stats["txPower"].asUInt(),
+            (unsigned long long)stats["rateChanges"].asUInt64(),
+            (unsigned long long)stats["powerChanges"].asUInt64());
+    }
+    if (options.telemetry) {
+        printf("Telemetry:   %llu reports", (unsigned long long)stats["telemetryReceived"].asUInt64());
+        for (const Json::Value& remote : remotes["remotes"]) {
+            printf(", %s %.1f%% loss", remote["id"].asCString(), remote["lossPermille"].asUInt() / 10.0);
+        }
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        BenchNode* node = nodes[i];
+        EdpStats* edpStats = &node->edp.stats;
+
+        printf("Node %zu:      %llu/%llu frames (%.1f%%), %.1f kB/s, reassembly avg %.2f ms, %u recovered, %u CRC errors, %u incomplete",
+            i + 1,
+            (unsigned long long)node->framesOkay, (unsigned long long)framesQueued,
+            100.0 * node->framesOkay / framesQueued,
+            node->framesOkay * 512 / elapsed / 1000,
+            edpStats->framesComplete ? edpStats->reassemblyUsSum / 1000.0 / edpStats->framesComplete : 0.0,
+            edpStats->chunksRecovered,
+            edpStats->framesCrcError,
+            edpStats->framesTimedOut + edpStats->framesDropped);
+        if (options.mesh) {
+            printf(", %llu messages dropped", (unsigned long long)node->network->stats.messagesDropped);
+        }
+        if (node->framesWrong) {
+            printf(", %llu WRONG", (unsigned long long)node->framesWrong);
+            wrong++;
+        }
+        printf("\n");
+    }
+
+    for (BenchNode* node : nodes) {
+        delete node->mesh;
+        delete node->network;
+        delete node->radio;
+        delete node;
+    }
+
+    return wrong ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+#include "rf24simfirmware.h"
+
+#include <cstdarg>
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "pico/mutex.h"
+#include "pico/time.h"
+#include "pico/unique_id.h"
+
+#include "log.h"
+#include "boardconfig.h"
+#include "statusleds.h"
+#include "wireless.h"
+
+Wireless wireless;
+BoardConfig boardConfig;
+ConfigData* BoardConfig::activeConfig = nullptr;
+StatusLeds statusLeds;
+critical_section_t bufferLock;
+
+static bool rf24sim_log = false;
+
+static bool rf24sim_interrupts = true;
+static bool rf24sim_in_irq = false;
+static uint32_t rf24sim_gpio_enabled = 0;  // Bit per pin
+static uint32_t rf24sim_gpio_pending = 0;
+static gpio_irq_callback_t rf24sim_gpio_callback = nullptr;
+
+void rf24sim_firmware_log(bool enabled) {
+    rf24sim_log = enabled;
+}
+
+void dlog(char* file, uint32_t line, char* text, ...) {
+    va_list args;
+
+    if (!rf24sim_log) {
+        return;
+    }
+
+    fprintf(stderr, "%10.6f %s:%u: ", RF24Air::shared()->now() / 1e6, file, line);
+    va_start(args, text);
+    vfprintf(stderr, text, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void sleep_us(uint64_t us) {
+    RF24Air::shared()->advance(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    RF24Air::shared()->advance(ms * 1000);
+}
+
+// Runs the pending IRQs, one at a time like the chip does
+static void rf24sim_gpio_dispatch() {
+    uint32_t ready;
+    uint gpio;
+
+    while (rf24sim_interrupts && !rf24sim_in_irq && rf24sim_gpio_callback) {
+        ready = rf24sim_gpio_pending & rf24sim_gpio_enabled;
+        if (!ready) {
+            break;
+        }
+
+        gpio = __builtin_ctz(ready);
+        rf24sim_gpio_pending &= ~(1u << gpio);
+
+        rf24sim_in_irq = true;
+        rf24sim_gpio_callback(gpio, GPIO_IRQ_EDGE_FALL);
+        rf24sim_in_irq = false;
+    }
+}
+
+void rf24sim_gpio_irq(uint gpio) {
+    rf24sim_gpio_pending |= (1u << gpio);
+    rf24sim_gpio_dispatch();
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+    (void)events;
+
+    if (enabled) {
+        rf24sim_gpio_enabled |= (1u << gpio);
+        rf24sim_gpio_dispatch();
+    } else {
+        rf24sim_gpio_enabled &= ~(1u << gpio);
+    }
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback) {
+    rf24sim_gpio_callback = callback;
+    gpio_set_irq_enabled(gpio, events, enabled);
+}
+
+uint32_t save_and_disable_interrupts() {
+    uint32_t status = rf24sim_interrupts;
+
+    rf24sim_interrupts = false;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    rf24sim_interrupts = status;
+    rf24sim_gpio_dispatch();
+}
+
+alarm_pool_t* alarm_pool_create_with_unused_hardware_alarm(uint max_timers) {
+    (void)max_timers;
+    return (alarm_pool_t*)&rf24sim_interrupts; // Never looked into
+}
+
+uint alarm_pool_hardware_alarm_num(alarm_pool_t* pool) {
+    (void)pool;
+    return 0;
+}
+
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t* pool, uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past) {
+    (void)pool;
+    (void)us;
+    (void)callback;
+    (void)user_data;
+    (void)fire_if_past;
+    return -1;
+}
+
+void pico_get_unique_board_id(pico_unique_board_id_t* id_out) {
+    memcpy(id_out->id, "RF24SIM0", PICO_UNIQUE_BOARD_ID_SIZE_BYTES);
+}
+
+// The sender's LEDs aren't looked at
+void StatusLeds::setStatic(uint8_t ledNum, bool red, bool green, bool blue) {
+}
+
+void StatusLeds::setStaticOn(uint8_t ledNum, bool red, bool green, bool blue) {
+}
+
+void StatusLeds::setStaticOff(uint8_t ledNum, bool red, bool green, bool blue) {
+}
+
+void StatusLeds::setBlinkOnce(uint8_t ledNum, bool red, bool green, bool blue) {
+}
+
+void StatusLeds::writeLeds() {
+}
@@ -0,0 +1,23 @@
+#ifndef RF24SIMFIRMWARE_H
+#define RF24SIMFIRMWARE_H
+
+// The firmware's wireless code (src/wireless.cpp) in the simulation. What
+// it expects from the rest of the firmware and the pico-sdk is provided by
+// rf24simfirmware.cpp and the headers in host/:
+// - The globals: wireless, boardConfig (point BoardConfig::activeConfig to
+//   a config before wireless.init()), statusLeds (does nothing) and
+//   bufferLock
+// - Time is the clock of RF24Air::shared(), sleep_us() advances it
+// - GPIO IRQs: rf24sim_gpio_irq() raises one, it runs right away unless
+//   the pin's IRQ or all interrupts are disabled. Then it waits until they
+//   are enabled again
+// - Alarms can't be added, so the sniffer doesn't run
+
+#include "pico/stdlib.h"
+
+void rf24sim_gpio_irq(uint gpio);
+
+// LOG() goes to stderr if enabled, with the simulated time
+void rf24sim_firmware_log(bool enabled);
+
+#endif // RF24SIMFIRMWARE_H
@@ -0,0 +1,323 @@
+#include "RF24Network.h"
+#include "RF24Mesh.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "edp_host.h"
+
+uint16_t RF24NetworkHeader::next_id = 1;
+
+RF24MeshAddress RF24Mesh::addrList[MESH_MAX_NODES];
+uint8_t RF24Mesh::addrCount = 0;
+
+RF24Network::RF24Network(RF24& radio) : radio(radio) {
+    node_address = 0;
+    queued = 0;
+    fragmentsLeft = 0;
+    memset(&stats, 0x00, sizeof(stats));
+}
+
+void RF24Network::begin(uint8_t channel, uint16_t nodeAddress) {
+    radio.setChannel(channel);
+    begin(nodeAddress);
+}
+
+// Pipe 1 gets the node's own address, pipe 2 the multicast address of its
+// level. The master has level 0 and doesn't receive multicasts
+void RF24Network::begin(uint16_t nodeAddress) {
+    uint8_t address[5];
+
+    node_address = nodeAddress;
+    queue.clear();
+    queued = 0;
+    fragmentsLeft = 0;
+
+    radio.stopListening();
+    radio.setAutoAck(true);
+    radio.enableDynamicAck();
+    radio.enableDynamicPayloads();
+    radio.setRetries(5, 15);
+
+    pipeAddress(node_address, address);
+    radio.openReadingPipe(1, address);
+    if (node_address) {
+        pipeAddress(NETWORK_MULTICAST_ADDRESS, address);
+        radio.openReadingPipe(2, address);
+    } else {
+        radio.closeReadingPipe(2);
+    }
+    radio.startListening();
+}
+
+// First byte is the node (or multicast), the rest is the same for all of
+// them, the radio needs that for pipes 2-5
+void RF24Network::pipeAddress(uint16_t node, uint8_t* address) {
+    address[0] = (node == NETWORK_MULTICAST_ADDRESS) ? 0xf1 : (uint8_t)node;
+    address[1] = 'M';
+    address[2] = 'E';
+    address[3] = 'S';
+    address[4] = 'H';
+}
+
+// Moves what the radio received to the queue
+uint8_t RF24Network::update() {
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint8_t bytes;
+    uint8_t type = 0;
+
+    while (radio.available()) {
+        bytes = radio.getDynamicPayloadSize();
+        radio.read(frame, bytes);
+        if (bytes >= RF24NETWORK_HEADER_SIZE) {
+            type = ((RF24NetworkHeader*)frame)->type;
+            receiveFrame(frame, bytes);
+        }
+    }
+
+    return type;
+}
+
+void RF24Network::receiveFrame(const uint8_t* frame, uint8_t length) {
+    RF24NetworkHeader header;
+    const uint8_t* data = frame + RF24NETWORK_HEADER_SIZE;
+    uint8_t dataLength = length - RF24NETWORK_HEADER_SIZE;
+
+    memcpy(&header, frame, sizeof(header));
+    if ((header.to_node != node_address) && (header.to_node != NETWORK_MULTICAST_ADDRESS)) {
+        return;
+    }
+
+    if ((header.type < NETWORK_FIRST_FRAGMENT) || (header.type > NETWORK_LAST_FRAGMENT)) {
+        Message message;
+        message.header = header;
+        message.data.assign(data, data + dataLength);
+        enqueue(message);
+        return;
+    }
+
+    if (header.type == NETWORK_FIRST_FRAGMENT) {
+        if (fragmentsLeft) {
+            stats.messagesDropped++;
+        }
+        fragmented.header = header;
+        fragmented.data.clear();
+        fragmentsLeft = header.reserved;
+    } else if (!fragmentsLeft || (header.id != fragmented.header.id) || (header.from_node != fragmented.header.from_node) ||
+        ((header.type == NETWORK_MORE_FRAGMENTS) && (header.reserved != fragmentsLeft)) ||
+        ((header.type == NETWORK_LAST_FRAGMENT) && (fragmentsLeft != 1)))
+    {
+        // One in between is missing
+        if (fragmentsLeft) {
+            stats.messagesDropped++;
+        }
+        fragmentsLeft = 0;
+        return;
+    }
+
+    if (fragmented.data.size() + dataLength > MAX_PAYLOAD_SIZE) {
+        stats.messagesDropped++;
+        fragmentsLeft = 0;
+        return;
+    }
+    fragmented.data.insert(fragmented.data.end(), data, data + dataLength);
+    fragmentsLeft--;
+
+    if (header.type == NETWORK_LAST_FRAGMENT) {
+        fragmented.header.type = header.reserved;
+        fragmentsLeft = 0;
+        enqueue(fragmented);
+    }
+}
+
+void RF24Network::enqueue(const Message& message) {
+    if (queued + message.data.size() > MAX_PAYLOAD_SIZE + RF24NETWORK_HEADER_SIZE) {
+        stats.messagesDropped++;
+        return;
+    }
+    queue.push_back(message);
+    queued += message.data.size();
+}
+
+bool RF24Network::available() {
+    return !queue.empty();
+}
+
+uint16_t RF24Network::peek(RF24NetworkHeader& header) {
+    if (queue.empty()) {
+        return 0;
+    }
+    header = queue.front().header;
+    return queue.front().data.size();
+}
+
+uint16_t RF24Network::read(RF24NetworkHeader& header, void* message, uint16_t maxlen) {
+    uint16_t length;
+
+    if (queue.empty()) {
+        return 0;
+    }
+
+    header = queue.front().header;
+    length = MIN(maxlen, (uint16_t)queue.front().data.size());
+    if (message && length) {
+        memcpy(message, queue.front().data.data(), length);
+    }
+    queued -= queue.front().data.size();
+    queue.pop_front();
+
+    return length;
+}
+
+bool RF24Network::write(RF24NetworkHeader& header, const void* message, uint16_t len) {
+    return writeFrames(header, message, len, header.to_node, false);
+}
+
+// One level only, so any level reaches all nodes
+bool RF24Network::multicast(RF24NetworkHeader& header, const void* message, uint16_t len, uint8_t level) {
+    (void)level;
+    return writeFrames(header, message, len, NETWORK_MULTICAST_ADDRESS, true);
+}
+
+bool RF24Network::writeFrames(RF24NetworkHeader& header, const void* message, uint16_t len, uint16_t to, bool multicast) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint8_t address[5];
+    RF24NetworkHeader frameHeader = header;
+    uint8_t fragments = MAX(1, (len + RF24NETWORK_FRAGMENT_SIZE - 1) / RF24NETWORK_FRAGMENT_SIZE);
+    uint16_t offset = 0;
+    uint8_t size;
+    bool success = true;
+
+    if (len > MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    header.from_node = node_address;
+    header.to_node = to;
+    frameHeader.from_node = node_address;
+    frameHeader.to_node = to;
+
+    pipeAddress(to, address);
+    radio.stopListening();
+    radio.openWritingPipe(address);
+
+    for (uint8_t i = 0; i < fragments; i++) {
+        size = MIN(len - offset, (uint16_t)RF24NETWORK_FRAGMENT_SIZE);
+
+        if (fragments == 1) {
+            frameHeader.type = header.type;
+            frameHeader.reserved = 0;
+        } else if (i == 0) {
+            frameHeader.type = NETWORK_FIRST_FRAGMENT;
+            frameHeader.reserved = fragments;
+        } else if (i == fragments - 1) {
+            frameHeader.type = NETWORK_LAST_FRAGMENT;
+            frameHeader.reserved = header.type;
+        } else {
+            frameHeader.type = NETWORK_MORE_FRAGMENTS;
+            frameHeader.reserved = fragments - i;
+        }
+
+        memcpy(frame, &frameHeader, sizeof(frameHeader));
+        memcpy(frame + sizeof(frameHeader), (const uint8_t*)message + offset, size);
+        offset += size;
+
+        radio.writeFast(frame, sizeof(frameHeader) + size, multicast);
+        if (!radio.txStandBy(txTimeout)) {
+            success = false;
+            break;
+        }
+    }
+
+    radio.startListening();
+    return success;
+}
+
+RF24Mesh::RF24Mesh(RF24& radio, RF24Network& network) : radio(radio), network(network) {
+    address = 0;
+}
+
+void RF24Mesh::setNodeID(uint8_t nodeID) {
+    this->nodeID = nodeID;
+}
+
+bool RF24Mesh::begin(uint8_t channel, rf24_datarate_e data_rate, uint32_t timeout) {
+    (void)timeout;
+
+    radio.begin();
+    radio.setChannel(channel);
+    radio.setDataRate(data_rate);
+
+    if (!nodeID) {
+        network.begin(0);
+        return true;
+    }
+    return renewAddress() != NETWORK_MULTICAST_ADDRESS;
+}
+
+uint8_t RF24Mesh::update() {
+    if (!nodeID) {
+        addrListTop = addrCount;
+    }
+    return network.update();
+}
+
+// Children of the master get 01-05
+uint16_t RF24Mesh::renewAddress(uint32_t timeout) {
+    int16_t known = getAddress(nodeID);
+
+    (void)timeout;
+
+    if (known > 0) {
+        address = known;
+    } else if (addrCount < MESH_MAX_NODES) {
+        address = addrCount + 1;
+        addrList[addrCount].nodeID = nodeID;
+        addrList[addrCount].address = address;
+        addrCount++;
+    } else {
+        return NETWORK_MULTICAST_ADDRESS;
+    }
+
+    network.begin(address);
+    return address;
+}
+
+bool RF24Mesh::checkConnection() {
+    return !nodeID || (getAddress(nodeID) == address);
+}
+
+bool RF24Mesh::write(const void* data, uint8_t msg_type, size_t size, uint8_t nodeID) {
+    int16_t to = nodeID ? getAddress(nodeID) : 0;
+
+    if (to < 0) {
+        return false;
+    }
+
+    RF24NetworkHeader header(to, msg_type);
+    return network.write(header, data, size);
+}
+
+int16_t RF24Mesh::getNodeID(uint16_t address) {
+    if (!address) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < addrCount; i++) {
+        if (addrList[i].address == address) {
+            return addrList[i].nodeID;
+        }
+    }
+    return -1;
+}
+
+int16_t RF24Mesh::getAddress(uint8_t nodeID) {
+    if (!nodeID) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < addrCount; i++) {
+        if (addrList[i].nodeID == nodeID) {
+            return addrList[i].address;
+        }
+    }
+    return -1;
+}
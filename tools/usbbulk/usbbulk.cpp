@@ -0,0 +1,465 @@
+#include "usbbulk.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "dmxcodec.h"
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UsbBulkLink::UsbBulkLink() {
+    this->context = nullptr;
+    this->handle = nullptr;
+    this->interface = -1;
+    this->endpointOut = 0;
+    this->endpointIn = 0;
+    this->delta = true;
+    this->txLength = 0;
+    this->rxLength = 0;
+    this->frameHandler = nullptr;
+    this->frameHandlerContext = nullptr;
+    this->pongHandler = nullptr;
+    this->pongHandlerContext = nullptr;
+    this->statsHandler = nullptr;
+    this->statsHandlerContext = nullptr;
+    memset(&stats, 0x00, sizeof(struct UsbBulkLinkStats));
+    memset(sentValid, 0x00, sizeof(sentValid));
+    memset(received, 0x00, sizeof(received));
+}
+
+UsbBulkLink::~UsbBulkLink() {
+    close();
+}
+
+// The vendor interface is the one with class 0xff and two bulk endpoints
+bool UsbBulkLink::findInterface(libusb_device* device) {
+    struct libusb_config_descriptor* config;
+
+    if (libusb_get_active_config_descriptor(device, &config) != 0) {
+        return false;
+    }
+
+    interface = -1;
+    for (int i = 0; (i < config->bNumInterfaces) && (interface < 0); i++) {
+        const struct libusb_interface_descriptor* descriptor = &config->interface[i].altsetting[0];
+
+        if ((descriptor->bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC) || (descriptor->bNumEndpoints != 2)) {
+            continue;
+        }
+        for (int e = 0; e < 2; e++) {
+            const struct libusb_endpoint_descriptor* endpoint = &descriptor->endpoint[e];
+            if (endpoint->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+                endpointIn = endpoint->bEndpointAddress;
+            } else {
+                endpointOut = endpoint->bEndpointAddress;
+            }
+        }
+        interface = descriptor->bInterfaceNumber;
+    }
+
+    libusb_free_config_descriptor(config);
+    return (interface >= 0);
+}
+
+bool UsbBulkLink::open(const char* serial) {
+    libusb_device** devices;
+    ssize_t count;
+
+    close();
+
+    if (libusb_init(&context) != 0) {
+        context = nullptr;
+        return false;
+    }
+
+    count = libusb_get_device_list(context, &devices);
+    for (ssize_t i = 0; (i < count) && !handle; i++) {
+        struct libusb_device_descriptor descriptor;
+        char deviceSerial[64];
+
+        if ((libusb_get_device_descriptor(devices[i], &descriptor) != 0) ||
+            (descriptor.idVendor != USBBULK_VID) || (descriptor.idProduct != USBBULK_PID)) {
+            continue;
+        }
+        if (libusb_open(devices[i], &handle) != 0) {
+            handle = nullptr;
+            continue;
+        }
+        if (serial && ((libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber, (unsigned char*)deviceSerial, sizeof(deviceSerial)) < 0) ||
+            strcmp(serial, deviceSerial))) {
+            libusb_close(handle);
+            handle = nullptr;
+            continue;
+        }
+        if (!findInterface(devices[i]) || (libusb_claim_interface(handle, interface) != 0)) {
+            libusb_close(handle);
+            handle = nullptr;
+        }
+    }
+    if (count >= 0) {
+        libusb_free_device_list(devices, 1);
+    }
+
+    if (!handle) {
+        close();
+        return false;
+    }
+
+    // Everything is sent as a full frame first
+    memset(sentValid, 0x00, sizeof(sentValid));
+    txLength = 0;
+    rxLength = 0;
+    return true;
+}
+
+void UsbBulkLink::close() {
+    if (handle) {
+        libusb_release_interface(handle, interface);
+        libusb_close(handle);
+        handle = nullptr;
+    }
+    if (context) {
+        libusb_exit(context);
+        context = nullptr;
+    }
+}
+
+void UsbBulkLink::setFrameHandler(UsbBulkFrameHandler handler, void* context) {
+    this->frameHandlerContext = context;
+    this->frameHandler = handler;
+}
+
+void UsbBulkLink::setPongHandler(UsbBulkPongHandler handler, void* context) {
+    this->pongHandlerContext = context;
+    this->pongHandler = handler;
+}
+
+void UsbBulkLink::setStatsHandler(UsbBulkStatsHandler handler, void* context) {
+    this->statsHandlerContext = context;
+    this->statsHandler = handler;
+}
+
+bool UsbBulkLink::writeAll(const uint8_t* data, uint32_t length) {
+    int transferred;
+
+    if (!handle) {
+        return false;
+    }
+
+    while (length) {
+        if (libusb_bulk_transfer(handle, endpointOut, (unsigned char*)data, length, &transferred, USBBULK_TIMEOUT_MS) != 0) {
+            stats.sendErrors++;
+            return false;
+        }
+        data += transferred;
+        length -= transferred;
+        stats.bytesSent += transferred;
+    }
+
+    return true;
+}
+
+bool UsbBulkLink::sendMessage(UsbBulk_Commands command, const void* payload, uint16_t length) {
+    uint8_t message[sizeof(struct UsbBulk_MessageHeader) + 64];
+    struct UsbBulk_MessageHeader* header = (struct UsbBulk_MessageHeader*)message;
+
+    if (length > (sizeof(message) - sizeof(struct UsbBulk_MessageHeader))) {
+        return false;
+    }
+
+    // Queued universes go first, so everything arrives in order
+    if (!flush()) {
+        return false;
+    }
+
+    header->magic = USB_BULK_MAGIC;
+    header->command = command;
+    header->length = length;
+    if (length) {
+        memcpy(message + sizeof(struct UsbBulk_MessageHeader), payload, length);
+    }
+
+    stats.messagesSent++;
+    return writeAll(message, sizeof(struct UsbBulk_MessageHeader) + length);
+}
+
+// Changed channels as ranges. Ranges closer than a range header are merged.
+// Returns the length or 0 if it doesn't fit
+uint16_t UsbBulkLink::encodeRanges(const uint8_t* data, const uint8_t* previous, uint8_t* destination, uint16_t destinationSize) {
+    uint16_t length = 0;
+    uint16_t chan = 0;
+
+    while (chan < 512) {
+        if (data[chan] == previous[chan]) {
+            chan++;
+            continue;
+        }
+
+        uint16_t start = chan;
+        uint16_t end = chan + 1;     // Exclusive
+        uint16_t same = 0;
+        for (chan++; chan < 512; chan++) {
+            if (data[chan] == previous[chan]) {
+                if (++same > sizeof(struct UsbBulk_Range)) {
+                    break;
+                }
+            } else {
+                same = 0;
+                end = chan + 1;
+            }
+        }
+        chan = end;
+
+        struct UsbBulk_Range range;
+        range.offset = start;
+        range.count = end - start;
+        if ((length + sizeof(range) + range.count) > destinationSize) {
+            return 0;
+        }
+        memcpy(destination + length, &range, sizeof(range));
+        memcpy(destination + length + sizeof(range), data + start, range.count);
+        length += sizeof(range) + range.count;
+    }
+
+    return length;
+}
+
+bool UsbBulkLink::setUniverse(uint8_t bufferId, const uint8_t* data) {
+    uint8_t encoded[600];
+    uint8_t ranges[600];
+    struct UsbBulk_UniverseHeader header;
+    const uint8_t* payload = data;
+    uint64_t now = nowUs();
+    uint16_t length;
+    uint16_t rangesLength = 0;
+    bool unchanged;
+
+    if (bufferId >= USBBULK_UNIVERSES) {
+        return false;
+    }
+
+    // Same choice as the device makes for input universes, plus the changes
+    // to what was sent last (unless a full frame is due)
+    for (length = 512; length && !data[length - 1]; length--);
+
+    header.bufferId = bufferId;
+    header.encoding = UsbBulk_Encoding::bulkRaw;
+    header.length = length;
+
+    unchanged = sentValid[bufferId] && !memcmp(data, sent[bufferId], 512);
+    if (delta && sentValid[bufferId] && ((now - sentKeyframe[bufferId]) < USB_BULK_REFRESH_US)) {
+        rangesLength = unchanged ? 0 : encodeRanges(data, sent[bufferId], ranges, sizeof(ranges));
+        if (unchanged || (rangesLength && (rangesLength < header.length))) {
+            header.encoding = UsbBulk_Encoding::bulkRanges;
+            header.length = rangesLength;
+            payload = ranges;
+        }
+    }
+
+    if (!length) {
+        header.encoding = UsbBulk_Encoding::bulkAllZero;
+        header.length = 0;
+    } else if (header.length && (length = DmxCodec::encode(data, 512, encoded, header.length - 1))) {
+        header.encoding = UsbBulk_Encoding::bulkDmxCodec;
+        header.length = length;
+        payload = encoded;
+    }
+
+    if (header.encoding != UsbBulk_Encoding::bulkRanges) {
+        sentKeyframe[bufferId] = now;
+    }
+
+    if (txLength + sizeof(header) + header.length > sizeof(txMessage)) {
+        if (!flush()) {
+            return false;
+        }
+    }
+    if (!txLength) {
+        txLength = sizeof(struct UsbBulk_MessageHeader);
+    }
+    memcpy(txMessage + txLength, &header, sizeof(header));
+    memcpy(txMessage + txLength + sizeof(header), payload, header.length);
+    txLength += sizeof(header) + header.length;
+
+    memcpy(sent[bufferId], data, 512);
+    sentValid[bufferId] = true;
+
+    stats.universesSent++;
+    stats.channelBytes += 512;
+    stats.encodings[header.encoding]++;
+    return true;
+}
+
+// All queued universes in one bulk transfer
+bool UsbBulkLink::flush() {
+    struct UsbBulk_MessageHeader* header = (struct UsbBulk_MessageHeader*)txMessage;
+    uint32_t length = txLength;
+
+    if (!length) {
+        return true;
+    }
+    txLength = 0;
+
+    header->magic = USB_BULK_MAGIC;
+    header->command = UsbBulk_Commands::BulkFrames;
+    header->length = length - sizeof(struct UsbBulk_MessageHeader);
+
+    stats.messagesSent++;
+    if (!writeAll(txMessage, length)) {
+        // Who knows what the device has now
+        memset(sentValid, 0x00, sizeof(sentValid));
+        return false;
+    }
+    return true;
+}
+
+bool UsbBulkLink::sendPing(const uint8_t* payload, uint16_t length) {
+    stats.pingsSent++;
+    return sendMessage(UsbBulk_Commands::BulkPing, payload, std::min<uint16_t>(length, USB_BULK_MAX_PING));
+}
+
+bool UsbBulkLink::subscribe(uint32_t bufferMask, uint16_t intervalMs) {
+    struct UsbBulk_Subscribe subscribe;
+
+    subscribe.bufferMask = bufferMask;
+    subscribe.intervalMs = intervalMs;
+    return sendMessage(UsbBulk_Commands::BulkSubscribe, &subscribe, sizeof(subscribe));
+}
+
+bool UsbBulkLink::requestStats() {
+    return sendMessage(UsbBulk_Commands::BulkStatsRequest, nullptr, 0);
+}
+
+bool UsbBulkLink::decodeUniverse(const struct UsbBulk_UniverseHeader* header, const uint8_t* data) {
+    uint8_t* frame;
+    uint16_t length;
+
+    if (header->bufferId >= USBBULK_UNIVERSES) {
+        return false;
+    }
+    frame = received[header->bufferId];
+
+    switch (header->encoding) {
+        case UsbBulk_Encoding::bulkRaw:
+            if (header->length > 512) {
+                return false;
+            }
+            memcpy(frame, data, header->length);
+            memset(frame + header->length, 0x00, 512 - header->length);
+            return true;
+
+        case UsbBulk_Encoding::bulkDmxCodec:
+            length = DmxCodec::decode(data, header->length, frame, 512);
+            memset(frame + length, 0x00, 512 - length);
+            return (length != 0);
+
+        case UsbBulk_Encoding::bulkAllZero:
+            memset(frame, 0x00, 512);
+            return true;
+
+        case UsbBulk_Encoding::bulkRanges:
+            for (uint16_t position = 0; position < header->length; ) {
+                struct UsbBulk_Range range;
+                if ((position + sizeof(range)) > header->length) {
+                    return false;
+                }
+                memcpy(&range, data + position, sizeof(range));
+                position += sizeof(range);
+                if (((range.offset + range.count) > 512) || ((position + range.count) > header->length)) {
+                    return false;
+                }
+                memcpy(frame + range.offset, data + position, range.count);
+                position += range.count;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void UsbBulkLink::handleMessage(UsbBulk_Commands command, const uint8_t* payload, uint16_t length) {
+    if (command == UsbBulk_Commands::BulkPong) {
+        stats.pongsReceived++;
+        if (pongHandler) {
+            pongHandler(pongHandlerContext, payload, length);
+        }
+    } else if ((command == UsbBulk_Commands::BulkStats) && (length >= sizeof(struct UsbBulkStats))) {
+        struct UsbBulkStats deviceStats;
+        memcpy(&deviceStats, payload, sizeof(deviceStats));
+        if (statsHandler) {
+            statsHandler(statsHandlerContext, deviceStats);
+        }
+    } else if (command == UsbBulk_Commands::BulkFrames) {
+        for (uint16_t position = 0; (position + sizeof(struct UsbBulk_UniverseHeader)) <= length; ) {
+            struct UsbBulk_UniverseHeader header;
+            memcpy(&header, payload + position, sizeof(header));
+            position += sizeof(header);
+            if (((position + header.length) > length) || !decodeUniverse(&header, payload + position)) {
+                stats.invalidReceived++;
+                return;
+            }
+            position += header.length;
+
+            stats.framesReceived++;
+            if (frameHandler) {
+                frameHandler(frameHandlerContext, header.bufferId, received[header.bufferId]);
+            }
+        }
+    } else {
+        stats.invalidReceived++;
+    }
+}
+
+int UsbBulkLink::poll(int timeoutMs) {
+    int processed = 0;
+    int transferred;
+    int result;
+
+    if (!handle) {
+        return -1;
+    }
+
+    // A transfer may end in the middle of a message, the rest comes with the
+    // next one. Whole packets only, libusb reports an overflow otherwise
+    result = libusb_bulk_transfer(handle, endpointIn, rxStream + rxLength, ((sizeof(rxStream) - rxLength) / 64) * 64, &transferred, timeoutMs ? timeoutMs : 1);
+    if ((result != 0) && (result != LIBUSB_ERROR_TIMEOUT)) {
+        return -1;
+    }
+    rxLength += transferred;
+
+    uint32_t position = 0;
+    while (position < rxLength) {
+        struct UsbBulk_MessageHeader header;
+
+        if (rxStream[position] != USB_BULK_MAGIC) {
+            stats.invalidReceived++;
+            position++;
+            continue;
+        }
+        if ((position + sizeof(header)) > rxLength) {
+            break;
+        }
+        memcpy(&header, rxStream + position, sizeof(header));
+        if ((position + sizeof(header) + header.length) > rxLength) {
+            if ((sizeof(header) + header.length) > sizeof(rxStream)) {
+                // Can't be one of ours
+                stats.invalidReceived++;
+                position++;
+                continue;
+            }
+            break;
+        }
+
+        handleMessage(header.command, rxStream + position + sizeof(header), header.length);
+        position += sizeof(header) + header.length;
+        processed++;
+    }
+
+    memmove(rxStream, rxStream + position, rxLength - position);
+    rxLength -= position;
+
+    return processed;
+}
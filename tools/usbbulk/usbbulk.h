@@ -0,0 +1,105 @@
+#ifndef USBBULK_H
+#define USBBULK_H
+
+// Host side of the native bulk protocol (src/usb_Bulk.h) via libusb: Sends
+// the universes to a dmxsun's vendor interface, each encoded as whatever is
+// smallest, and handles the input universes, Pongs and stats coming back
+
+#include <cstdint>
+#include <cstring>
+
+#include <libusb.h>
+
+#include "usb_Bulk.h"
+
+#define USBBULK_VID             0x1209
+#define USBBULK_PID             0xACEB
+#define USBBULK_UNIVERSES           24
+#define USBBULK_MAX_MESSAGE      16384 // Queued universes are sent when the next one wouldn't fit
+#define USBBULK_TIMEOUT_MS        1000
+
+struct UsbBulkLinkStats {
+    uint64_t messagesSent;
+    uint64_t universesSent;
+    uint64_t bytesSent;
+    uint64_t channelBytes;            // What the universes sent would have been raw
+    uint64_t encodings[4];            // Universes sent per UsbBulk_Encoding
+    uint64_t sendErrors;
+    uint64_t pingsSent;
+    uint64_t pongsReceived;
+    uint64_t framesReceived;
+    uint64_t invalidReceived;
+};
+
+// Called for every input universe, for Pongs and for device stats
+typedef void (*UsbBulkFrameHandler)(void* context, uint8_t bufferId, const uint8_t* data);
+typedef void (*UsbBulkPongHandler)(void* context, const uint8_t* payload, uint16_t length);
+typedef void (*UsbBulkStatsHandler)(void* context, const struct UsbBulkStats& stats);
+
+class UsbBulkLink {
+  public:
+    UsbBulkLink();
+    ~UsbBulkLink();
+
+    // First dmxsun found, or the one with this serial number
+    bool open(const char* serial = nullptr);
+    void close();
+
+    // Send the changed channels instead of full frames
+    void enableDelta(bool enable) { delta = enable; }
+
+    // Queues the universe, it's sent with the next flush() or when the
+    // message is full. Unchanged universes are sent too (4 byte), so the
+    // device doesn't apply its loss policy
+    bool setUniverse(uint8_t bufferId, const uint8_t* data);
+    bool flush();
+
+    bool sendPing(const uint8_t* payload, uint16_t length);
+    bool subscribe(uint32_t bufferMask, uint16_t intervalMs);
+    bool requestStats();
+
+    // Handles everything that came in within timeoutMs. Returns the number
+    // of messages processed or -1 on error
+    int poll(int timeoutMs);
+
+    void setFrameHandler(UsbBulkFrameHandler handler, void* context);
+    void setPongHandler(UsbBulkPongHandler handler, void* context);
+    void setStatsHandler(UsbBulkStatsHandler handler, void* context);
+
+    struct UsbBulkLinkStats stats;
+
+  private:
+    libusb_context* context;
+    libusb_device_handle* handle;
+    int interface;
+    uint8_t endpointOut;
+    uint8_t endpointIn;
+    bool delta;
+
+    uint8_t txMessage[USBBULK_MAX_MESSAGE];
+    uint32_t txLength;                // 0 = no message started
+
+    uint8_t sent[USBBULK_UNIVERSES][512];
+    bool sentValid[USBBULK_UNIVERSES];
+    uint64_t sentKeyframe[USBBULK_UNIVERSES]; // When the last full frame was sent, in us
+
+    uint8_t rxStream[USBBULK_MAX_MESSAGE * 2];
+    uint32_t rxLength;
+    uint8_t received[USBBULK_UNIVERSES][512];
+
+    UsbBulkFrameHandler frameHandler;
+    void* frameHandlerContext;
+    UsbBulkPongHandler pongHandler;
+    void* pongHandlerContext;
+    UsbBulkStatsHandler statsHandler;
+    void* statsHandlerContext;
+
+    bool findInterface(libusb_device* device);
+    bool sendMessage(UsbBulk_Commands command, const void* payload, uint16_t length);
+    bool writeAll(const uint8_t* data, uint32_t length);
+    uint16_t encodeRanges(const uint8_t* data, const uint8_t* previous, uint8_t* destination, uint16_t destinationSize);
+    void handleMessage(UsbBulk_Commands command, const uint8_t* payload, uint16_t length);
+    bool decodeUniverse(const struct UsbBulk_UniverseHeader* header, const uint8_t* data);
+};
+
+#endif // USBBULK_H
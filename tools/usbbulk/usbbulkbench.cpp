@@ -0,0 +1,237 @@
+// usbbulkbench: Throughput and latency of the native bulk protocol
+//
+// Sends a test pattern on up to 24 buffers at a given frame rate via the
+// vendor interface, pings the device in between, optionally subscribes to
+// input universes and reports the achieved frame rate, throughput, how the
+// universes were encoded, round-trip times and the device's counters
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "usbbulk.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct PingStats {
+    uint32_t received;
+    double   rttMin;
+    double   rttMax;
+    double   rttSum;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --serial <serial>  Device to use (default: the first one found)\n"
+        "  --universes <n>    Number of buffers, 1-%u (default %u)\n"
+        "  --fps <n>          Frames per second per buffer (default 44)\n"
+        "  --seconds <n>      Duration of the test (default 10)\n"
+        "  --pattern <name>   fade, chase or random (default fade)\n"
+        "  --no-delta         Always send full frames\n"
+        "  --ping-ms <n>      Ping interval in ms, 0 = off (default 100)\n"
+        "  --input <mask>     Subscribe to these buffers (hex), written by other sources\n"
+        "  --input-ms <n>     Minimum interval of the input universes (default 20)\n",
+        name, USBBULK_UNIVERSES, USBBULK_UNIVERSES);
+}
+
+static void fillPattern(const std::string& pattern, uint32_t frame, uint8_t universe, uint8_t* data) {
+    if (pattern == "random") {
+        for (int i = 0; i < 512; i++) {
+            data[i] = rand();
+        }
+    } else if (pattern == "chase") {
+        memset(data, 0x00, 512);
+        for (int i = 0; i < 8; i++) {
+            data[(frame + universe * 8 + i) % 512] = 255 - i * 32;
+        }
+    } else {
+        // All channels fade up and down, universes are out of phase
+        uint32_t phase = (frame + universe * 10) % 512;
+        memset(data, (phase < 256) ? phase : (511 - phase), 512);
+    }
+}
+
+static void pongReceived(void* context, const uint8_t* payload, uint16_t length) {
+    PingStats* pingStats = (PingStats*)context;
+    int64_t sent;
+
+    if (length < sizeof(sent)) {
+        return;
+    }
+    memcpy(&sent, payload, sizeof(sent));
+
+    double rtt = (std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() - sent) / 1e6;
+    if (!pingStats->received || (rtt < pingStats->rttMin)) {
+        pingStats->rttMin = rtt;
+    }
+    if (rtt > pingStats->rttMax) {
+        pingStats->rttMax = rtt;
+    }
+    pingStats->rttSum += rtt;
+    pingStats->received++;
+}
+
+static void statsReceived(void* context, const struct UsbBulkStats& stats) {
+    memcpy(context, &stats, sizeof(struct UsbBulkStats));
+}
+
+int main(int argc, char** argv) {
+    UsbBulkLink link;
+    PingStats pingStats;
+    struct UsbBulkStats deviceStats;
+    std::string serial;
+    std::string pattern = "fade";
+    int universes = USBBULK_UNIVERSES;
+    double fps = 44;
+    double seconds = 10;
+    int pingMs = 100;
+    uint32_t inputMask = 0;
+    int inputMs = 20;
+    bool delta = true;
+    uint8_t data[512];
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if ((arg == "--serial") && hasValue) {
+            serial = argv[++i];
+        } else if ((arg == "--universes") && hasValue) {
+            universes = atoi(argv[++i]);
+        } else if ((arg == "--fps") && hasValue) {
+            fps = atof(argv[++i]);
+        } else if ((arg == "--seconds") && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if ((arg == "--pattern") && hasValue) {
+            pattern = argv[++i];
+        } else if ((arg == "--ping-ms") && hasValue) {
+            pingMs = atoi(argv[++i]);
+        } else if ((arg == "--input") && hasValue) {
+            inputMask = strtoul(argv[++i], nullptr, 16);
+        } else if ((arg == "--input-ms") && hasValue) {
+            inputMs = atoi(argv[++i]);
+        } else if (arg == "--no-delta") {
+            delta = false;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((universes < 1) || (universes > USBBULK_UNIVERSES) || (fps <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!link.open(serial.empty() ? nullptr : serial.c_str())) {
+        fprintf(stderr, "No dmxsun with a vendor interface found (permissions?)\n");
+        return 1;
+    }
+    link.enableDelta(delta);
+
+    memset(&pingStats, 0x00, sizeof(pingStats));
+    memset(&deviceStats, 0x00, sizeof(deviceStats));
+    link.setPongHandler(pongReceived, &pingStats);
+    link.setStatsHandler(statsReceived, &deviceStats);
+
+    if (inputMask) {
+        link.subscribe(inputMask, inputMs);
+    }
+
+    Clock::duration framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    Clock::duration pingPeriod = std::chrono::milliseconds(pingMs);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    Clock::time_point nextFrame = start;
+    Clock::time_point nextPing = start;
+    uint32_t frameSets = 0;
+    uint32_t lateFrameSets = 0;
+    double sendUsSum = 0;
+    double sendUsMax = 0;
+
+    while (Clock::now() < end) {
+        Clock::time_point now = Clock::now();
+
+        if (now >= nextFrame) {
+            for (int universe = 0; universe < universes; universe++) {
+                fillPattern(pattern, frameSets, universe, data);
+                link.setUniverse(universe, data);
+            }
+            link.flush();
+            frameSets++;
+
+            // Until the last byte of the frame set has been taken by the device
+            double sendUs = std::chrono::duration<double, std::micro>(Clock::now() - now).count();
+            sendUsSum += sendUs;
+            if (sendUs > sendUsMax) {
+                sendUsMax = sendUs;
+            }
+
+            nextFrame += framePeriod;
+            if (Clock::now() > nextFrame) {
+                // Can't keep up, don't try to catch up with a burst
+                lateFrameSets++;
+                nextFrame = Clock::now();
+            }
+        }
+
+        if (pingMs && (now >= nextPing)) {
+            int64_t sent = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+            link.sendPing((const uint8_t*)&sent, sizeof(sent));
+            nextPing += pingPeriod;
+        }
+
+        Clock::time_point next = (pingMs && (nextPing < nextFrame)) ? nextPing : nextFrame;
+        int timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+        if (link.poll((timeoutMs > 0) ? timeoutMs : 0) < 0) {
+            fprintf(stderr, "Receiving failed\n");
+            break;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Late Pongs and the device's counters
+    link.requestStats();
+    for (int i = 0; i < 20; i++) {
+        link.poll(10);
+    }
+
+    printf("Buffers:     %d, pattern %s, %s\n", universes, pattern.c_str(), delta ? "delta" : "full frames");
+    printf("Frame rate:  %.1f fps target, %.1f fps achieved, %u late\n", fps, frameSets / elapsed, lateFrameSets);
+    printf("Frame set:   %.0f us avg, %.0f us max until sent\n", frameSets ? sendUsSum / frameSets : 0, sendUsMax);
+    printf("Sent:        %llu universes in %llu messages, %.1f kB/s (%.1f kB/s raw), %llu errors\n",
+        (unsigned long long)link.stats.universesSent,
+        (unsigned long long)link.stats.messagesSent,
+        link.stats.bytesSent / elapsed / 1000,
+        link.stats.channelBytes / elapsed / 1000,
+        (unsigned long long)link.stats.sendErrors);
+    printf("Encodings:   raw %llu, ranges %llu, codec %llu, zero %llu\n",
+        (unsigned long long)link.stats.encodings[UsbBulk_Encoding::bulkRaw],
+        (unsigned long long)link.stats.encodings[UsbBulk_Encoding::bulkRanges],
+        (unsigned long long)link.stats.encodings[UsbBulk_Encoding::bulkDmxCodec],
+        (unsigned long long)link.stats.encodings[UsbBulk_Encoding::bulkAllZero]);
+    if (pingMs) {
+        printf("Ping:        %llu sent, %u received, %llu lost",
+            (unsigned long long)link.stats.pingsSent,
+            pingStats.received,
+            (unsigned long long)(link.stats.pingsSent - pingStats.received));
+        if (pingStats.received) {
+            printf(", rtt min/avg/max %.2f/%.2f/%.2f ms", pingStats.rttMin, pingStats.rttSum / pingStats.received, pingStats.rttMax);
+        }
+        printf("\n");
+    }
+    if (inputMask) {
+        printf("Input:       %llu universes received, %llu invalid\n",
+            (unsigned long long)link.stats.framesReceived,
+            (unsigned long long)link.stats.invalidReceived);
+    }
+    printf("Device:      %u universes, %u messages, %u invalid, %u resync bytes, %u input sent, %u TX full, apply max %u us\n",
+        deviceStats.universes, deviceStats.messages, deviceStats.invalid, deviceStats.resyncBytes,
+        deviceStats.inputFrames, deviceStats.txFull, deviceStats.applyUsMax);
+
+    return 0;
+}
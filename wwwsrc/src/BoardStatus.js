@@ -65,6 +65,14 @@ class BoardStatus extends React.Component{
                     document.getElementById(modalName + 'InputSparse').checked = this.props.wireless.sparse;
                     document.getElementById(modalName + 'InputRate').value = this.props.wireless.dataRate;
                     document.getElementById(modalName + 'InputPower').value = this.props.wireless.txPower;
+                    document.getElementById(modalName + 'InputFec').value = this.props.wireless.fec;
+                    document.getElementById(modalName + 'InputNoAck').checked = this.props.wireless.noAck;
+                    document.getElementById(modalName + 'InputHop').value = this.props.wireless.hop;
+                    document.getElementById(modalName + 'InputAdaptive').checked = this.props.wireless.adaptive;
+                    document.getElementById(modalName + 'InputTelemetry').checked = this.props.wireless.telemetry;
+                    document.getElementById(modalName + 'InputDual').value = this.props.wireless.dual;
+                    document.getElementById(modalName + 'InputChannel2').value = this.props.wireless.channel2;
+                    document.getElementById(modalName + 'InputUniverses2').value = this.props.wireless.universes2;
                     document.getElementById(modalName).configured = true;
                 }
             });
@@ -193,6 +201,14 @@ class BoardStatus extends React.Component{
             url += 'sparse=' + encodeURIComponent(document.getElementById(modalName + 'InputSparse').checked) + '&';
             url += 'rate=' + encodeURIComponent(document.getElementById(modalName + 'InputRate').value) + '&';
             url += 'power=' + encodeURIComponent(document.getElementById(modalName + 'InputPower').value) + '&';
+            url += 'fec=' + encodeURIComponent(document.getElementById(modalName + 'InputFec').value) + '&';
+            url += 'noAck=' + encodeURIComponent(document.getElementById(modalName + 'InputNoAck').checked) + '&';
+            url += 'hop=' + encodeURIComponent(document.getElementById(modalName + 'InputHop').value) + '&';
+            url += 'adaptive=' + encodeURIComponent(document.getElementById(modalName + 'InputAdaptive').checked) + '&';
+            url += 'telemetry=' + encodeURIComponent(document.getElementById(modalName + 'InputTelemetry').checked) + '&';
+            url += 'dual=' + encodeURIComponent(document.getElementById(modalName + 'InputDual').value) + '&';
+            url += 'channel2=' + encodeURIComponent(document.getElementById(modalName + 'InputChannel2').value) + '&';
+            url += 'universes2=' + encodeURIComponent(document.getElementById(modalName + 'InputUniverses2').value) + '&';
 
             fetch(url)
                 .then(res => res.json())
@@ -356,6 +372,67 @@ class BoardStatus extends React.Component{
                                 </select>
                                 <label htmlFor="modalWirelessInputPower" className="form-label">Radio TX power:</label>
                             </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <select className="form-select" aria-label="Forward error correction" id="modalWirelessInputFec" defaultValue="0">
+                                   <option value="0">Off</option>
+                                   <option value="1">1 parity chunk per frame</option>
+                                   <option value="2">2 parity chunks per frame</option>
+                                   <option value="3">3 parity chunks per frame</option>
+                                   <option value="4">4 parity chunks per frame</option>
+                                </select>
+                                <label htmlFor="modalWirelessInputFec" className="form-label">Forward error correction:</label>
+                            </div>
+                            <br />
+
+                            <div className="form-check form-switch">
+                                <input className="form-check-input" type="checkbox" id="modalWirelessInputNoAck" />
+                                <label className="form-check-label" htmlFor="modalWirelessInputNoAck">Broadcast without ACKs</label>
+                            </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <select className="form-select" aria-label="Channel hopping" id="modalWirelessInputHop" defaultValue="0">
+                                   <option value="0">Off</option>
+                                   <option value="1">Leader (picks the channels)</option>
+                                   <option value="2">Follower</option>
+                                </select>
+                                <label htmlFor="modalWirelessInputHop" className="form-label">Channel hopping (broadcast):</label>
+                            </div>
+                            <br />
+
+                            <div className="form-check form-switch">
+                                <input className="form-check-input" type="checkbox" id="modalWirelessInputAdaptive" />
+                                <label className="form-check-label" htmlFor="modalWirelessInputAdaptive">Adapt data rate and power (broadcast)</label>
+                            </div>
+
+                            <div className="form-check form-switch">
+                                <input className="form-check-input" type="checkbox" id="modalWirelessInputTelemetry" />
+                                <label className="form-check-label" htmlFor="modalWirelessInputTelemetry">Receivers report their stats in ACKs (broadcast)</label>
+                            </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <select className="form-select" aria-label="Second radio module" id="modalWirelessInputDual" defaultValue="0">
+                                   <option value="0">Off</option>
+                                   <option value="1">Static (universes below)</option>
+                                   <option value="2">Balanced by airtime</option>
+                                </select>
+                                <label htmlFor="modalWirelessInputDual" className="form-label">Second radio module (broadcast, dual radio builds):</label>
+                            </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <input type="number" min="0" max="125" className="form-control" id="modalWirelessInputChannel2" placeholder="0" defaultValue="92" />
+                                <label htmlFor="modalWirelessInputChannel2" className="form-label">Second module's radio channel:</label>
+                            </div>
+                            <br />
+
+                            <div className="form-floating">
+                                <input type="number" min="0" max="15" className="form-control" id="modalWirelessInputUniverses2" placeholder="0" defaultValue="10" />
+                                <label htmlFor="modalWirelessInputUniverses2" className="form-label">Universes on the second module (bitmask, static):</label>
+                            </div>
 
                         </div>
                         <div className="modal-footer">
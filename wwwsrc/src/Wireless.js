@@ -23,6 +23,7 @@ const options = {
 
 class Wireless extends React.Component {
     chartReference = {};
+    occupancyChartReference = {};
 
     constructor() {
         super();
@@ -36,8 +37,24 @@ class Wireless extends React.Component {
                         data: [],
                         fill: true,
                     },
+                    {
+                        label: 'Peak hold',
+                        data: [],
+                        fill: false,
+                    },
                 ],
             },
+            occupancyData: {
+                labels: [],
+                datasets: [
+                    {
+                        label: 'Occupancy (%)',
+                        data: [],
+                        fill: true,
+                    },
+                ],
+            },
+            spectrumHighRes: false,
             wireless: {
               role: 0,
             },
@@ -45,6 +62,7 @@ class Wireless extends React.Component {
         };
         for (let i = 2400; i < 2517; i++) {
             this.state.spectrumData.labels.push(i);
+            this.state.occupancyData.labels.push(i);
         }
     }
 
@@ -123,13 +141,34 @@ class Wireless extends React.Component {
                         let newSpectrumData = this.state.spectrumData;
                         newSpectrumData.datasets[0].data.length = 0;
                         Array.prototype.push.apply(newSpectrumData.datasets[0].data, new Uint16Array(uncompressed.buffer));
+                        newSpectrumData.datasets[1].data.length = 0;
+                        if (result.highRes) {
+                            let peak = snappyjs.uncompress(couch64.base64DecToArr(result.peak));
+                            Array.prototype.push.apply(newSpectrumData.datasets[1].data, new Uint16Array(peak.buffer));
+
+                            let occupancy = snappyjs.uncompress(couch64.base64DecToArr(result.occupancy));
+                            let newOccupancyData = this.state.occupancyData;
+                            newOccupancyData.datasets[0].data.length = 0;
+                            Array.prototype.push.apply(newOccupancyData.datasets[0].data, new Uint8Array(occupancy.buffer));
+                            this.occupancyChartReference.data = newOccupancyData;
+                            this.occupancyChartReference.update();
+                        }
                         this.chartReference.data = newSpectrumData;
                         this.chartReference.update();
+                        this.setState({ spectrumHighRes: result.highRes });
                     }
                 }
             );
     }
 
+    setSpectrumHighRes(e) {
+        fetch(window.urlPrefix + '/config/wireless/spectrum/set.json?highRes=' + e.target.checked);
+    }
+
+    resetSpectrum() {
+        fetch(window.urlPrefix + '/config/wireless/spectrum/set.json?reset=1');
+    }
+
     updateStats() {
       // Check if there is already a request running. If so, do nothing
       if (this.state.loading) {
@@ -153,6 +192,18 @@ class Wireless extends React.Component {
         ).finally(
             () => { this.setState({ loading: false }); }
         );
+
+    // Telemetry of the receivers has its own endpoint, it doesn't fit into the stats
+    fetch(window.urlPrefix + '/config/wireless/remotes/get.json')
+        .then(res => res.json())
+        .catch(() => {})
+        .then(
+            (result) => {
+                if (result) {
+                    this.setState({ remotes: result.remotes });
+                }
+            }
+        );
     }
 
     render() {
@@ -181,6 +232,14 @@ class Wireless extends React.Component {
                           <div  style={{ width: "800px" }}>
                             <Bar ref={(reference) => this.chartReference = reference } data={this.state.spectrumData} options={options} />
                           </div>
+                          <div className="form-check form-switch">
+                            <input className="form-check-input" type="checkbox" id="wirelessSpectrumHighRes" checked={this.state.spectrumHighRes} onChange={this.setSpectrumHighRes.bind(this)} />
+                            <label className="form-check-label" htmlFor="wirelessSpectrumHighRes">High resolution (peak hold and occupancy)</label>
+                          </div>
+                          <button type="button" className="btn btn-outline-secondary" onClick={this.resetSpectrum.bind(this)}>Reset peak and occupancy</button>
+                          <div style={{ width: "800px", display: this.state.spectrumHighRes ? "block" : "none" }}>
+                            <Bar ref={(reference) => this.occupancyChartReference = reference } data={this.state.occupancyData} options={options} />
+                          </div>
                         </div>
                         <div className="col">
                           &nbsp;
@@ -202,6 +261,24 @@ class Wireless extends React.Component {
                         <tr><th>Packets successfully sent:</th><td>{this.state.stats.sentSuccess}</td></tr>
                         <tr><th>Packets received:</th><td>{this.state.stats.received}</td></tr>
                       </tbody></table>
+                      {(this.state.remotes && this.state.remotes.length) ?
+                        <table className="table"><thead>
+                          <tr><th>Receiver</th><th>Frames complete</th><th>CRC errors</th><th>Incomplete</th><th>RX FIFO full</th><th>Loss (‰)</th><th>Latency (µs)</th><th>Last seen (ms)</th></tr>
+                        </thead><tbody>
+                          {this.state.remotes.map((remote) =>
+                            <tr key={remote.id}>
+                              <td>{remote.id}</td>
+                              <td>{remote.framesComplete}</td>
+                              <td>{remote.framesCrcError}</td>
+                              <td>{remote.framesIncomplete}</td>
+                              <td>{remote.rxFifoFull}</td>
+                              <td>{remote.lossPermille}</td>
+                              <td>{remote.latencyEstUs}</td>
+                              <td>{remote.lastSeenMs}</td>
+                            </tr>
+                          )}
+                        </tbody></table>
+                      : ''}
                     </div>
                   </div>
                 </div>